@@ -73,4 +73,92 @@ void ThreadPool::enqueue(std::function<void()> job)
     wait_cv.notify_one();
     lock.unlock();
 
+}
+
+uint32_t ThreadPool::size() const
+{
+    return (uint32_t)threads.size();
+}
+
+// Shared between the caller and the helper jobs of one parallel_for.
+// Helpers can start after the caller has already returned (all chunks got eaten before they woke up)
+// so this lives in a shared_ptr and a late helper only ever touches the counters.
+struct ParallelRange
+{
+    std::atomic<size_t> next_chunk{0};
+    size_t chunks_done = 0;
+    size_t chunk_count;
+    size_t chunk_size;
+    size_t count;
+    const std::function<void(size_t, size_t)>* fn;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+};
+
+static void run_chunks(ParallelRange& range)
+{
+    size_t finished = 0;
+    while(true)
+    {
+        size_t chunk = range.next_chunk.fetch_add(1);
+        if(chunk >= range.chunk_count) break;
+
+        size_t begin = chunk * range.chunk_size;
+        size_t end = begin + range.chunk_size;
+        if(end > range.count) end = range.count;
+
+        (*range.fn)(begin, end);
+        finished++;
+    }
+
+    if(finished == 0) return;
+
+    std::unique_lock<std::mutex> lock(range.done_mutex);
+    range.chunks_done += finished;
+    if(range.chunks_done == range.chunk_count)
+    {
+        range.done_cv.notify_all();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)>& fn)
+{
+    if(count == 0) return;
+    if(chunk_size == 0) chunk_size = count;
+
+    size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    // Not worth waking anybody up for one chunk
+    if(chunk_count == 1 || threads.empty())
+    {
+        for(size_t begin = 0; begin < count; begin += chunk_size)
+        {
+            fn(begin, begin + chunk_size < count ? begin + chunk_size : count);
+        }
+        return;
+    }
+
+    std::shared_ptr<ParallelRange> range = std::make_shared<ParallelRange>();
+    range->chunk_count = chunk_count;
+    range->chunk_size = chunk_size;
+    range->count = count;
+    range->fn = &fn;
+
+    size_t helpers = chunk_count - 1;
+    if(helpers > threads.size()) helpers = threads.size();
+
+    for(size_t i = 0; i < helpers; i++)
+    {
+        enqueue([range]() {
+            run_chunks(*range);
+        });
+    }
+
+    run_chunks(*range);
+
+    std::unique_lock<std::mutex> lock(range->done_mutex);
+    range->done_cv.wait(lock, [&range]() {
+        return range->chunks_done == range->chunk_count;
+    });
 }
\ No newline at end of file
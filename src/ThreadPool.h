@@ -5,6 +5,9 @@
 #include <condition_variable>
 #include <queue>
 #include <functional>
+#include <atomic>
+#include <memory>
+#include <cstdint>
 
 class ThreadPool
 {
@@ -20,4 +23,10 @@ class ThreadPool
         ThreadPool(uint32_t thd_count);
         ~ThreadPool();
         void enqueue(std::function<void()> job);
+        uint32_t size() const;
+
+        // Splits [0, count) into chunks of chunk_size and runs fn(begin, end) on each one across the workers.
+        // The calling thread works on chunks too and this doesn't return until every chunk is done, so it doubles as a barrier.
+        // Safe to call from inside a job since the caller never sits waiting on a job that hasn't started.
+        void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)>& fn);
 };
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "aabb_tree.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+static uint32_t allocate_node(AABBTree& tree)
+{
+    if(tree.free_list == TREE_NULL)
+    {
+        tree.nodes.push_back(TreeNode());
+        return (uint32_t)tree.nodes.size() - 1;
+    }
+
+    uint32_t index = tree.free_list;
+    tree.free_list = tree.nodes[index].parent;
+    tree.nodes[index] = TreeNode();
+    return index;
+}
+
+static void free_node(AABBTree& tree, uint32_t index)
+{
+    tree.nodes[index].parent = tree.free_list;
+    tree.nodes[index].height = -1;
+    tree.free_list = index;
+}
+
+static inline bool is_leaf(const TreeNode& node)
+{
+    return node.child1 == TREE_NULL;
+}
+
+static void refit(AABBTree& tree, uint32_t index)
+{
+    TreeNode& node = tree.nodes[index];
+    const TreeNode& a = tree.nodes[node.child1];
+    const TreeNode& b = tree.nodes[node.child2];
+    node.box = aabb_merge(a.box, b.box);
+    node.height = 1 + std::max(a.height, b.height);
+}
+
+// Tries swapping one of index's children with one of its grandchildren (Catto's tree rotations).
+// Only ever does the swap that shrinks the surface area of the child that changes the most.
+static void rotate(AABBTree& tree, uint32_t index)
+{
+    TreeNode& node = tree.nodes[index];
+    uint32_t b = node.child1;
+    uint32_t c = node.child2;
+
+    enum { NONE, B_F, B_G, C_D, C_E } best = NONE;
+    float best_cost = 0.0;
+
+    // Swap B with one of C's children
+    if(!is_leaf(tree.nodes[c]))
+    {
+        uint32_t f = tree.nodes[c].child1;
+        uint32_t g = tree.nodes[c].child2;
+        float area = aabb_surface_area(tree.nodes[c].box);
+
+        float cost_bf = aabb_surface_area(aabb_merge(tree.nodes[b].box, tree.nodes[g].box)) - area;
+        float cost_bg = aabb_surface_area(aabb_merge(tree.nodes[f].box, tree.nodes[b].box)) - area;
+        if(cost_bf < best_cost) { best = B_F; best_cost = cost_bf; }
+        if(cost_bg < best_cost) { best = B_G; best_cost = cost_bg; }
+    }
+
+    // Swap C with one of B's children
+    if(!is_leaf(tree.nodes[b]))
+    {
+        uint32_t d = tree.nodes[b].child1;
+        uint32_t e = tree.nodes[b].child2;
+        float area = aabb_surface_area(tree.nodes[b].box);
+
+        float cost_cd = aabb_surface_area(aabb_merge(tree.nodes[c].box, tree.nodes[e].box)) - area;
+        float cost_ce = aabb_surface_area(aabb_merge(tree.nodes[d].box, tree.nodes[c].box)) - area;
+        if(cost_cd < best_cost) { best = C_D; best_cost = cost_cd; }
+        if(cost_ce < best_cost) { best = C_E; best_cost = cost_ce; }
+    }
+
+    // child is index's child that moves down, grandchild moves up into its place under other
+    uint32_t child, other, grandchild;
+    switch(best)
+    {
+        case B_F: child = b; other = c; grandchild = tree.nodes[c].child1; break;
+        case B_G: child = b; other = c; grandchild = tree.nodes[c].child2; break;
+        case C_D: child = c; other = b; grandchild = tree.nodes[b].child1; break;
+        case C_E: child = c; other = b; grandchild = tree.nodes[b].child2; break;
+        default: return;
+    }
+
+    if(tree.nodes[index].child1 == child) tree.nodes[index].child1 = grandchild;
+    else tree.nodes[index].child2 = grandchild;
+    tree.nodes[grandchild].parent = index;
+
+    if(tree.nodes[other].child1 == grandchild) tree.nodes[other].child1 = child;
+    else tree.nodes[other].child2 = child;
+    tree.nodes[child].parent = other;
+
+    refit(tree, other);
+    refit(tree, index);
+}
+
+// Walks down the tree picking whichever spot adds the least surface area (the SAH cost of the tree)
+static uint32_t find_best_sibling(const AABBTree& tree, const AABB& box)
+{
+    uint32_t index = tree.root;
+    float box_area = aabb_surface_area(box);
+
+    while(!is_leaf(tree.nodes[index]))
+    {
+        const TreeNode& node = tree.nodes[index];
+        float area = aabb_surface_area(node.box);
+        float combined = aabb_surface_area(aabb_merge(node.box, box));
+
+        // Cost of making a new parent for this node and the new leaf
+        float cost_here = 2.0f * combined;
+
+        // Every node below here grows by at least this much if we keep going down
+        float inherited = 2.0f * (combined - area);
+
+        float cost_child[2];
+        uint32_t children[2] = { node.child1, node.child2 };
+        for(int i = 0; i < 2; i++)
+        {
+            const TreeNode& child = tree.nodes[children[i]];
+            float merged = aabb_surface_area(aabb_merge(box, child.box));
+            if(is_leaf(child))
+            {
+                cost_child[i] = merged + inherited;
+            }
+            else
+            {
+                // Lower bound, the new leaf still has to end up somewhere inside
+                float growth = merged - aabb_surface_area(child.box);
+                cost_child[i] = std::max(growth, 0.0f) + box_area + inherited;
+            }
+        }
+
+        if(cost_here < cost_child[0] && cost_here < cost_child[1]) break;
+        index = cost_child[0] < cost_child[1] ? children[0] : children[1];
+    }
+
+    return index;
+}
+
+static void insert_leaf(AABBTree& tree, uint32_t leaf)
+{
+    if(tree.root == TREE_NULL)
+    {
+        tree.root = leaf;
+        tree.nodes[leaf].parent = TREE_NULL;
+        return;
+    }
+
+    AABB box = tree.nodes[leaf].box;
+    uint32_t sibling = find_best_sibling(tree, box);
+
+    // New parent takes the sibling's place and holds both it and the leaf
+    uint32_t old_parent = tree.nodes[sibling].parent;
+    uint32_t new_parent = allocate_node(tree);
+    tree.nodes[new_parent].parent = old_parent;
+    tree.nodes[new_parent].child1 = sibling;
+    tree.nodes[new_parent].child2 = leaf;
+    tree.nodes[sibling].parent = new_parent;
+    tree.nodes[leaf].parent = new_parent;
+    refit(tree, new_parent);
+
+    if(old_parent == TREE_NULL)
+    {
+        tree.root = new_parent;
+    }
+    else if(tree.nodes[old_parent].child1 == sibling)
+    {
+        tree.nodes[old_parent].child1 = new_parent;
+    }
+    else
+    {
+        tree.nodes[old_parent].child2 = new_parent;
+    }
+
+    // Fix up the boxes on the way back to the root and rotate where it helps
+    uint32_t index = tree.nodes[new_parent].parent;
+    while(index != TREE_NULL)
+    {
+        refit(tree, index);
+        rotate(tree, index);
+        index = tree.nodes[index].parent;
+    }
+}
+
+static void remove_leaf(AABBTree& tree, uint32_t leaf)
+{
+    if(leaf == tree.root)
+    {
+        tree.root = TREE_NULL;
+        return;
+    }
+
+    // The leaf's sibling takes the parent's place
+    uint32_t parent = tree.nodes[leaf].parent;
+    uint32_t grandparent = tree.nodes[parent].parent;
+    uint32_t sibling = tree.nodes[parent].child1 == leaf ? tree.nodes[parent].child2 : tree.nodes[parent].child1;
+
+    if(grandparent == TREE_NULL)
+    {
+        tree.root = sibling;
+        tree.nodes[sibling].parent = TREE_NULL;
+        free_node(tree, parent);
+        return;
+    }
+
+    if(tree.nodes[grandparent].child1 == parent) tree.nodes[grandparent].child1 = sibling;
+    else tree.nodes[grandparent].child2 = sibling;
+    tree.nodes[sibling].parent = grandparent;
+    free_node(tree, parent);
+
+    uint32_t index = grandparent;
+    while(index != TREE_NULL)
+    {
+        refit(tree, index);
+        rotate(tree, index);
+        index = tree.nodes[index].parent;
+    }
+}
+
+uint32_t tree_insert(AABBTree& tree, const AABB& box, uint32_t user)
+{
+    uint32_t leaf = allocate_node(tree);
+    tree.nodes[leaf].box = aabb_expand(box, tree.margin);
+    tree.nodes[leaf].user = user;
+    tree.nodes[leaf].height = 0;
+
+    insert_leaf(tree, leaf);
+    tree.leaf_count++;
+    return leaf;
+}
+
+void tree_remove(AABBTree& tree, uint32_t proxy)
+{
+    if(proxy >= tree.nodes.size() || tree.nodes[proxy].height != 0)
+    {
+        std::cerr << "AABB TREE: tried to remove invalid proxy <proxy: " << proxy << ">" << std::endl;
+        return;
+    }
+
+    remove_leaf(tree, proxy);
+    free_node(tree, proxy);
+    tree.leaf_count--;
+}
+
+bool tree_move(AABBTree& tree, uint32_t proxy, const AABB& box, const glm::vec3& displacement)
+{
+    if(aabb_contains(tree.nodes[proxy].box, box)) return false;
+
+    remove_leaf(tree, proxy);
+
+    // Stretch the fat box along where the body is heading so it doesn't fall straight out again next step
+    AABB fat = aabb_expand(box, tree.margin);
+    glm::vec3 d = displacement * tree.displacement_scale;
+    fat.min = glm::min(fat.min, fat.min + d);
+    fat.max = glm::max(fat.max, fat.max + d);
+    tree.nodes[proxy].box = fat;
+
+    insert_leaf(tree, proxy);
+    return true;
+}
+
+const AABB& tree_fat_box(const AABBTree& tree, uint32_t proxy)
+{
+    return tree.nodes[proxy].box;
+}
+
+uint32_t tree_user(const AABBTree& tree, uint32_t proxy)
+{
+    return tree.nodes[proxy].user;
+}
+
+int32_t tree_height(const AABBTree& tree)
+{
+    return tree.root == TREE_NULL ? 0 : tree.nodes[tree.root].height;
+}
+
+void tree_query(const AABBTree& tree, const AABB& box, std::vector<uint32_t>& out)
+{
+    if(tree.root == TREE_NULL) return;
+
+    TraversalStack stack;
+    stack.push(tree.root);
+
+    while(!stack.empty())
+    {
+        const TreeNode& node = tree.nodes[stack.pop()];
+        if(!aabb_overlap(node.box, box)) continue;
+
+        if(is_leaf(node))
+        {
+            out.push_back(node.user);
+            continue;
+        }
+
+        stack.push(node.child1);
+        stack.push(node.child2);
+    }
+}
+
+float ray_aabb(const glm::vec3& origin, const glm::vec3& inv_dir, const AABB& box, float max_t)
+{
+    glm::vec3 t0 = (box.min - origin) * inv_dir;
+    glm::vec3 t1 = (box.max - origin) * inv_dir;
+
+    float enter = 0.0f, exit = max_t;
+    for(int axis = 0; axis < 3; axis++)
+    {
+        // 0 * inf: the ray is parallel to this axis' planes and lies right on one of them, so it's inside the slab the
+        // whole way. Any other parallel ray gets two infinities, same sign if it's outside the slab.
+        if(std::isnan(t0[axis]) || std::isnan(t1[axis])) continue;
+        enter = std::max(enter, std::min(t0[axis], t1[axis]));
+        exit = std::min(exit, std::max(t0[axis], t1[axis]));
+    }
+    return enter <= exit ? enter : -1.0f;
+}
+
+void tree_raycast(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& dir, float max_t, std::vector<TreeRayHit>& out)
+{
+    tree_raycast(tree, origin, dir, max_t, [&out, max_t](uint32_t user, float t) {
+        out.push_back({ user, t });
+        return max_t;
+    });
+}
+
+// Descends both sides of every internal node together so each overlapping pair is only found once
+static void pairs_between(const AABBTree& tree, uint32_t a, uint32_t b, std::vector<CollisionPair>& out)
+{
+    const TreeNode& na = tree.nodes[a];
+    const TreeNode& nb = tree.nodes[b];
+    if(!aabb_overlap(na.box, nb.box)) return;
+
+    bool leaf_a = is_leaf(na);
+    bool leaf_b = is_leaf(nb);
+
+    if(leaf_a && leaf_b)
+    {
+        out.push_back(make_pair_sorted(na.user, nb.user));
+    }
+    else if(leaf_b || (!leaf_a && na.height >= nb.height))
+    {
+        pairs_between(tree, na.child1, b, out);
+        pairs_between(tree, na.child2, b, out);
+    }
+    else
+    {
+        pairs_between(tree, a, nb.child1, out);
+        pairs_between(tree, a, nb.child2, out);
+    }
+}
+
+static void pairs_within(const AABBTree& tree, uint32_t index, std::vector<CollisionPair>& out)
+{
+    const TreeNode& node = tree.nodes[index];
+    if(is_leaf(node)) return;
+
+    pairs_within(tree, node.child1, out);
+    pairs_within(tree, node.child2, out);
+    pairs_between(tree, node.child1, node.child2, out);
+}
+
+void tree_query_pairs(const AABBTree& tree, std::vector<CollisionPair>& out)
+{
+    if(tree.root == TREE_NULL) return;
+    pairs_within(tree, tree.root, out);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include "collision.h"
+
+/*
+    Dynamic AABB tree broadphase.
+
+    Leaves store a fat box (the real box grown by a margin and stretched along the direction the body is moving).
+    As long as the body stays inside its fat box the tree doesn't change at all, once it leaves it the leaf gets pulled out
+    and reinserted. Insertion walks down picking the cheapest spot by surface area (SAH), and on the way back up
+    every node tries swapping a child with a grandchild (tree rotation) if that shrinks the tree.
+
+    Nodes live in one flat array and reference each other by index so the tree can be copied / reallocated freely.
+    Nodes that get freed go on a free list threaded through the parent field.
+
+    Queries return the user value of each leaf, whatever the caller passed to tree_insert (body id, mesh index, ...).
+*/
+
+#define TREE_NULL UINT32_MAX
+
+struct TreeNode
+{
+    AABB box;
+    uint32_t parent = TREE_NULL;    // Next free node when this one is on the free list
+    uint32_t child1 = TREE_NULL;    // TREE_NULL for leaves
+    uint32_t child2 = TREE_NULL;
+    int32_t height = 0;             // 0 for leaves, -1 for free nodes
+    uint32_t user = 0;
+};
+
+struct AABBTree
+{
+    float margin = 0.1;                 // How much leaves get fattened by
+    float displacement_scale = 2.0;     // How far ahead (in steps) the fat box gets stretched along the displacement
+
+    std::vector<TreeNode> nodes;
+    uint32_t root = TREE_NULL;
+    uint32_t free_list = TREE_NULL;
+    uint32_t leaf_count = 0;
+};
+
+struct TreeRayHit
+{
+    uint32_t user;
+    float t;        // Distance along the ray where it enters the leaf's fat box
+};
+
+// Returns the proxy id of the leaf, which stays valid until tree_remove
+uint32_t tree_insert(AABBTree& tree, const AABB& box, uint32_t user);
+void tree_remove(AABBTree& tree, uint32_t proxy);
+
+// Updates a leaf to cover box. Only touches the tree if box left the fat box, returns true if the leaf got reinserted.
+bool tree_move(AABBTree& tree, uint32_t proxy, const AABB& box, const glm::vec3& displacement);
+
+const AABB& tree_fat_box(const AABBTree& tree, uint32_t proxy);
+uint32_t tree_user(const AABBTree& tree, uint32_t proxy);
+int32_t tree_height(const AABBTree& tree);
+
+// Appends the user value of every leaf whose fat box overlaps box
+void tree_query(const AABBTree& tree, const AABB& box, std::vector<uint32_t>& out);
+
+// Appends every leaf the ray (origin + t * dir, t in [0, max_t]) passes through, in no particular order.
+// dir doesn't need to be normalized, t is in units of dir.
+void tree_raycast(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& dir, float max_t, std::vector<TreeRayHit>& out);
+
+// Calls fn(user, t) for every leaf the ray passes through. fn returns the new max_t
+// (return t to only look for closer hits, max_t to keep going, 0 to stop).
+template <typename Fn>
+void tree_raycast(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& dir, float max_t, const Fn& fn);
+
+// Appends every pair of leaves (user values) whose fat boxes overlap
+void tree_query_pairs(const AABBTree& tree, std::vector<CollisionPair>& out);
+
+// Ray vs box slab test. Returns the entry distance or -1 on a miss. Rays parallel to an axis (inv_dir infinite) are
+// fine, even when they run exactly along one of the box's faces.
+float ray_aabb(const glm::vec3& origin, const glm::vec3& inv_dir, const AABB& box, float max_t);
+
+template <typename Fn>
+void tree_raycast(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& dir, float max_t, const Fn& fn)
+{
+    if(tree.root == TREE_NULL) return;
+
+    glm::vec3 inv_dir = 1.0f / dir;
+
+    TraversalStack stack;
+    stack.push(tree.root);
+
+    while(!stack.empty())
+    {
+        uint32_t index = stack.pop();
+        const TreeNode& node = tree.nodes[index];
+
+        float t = ray_aabb(origin, inv_dir, node.box, max_t);
+        if(t < 0.0f) continue;
+
+        if(node.child1 == TREE_NULL)
+        {
+            max_t = fn(node.user, t);
+            if(max_t <= 0.0f) return;
+            continue;
+        }
+
+        stack.push(node.child1);
+        stack.push(node.child2);
+    }
+}
@@ -0,0 +1,299 @@
+#include "broadphase_grid.h"
+#include <cmath>
+#include <algorithm>
+
+static inline int32_t cell_coord(float x, float inv_cell_size)
+{
+    return (int32_t)floorf(x * inv_cell_size);
+}
+
+static inline uint32_t cell_hash(int32_t x, int32_t y, int32_t z, uint32_t mask)
+{
+    // Large primes from Teschner et al. "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+    return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u)) & mask;
+}
+
+static uint32_t next_pow2(uint32_t x)
+{
+    uint32_t p = 1;
+    while(p < x) p <<= 1;
+    return p;
+}
+
+// Builds the grid over count entries, entry k is particle index(k). Everything stored in the grid is the particle index.
+template <typename Index>
+static void build_entries(SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, uint32_t count, Index index)
+{
+    float cell_size = grid.cell_size;
+    if(cell_size <= 0.0)
+    {
+        float max_radius = 0.0;
+        for(uint32_t k = 0; k < count; k++) max_radius = std::max(max_radius, radii[index(k)]);
+        cell_size = max_radius > 0.0f ? 2.0f * max_radius : 1.0f;
+    }
+    grid.inv_cell_size = 1.0f / cell_size;
+
+    uint32_t table_size = next_pow2(grid.table_size ? grid.table_size : std::max(count * 2, 64u));
+    grid.mask = table_size - 1;
+
+    // Bucket key for every particle. Independent per particle so it can go wide.
+    grid.keys.resize(count);
+    float inv = grid.inv_cell_size;
+    uint32_t mask = grid.mask;
+    phys_parallel_for(grid.pool, count, 0, [&](size_t begin, size_t end) {
+        for(size_t k = begin; k < end; k++)
+        {
+            uint32_t i = index((uint32_t)k);
+            grid.keys[k] = cell_hash(cell_coord(positions.x[i], inv), cell_coord(positions.y[i], inv), cell_coord(positions.z[i], inv), mask);
+        }
+    });
+
+    // Counting sort by key: count, prefix sum, scatter
+    grid.bucket_start.assign(table_size + 1, 0);
+    for(uint32_t k = 0; k < count; k++)
+    {
+        grid.bucket_start[grid.keys[k] + 1]++;
+    }
+    for(uint32_t b = 0; b < table_size; b++)
+    {
+        grid.bucket_start[b + 1] += grid.bucket_start[b];
+    }
+
+    grid.sorted.resize(count);
+    std::vector<uint32_t> cursor(grid.bucket_start.begin(), grid.bucket_start.end() - 1);
+    for(uint32_t k = 0; k < count; k++)
+    {
+        grid.sorted[cursor[grid.keys[k]]++] = index(k);
+    }
+}
+
+void grid_build(SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii)
+{
+    build_entries(grid, positions, radii, (uint32_t)positions.size(), [](uint32_t k) { return k; });
+}
+
+void grid_build_subset(SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, const std::vector<uint32_t>& subset)
+{
+    const uint32_t* members = subset.data();
+    build_entries(grid, positions, radii, (uint32_t)subset.size(), [members](uint32_t k) { return members[k]; });
+}
+
+// Buckets of the 27 cells around (x, y, z) with duplicates taken out so we never visit a bucket twice
+static int neighbour_buckets(const SpatialHashGrid& grid, int32_t x, int32_t y, int32_t z, uint32_t* buckets)
+{
+    int n = 0;
+    for(int dz = -1; dz <= 1; dz++)
+    for(int dy = -1; dy <= 1; dy++)
+    for(int dx = -1; dx <= 1; dx++)
+    {
+        uint32_t b = cell_hash(x + dx, y + dy, z + dz, grid.mask);
+
+        bool seen = false;
+        for(int k = 0; k < n; k++)
+        {
+            if(buckets[k] == b) { seen = true; break; }
+        }
+        if(!seen) buckets[n++] = b;
+    }
+    return n;
+}
+
+static inline bool spheres_overlap(const Vec3Array& positions, const FloatArray& radii, uint32_t i, uint32_t j)
+{
+    float dx = positions.x[i] - positions.x[j];
+    float dy = positions.y[i] - positions.y[j];
+    float dz = positions.z[i] - positions.z[j];
+    float r = radii[i] + radii[j];
+    return dx * dx + dy * dy + dz * dz < r * r;
+}
+
+template <typename Index>
+static void find_pairs_range(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, const uint8_t* active,
+                             Index index, size_t begin, size_t end, std::vector<CollisionPair>& out)
+{
+    uint32_t buckets[27];
+    for(size_t k = begin; k < end; k++)
+    {
+        uint32_t i = index((uint32_t)k);
+        if(radii[i] <= 0.0) continue;
+        if(active && !active[i]) continue;
+
+        int n = neighbour_buckets(grid,
+            cell_coord(positions.x[i], grid.inv_cell_size),
+            cell_coord(positions.y[i], grid.inv_cell_size),
+            cell_coord(positions.z[i], grid.inv_cell_size),
+            buckets);
+
+        size_t first = out.size();
+        for(int b = 0; b < n; b++)
+        {
+            for(uint32_t s = grid.bucket_start[buckets[b]]; s < grid.bucket_start[buckets[b] + 1]; s++)
+            {
+                uint32_t j = grid.sorted[s];
+
+                // Only the lower index reports a pair so every pair comes out once.
+                // Inactive particles never report anything so the active side reports those pairs no matter the order.
+                bool j_reports = !active || active[j];
+                if(j == i || (j_reports && j < i) || radii[j] <= 0.0) continue;
+                if(spheres_overlap(positions, radii, i, j))
+                {
+                    out.push_back(make_pair_sorted(i, j));
+                }
+            }
+        }
+
+        // Buckets come out in hash order, sort this particle's pairs so the output doesn't depend on the table layout
+        std::sort(out.begin() + first, out.end(), [](const CollisionPair& a, const CollisionPair& b) {
+            return a.a != b.a ? a.a < b.a : a.b < b.b;
+        });
+    }
+}
+
+template <typename Index>
+static void find_pairs(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, const uint8_t* active,
+                       Index index, size_t count, std::vector<CollisionPair>& pairs)
+{
+    if(count == 0) return;
+
+    if(!grid.pool)
+    {
+        find_pairs_range(grid, positions, radii, active, index, 0, count, pairs);
+        return;
+    }
+
+    // Every chunk collects into its own list, then they get stitched together in chunk order
+    size_t chunk = phys_chunk_size(count, grid.pool->size());
+    size_t chunk_count = (count + chunk - 1) / chunk;
+    std::vector<std::vector<CollisionPair>> chunk_pairs(chunk_count);
+
+    grid.pool->parallel_for(count, chunk, [&](size_t begin, size_t end) {
+        find_pairs_range(grid, positions, radii, active, index, begin, end, chunk_pairs[begin / chunk]);
+    });
+
+    size_t total = pairs.size();
+    for(const std::vector<CollisionPair>& list : chunk_pairs) total += list.size();
+    pairs.reserve(total);
+    for(const std::vector<CollisionPair>& list : chunk_pairs)
+    {
+        pairs.insert(pairs.end(), list.begin(), list.end());
+    }
+}
+
+void grid_find_pairs(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, std::vector<CollisionPair>& pairs,
+                     const uint8_t* active)
+{
+    find_pairs(grid, positions, radii, active, [](uint32_t k) { return k; }, positions.size(), pairs);
+}
+
+void grid_find_pairs_subset(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                            const std::vector<uint32_t>& subset, std::vector<CollisionPair>& pairs)
+{
+    const uint32_t* members = subset.data();
+    find_pairs(grid, positions, radii, nullptr, [members](uint32_t k) { return members[k]; }, subset.size(), pairs);
+}
+
+void grid_find_pairs_between(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                             const std::vector<uint32_t>& queries, std::vector<CollisionPair>& pairs)
+{
+    if(grid.sorted.empty()) return;
+
+    // Same cell walk as grid_query_sphere, the queries weren't part of the build so they can be any size
+    std::vector<uint32_t> buckets;
+    for(uint32_t i : queries)
+    {
+        if(radii[i] <= 0.0) continue;
+
+        float reach = radii[i] + 0.5f / grid.inv_cell_size;
+        int32_t min_x = cell_coord(positions.x[i] - reach, grid.inv_cell_size), max_x = cell_coord(positions.x[i] + reach, grid.inv_cell_size);
+        int32_t min_y = cell_coord(positions.y[i] - reach, grid.inv_cell_size), max_y = cell_coord(positions.y[i] + reach, grid.inv_cell_size);
+        int32_t min_z = cell_coord(positions.z[i] - reach, grid.inv_cell_size), max_z = cell_coord(positions.z[i] + reach, grid.inv_cell_size);
+
+        size_t first = pairs.size();
+        uint64_t cells = (uint64_t)(max_x - min_x + 1) * (max_y - min_y + 1) * (max_z - min_z + 1);
+        if(cells > grid.mask + 1)
+        {
+            for(uint32_t j : grid.sorted)
+            {
+                if(radii[j] > 0.0 && spheres_overlap(positions, radii, i, j)) pairs.push_back(make_pair_sorted(i, j));
+            }
+        }
+        else
+        {
+            buckets.clear();
+            for(int32_t z = min_z; z <= max_z; z++)
+            for(int32_t y = min_y; y <= max_y; y++)
+            for(int32_t x = min_x; x <= max_x; x++)
+            {
+                buckets.push_back(cell_hash(x, y, z, grid.mask));
+            }
+            std::sort(buckets.begin(), buckets.end());
+            buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+            for(uint32_t b : buckets)
+            {
+                for(uint32_t s = grid.bucket_start[b]; s < grid.bucket_start[b + 1]; s++)
+                {
+                    uint32_t j = grid.sorted[s];
+                    if(radii[j] > 0.0 && spheres_overlap(positions, radii, i, j)) pairs.push_back(make_pair_sorted(i, j));
+                }
+            }
+        }
+
+        std::sort(pairs.begin() + first, pairs.end(), [](const CollisionPair& a, const CollisionPair& b) {
+            return a.a != b.a ? a.a < b.a : a.b < b.b;
+        });
+    }
+}
+
+void grid_query_sphere(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                       const glm::vec3& center, float radius, std::vector<uint32_t>& out)
+{
+    if(grid.sorted.empty()) return;
+
+    // Particles can stick out of their cell by up to half a cell
+    float reach = radius + 0.5f / grid.inv_cell_size;
+    int32_t min_x = cell_coord(center.x - reach, grid.inv_cell_size), max_x = cell_coord(center.x + reach, grid.inv_cell_size);
+    int32_t min_y = cell_coord(center.y - reach, grid.inv_cell_size), max_y = cell_coord(center.y + reach, grid.inv_cell_size);
+    int32_t min_z = cell_coord(center.z - reach, grid.inv_cell_size), max_z = cell_coord(center.z + reach, grid.inv_cell_size);
+
+    // A huge query would visit more cells than there are buckets, at that point just check every particle once
+    uint64_t cells = (uint64_t)(max_x - min_x + 1) * (max_y - min_y + 1) * (max_z - min_z + 1);
+    if(cells > grid.mask + 1)
+    {
+        for(uint32_t i = 0; i < positions.size(); i++)
+        {
+            float r = radius + radii[i];
+            if(radii[i] > 0.0 && glm::dot(positions.get(i) - center, positions.get(i) - center) < r * r) out.push_back(i);
+        }
+        return;
+    }
+
+    // Different cells can land in the same bucket so collect them first and only visit each bucket once
+    std::vector<uint32_t> buckets;
+    buckets.reserve(cells);
+    for(int32_t z = min_z; z <= max_z; z++)
+    for(int32_t y = min_y; y <= max_y; y++)
+    for(int32_t x = min_x; x <= max_x; x++)
+    {
+        buckets.push_back(cell_hash(x, y, z, grid.mask));
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+    for(uint32_t b : buckets)
+    {
+        for(uint32_t s = grid.bucket_start[b]; s < grid.bucket_start[b + 1]; s++)
+        {
+            uint32_t i = grid.sorted[s];
+            glm::vec3 d = positions.get(i) - center;
+            float r = radius + radii[i];
+            if(radii[i] > 0.0 && glm::dot(d, d) < r * r) out.push_back(i);
+        }
+    }
+}
+
+void phys_world_find_pairs(const ParticleWorld& world, SpatialHashGrid& grid, std::vector<CollisionPair>& pairs)
+{
+    grid_build(grid, world.position, world.radius);
+    grid_find_pairs(grid, world.position, world.radius, pairs);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "physics.h"
+#include "collision.h"
+
+/*
+    Uniform spatial hash broadphase for particles.
+
+    Every build hashes each particle's cell into a fixed size table and counting sorts the particle indices by bucket,
+    so the whole grid is just two flat arrays (bucket start offsets + sorted indices) and there's no per-cell allocation.
+    As long as cell_size is at least the biggest diameter, anything a particle can touch is in one of the 27 cells around it.
+
+    Unrelated cells can hash into the same bucket, that just costs a few extra distance tests.
+*/
+
+struct SpatialHashGrid
+{
+    float cell_size = 0.0;          // 0 = use the biggest diameter in the set every build
+    uint32_t table_size = 0;        // Buckets in the table (rounded to a power of 2). 0 = 2x the particle count.
+    ThreadPool* pool = nullptr;     // Optional, splits key generation and pair finding across threads
+
+    // Built by grid_build
+    float inv_cell_size = 0.0;
+    uint32_t mask = 0;
+    std::vector<uint32_t> bucket_start;     // table_size + 1 offsets into sorted
+    std::vector<uint32_t> sorted;           // particle indices grouped by bucket
+    std::vector<uint32_t> keys;             // bucket of every particle
+};
+
+void grid_build(SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii);
+
+// Appends every pair (i < j) whose spheres overlap. grid_build has to be called with the same arrays first.
+// Pairs come out sorted by i.
+// With an active mask, pairs where neither side is active are skipped without being tested (sleeping bodies),
+// the pairs then come out grouped by whichever side is active instead of strictly sorted.
+void grid_find_pairs(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, std::vector<CollisionPair>& pairs,
+                     const uint8_t* active = nullptr);
+
+// Same as grid_build / grid_find_pairs but only over the listed particle indices, the rest aren't in the grid at all
+void grid_build_subset(SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii, const std::vector<uint32_t>& subset);
+void grid_find_pairs_subset(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                            const std::vector<uint32_t>& subset, std::vector<CollisionPair>& pairs);
+
+// Appends a pair for every query index whose sphere overlaps something in the grid. The queries must not be in the grid
+// (e.g. awake bodies against a grid of sleeping ones) and can be any size. Pairs come out grouped by query.
+void grid_find_pairs_between(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                             const std::vector<uint32_t>& queries, std::vector<CollisionPair>& pairs);
+
+// Appends the index of every particle whose sphere overlaps the query sphere
+void grid_query_sphere(const SpatialHashGrid& grid, const Vec3Array& positions, const FloatArray& radii,
+                       const glm::vec3& center, float radius, std::vector<uint32_t>& out);
+
+// Shortcut for building over a whole ParticleWorld. Pairs are particle slots.
+void phys_world_find_pairs(const ParticleWorld& world, SpatialHashGrid& grid, std::vector<CollisionPair>& pairs);
@@ -0,0 +1,276 @@
+#include "ccd.h"
+#include <algorithm>
+#include <cmath>
+
+#define CCD_MAX_SLIDES 4        // Most times a swept particle hits something and carries on along it in one step
+
+// Smallest t in [0, max_t] where center + t * d is radius away from point, -1 if never
+static float sweep_point(const glm::vec3& center, float radius, const glm::vec3& d, const glm::vec3& point, float max_t)
+{
+    glm::vec3 m = center - point;
+    float a = glm::dot(d, d);
+    float b = glm::dot(m, d);
+    float c = glm::dot(m, m) - radius * radius;
+    if(a <= 0.0f || b >= 0.0f) return -1.0f;
+
+    float disc = b * b - a * c;
+    if(disc < 0.0f) return -1.0f;
+
+    float t = (-b - sqrtf(disc)) / a;
+    return t >= 0.0f && t <= max_t ? t : -1.0f;
+}
+
+// Same against the side of the cylinder around edge p -> q, only hits between the two ends count
+static float sweep_edge(const glm::vec3& center, float radius, const glm::vec3& d, const glm::vec3& p, const glm::vec3& q,
+                        float max_t, glm::vec3& contact)
+{
+    glm::vec3 e = q - p;
+    glm::vec3 m = center - p;
+    float ee = glm::dot(e, e);
+    float md = glm::dot(m, e);
+    float nd = glm::dot(d, e);
+
+    // Only the motion and offset perpendicular to the edge count
+    float a = ee * glm::dot(d, d) - nd * nd;
+    float b = ee * glm::dot(m, d) - nd * md;
+    float c = ee * (glm::dot(m, m) - radius * radius) - md * md;
+    if(a <= 1e-12f || b >= 0.0f) return -1.0f;
+
+    float disc = b * b - a * c;
+    if(disc < 0.0f) return -1.0f;
+
+    float t = (-b - sqrtf(disc)) / a;
+    if(t < 0.0f || t > max_t) return -1.0f;
+
+    float s = md + t * nd;
+    if(s < 0.0f || s > ee) return -1.0f;
+
+    contact = p + e * (s / ee);
+    return t;
+}
+
+bool sweep_sphere_triangle(const glm::vec3& center, float radius, const glm::vec3& displacement, const glm::vec3* tri, SweepHit& hit)
+{
+    glm::vec3 face = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+    float face_len = glm::length(face);
+    if(face_len <= 0.0f) return false;
+    glm::vec3 n = face / face_len;
+
+    // Already touching
+    glm::vec3 closest = closest_point_triangle(center, tri[0], tri[1], tri[2]);
+    glm::vec3 away = center - closest;
+    float dist = glm::length(away);
+    if(dist <= radius)
+    {
+        // Sliding along or moving away from what it's touching can't run into this triangle any further
+        glm::vec3 normal = dist > 1e-6f ? away / dist : (glm::dot(n, center - tri[0]) >= 0.0f ? n : -n);
+        if(hit.t <= 0.0f || glm::dot(displacement, normal) >= 0.0f) return false;
+        hit.t = 0.0;
+        hit.point = closest;
+        hit.normal = normal;
+        return true;
+    }
+
+    // Face first, if the sphere lands on the inside of the triangle nothing else can be earlier
+    float side = glm::dot(n, center - tri[0]);
+    glm::vec3 up = side >= 0.0f ? n : -n;
+    float closing = -glm::dot(up, displacement);
+    if(closing > 0.0f)
+    {
+        float t = (fabsf(side) - radius) / closing;
+        if(t >= 0.0f && t < hit.t)
+        {
+            glm::vec3 point = center + displacement * t - up * radius;
+            if(above_triangle(point, tri, n))
+            {
+                hit.t = t;
+                hit.point = point;
+                hit.normal = up;
+                return true;
+            }
+        }
+    }
+
+    // Otherwise it can only clip an edge or a corner
+    bool found = false;
+    for(int i = 0; i < 3; i++)
+    {
+        glm::vec3 contact;
+        float t = sweep_edge(center, radius, displacement, tri[i], tri[(i + 1) % 3], hit.t, contact);
+        if(t >= 0.0f && t < hit.t)
+        {
+            hit.t = t;
+            hit.point = contact;
+            found = true;
+        }
+
+        t = sweep_point(center, radius, displacement, tri[i], hit.t);
+        if(t >= 0.0f && t < hit.t)
+        {
+            hit.t = t;
+            hit.point = tri[i];
+            found = true;
+        }
+    }
+
+    if(found) hit.normal = glm::normalize(center + displacement * hit.t - hit.point);
+    return found;
+}
+
+bool sweep_sphere_mesh(const MeshCollider& mesh, const glm::vec3& center, float radius, const glm::vec3& displacement,
+                       SweepHit& hit, std::vector<uint32_t>& scratch)
+{
+    glm::vec3 end = center + displacement * hit.t;
+    AABB box{ glm::min(center, end) - glm::vec3(radius), glm::max(center, end) + glm::vec3(radius) };
+
+    scratch.clear();
+    mesh_query(mesh, box, scratch);
+
+    bool found = false;
+    for(uint32_t t : scratch)
+    {
+        if(sweep_sphere_triangle(center, radius, displacement, &mesh.corners[t * 3], hit))
+        {
+            hit.id = mesh.triangle_ids[t];
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool sweep_sphere_plane(const ContactPlane& plane, const glm::vec3& center, float radius, const glm::vec3& displacement, SweepHit& hit)
+{
+    float dist = glm::dot(plane.normal, center) - plane.offset;
+    float closing = -glm::dot(plane.normal, displacement);
+    if(closing <= 0.0f) return false;
+
+    float t = dist > radius ? (dist - radius) / closing : 0.0f;
+    if(t >= hit.t) return false;
+
+    hit.t = t;
+    hit.point = center + displacement * t - plane.normal * std::min(dist, radius);
+    hit.normal = plane.normal;
+    return true;
+}
+
+float sweep_sphere_sphere(const glm::vec3& center_a, float radius_a, const glm::vec3& displacement_a,
+                          const glm::vec3& center_b, float radius_b, const glm::vec3& displacement_b)
+{
+    // B standing still and A moving by the difference
+    glm::vec3 m = center_a - center_b;
+    float r = radius_a + radius_b;
+    if(glm::dot(m, m) <= r * r) return 0.0f;
+    return sweep_point(center_a, r, displacement_a - displacement_b, center_b, 1.0f);
+}
+
+void rigid_update_ccd(RigidBodyWorld& world, float delta)
+{
+    phys_parallel_for(world.pool, rigid_count(world), world.chunk_size, [&world, delta](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            world.ccd_margin[i] = 0.0;
+            world.swept_radius[i] = world.radius[i];
+            if(world.ccd_threshold[i] <= 0.0f || world.mass_inv[i] == 0.0f || !world.awake[i]) continue;
+
+            // Velocity isn't integrated yet so gravity's share of this step goes on top, spinning adds up to radius * w
+            glm::vec3 v = world.linear_velocity.get(i) + world.gravity * delta;
+            float reach = (glm::length(v) + glm::length(world.angular_velocity.get(i)) * world.radius[i]) * delta;
+            if(reach <= world.ccd_threshold[i] * world.radius[i]) continue;
+
+            world.ccd_margin[i] = reach;
+            world.swept_radius[i] = world.radius[i] + reach;
+        }
+    });
+}
+
+// First thing a particle moving from start by displacement runs into, hit.t stays 1 if there's nothing
+static SweepHit sweep_static(const MeshCollider* mesh, const std::vector<ContactPlane>& planes, const glm::vec3& start, float radius,
+                             const glm::vec3& displacement, std::vector<uint32_t>& scratch)
+{
+    SweepHit hit;
+    if(mesh) sweep_sphere_mesh(*mesh, start, radius, displacement, hit, scratch);
+    for(uint32_t p = 0; p < planes.size(); p++)
+    {
+        if(sweep_sphere_plane(planes[p], start, radius, displacement, hit)) hit.id = p;
+    }
+    return hit;
+}
+
+// Pushes the particle out along normal to radius from point and takes the velocity into the surface out
+static inline void resolve_particle(glm::vec3& position, glm::vec3& velocity, const glm::vec3& target, const glm::vec3& normal,
+                                    float restitution)
+{
+    position = target;
+    float v_n = glm::dot(velocity, normal);
+    if(v_n < 0.0f) velocity -= normal * ((1.0f + restitution) * v_n);
+}
+
+void phys_world_collide_static(ParticleWorld& world, const MeshCollider* mesh, const std::vector<ContactPlane>& planes,
+                               float delta, float restitution)
+{
+    phys_parallel_for(world.pool, phys_world_count(world), world.chunk_size, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> scratch;
+        for(size_t i = begin; i < end; i++)
+        {
+            if(world.mass_inv[i] == 0.0f) continue;
+
+            float radius = world.radius[i];
+            glm::vec3 position = world.position.get(i);
+            glm::vec3 velocity = world.velocity.get(i);
+            glm::vec3 displacement = velocity * delta;
+
+            if(world.ccd_threshold[i] > 0.0f && glm::length(displacement) > world.ccd_threshold[i] * radius)
+            {
+                // Clip and slide: stop where it touches, a hair off the surface so the next sweep doesn't start touching,
+                // then carry on with whatever is left of the motion along the surface
+                glm::vec3 start = position - displacement;
+                bool touched = false;
+                for(uint32_t slide = 0; slide < CCD_MAX_SLIDES; slide++)
+                {
+                    SweepHit hit = sweep_static(mesh, planes, start, radius, displacement, scratch);
+                    if(hit.t >= 1.0f)
+                    {
+                        start += displacement;
+                        break;
+                    }
+
+                    touched = true;
+                    resolve_particle(start, velocity, start + displacement * hit.t + hit.normal * (radius * 1e-3f), hit.normal, restitution);
+                    displacement *= 1.0f - hit.t;
+                    displacement -= hit.normal * std::min(glm::dot(displacement, hit.normal), 0.0f);
+                }
+                if(!touched) continue;
+                position = start;
+            }
+            else
+            {
+                if(radius <= 0.0f) continue;
+
+                if(mesh)
+                {
+                    scratch.clear();
+                    mesh_query(*mesh, AABB{ position - glm::vec3(radius), position + glm::vec3(radius) }, scratch);
+                    for(uint32_t t : scratch)
+                    {
+                        const glm::vec3* tri = &mesh->corners[t * 3];
+                        glm::vec3 closest = closest_point_triangle(position, tri[0], tri[1], tri[2]);
+                        glm::vec3 away = position - closest;
+                        float dist = glm::length(away);
+                        if(dist >= radius || dist <= 1e-6f) continue;
+                        resolve_particle(position, velocity, closest + away * (radius / dist), away / dist, restitution);
+                    }
+                }
+
+                for(const ContactPlane& plane : planes)
+                {
+                    float dist = glm::dot(plane.normal, position) - plane.offset;
+                    if(dist >= radius) continue;
+                    resolve_particle(position, velocity, position + plane.normal * (radius - dist), plane.normal, restitution);
+                }
+            }
+
+            world.position.set(i, position);
+            world.velocity.set(i, velocity);
+        }
+    });
+}
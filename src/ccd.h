@@ -0,0 +1,60 @@
+#pragma once
+#include "mesh_bvh.h"
+
+/*
+    Continuous collision detection for things that move far enough in one step to skip straight through thin geometry.
+
+    Only bodies moving further than ccd_threshold * radius in a step pay for any of this, everything else is untouched.
+
+    Rigid bodies get speculative contacts: rigid_update_ccd gives fast bodies a ccd_margin (how far they can get this
+    step), the broadphase sees them grown by it and the narrowphase keeps contacts out to that distance with the gap as
+    negative penetration. The solver lets the body close the gap but not go any further, so it arrives exactly at the
+    surface without ever stepping back in time.
+
+    Particles only have a sphere and no solver, so they get a swept sphere instead: the motion of the step is cast
+    against the mesh BVH and the planes. On a hit the particle is put back at the time of impact, its velocity reflected,
+    and the rest of the motion projected onto the surface and swept again (a few times at most), so particles slide along
+    floors and walls instead of stopping dead. The same sweeps are used by the scene queries. A ParticleWorld with
+    statics set does this after every phys_world_step, so plain particles don't need to call anything.
+*/
+
+struct SweepHit
+{
+    float t = 1.0;                          // Fraction of the displacement travelled before touching
+    glm::vec3 point = glm::vec3(0.0);       // Where the sphere touches
+    glm::vec3 normal = glm::vec3(0.0);      // Pointing from what got hit towards the sphere
+    uint32_t id = UINT32_MAX;               // Triangle id / plane index
+};
+
+// Sphere moving from center to center + displacement against a triangle. Starting out overlapping is a hit at t = 0,
+// unless the displacement runs along or away from the surface there (sliding / leaving isn't running into it).
+// Only hits earlier than hit.t count, hit is left alone on a miss.
+bool sweep_sphere_triangle(const glm::vec3& center, float radius, const glm::vec3& displacement, const glm::vec3* tri, SweepHit& hit);
+
+// Same against every triangle of the mesh (through the BVH), the id is the triangle id
+bool sweep_sphere_mesh(const MeshCollider& mesh, const glm::vec3& center, float radius, const glm::vec3& displacement,
+                       SweepHit& hit, std::vector<uint32_t>& scratch);
+
+bool sweep_sphere_plane(const ContactPlane& plane, const glm::vec3& center, float radius, const glm::vec3& displacement, SweepHit& hit);
+
+// Two moving spheres, returns the time of impact in [0, 1] or -1 if they don't touch during the step
+float sweep_sphere_sphere(const glm::vec3& center_a, float radius_a, const glm::vec3& displacement_a,
+                          const glm::vec3& center_b, float radius_b, const glm::vec3& displacement_b);
+
+// Works out ccd_margin and swept_radius for every body from its velocity, call once per step before the broadphase
+void rigid_update_ccd(RigidBodyWorld& world, float delta);
+
+// What phys_world_step collides a world's particles with when ParticleWorld::statics points at one
+struct StaticCollision
+{
+    const MeshCollider* mesh = nullptr;     // Can be nullptr, the world doesn't own it
+    std::vector<ContactPlane> planes;
+    float restitution = 0.0;
+};
+
+// Collides every particle with the mesh (can be nullptr) and the planes after a step of delta. Particles that moved
+// further than their ccd_threshold * radius get swept back along velocity * delta (exact for symplectic Euler) and slide along
+// whatever they hit, the rest just get pushed out of whatever they overlap. Velocity into the surface is reflected with
+// restitution.
+void phys_world_collide_static(ParticleWorld& world, const MeshCollider* mesh, const std::vector<ContactPlane>& planes,
+                               float delta, float restitution = 0.0);
@@ -0,0 +1,90 @@
+#include "cell_list.h"
+#include "spatial_sort.h"
+#include <algorithm>
+
+glm::ivec3 cell_list_cell(const CellList& cells, const glm::vec3& p)
+{
+    glm::ivec3 cell = glm::ivec3(glm::floor(p / cells.cell_size)) - cells.grid_min;
+    int32_t limit = (1 << cells.key_bits) - 1;
+    return glm::clamp(cell, glm::ivec3(0), glm::ivec3(limit));
+}
+
+bool cell_list_build(CellList& cells, ParticleWorld& world, float cell_size)
+{
+    size_t count = phys_world_count(world);
+    cells.cell_size = cell_size;
+    cells.cell_keys.clear();
+    cells.cell_start.assign(1, 0);
+    if(count == 0) return false;
+
+    // Only as many key bits as the particles are spread out
+    glm::vec3 lo = world.position.get(0), hi = lo;
+    for(size_t i = 1; i < count; i++)
+    {
+        glm::vec3 p = world.position.get(i);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    cells.grid_min = glm::ivec3(glm::floor(lo / cell_size));
+    glm::ivec3 extent = glm::ivec3(glm::floor(hi / cell_size)) - cells.grid_min + 1;
+    int32_t widest = std::max(extent.x, std::max(extent.y, extent.z));
+    cells.key_bits = 1;
+    while(cells.key_bits < MORTON_AXIS_BITS && (1 << cells.key_bits) < widest) cells.key_bits++;
+
+    cells.keys.resize(count);
+    cells.order.resize(count);
+    bool sorted = true;
+    for(size_t i = 0; i < count; i++)
+    {
+        cells.keys[i] = morton_encode(glm::uvec3(cell_list_cell(cells, world.position.get(i))));
+        cells.order[i] = (uint32_t)i;
+        if(i > 0 && cells.keys[i] < cells.keys[i - 1]) sorted = false;
+    }
+
+    // Nothing moved far enough to change the order since last time
+    if(!sorted)
+    {
+        morton_sort(cells.keys, cells.order, cells.key_bits * 3, cells.key_scratch, cells.order_scratch);
+        phys_world_reorder(world, cells.order);
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(i == 0 || cells.keys[i] != cells.keys[i - 1])
+        {
+            if(i > 0) cells.cell_start.push_back((uint32_t)i);
+            cells.cell_keys.push_back(cells.keys[i]);
+        }
+    }
+    cells.cell_start.push_back((uint32_t)count);
+    return !sorted;
+}
+
+uint32_t cell_list_neighbours(const CellList& cells, const glm::ivec3& cell, CellRun* runs)
+{
+    int32_t limit = 1 << cells.key_bits;
+    uint32_t count = 0;
+    for(int32_t dz = -1; dz <= 1; dz++)
+    for(int32_t dy = -1; dy <= 1; dy++)
+    for(int32_t dx = -1; dx <= 1; dx++)
+    {
+        glm::ivec3 n = cell + glm::ivec3(dx, dy, dz);
+        if(n.x < 0 || n.y < 0 || n.z < 0 || n.x >= limit || n.y >= limit || n.z >= limit) continue;
+
+        uint64_t key = morton_encode(glm::uvec3(n));
+        auto it = std::lower_bound(cells.cell_keys.begin(), cells.cell_keys.end(), key);
+        if(it == cells.cell_keys.end() || *it != key) continue;
+
+        size_t c = it - cells.cell_keys.begin();
+        runs[count++] = { cells.cell_start[c], cells.cell_start[c + 1] };
+    }
+
+    std::sort(runs, runs + count, [](const CellRun& a, const CellRun& b) { return a.begin < b.begin; });
+    uint32_t merged = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(merged > 0 && runs[merged - 1].end == runs[i].begin) runs[merged - 1].end = runs[i].end;
+        else runs[merged++] = runs[i];
+    }
+    return merged;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+
+/*
+    Cell list over a ParticleWorld: a grid of cell_size cubes where the world's particles get sorted by the Z-order
+    (Morton) key of their cell and the whole world gets reordered to match (see phys_world_reorder and spatial_sort.h).
+    Particles in the same cell end up next to each other and neighbouring cells mostly end up close by, so neighbour
+    loops read memory front to back. Particles only move a little between builds so the order stays close to sorted.
+    The sort is a radix sort over only as many key bits as the particles' bounds need.
+
+    Each non-empty cell is one run of slots. cell_list_neighbours finds the 27 cells around a cell by binary searching
+    the sorted keys, and neighbour cells that sit next to each other in memory get merged into one run.
+
+    Used by the SPH fluid (sph.h) and the granular DEM (dem.h).
+*/
+
+struct CellRun
+{
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct CellList
+{
+    float cell_size = 1.0;
+    glm::ivec3 grid_min = glm::ivec3(0);
+    uint32_t key_bits = 0;              // Bits per axis in the Morton keys
+    std::vector<uint64_t> cell_keys;    // Morton key of every non-empty cell
+    std::vector<uint32_t> cell_start;   // cell_keys.size() + 1 offsets into the particles
+
+    // order[i] is the slot particle i was in before the last build, only valid when the build reordered the world
+    std::vector<uint32_t> order;
+
+    // Scratch
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> key_scratch;
+    std::vector<uint32_t> order_scratch;
+};
+
+// Sorts and reorders the world and builds the cells. Returns true if the world got reordered, anything else kept per
+// particle alongside the world has to be shuffled the same way (see order).
+bool cell_list_build(CellList& cells, ParticleWorld& world, float cell_size);
+
+// Cell coordinates relative to grid_min. Anything that flew off since the build gets clamped into the edge cells.
+glm::ivec3 cell_list_cell(const CellList& cells, const glm::vec3& p);
+
+// Particle runs of the (up to) 27 cells around cell, in memory order with touching runs merged. runs needs room for 27.
+uint32_t cell_list_neighbours(const CellList& cells, const glm::ivec3& cell, CellRun* runs);
+
+// Runs kernel(first particle, end particle, runs, run count) for every cell, chunk_size cells at a time across the pool
+template <typename Kernel>
+void cell_list_for_each(const CellList& cells, const ParticleWorld& world, size_t chunk_size, const Kernel& kernel)
+{
+    phys_parallel_for(world.pool, cells.cell_keys.size(), chunk_size, [&](size_t begin, size_t end) {
+        CellRun runs[27];
+        for(size_t c = begin; c < end; c++)
+        {
+            uint32_t first = cells.cell_start[c];
+            uint32_t count = cell_list_neighbours(cells, cell_list_cell(cells, world.position.get(first)), runs);
+            kernel(first, cells.cell_start[c + 1], runs, count);
+        }
+    });
+}
@@ -0,0 +1,562 @@
+#include "cloth.h"
+#include "integrators.h"
+#include "spatial_sort.h"
+#include "physics_simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+// Index of the particle each vertex welds into. Vertices get bucketed on a weld_distance grid and everything in the
+// same bucket becomes one particle, particles are numbered in the order their first vertex shows up in the mesh.
+static uint32_t weld_vertices(const std::vector<glm::vec3>& positions, float weld_distance, std::vector<uint32_t>& vertex_particle)
+{
+    uint32_t count = (uint32_t)positions.size();
+    vertex_particle.resize(count);
+
+    if(weld_distance <= 0.0f)
+    {
+        for(uint32_t i = 0; i < count; i++) vertex_particle[i] = i;
+        return count;
+    }
+
+    struct Key
+    {
+        int64_t x, y, z;
+        uint32_t vertex;
+    };
+
+    float inv = 1.0f / weld_distance;
+    std::vector<Key> keys(count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        glm::vec3 p = positions[i] * inv;
+        keys[i] = { (int64_t)floorf(p.x), (int64_t)floorf(p.y), (int64_t)floorf(p.z), i };
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+        if(a.x != b.x) return a.x < b.x;
+        if(a.y != b.y) return a.y < b.y;
+        if(a.z != b.z) return a.z < b.z;
+        return a.vertex < b.vertex;
+    });
+
+    // Lowest vertex of every bucket stands in for the rest of it
+    std::vector<uint32_t> first(count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        bool same = i > 0 && keys[i].x == keys[i - 1].x && keys[i].y == keys[i - 1].y && keys[i].z == keys[i - 1].z;
+        first[keys[i].vertex] = same ? first[keys[i - 1].vertex] : keys[i].vertex;
+    }
+
+    uint32_t particles = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        vertex_particle[i] = first[i] == i ? particles++ : vertex_particle[first[i]];
+    }
+    return particles;
+}
+
+void cloth_from_geometry(Cloth& cloth, const MeshGeometry& geometry, const glm::mat4& transform, const ClothSettings& settings,
+                         ThreadPool* pool)
+{
+    cloth = Cloth();
+    cloth.world.pool = pool;
+    cloth.aero_drag = settings.aero_drag;
+    cloth.thickness = settings.thickness;
+    cloth.collision_margin = settings.collision_margin;
+    cloth.solver.substeps = settings.substeps;
+    cloth.solver.max_speed = settings.max_speed;
+
+    std::vector<glm::vec3> positions(geometry.vertices.size());
+    for(size_t i = 0; i < positions.size(); i++)
+    {
+        positions[i] = glm::vec3(transform * glm::vec4(geometry.vertices[i].position, 1.0));
+    }
+
+    uint32_t particle_count = weld_vertices(positions, settings.weld_distance, cloth.vertex_particle);
+    cloth.rest_position.resize(particle_count);
+    for(size_t i = 0; i < positions.size(); i++) cloth.rest_position[cloth.vertex_particle[i]] = positions[i];
+
+    // Triangles that didn't collapse into a line or a point while welding
+    for(size_t i = 0; i + 2 < geometry.indices.size(); i += 3)
+    {
+        uint32_t a = cloth.vertex_particle[geometry.indices[i + 0]];
+        uint32_t b = cloth.vertex_particle[geometry.indices[i + 1]];
+        uint32_t c = cloth.vertex_particle[geometry.indices[i + 2]];
+        if(a == b || b == c || c == a) continue;
+        cloth.triangles.insert(cloth.triangles.end(), { a, b, c });
+    }
+    uint32_t triangle_count = (uint32_t)cloth.triangles.size() / 3;
+
+    // Particle mass is a third of every triangle around it, stray vertices without triangles don't weigh anything
+    std::vector<float> mass(particle_count, 0.0f);
+    for(uint32_t t = 0; t < triangle_count; t++)
+    {
+        const uint32_t* tri = &cloth.triangles[t * 3];
+        glm::vec3 p0 = cloth.rest_position[tri[0]];
+        float area = 0.5f * glm::length(glm::cross(cloth.rest_position[tri[1]] - p0, cloth.rest_position[tri[2]] - p0));
+        for(int k = 0; k < 3; k++) mass[tri[k]] += settings.density * area / 3.0f;
+    }
+
+    phys_world_reserve(cloth.world, particle_count);
+    cloth.mass_inv.resize(particle_count);
+    for(uint32_t i = 0; i < particle_count; i++)
+    {
+        PhysicsParticle particle;
+        particle.position = cloth.rest_position[i];
+        particle.damping = settings.damping;
+        particle.mass_inv = mass[i] > 0.0f ? 1.0f / mass[i] : 0.0f;
+        particle.radius = settings.thickness * 0.5f;
+        phys_world_add(cloth.world, particle);
+        cloth.mass_inv[i] = particle.mass_inv;
+    }
+
+    // Triangles around every particle, for gathering wind and normals
+    cloth.particle_triangle_start.assign(particle_count + 1, 0);
+    for(uint32_t p : cloth.triangles) cloth.particle_triangle_start[p + 1]++;
+    for(uint32_t i = 0; i < particle_count; i++) cloth.particle_triangle_start[i + 1] += cloth.particle_triangle_start[i];
+    cloth.particle_triangles.resize(cloth.triangles.size());
+    std::vector<uint32_t> fill(cloth.particle_triangle_start.begin(), cloth.particle_triangle_start.end() - 1);
+    for(uint32_t t = 0; t < triangle_count; t++)
+    {
+        for(int k = 0; k < 3; k++) cloth.particle_triangles[fill[cloth.triangles[t * 3 + k]]++] = t;
+    }
+
+    // Every edge once with the corner across from it in each triangle it belongs to. Sorting brings the two sides of
+    // a shared edge next to each other.
+    struct Edge
+    {
+        uint32_t a, b;
+        uint32_t opposite;
+    };
+    std::vector<Edge> edges;
+    edges.reserve(cloth.triangles.size());
+    for(uint32_t t = 0; t < triangle_count; t++)
+    {
+        const uint32_t* tri = &cloth.triangles[t * 3];
+        for(int k = 0; k < 3; k++)
+        {
+            uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            edges.push_back({ std::min(a, b), std::max(a, b), tri[(k + 2) % 3] });
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+        if(x.a != y.a) return x.a < y.a;
+        if(x.b != y.b) return x.b < y.b;
+        return x.opposite < y.opposite;
+    });
+
+    for(size_t i = 0; i < edges.size();)
+    {
+        size_t end = i + 1;
+        while(end < edges.size() && edges[end].a == edges[i].a && edges[end].b == edges[i].b) end++;
+
+        xpbd_add_distance(cloth.solver, cloth.world, edges[i].a, edges[i].b, settings.stretch_compliance);
+
+        // Edges with more than two triangles on them only bend between the first two
+        if(end - i >= 2 && edges[i].opposite != edges[i + 1].opposite)
+        {
+            xpbd_add_distance(cloth.solver, cloth.world, edges[i].opposite, edges[i + 1].opposite, settings.bend_compliance);
+        }
+        i = end;
+    }
+
+    cloth.triangle_vector.resize(triangle_count);
+    cloth.render_position.resize(particle_count);
+    xpbd_build(cloth.solver, cloth.world);
+}
+
+void cloth_pin(Cloth& cloth, uint32_t vertex, bool pinned)
+{
+    if(vertex >= cloth.vertex_particle.size()) return;
+    uint32_t p = cloth.vertex_particle[vertex];
+
+    cloth.world.mass_inv[p] = pinned ? 0.0f : cloth.mass_inv[p];
+    cloth.world.acceleration.set(p, pinned ? glm::vec3(0.0) : glm::vec3(0.0, -grav, 0.0));
+    cloth.world.velocity.set(p, glm::vec3(0.0));
+}
+
+void cloth_move_pin(Cloth& cloth, uint32_t vertex, const glm::vec3& position)
+{
+    if(vertex >= cloth.vertex_particle.size()) return;
+    cloth.world.position.set(cloth.vertex_particle[vertex], position);
+}
+
+static void apply_wind(Cloth& cloth)
+{
+    ParticleWorld& world = cloth.world;
+    uint32_t triangle_count = (uint32_t)cloth.triangles.size() / 3;
+
+    // Force on every triangle: the relative air velocity along the normal, times the area. The cross product is
+    // already twice the area times the normal so only one division is needed.
+    phys_parallel_for(world.pool, triangle_count, 0, [&cloth, &world](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++)
+        {
+            const uint32_t* tri = &cloth.triangles[t * 3];
+            glm::vec3 p0 = world.position.get(tri[0]);
+            glm::vec3 area_normal = 0.5f * glm::cross(world.position.get(tri[1]) - p0, world.position.get(tri[2]) - p0);
+            float area_sq = glm::dot(area_normal, area_normal);
+            if(area_sq < 1e-20f)
+            {
+                cloth.triangle_vector[t] = glm::vec3(0.0);
+                continue;
+            }
+
+            glm::vec3 velocity = (world.velocity.get(tri[0]) + world.velocity.get(tri[1]) + world.velocity.get(tri[2])) / 3.0f;
+            glm::vec3 relative = cloth.wind - velocity;
+
+            // (relative . n) * area * n with n = area_normal / area
+            cloth.triangle_vector[t] = area_normal * (cloth.aero_drag * glm::dot(relative, area_normal) / sqrtf(area_sq));
+        }
+    });
+
+    // Every particle takes a third of each triangle around it
+    phys_for_each_chunk(world, [&cloth, &world](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 force(0.0);
+            for(uint32_t k = cloth.particle_triangle_start[i]; k < cloth.particle_triangle_start[i + 1]; k++)
+            {
+                force += cloth.triangle_vector[cloth.particle_triangles[k]];
+            }
+            world.force.set(i, world.force.get(i) + force / 3.0f);
+        }
+    });
+}
+
+// What the self collision kernels read, indexed by sorted position
+struct SelfCollisionArgs
+{
+    const float* px; const float* py; const float* pz;
+    const float* rx; const float* ry; const float* rz;     // Rest shape
+    const uint32_t* particle;
+    float reach_sq;         // (thickness + margin)^2
+    float thickness_sq;
+};
+
+// Appends a pair for every particle in [begin, end) that's within reach of particle s now and wasn't closer than
+// thickness in the rest shape. Scalar reference, the vector kernels use it for whatever doesn't fill a whole register.
+static void self_collide_scalar(const SelfCollisionArgs& args, uint32_t s, uint32_t begin, uint32_t end, std::vector<CollisionPair>& out)
+{
+    for(uint32_t j = begin; j < end; j++)
+    {
+        float dx = args.px[s] - args.px[j], dy = args.py[s] - args.py[j], dz = args.pz[s] - args.pz[j];
+        if(!(dx * dx + dy * dy + dz * dz < args.reach_sq)) continue;
+
+        float rx = args.rx[s] - args.rx[j], ry = args.ry[s] - args.ry[j], rz = args.rz[s] - args.rz[j];
+        if(rx * rx + ry * ry + rz * rz < args.thickness_sq) continue;
+        out.push_back(make_pair_sorted(args.particle[s], args.particle[j]));
+    }
+}
+
+#if PHYS_X86
+
+static void self_collide_sse(const SelfCollisionArgs& args, uint32_t s, uint32_t begin, uint32_t end, std::vector<CollisionPair>& out)
+{
+    const __m128 px = _mm_set1_ps(args.px[s]), py = _mm_set1_ps(args.py[s]), pz = _mm_set1_ps(args.pz[s]);
+    const __m128 rx = _mm_set1_ps(args.rx[s]), ry = _mm_set1_ps(args.ry[s]), rz = _mm_set1_ps(args.rz[s]);
+    const __m128 reach_sq = _mm_set1_ps(args.reach_sq);
+    const __m128 thickness_sq = _mm_set1_ps(args.thickness_sq);
+
+    uint32_t j = begin;
+    for(; j + 4 <= end; j += 4)
+    {
+        __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(args.px + j));
+        __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(args.py + j));
+        __m128 dz = _mm_sub_ps(pz, _mm_loadu_ps(args.pz + j));
+        __m128 near = _mm_cmplt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), reach_sq);
+        int mask = _mm_movemask_ps(near);
+        if(!mask) continue;
+
+        __m128 ex = _mm_sub_ps(rx, _mm_loadu_ps(args.rx + j));
+        __m128 ey = _mm_sub_ps(ry, _mm_loadu_ps(args.ry + j));
+        __m128 ez = _mm_sub_ps(rz, _mm_loadu_ps(args.rz + j));
+        __m128 apart = _mm_cmpnlt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez)), thickness_sq);
+        mask &= _mm_movemask_ps(apart);
+        for(uint32_t lane = 0; mask; lane++, mask >>= 1)
+        {
+            if(mask & 1) out.push_back(make_pair_sorted(args.particle[s], args.particle[j + lane]));
+        }
+    }
+    self_collide_scalar(args, s, j, end, out);
+}
+
+SIMD_TARGET("avx2")
+static void self_collide_avx2(const SelfCollisionArgs& args, uint32_t s, uint32_t begin, uint32_t end, std::vector<CollisionPair>& out)
+{
+    const __m256 px = _mm256_set1_ps(args.px[s]), py = _mm256_set1_ps(args.py[s]), pz = _mm256_set1_ps(args.pz[s]);
+    const __m256 rx = _mm256_set1_ps(args.rx[s]), ry = _mm256_set1_ps(args.ry[s]), rz = _mm256_set1_ps(args.rz[s]);
+    const __m256 reach_sq = _mm256_set1_ps(args.reach_sq);
+    const __m256 thickness_sq = _mm256_set1_ps(args.thickness_sq);
+
+    uint32_t j = begin;
+    for(; j + 8 <= end; j += 8)
+    {
+        __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(args.px + j));
+        __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(args.py + j));
+        __m256 dz = _mm256_sub_ps(pz, _mm256_loadu_ps(args.pz + j));
+        __m256 dist_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(dist_sq, reach_sq, _CMP_LT_OQ));
+        if(!mask) continue;
+
+        __m256 ex = _mm256_sub_ps(rx, _mm256_loadu_ps(args.rx + j));
+        __m256 ey = _mm256_sub_ps(ry, _mm256_loadu_ps(args.ry + j));
+        __m256 ez = _mm256_sub_ps(rz, _mm256_loadu_ps(args.rz + j));
+        __m256 rest_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez));
+        mask &= _mm256_movemask_ps(_mm256_cmp_ps(rest_sq, thickness_sq, _CMP_NLT_UQ));
+        for(uint32_t lane = 0; mask; lane++, mask >>= 1)
+        {
+            if(mask & 1) out.push_back(make_pair_sorted(args.particle[s], args.particle[j + lane]));
+        }
+    }
+    self_collide_scalar(args, s, j, end, out);
+}
+
+#endif
+
+typedef void (*SelfCollideFn)(const SelfCollisionArgs& args, uint32_t s, uint32_t begin, uint32_t end, std::vector<CollisionPair>& out);
+
+static SelfCollideFn self_collide_fn(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: return self_collide_avx2;
+        case SIMD_SSE: return self_collide_sse;
+        default: break;
+    }
+#endif
+    return self_collide_scalar;
+}
+
+// Sorts the particles by cell key and copies their current and rest positions into that order
+static void sort_into_cells(Cloth& cloth, float cell_size)
+{
+    ParticleWorld& world = cloth.world;
+    size_t count = phys_world_count(world);
+
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for(size_t i = 0; i < count; i++)
+    {
+        lo = glm::min(lo, world.position.get(i));
+        hi = glm::max(hi, world.position.get(i));
+    }
+
+    // Enough bits per axis for the bounds plus an empty cell on every side, so neighbour keys never borrow from or
+    // carry into the next axis. A cloth that blew up past 2^21 cells gets clamped into the edge cells, which only
+    // costs extra tests.
+    float inv = 1.0f / cell_size;
+    float cells = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z) * inv;
+    uint32_t bits = 2;
+    while(bits < MORTON_AXIS_BITS && (float)(1u << bits) < cells + 3.0f) bits++;
+    float last = (float)((1u << bits) - 3);
+
+    cloth.sorted_key.resize(count);
+    cloth.sorted_particle.resize(count);
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 c = (world.position.get(i) - lo) * inv;
+            uint64_t x = (uint64_t)fminf(fmaxf(c.x, 0.0f), last) + 1;
+            uint64_t y = (uint64_t)fminf(fmaxf(c.y, 0.0f), last) + 1;
+            uint64_t z = (uint64_t)fminf(fmaxf(c.z, 0.0f), last) + 1;
+            cloth.sorted_key[i] = z << (2 * bits) | y << bits | x;
+            cloth.sorted_particle[i] = (uint32_t)i;
+        }
+    });
+    morton_sort(cloth.sorted_key, cloth.sorted_particle, 3 * bits, cloth.key_scratch, cloth.particle_scratch);
+
+    cloth.sorted_position.resize(count);
+    cloth.sorted_rest.resize(count);
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t s = begin; s < end; s++)
+        {
+            uint32_t i = cloth.sorted_particle[s];
+            cloth.sorted_position.set(s, world.position.get(i));
+            cloth.sorted_rest.set(s, cloth.rest_position[i]);
+        }
+    });
+
+    cloth.cell_key.clear();
+    cloth.cell_start.clear();
+    for(size_t s = 0; s < count; s++)
+    {
+        if(s > 0 && cloth.sorted_key[s] == cloth.sorted_key[s - 1]) continue;
+        cloth.cell_key.push_back(cloth.sorted_key[s]);
+        cloth.cell_start.push_back((uint32_t)s);
+    }
+    cloth.cell_start.push_back((uint32_t)count);
+
+    // Row and layer strides in key space
+    cloth.row_stride = 1ull << bits;
+    cloth.layer_stride = 1ull << (2 * bits);
+}
+
+// Key offsets of the first and last cell of every run of cells ahead of a cell. The first run starts at the cell itself
+// (its own particles only get tested against the ones after them).
+#define SELF_RUNS 5
+
+static void self_runs(const Cloth& cloth, int64_t* first, int64_t* last)
+{
+    int64_t row = (int64_t)cloth.row_stride;
+    int64_t layer = (int64_t)cloth.layer_stride;
+    int64_t centers[SELF_RUNS] = { 0, row, layer - row, layer, layer + row };
+    for(int r = 0; r < SELF_RUNS; r++)
+    {
+        first[r] = r == 0 ? 0 : centers[r] - 1;
+        last[r] = centers[r] + 1;
+    }
+}
+
+// Pairs of every particle in cells [begin, end) with the particles ahead of it, in cell order
+static void self_collide_cells(const Cloth& cloth, const SelfCollisionArgs& args, SelfCollideFn collide, size_t begin, size_t end,
+                               std::vector<CollisionPair>& out)
+{
+    if(begin >= end) return;
+
+    const std::vector<uint64_t>& keys = cloth.cell_key;
+    int64_t first_offset[SELF_RUNS], last_offset[SELF_RUNS];
+    self_runs(cloth, first_offset, last_offset);
+
+    // first_cell[r] is the first cell at or past the run's first key, end_cell[r] the first one past its last key.
+    // Both only ever move forward as the cells do.
+    size_t first_cell[SELF_RUNS], end_cell[SELF_RUNS];
+    for(int r = 0; r < SELF_RUNS; r++)
+    {
+        first_cell[r] = std::lower_bound(keys.begin(), keys.end(), keys[begin] + first_offset[r]) - keys.begin();
+        end_cell[r] = first_cell[r];
+    }
+
+    for(size_t c = begin; c < end; c++)
+    {
+        uint64_t key = keys[c];
+        uint32_t run_begin[SELF_RUNS], run_end[SELF_RUNS];
+        for(int r = 0; r < SELF_RUNS; r++)
+        {
+            uint64_t first = key + first_offset[r];
+            uint64_t last = key + last_offset[r];
+            while(first_cell[r] < keys.size() && keys[first_cell[r]] < first) first_cell[r]++;
+            end_cell[r] = std::max(end_cell[r], first_cell[r]);
+            while(end_cell[r] < keys.size() && keys[end_cell[r]] <= last) end_cell[r]++;
+            run_begin[r] = cloth.cell_start[first_cell[r]];
+            run_end[r] = cloth.cell_start[end_cell[r]];
+        }
+
+        for(uint32_t s = cloth.cell_start[c]; s < cloth.cell_start[c + 1]; s++)
+        {
+            collide(args, s, s + 1, run_end[0], out);
+            for(int r = 1; r < SELF_RUNS; r++)
+            {
+                if(run_begin[r] < run_end[r]) collide(args, s, run_begin[r], run_end[r], out);
+            }
+        }
+    }
+}
+
+static void find_self_collisions(Cloth& cloth)
+{
+    ParticleWorld& world = cloth.world;
+    float margin = cloth.collision_margin > 0.0f ? cloth.collision_margin : cloth.thickness;
+
+    // Pairs within thickness + margin of each other now could touch by the end of the step
+    float reach = cloth.thickness + margin;
+    sort_into_cells(cloth, reach);
+
+    // Neighbours that are closer than thickness in the rest shape would fight the distance constraints
+    SelfCollisionArgs args = {
+        cloth.sorted_position.x.data(), cloth.sorted_position.y.data(), cloth.sorted_position.z.data(),
+        cloth.sorted_rest.x.data(), cloth.sorted_rest.y.data(), cloth.sorted_rest.z.data(),
+        cloth.sorted_particle.data(), reach * reach, cloth.thickness * cloth.thickness
+    };
+    SelfCollideFn collide = self_collide_fn(simd_level());
+
+    // Every chunk of cells collects into its own list, stitched together in cell order so the pairs come out the same
+    // for any thread count
+    std::vector<CollisionPair>& pairs = cloth.solver.collisions;
+    pairs.clear();
+    size_t cell_count = cloth.cell_key.size();
+    if(!world.pool || cell_count == 0)
+    {
+        self_collide_cells(cloth, args, collide, 0, cell_count, pairs);
+    }
+    else
+    {
+        size_t chunk = phys_chunk_size(cell_count, world.pool->size());
+        cloth.chunk_pairs.resize((cell_count + chunk - 1) / chunk);
+        world.pool->parallel_for(cell_count, chunk, [&](size_t begin, size_t end) {
+            std::vector<CollisionPair>& list = cloth.chunk_pairs[begin / chunk];
+            list.clear();
+            self_collide_cells(cloth, args, collide, begin, end, list);
+        });
+        for(const std::vector<CollisionPair>& list : cloth.chunk_pairs) pairs.insert(pairs.end(), list.begin(), list.end());
+    }
+    cloth.solver.collision_distance = cloth.thickness;
+}
+
+void cloth_step(Cloth& cloth, float delta)
+{
+    if(cloth.aero_drag > 0.0f && cloth.wind != glm::vec3(0.0)) apply_wind(cloth);
+
+    cloth.solver.collisions.clear();
+    if(cloth.thickness > 0.0f) find_self_collisions(cloth);
+
+    xpbd_step(cloth.solver, cloth.world, delta);
+}
+
+void cloth_update(Cloth& cloth, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            cloth.world.previous_position = cloth.world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            cloth_step(cloth, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(phys_world_checksum(cloth.world));
+    }
+}
+
+void cloth_write_vertices(Cloth& cloth, MeshGeometry& mesh, float alpha)
+{
+    ParticleWorld& world = cloth.world;
+    if(mesh.vertices.size() != cloth.vertex_particle.size()) return;
+
+    std::vector<glm::vec3>& position = cloth.render_position;
+    phys_for_each_chunk(world, [&world, &position, alpha](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) position[i] = glm::mix(world.previous_position.get(i), world.position.get(i), alpha);
+    });
+
+    uint32_t triangle_count = (uint32_t)cloth.triangles.size() / 3;
+    phys_parallel_for(world.pool, triangle_count, 0, [&cloth, &position](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++)
+        {
+            const uint32_t* tri = &cloth.triangles[t * 3];
+            cloth.triangle_vector[t] = glm::cross(position[tri[1]] - position[tri[0]], position[tri[2]] - position[tri[0]]);
+        }
+    });
+
+    // Area weighted normal of the triangles around each particle, same for every vertex welded into it so seams don't show
+    phys_parallel_for(world.pool, mesh.vertices.size(), 0, [&cloth, &mesh, &position](size_t begin, size_t end) {
+        for(size_t v = begin; v < end; v++)
+        {
+            uint32_t p = cloth.vertex_particle[v];
+            glm::vec3 normal(0.0);
+            for(uint32_t k = cloth.particle_triangle_start[p]; k < cloth.particle_triangle_start[p + 1]; k++)
+            {
+                normal += cloth.triangle_vector[cloth.particle_triangles[k]];
+            }
+            float len_sq = glm::dot(normal, normal);
+
+            mesh.vertices[v].position = position[p];
+            mesh.vertices[v].normal = len_sq > 1e-24f ? normal / sqrtf(len_sq) : glm::vec3(0.0, 1.0, 0.0);
+        }
+    });
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "xpbd.h"
+#include "mesh.h"
+
+/*
+    Cloth made out of any MeshGeometry. Every vertex becomes a particle and every edge a distance constraint. Bending is
+    a softer distance constraint between the two corners across from every edge shared by two triangles, which is half
+    the cost of a real dihedral angle constraint (xpbd_add_bending) and keeps everything in the solver's cheapest path.
+    Rest lengths are whatever the mesh has, so a curtain modelled with folds keeps them. The particles live in the
+    cloth's own ParticleWorld and get stepped by an XpbdSolver.
+
+    Loaders split vertices wherever the uvs or normals jump, so vertices sitting on top of each other get welded into one
+    particle first, otherwise the cloth would fall apart along every seam. Written back positions and normals go to the
+    original vertices, which keeps the uvs.
+
+    Wind pushes on every triangle along its normal (the part of the relative air velocity hitting the face head on), so
+    cloth edge-on to the wind doesn't catch any of it. Each triangle's force gets worked out on its own and every
+    particle sums its triangles' shares, so nothing writes to the same particle from two threads.
+
+    Self collision keeps particles thickness apart. Every step the particles get sorted into cells of thickness plus a
+    margin for however far they move during the step, and every pair within that distance that isn't already closer
+    than thickness in the rest shape becomes a collision for the solver. Only particles collide, not triangles, so
+    thickness has to be around the distance between neighbouring vertices or particles slip through the holes between
+    them. Particles that move further than the margin in one step can still pass through each other, set max_speed if
+    that's a problem.
+
+    The cells are keyed row by row (x, then y, then z) and radix sorted along with copies of the current and rest
+    positions, so the cells ahead of any cell come in 5 contiguous runs: the rest of its own row up to x + 1, three
+    cells of the next row and three rows of three in the next layer. Those runs are one stretch of the sorted copies
+    each, so every particle gets tested against them 4 or 8 at a time with plain vector loads (see physics_simd.h),
+    and walking the cells in order only ever moves the runs forward.
+*/
+
+struct ClothSettings
+{
+    float stretch_compliance = 0.0;     // 0 = doesn't stretch
+    float bend_compliance = 1e-3;
+    float density = 0.2;                // kg per m^2, every particle gets a third of the mass of its triangles
+    float damping = 0.99;
+    float weld_distance = 1e-5;         // Vertices this close together become one particle
+    float thickness = 0.0;              // Self collision distance, 0 = no self collision
+    float collision_margin = 0.0;       // Extra search distance for self collision pairs, 0 = thickness
+    float max_speed = 0.0;              // Particle speed limit, 0 = none
+    float aero_drag = 1.0;              // How hard wind pushes on the cloth
+    uint32_t substeps = 8;
+};
+
+struct Cloth
+{
+    ParticleWorld world;                // Particles are never removed so particle i is slot i and handle i
+    XpbdSolver solver;
+
+    glm::vec3 wind = glm::vec3(0.0);
+    float aero_drag = 1.0;
+    float thickness = 0.0;
+    float collision_margin = 0.0;
+
+    std::vector<uint32_t> vertex_particle;      // Particle of every mesh vertex
+    std::vector<uint32_t> triangles;            // 3 particles per triangle
+    std::vector<glm::vec3> rest_position;       // Particle positions in the rest shape
+    FloatArray mass_inv;                        // Unpinned mass of every particle
+
+    // Triangles around every particle
+    std::vector<uint32_t> particle_triangle_start;  // Particle count + 1 offsets into particle_triangles
+    std::vector<uint32_t> particle_triangles;
+
+    // Scratch
+    std::vector<glm::vec3> triangle_vector;     // Wind force or area weighted normal of every triangle
+    std::vector<glm::vec3> render_position;     // Per particle, blended by cloth_write_vertices
+
+    // Self collision scratch. Particles sorted by cell, see the comment at the top.
+    std::vector<uint64_t> sorted_key;           // Cell key of every sorted particle
+    std::vector<uint32_t> sorted_particle;      // Which particle is in every sorted position
+    std::vector<uint64_t> key_scratch;
+    std::vector<uint32_t> particle_scratch;
+    Vec3Array sorted_position;
+    Vec3Array sorted_rest;
+    std::vector<uint64_t> cell_key;             // Every non-empty cell
+    std::vector<uint32_t> cell_start;           // cell_key.size() + 1 offsets into the sorted particles
+    uint64_t row_stride = 0;                    // Key distance between neighbouring rows / layers of cells
+    uint64_t layer_stride = 0;
+    std::vector<std::vector<CollisionPair>> chunk_pairs;
+};
+
+// Builds the cloth out of the geometry moved by transform. pool can be nullptr.
+void cloth_from_geometry(Cloth& cloth, const MeshGeometry& geometry, const glm::mat4& transform, const ClothSettings& settings,
+                         ThreadPool* pool);
+
+// Pinned particles stay where they are (or wherever cloth_move_pin puts them), every vertex welded to the same particle
+// gets pinned with it
+void cloth_pin(Cloth& cloth, uint32_t vertex, bool pinned = true);
+void cloth_move_pin(Cloth& cloth, uint32_t vertex, const glm::vec3& position);
+
+// Wind, self collision and then the solver
+void cloth_step(Cloth& cloth, float delta);
+
+// Fixed step driver, same as phys_world_update
+void cloth_update(Cloth& cloth, FixedStepper& stepper, double frame_delta);
+
+// Writes positions blended by alpha (see phys_world_interpolate) and smooth normals into the mesh's vertices, ready for
+// one upload of the whole vertex buffer. The mesh has to be the one the cloth was built from, positions are in world
+// space so draw it with an identity model matrix.
+void cloth_write_vertices(Cloth& cloth, MeshGeometry& mesh, float alpha);
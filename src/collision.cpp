@@ -0,0 +1,59 @@
+#include "collision.h"
+
+AABB calculate_aabb(const std::vector<glm::vec3>& vertices)
+{
+    AABB box{};
+    if(vertices.empty()) return box;
+
+    glm::vec3 min = vertices[0];
+    glm::vec3 max = vertices[0];
+    for(const glm::vec3& pos : vertices)
+    {
+        if (pos.x < min.x) min.x = pos.x;
+        if (pos.y < min.y) min.y = pos.y;
+        if (pos.z < min.z) min.z = pos.z;
+
+        if (pos.x > max.x) max.x = pos.x;
+        if (pos.y > max.y) max.y = pos.y;
+        if (pos.z > max.z) max.z = pos.z;
+    }
+
+    box.min = min;
+    box.max = max;
+    return box;
+}
+
+AABB aabb_merge(const AABB& a, const AABB& b)
+{
+    AABB box;
+    box.min = glm::min(a.min, b.min);
+    box.max = glm::max(a.max, b.max);
+    return box;
+}
+
+AABB aabb_expand(const AABB& box, float margin)
+{
+    AABB out;
+    out.min = box.min - glm::vec3(margin);
+    out.max = box.max + glm::vec3(margin);
+    return out;
+}
+
+bool aabb_overlap(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+bool aabb_contains(const AABB& outer, const AABB& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+float aabb_surface_area(const AABB& box)
+{
+    glm::vec3 d = box.max - box.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
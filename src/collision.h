@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+    Types shared between the different collision stages.
+*/
+
+struct AABB
+{
+    glm::vec3 min = glm::vec3(0.0);
+    glm::vec3 max = glm::vec3(0.0);
+};
+
+AABB calculate_aabb(const std::vector<glm::vec3>& vertices);
+AABB aabb_merge(const AABB& a, const AABB& b);
+AABB aabb_expand(const AABB& box, float margin);
+bool aabb_overlap(const AABB& a, const AABB& b);
+bool aabb_contains(const AABB& outer, const AABB& inner);
+float aabb_surface_area(const AABB& box);
+
+// Two things (particle slots, body ids, ... depends on who produced it) that might be touching.
+// Always stored with a < b so the same pair never shows up twice with its ends flipped.
+struct CollisionPair
+{
+    uint32_t a;
+    uint32_t b;
+};
+
+inline CollisionPair make_pair_sorted(uint32_t a, uint32_t b)
+{
+    return a < b ? CollisionPair{ a, b } : CollisionPair{ b, a };
+}
+
+inline uint64_t pair_key(uint32_t a, uint32_t b)
+{
+    CollisionPair p = make_pair_sorted(a, b);
+    return ((uint64_t)p.a << 32) | p.b;
+}
+
+#define TRAVERSAL_STACK_SIZE 256
+
+// Node stack for walking the trees. Lives in a fixed array for any sane tree and only moves into the heap when a walk
+// goes deeper than that, so a degenerate tree costs an allocation instead of quietly losing subtrees.
+struct TraversalStack
+{
+    uint32_t local[TRAVERSAL_STACK_SIZE];
+    std::vector<uint32_t> heap;
+    uint32_t* nodes = local;
+    size_t capacity = TRAVERSAL_STACK_SIZE;
+    size_t count = 0;
+
+    TraversalStack() = default;
+    TraversalStack(const TraversalStack&) = delete;
+    TraversalStack& operator=(const TraversalStack&) = delete;
+
+    bool empty() const { return count == 0; }
+    uint32_t pop() { return nodes[--count]; }
+
+    void push(uint32_t node)
+    {
+        if(count == capacity)
+        {
+            if(heap.empty()) heap.assign(local, local + count);
+            capacity *= 2;
+            heap.resize(capacity);
+            nodes = heap.data();
+        }
+        nodes[count++] = node;
+    }
+};
@@ -0,0 +1,355 @@
+#include "contact_solver.h"
+#include <cmath>
+#include <algorithm>
+
+void contact_set_clear(ContactSet& contacts)
+{
+    contacts.body_a.clear();
+    contacts.body_b.clear();
+    contacts.feature.clear();
+    contacts.point.x.clear(); contacts.point.y.clear(); contacts.point.z.clear();
+    contacts.normal.x.clear(); contacts.normal.y.clear(); contacts.normal.z.clear();
+    contacts.penetration.clear();
+}
+
+void contact_add(ContactSet& contacts, uint32_t a, uint32_t b, uint64_t feature,
+                 const glm::vec3& point, const glm::vec3& normal, float penetration)
+{
+    contacts.body_a.push_back(a);
+    contacts.body_b.push_back(b);
+    contacts.feature.push_back(feature);
+    contacts.point.push_back(point);
+    contacts.normal.push_back(normal);
+    contacts.penetration.push_back(penetration);
+}
+
+// Resizes every solver array to the contact count, keeping the allocations from last step
+static void resize_solver_arrays(ContactSet& contacts)
+{
+    size_t count = contact_count(contacts);
+    Vec3Array* vecs[] = { &contacts.r_a, &contacts.r_b, &contacts.tangent1, &contacts.tangent2 };
+    for(Vec3Array* v : vecs)
+    {
+        v->x.resize(count);
+        v->y.resize(count);
+        v->z.resize(count);
+    }
+
+    FloatArray* floats[] = { &contacts.normal_mass, &contacts.tangent1_mass, &contacts.tangent2_mass, &contacts.friction,
+                             &contacts.bias, &contacts.position_bias, &contacts.normal_impulse, &contacts.tangent1_impulse,
+                             &contacts.tangent2_impulse, &contacts.position_impulse };
+    for(FloatArray* f : floats) f->resize(count);
+}
+
+static void zero_array(Vec3Array& arr, size_t count)
+{
+    arr.x.assign(count, 0.0f);
+    arr.y.assign(count, 0.0f);
+    arr.z.assign(count, 0.0f);
+}
+
+static inline uint32_t body_handle(const RigidBodyWorld& world, uint32_t slot)
+{
+    return slot == CONTACT_WORLD ? CONTACT_WORLD : world.handles.slot_to_handle[slot];
+}
+
+static inline ContactKey contact_key(const RigidBodyWorld& world, const ContactSet& contacts, size_t c)
+{
+    return ContactKey{ pair_key(body_handle(world, contacts.body_a[c]), body_handle(world, contacts.body_b[c])), contacts.feature[c] };
+}
+
+static inline glm::vec3 point_velocity(const Vec3Array& linear, const Vec3Array& angular, uint32_t body, const glm::vec3& r)
+{
+    if(body == CONTACT_WORLD) return glm::vec3(0.0);
+    return linear.get(body) + glm::cross(angular.get(body), r);
+}
+
+static inline void apply_impulse(const RigidBodyWorld& world, Vec3Array& linear, Vec3Array& angular,
+                                 uint32_t body, const glm::vec3& r, const glm::vec3& impulse)
+{
+    // Static bodies never move, skipping them also means islands solved on different threads never write to the same body
+    if(body == CONTACT_WORLD || world.mass_inv[body] == 0.0f) return;
+    linear.set(body, linear.get(body) + impulse * world.mass_inv[body]);
+    angular.set(body, angular.get(body) + world.inertia_inv_world[body] * glm::cross(r, impulse));
+}
+
+// 1 / (m_a^-1 + m_b^-1 + (r_a x d) . I_a^-1 (r_a x d) + same for b)
+static inline float effective_mass(const RigidBodyWorld& world, uint32_t a, uint32_t b,
+                                   const glm::vec3& r_a, const glm::vec3& r_b, const glm::vec3& dir)
+{
+    float k = 0.0;
+    glm::vec3 rd_a = glm::cross(r_a, dir);
+    k += world.mass_inv[a] + glm::dot(rd_a, world.inertia_inv_world[a] * rd_a);
+    if(b != CONTACT_WORLD)
+    {
+        glm::vec3 rd_b = glm::cross(r_b, dir);
+        k += world.mass_inv[b] + glm::dot(rd_b, world.inertia_inv_world[b] * rd_b);
+    }
+    return k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+// Any two unit vectors perpendicular to n and each other
+static inline void tangent_basis(const glm::vec3& n, glm::vec3& t1, glm::vec3& t2)
+{
+    if(fabsf(n.x) >= 0.57735f) t1 = glm::normalize(glm::vec3(n.y, -n.x, 0.0));
+    else t1 = glm::normalize(glm::vec3(0.0, n.z, -n.y));
+    t2 = glm::cross(n, t1);
+}
+
+void contact_solver_begin(ContactSolver& solver, const RigidBodyWorld& world, ContactSet& contacts)
+{
+    resize_solver_arrays(contacts);
+
+    size_t body_count = rigid_count(world);
+    zero_array(solver.bias_linear_velocity, body_count);
+    zero_array(solver.bias_angular_velocity, body_count);
+}
+
+static void prepare_contact(const ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, size_t c, float inv_delta)
+{
+    uint32_t a = contacts.body_a[c];
+    uint32_t b = contacts.body_b[c];
+    glm::vec3 n = contacts.normal.get(c);
+    glm::vec3 p = contacts.point.get(c);
+
+    glm::vec3 r_a = p - world.position.get(a);
+    glm::vec3 r_b = b == CONTACT_WORLD ? glm::vec3(0.0) : p - world.position.get(b);
+    contacts.r_a.set(c, r_a);
+    contacts.r_b.set(c, r_b);
+
+    glm::vec3 t1, t2;
+    tangent_basis(n, t1, t2);
+    contacts.tangent1.set(c, t1);
+    contacts.tangent2.set(c, t2);
+
+    contacts.normal_mass[c] = effective_mass(world, a, b, r_a, r_b, n);
+    contacts.tangent1_mass[c] = effective_mass(world, a, b, r_a, r_b, t1);
+    contacts.tangent2_mass[c] = effective_mass(world, a, b, r_a, r_b, t2);
+
+    float friction_b = b == CONTACT_WORLD ? world.friction[a] : world.friction[b];
+    float restitution_b = b == CONTACT_WORLD ? 0.0f : world.restitution[b];
+    contacts.friction[c] = sqrtf(world.friction[a] * friction_b);
+    float restitution = std::max(world.restitution[a], restitution_b);
+
+    // Restitution is based on the closing speed before any impulses get applied, warm starting included (that only
+    // happens once every contact is prepared)
+    glm::vec3 v_rel = point_velocity(world.linear_velocity, world.angular_velocity, b, r_b)
+                    - point_velocity(world.linear_velocity, world.angular_velocity, a, r_a);
+    float v_n = glm::dot(v_rel, n);
+    float bias = v_n < -solver.restitution_threshold ? -restitution * v_n : 0.0f;
+
+    // Speculative contact (still apart). Closing the gap this step is fine, only going further than that gets stopped.
+    // If the gap closes this step the bounce is kept, it just starts a fraction of a step early.
+    if(contacts.penetration[c] < 0.0f)
+    {
+        float gap_bias = contacts.penetration[c] * inv_delta;
+        if(v_n >= gap_bias || bias <= 0.0f) bias = gap_bias;
+    }
+
+    float correction = solver.baumgarte * inv_delta * std::max(contacts.penetration[c] - solver.slop, 0.0f);
+    if(solver.split_impulse)
+    {
+        contacts.position_bias[c] = correction;
+    }
+    else
+    {
+        contacts.position_bias[c] = 0.0;
+        bias = std::max(bias, correction);
+    }
+    contacts.bias[c] = bias;
+
+    contacts.normal_impulse[c] = 0.0;
+    contacts.tangent1_impulse[c] = 0.0;
+    contacts.tangent2_impulse[c] = 0.0;
+    contacts.position_impulse[c] = 0.0;
+}
+
+// Has to run after every contact in the batch is prepared, so none of them see the others' warm start in their bias
+static void warm_start_contact(const ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, size_t c)
+{
+    if(!solver.warm_start) return;
+
+    uint32_t a = contacts.body_a[c];
+    uint32_t b = contacts.body_b[c];
+    glm::vec3 n = contacts.normal.get(c);
+    glm::vec3 t1 = contacts.tangent1.get(c);
+    glm::vec3 t2 = contacts.tangent2.get(c);
+    glm::vec3 r_a = contacts.r_a.get(c);
+    glm::vec3 r_b = contacts.r_b.get(c);
+
+    auto cached = solver.cache.find(contact_key(world, contacts, c));
+    if(cached == solver.cache.end()) return;
+
+    float scale = solver.warm_start_scale;
+    contacts.normal_impulse[c] = cached->second.normal * scale;
+    contacts.tangent1_impulse[c] = glm::dot(cached->second.tangent, t1) * scale;
+    contacts.tangent2_impulse[c] = glm::dot(cached->second.tangent, t2) * scale;
+
+    glm::vec3 impulse = n * contacts.normal_impulse[c] + t1 * contacts.tangent1_impulse[c] + t2 * contacts.tangent2_impulse[c];
+    apply_impulse(world, world.linear_velocity, world.angular_velocity, a, r_a, -impulse);
+    apply_impulse(world, world.linear_velocity, world.angular_velocity, b, r_b, impulse);
+}
+
+static void solve_contact(RigidBodyWorld& world, ContactSet& contacts, size_t c)
+{
+    Vec3Array& linear = world.linear_velocity;
+    Vec3Array& angular = world.angular_velocity;
+
+    uint32_t a = contacts.body_a[c];
+    uint32_t b = contacts.body_b[c];
+    glm::vec3 r_a = contacts.r_a.get(c);
+    glm::vec3 r_b = contacts.r_b.get(c);
+
+    // Friction first so the normal impulse (which is what keeps things from sinking) gets the last word
+    float max_friction = contacts.friction[c] * contacts.normal_impulse[c];
+    for(int k = 0; k < 2; k++)
+    {
+        glm::vec3 t = k == 0 ? contacts.tangent1.get(c) : contacts.tangent2.get(c);
+        float& total = k == 0 ? contacts.tangent1_impulse[c] : contacts.tangent2_impulse[c];
+        float mass = k == 0 ? contacts.tangent1_mass[c] : contacts.tangent2_mass[c];
+
+        glm::vec3 v_rel = point_velocity(linear, angular, b, r_b) - point_velocity(linear, angular, a, r_a);
+        float lambda = -glm::dot(v_rel, t) * mass;
+
+        float old_total = total;
+        total = std::clamp(old_total + lambda, -max_friction, max_friction);
+        glm::vec3 impulse = t * (total - old_total);
+
+        apply_impulse(world, linear, angular, a, r_a, -impulse);
+        apply_impulse(world, linear, angular, b, r_b, impulse);
+    }
+
+    glm::vec3 n = contacts.normal.get(c);
+    glm::vec3 v_rel = point_velocity(linear, angular, b, r_b) - point_velocity(linear, angular, a, r_a);
+    float lambda = (contacts.bias[c] - glm::dot(v_rel, n)) * contacts.normal_mass[c];
+
+    float old_total = contacts.normal_impulse[c];
+    contacts.normal_impulse[c] = std::max(old_total + lambda, 0.0f);
+    glm::vec3 impulse = n * (contacts.normal_impulse[c] - old_total);
+
+    apply_impulse(world, linear, angular, a, r_a, -impulse);
+    apply_impulse(world, linear, angular, b, r_b, impulse);
+}
+
+static void solve_contact_position(ContactSolver& solver, const RigidBodyWorld& world, ContactSet& contacts, size_t c)
+{
+    Vec3Array& linear = solver.bias_linear_velocity;
+    Vec3Array& angular = solver.bias_angular_velocity;
+
+    if(contacts.position_bias[c] <= 0.0f && contacts.position_impulse[c] <= 0.0f) return;
+
+    uint32_t a = contacts.body_a[c];
+    uint32_t b = contacts.body_b[c];
+    glm::vec3 r_a = contacts.r_a.get(c);
+    glm::vec3 r_b = contacts.r_b.get(c);
+    glm::vec3 n = contacts.normal.get(c);
+
+    glm::vec3 v_rel = point_velocity(linear, angular, b, r_b) - point_velocity(linear, angular, a, r_a);
+    float lambda = (contacts.position_bias[c] - glm::dot(v_rel, n)) * contacts.normal_mass[c];
+
+    float old_total = contacts.position_impulse[c];
+    contacts.position_impulse[c] = std::max(old_total + lambda, 0.0f);
+    glm::vec3 impulse = n * (contacts.position_impulse[c] - old_total);
+
+    apply_impulse(world, linear, angular, a, r_a, -impulse);
+    apply_impulse(world, linear, angular, b, r_b, impulse);
+}
+
+void contact_solver_prepare(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta)
+{
+    contact_solver_begin(solver, world, contacts);
+
+    float inv_delta = delta > 0.0f ? 1.0f / delta : 0.0f;
+    size_t count = contact_count(contacts);
+    for(size_t c = 0; c < count; c++) prepare_contact(solver, world, contacts, c, inv_delta);
+    for(size_t c = 0; c < count; c++) warm_start_contact(solver, world, contacts, c);
+}
+
+void contact_solver_iterate(ContactSolver&, RigidBodyWorld& world, ContactSet& contacts)
+{
+    size_t count = contact_count(contacts);
+    for(size_t c = 0; c < count; c++) solve_contact(world, contacts, c);
+}
+
+void contact_solver_iterate_positions(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts)
+{
+    size_t count = contact_count(contacts);
+    for(size_t c = 0; c < count; c++) solve_contact_position(solver, world, contacts, c);
+}
+
+void contact_solver_solve(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts,
+                          const uint32_t* indices, size_t count, float delta)
+{
+    float inv_delta = delta > 0.0f ? 1.0f / delta : 0.0f;
+    for(size_t i = 0; i < count; i++) prepare_contact(solver, world, contacts, indices[i], inv_delta);
+    for(size_t i = 0; i < count; i++) warm_start_contact(solver, world, contacts, indices[i]);
+
+    for(uint32_t it = 0; it < solver.velocity_iterations; it++)
+    {
+        for(size_t i = 0; i < count; i++) solve_contact(world, contacts, indices[i]);
+    }
+
+    if(!solver.split_impulse) return;
+    for(uint32_t it = 0; it < solver.position_iterations; it++)
+    {
+        for(size_t i = 0; i < count; i++) solve_contact_position(solver, world, contacts, indices[i]);
+    }
+}
+
+void contact_solver_apply_split(ContactSolver& solver, RigidBodyWorld& world, float delta)
+{
+    size_t count = std::min(rigid_count(world), solver.bias_linear_velocity.size());
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 v = solver.bias_linear_velocity.get(i);
+        glm::vec3 w = solver.bias_angular_velocity.get(i);
+        if(v == glm::vec3(0.0) && w == glm::vec3(0.0)) continue;
+
+        world.position.set(i, world.position.get(i) + v * delta);
+
+        glm::quat q = world.orientation[i];
+        q += glm::quat(0.0, w.x, w.y, w.z) * q * (0.5f * delta);
+        world.orientation[i] = glm::normalize(q);
+    }
+
+    rigid_update_inertia(world);
+}
+
+void contact_solver_store(ContactSolver& solver, const RigidBodyWorld& world, const ContactSet& contacts)
+{
+    solver.cache.clear();
+    if(!solver.warm_start) return;
+
+    size_t count = contact_count(contacts);
+    for(size_t c = 0; c < count; c++)
+    {
+        CachedImpulse cached;
+        cached.normal = contacts.normal_impulse[c];
+        cached.tangent = contacts.tangent1.get(c) * contacts.tangent1_impulse[c] + contacts.tangent2.get(c) * contacts.tangent2_impulse[c];
+        solver.cache[contact_key(world, contacts, c)] = cached;
+    }
+}
+
+void contact_solver_step(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta)
+{
+    rigid_integrate_velocities(world, delta);
+
+    contact_solver_prepare(solver, world, contacts, delta);
+    for(uint32_t i = 0; i < solver.velocity_iterations; i++)
+    {
+        contact_solver_iterate(solver, world, contacts);
+    }
+
+    if(solver.split_impulse)
+    {
+        for(uint32_t i = 0; i < solver.position_iterations; i++)
+        {
+            contact_solver_iterate_positions(solver, world, contacts);
+        }
+    }
+
+    rigid_integrate_positions(world, delta);
+    if(solver.split_impulse) contact_solver_apply_split(solver, world, delta);
+
+    contact_solver_store(solver, world, contacts);
+}
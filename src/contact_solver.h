@@ -0,0 +1,132 @@
+#pragma once
+#include <unordered_map>
+#include "rigid_body.h"
+#include "collision.h"
+
+/*
+    Sequential impulse (projected Gauss-Seidel) contact solver for a RigidBodyWorld.
+
+    Contacts are stored the same way bodies are: ContactSet is one flat array per property, index i in all of them
+    is one contact point. The narrowphase fills in the geometric part (bodies, point, normal, penetration), the solver
+    fills in everything else during contact_solver_prepare and keeps the accumulated impulses in the same arrays.
+
+    Every iteration walks the contacts in order and applies whatever impulse makes the relative velocity at that point
+    right, clamping the running total instead of the single impulse (normal total >= 0, friction total inside the
+    Coulomb cone) so earlier contacts can be partially undone by later ones.
+
+    The accumulated impulses are kept in a cache keyed by the two body handles + a feature id, so the next step can
+    start from last step's answer (warm starting). Resting stacks then only need a couple of iterations.
+
+    Position drift is fixed either with Baumgarte (feed a bit of the penetration back as extra target velocity) or
+    split impulses (solve the penetration on a separate set of pseudo velocities that only move the bodies and never
+    show up in the real velocities, so resolving overlap doesn't make things bounce).
+*/
+
+// Body index used for the second body when the contact is against static world geometry (planes)
+#define CONTACT_WORLD UINT32_MAX
+
+struct ContactSet
+{
+    // Filled by the narrowphase
+    std::vector<uint32_t> body_a;       // Slots into the RigidBodyWorld arrays
+    std::vector<uint32_t> body_b;       // CONTACT_WORLD for static geometry
+    std::vector<uint64_t> feature;      // Tells contacts between the same two bodies apart (plane index, manifold point, ...)
+    Vec3Array point;                    // World space
+    Vec3Array normal;                   // Points from a to b
+    FloatArray penetration;             // > 0 when overlapping, < 0 for speculative contacts (the gap)
+
+    // Filled by contact_solver_prepare
+    Vec3Array r_a;                      // point - center of a
+    Vec3Array r_b;
+    Vec3Array tangent1;
+    Vec3Array tangent2;
+    FloatArray normal_mass;             // 1 / effective mass along each direction
+    FloatArray tangent1_mass;
+    FloatArray tangent2_mass;
+    FloatArray friction;
+    FloatArray bias;                    // Target separating velocity (restitution + Baumgarte)
+    FloatArray position_bias;           // Target pseudo velocity when using split impulses
+
+    // Accumulated impulses
+    FloatArray normal_impulse;
+    FloatArray tangent1_impulse;
+    FloatArray tangent2_impulse;
+    FloatArray position_impulse;
+};
+
+void contact_set_clear(ContactSet& contacts);
+void contact_add(ContactSet& contacts, uint32_t a, uint32_t b, uint64_t feature,
+                 const glm::vec3& point, const glm::vec3& normal, float penetration);
+inline size_t contact_count(const ContactSet& contacts) { return contacts.body_a.size(); }
+
+struct ContactKey
+{
+    uint64_t bodies;    // pair_key of the two body handles
+    uint64_t feature;
+
+    bool operator==(const ContactKey& other) const { return bodies == other.bodies && feature == other.feature; }
+};
+
+struct ContactKeyHash
+{
+    size_t operator()(const ContactKey& key) const
+    {
+        return std::hash<uint64_t>()(key.bodies ^ (key.feature * 0x9E3779B97F4A7C15ull));
+    }
+};
+
+// What gets carried over to the next step. Friction is stored as a world space vector since the tangent basis
+// gets rebuilt every step and won't line up with last step's.
+struct CachedImpulse
+{
+    float normal;
+    glm::vec3 tangent;
+};
+
+struct ContactSolver
+{
+    uint32_t velocity_iterations = 8;
+    uint32_t position_iterations = 3;   // Only used with split_impulse
+
+    float baumgarte = 0.2;              // Fraction of the penetration fixed per step
+    float slop = 0.005;                 // Penetration that's allowed to stay so contacts don't jitter in and out
+    float restitution_threshold = 1.0;  // Closing speeds below this don't bounce
+    bool split_impulse = true;
+
+    bool warm_start = true;
+    float warm_start_scale = 1.0;       // < 1 if warm starting overshoots
+
+    std::unordered_map<ContactKey, CachedImpulse, ContactKeyHash> cache;
+
+    // Pseudo velocities for split impulses, one per body. Only valid during contact_solver_step.
+    Vec3Array bias_linear_velocity;
+    Vec3Array bias_angular_velocity;
+};
+
+// Sizes the solver arrays for the contact set and clears the pseudo velocities. contact_solver_prepare calls this,
+// call it yourself before contact_solver_solve.
+void contact_solver_begin(ContactSolver& solver, const RigidBodyWorld& world, ContactSet& contacts);
+
+// Builds the per contact solver data (lever arms, tangents, effective masses, bias) and applies the warm start impulses
+void contact_solver_prepare(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta);
+
+// One pass of normal + friction impulses over every contact
+void contact_solver_iterate(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts);
+
+// Solves the penetration on the pseudo velocities (split impulse only)
+void contact_solver_iterate_positions(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts);
+
+// Prepare + all velocity and position iterations, but only for the contacts listed in indices.
+// Two calls that don't share a dynamic body can run at the same time (see islands.h).
+void contact_solver_solve(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts,
+                          const uint32_t* indices, size_t count, float delta);
+
+// Moves the bodies by their pseudo velocities. Call after rigid_integrate_positions.
+void contact_solver_apply_split(ContactSolver& solver, RigidBodyWorld& world, float delta);
+
+// Replaces the cache with this step's accumulated impulses
+void contact_solver_store(ContactSolver& solver, const RigidBodyWorld& world, const ContactSet& contacts);
+
+// Full step for a world whose contacts were found at the current positions:
+// integrate velocities, prepare, iterate, integrate positions, apply split impulses, store the cache
+void contact_solver_step(ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta);
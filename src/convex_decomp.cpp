@@ -0,0 +1,455 @@
+#include "convex_decomp.h"
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#define DECOMP_CACHE_MAGIC 0x50434443u     // "CDCP"
+#define DECOMP_CACHE_VERSION 1u
+
+enum VoxelState : uint8_t
+{
+    VOXEL_UNKNOWN,
+    VOXEL_SURFACE,
+    VOXEL_INSIDE,
+    VOXEL_OUTSIDE
+};
+
+struct VoxelGrid
+{
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float size;
+    std::vector<uint8_t> state;
+};
+
+// A cut through a part, keeps the voxels with coordinate on axis < cut (side 0) or >= cut (side 1). side < 0 keeps all.
+struct PartCut
+{
+    int axis = 0;
+    int cut = 0;
+    int side = -1;
+};
+
+struct DecompPart
+{
+    std::vector<uint32_t> voxels;
+    float concavity = 0.0;
+    bool final = false;
+};
+
+struct CutCandidate
+{
+    PartCut cut;
+    float cost = FLT_MAX;
+    float concavity[2] = { 0.0, 0.0 };
+};
+
+static inline uint32_t voxel_index(const VoxelGrid& grid, int x, int y, int z)
+{
+    return (uint32_t)(x + grid.dims.x * (y + grid.dims.y * z));
+}
+
+static inline glm::ivec3 voxel_coords(const VoxelGrid& grid, uint32_t index)
+{
+    int x = index % grid.dims.x;
+    int y = (index / grid.dims.x) % grid.dims.y;
+    int z = index / (grid.dims.x * grid.dims.y);
+    return glm::ivec3(x, y, z);
+}
+
+// Separating axis test between a triangle and a box (Akenine-Moller), triangle already relative to the box center
+static bool triangle_box_overlap(const glm::vec3& half, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+    glm::vec3 tmin = glm::min(v0, glm::min(v1, v2));
+    glm::vec3 tmax = glm::max(v0, glm::max(v1, v2));
+    if(glm::any(glm::greaterThan(tmin, half)) || glm::any(glm::lessThan(tmax, -half))) return false;
+
+    glm::vec3 edges[3] = { v1 - v0, v2 - v1, v0 - v2 };
+    for(const glm::vec3& edge : edges)
+    {
+        for(int i = 0; i < 3; i++)
+        {
+            glm::vec3 unit(0.0);
+            unit[i] = 1.0;
+            glm::vec3 axis = glm::cross(unit, edge);
+
+            float p0 = glm::dot(axis, v0), p1 = glm::dot(axis, v1), p2 = glm::dot(axis, v2);
+            float r = glm::dot(half, glm::abs(axis));
+            if(std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r) return false;
+        }
+    }
+
+    glm::vec3 normal = glm::cross(edges[0], edges[1]);
+    return fabsf(glm::dot(normal, v0)) <= glm::dot(half, glm::abs(normal));
+}
+
+static bool voxelize(const std::vector<glm::vec3>& triangles, uint32_t resolution, VoxelGrid& grid)
+{
+    if(triangles.empty() || resolution == 0) return false;
+
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for(const glm::vec3& v : triangles)
+    {
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+
+    float longest = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    if(longest <= 0.0f) return false;
+
+    // One empty voxel of padding all round so the flood fill can get around the whole thing
+    grid.size = longest / resolution;
+    grid.origin = lo - glm::vec3(grid.size);
+    grid.dims = glm::ivec3(glm::ceil((hi - lo) / grid.size)) + glm::ivec3(2);
+    grid.dims = glm::max(grid.dims, glm::ivec3(3));
+    grid.state.assign((size_t)grid.dims.x * grid.dims.y * grid.dims.z, VOXEL_UNKNOWN);
+
+    glm::vec3 half(grid.size * 0.5f);
+    for(size_t t = 0; t + 2 < triangles.size(); t += 3)
+    {
+        const glm::vec3& a = triangles[t];
+        const glm::vec3& b = triangles[t + 1];
+        const glm::vec3& c = triangles[t + 2];
+
+        glm::ivec3 first = glm::ivec3(glm::floor((glm::min(a, glm::min(b, c)) - grid.origin) / grid.size));
+        glm::ivec3 last = glm::ivec3(glm::floor((glm::max(a, glm::max(b, c)) - grid.origin) / grid.size));
+        first = glm::clamp(first, glm::ivec3(0), grid.dims - 1);
+        last = glm::clamp(last, glm::ivec3(0), grid.dims - 1);
+
+        for(int z = first.z; z <= last.z; z++)
+        {
+            for(int y = first.y; y <= last.y; y++)
+            {
+                for(int x = first.x; x <= last.x; x++)
+                {
+                    uint32_t index = voxel_index(grid, x, y, z);
+                    if(grid.state[index] == VOXEL_SURFACE) continue;
+
+                    glm::vec3 center = grid.origin + (glm::vec3(x, y, z) + 0.5f) * grid.size;
+                    if(triangle_box_overlap(half, a - center, b - center, c - center)) grid.state[index] = VOXEL_SURFACE;
+                }
+            }
+        }
+    }
+
+    // Flood fill from a padding corner, anything the outside can't reach is inside the model
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    grid.state[0] = VOXEL_OUTSIDE;
+    while(!stack.empty())
+    {
+        glm::ivec3 p = voxel_coords(grid, stack.back());
+        stack.pop_back();
+
+        const glm::ivec3 offsets[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        for(const glm::ivec3& offset : offsets)
+        {
+            glm::ivec3 n = p + offset;
+            if(glm::any(glm::lessThan(n, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(n, grid.dims))) continue;
+
+            uint32_t index = voxel_index(grid, n.x, n.y, n.z);
+            if(grid.state[index] != VOXEL_UNKNOWN) continue;
+            grid.state[index] = VOXEL_OUTSIDE;
+            stack.push_back(index);
+        }
+    }
+
+    for(uint8_t& state : grid.state)
+    {
+        if(state == VOXEL_UNKNOWN) state = VOXEL_INSIDE;
+    }
+    return true;
+}
+
+static inline bool in_part(const VoxelGrid& grid, const std::vector<uint32_t>& label, uint32_t id, const PartCut& cut, const glm::ivec3& p)
+{
+    if(glm::any(glm::lessThan(p, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(p, grid.dims))) return false;
+    if(label[voxel_index(grid, p.x, p.y, p.z)] != id) return false;
+    return cut.side < 0 || (p[cut.axis] >= cut.cut) == (cut.side == 1);
+}
+
+// Points the hull of a part (or one side of a cut through it) needs. Voxels with all 6 neighbours in the part can't be
+// on the hull so they're skipped. Surface voxels give their center since the mesh goes through them, voxels exposed
+// along a cut give all their corners so neighbouring pieces meet.
+// Returns the volume (in voxels) on that side, surface voxels count as half since the mesh cuts them about in two.
+static float part_points(const VoxelGrid& grid, const std::vector<uint32_t>& label, uint32_t id, const DecompPart& part,
+                         const PartCut& cut, std::vector<glm::vec3>& points)
+{
+    const glm::ivec3 offsets[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+    points.clear();
+    float volume = 0.0;
+    for(uint32_t index : part.voxels)
+    {
+        glm::ivec3 p = voxel_coords(grid, index);
+        if(cut.side >= 0 && (p[cut.axis] >= cut.cut) != (cut.side == 1)) continue;
+        volume += grid.state[index] == VOXEL_SURFACE ? 0.5f : 1.0f;
+
+        bool exposed = false;
+        for(const glm::ivec3& offset : offsets)
+        {
+            if(!in_part(grid, label, id, cut, p + offset)) { exposed = true; break; }
+        }
+        if(!exposed) continue;
+
+        glm::vec3 corner = grid.origin + glm::vec3(p) * grid.size;
+        if(grid.state[index] == VOXEL_SURFACE)
+        {
+            points.push_back(corner + glm::vec3(grid.size * 0.5f));
+        }
+        else
+        {
+            for(int c = 0; c < 8; c++)
+            {
+                points.push_back(corner + glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1) * grid.size);
+            }
+        }
+    }
+    return volume;
+}
+
+// How much the hull of the points overshoots that many voxels, as a fraction of the model volume
+static float concavity(const std::vector<glm::vec3>& points, float voxels, const VoxelGrid& grid, float total_volume,
+                       const HullSettings& hull_settings)
+{
+    ConvexHull hull;
+    if(!quickhull(points, hull_settings, hull)) return 0.0;
+
+    float voxel_volume = voxels * grid.size * grid.size * grid.size;
+    return std::max(hull_volume(hull) - voxel_volume, 0.0f) / total_volume;
+}
+
+static void run_parallel(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& fn)
+{
+    if(pool) pool->parallel_for(count, 1, fn);
+    else fn(0, count);
+}
+
+void decompose_model(const Model& model, const DecompSettings& settings, ThreadPool* pool, Decomposition& result)
+{
+    result = Decomposition();
+
+    std::vector<glm::vec3> triangles;
+    model_triangles(model, glm::mat4(1.0), triangles);
+
+    VoxelGrid grid;
+    if(!voxelize(triangles, settings.resolution, grid)) return;
+
+    // Parts are told apart by a label per voxel, so cutting one only relabels the voxels on one side
+    std::vector<uint32_t> label(grid.state.size(), UINT32_MAX);
+    std::vector<DecompPart> parts(1);
+    for(uint32_t i = 0; i < grid.state.size(); i++)
+    {
+        if(grid.state[i] == VOXEL_OUTSIDE) continue;
+        label[i] = 0;
+        parts[0].voxels.push_back(i);
+    }
+    result.voxel_count = (uint32_t)parts[0].voxels.size();
+
+    // Cut planes only get compared against each other so a capped hull is plenty to score them with
+    HullSettings eval_settings = { 64, settings.hull.merge_angle, false };
+    std::vector<glm::vec3> points;
+    float voxels = part_points(grid, label, 0, parts[0], PartCut(), points);
+    float total_volume = voxels * grid.size * grid.size * grid.size;
+    parts[0].concavity = concavity(points, voxels, grid, total_volume, eval_settings);
+
+    std::vector<CutCandidate> candidates;
+    while(parts.size() < settings.max_hulls)
+    {
+        uint32_t worst = UINT32_MAX;
+        for(uint32_t i = 0; i < parts.size(); i++)
+        {
+            if(parts[i].final || parts[i].concavity <= settings.max_concavity) continue;
+            if(worst == UINT32_MAX || parts[i].concavity > parts[worst].concavity) worst = i;
+        }
+        if(worst == UINT32_MAX) break;
+
+        DecompPart& part = parts[worst];
+        glm::ivec3 lo(INT32_MAX), hi(INT32_MIN);
+        for(uint32_t index : part.voxels)
+        {
+            glm::ivec3 p = voxel_coords(grid, index);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+
+        // Cuts spread through the inside of the bounds, so both sides always get voxels
+        candidates.clear();
+        for(int axis = 0; axis < 3; axis++)
+        {
+            int span = hi[axis] - lo[axis] + 1;
+            int previous = INT32_MIN;
+            for(uint32_t s = 1; s <= settings.plane_samples; s++)
+            {
+                int cut = lo[axis] + std::max(1, (int)(span * s / (settings.plane_samples + 1)));
+                if(cut > hi[axis] || cut == previous) continue;
+                previous = cut;
+
+                CutCandidate candidate;
+                candidate.cut.axis = axis;
+                candidate.cut.cut = cut;
+                candidates.push_back(candidate);
+            }
+        }
+        if(candidates.empty())
+        {
+            part.final = true;
+            continue;
+        }
+
+        run_parallel(pool, candidates.size(), [&](size_t begin, size_t end) {
+            std::vector<glm::vec3> side_points;
+            for(size_t c = begin; c < end; c++)
+            {
+                CutCandidate& candidate = candidates[c];
+                float counts[2];
+                for(int side = 0; side < 2; side++)
+                {
+                    PartCut cut = candidate.cut;
+                    cut.side = side;
+                    counts[side] = part_points(grid, label, worst, part, cut, side_points);
+                    candidate.concavity[side] = concavity(side_points, counts[side], grid, total_volume, eval_settings);
+                }
+
+                float imbalance = fabsf(counts[0] - counts[1]) * grid.size * grid.size * grid.size / total_volume;
+                candidate.cost = candidate.concavity[0] + candidate.concavity[1] + settings.balance_weight * imbalance;
+            }
+        });
+
+        // First lowest wins so the result doesn't depend on which thread finished first
+        const CutCandidate* best = &candidates[0];
+        for(const CutCandidate& candidate : candidates)
+        {
+            if(candidate.cost < best->cost) best = &candidate;
+        }
+
+        // Cutting doesn't help, the part is as convex as this resolution can tell
+        if(best->concavity[0] + best->concavity[1] >= part.concavity)
+        {
+            part.final = true;
+            continue;
+        }
+
+        DecompPart upper;
+        uint32_t upper_id = (uint32_t)parts.size();
+        std::vector<uint32_t> lower;
+        for(uint32_t index : part.voxels)
+        {
+            if(voxel_coords(grid, index)[best->cut.axis] >= best->cut.cut)
+            {
+                label[index] = upper_id;
+                upper.voxels.push_back(index);
+            }
+            else
+            {
+                lower.push_back(index);
+            }
+        }
+
+        part.voxels = std::move(lower);
+        part.concavity = best->concavity[0];
+        upper.concavity = best->concavity[1];
+        parts.push_back(std::move(upper));
+    }
+
+    // Final hulls, one per part
+    result.hulls.resize(parts.size());
+    std::vector<uint8_t> built(parts.size(), 0);
+    run_parallel(pool, parts.size(), [&](size_t begin, size_t end) {
+        std::vector<glm::vec3> part_hull_points;
+        for(size_t i = begin; i < end; i++)
+        {
+            part_points(grid, label, (uint32_t)i, parts[i], PartCut(), part_hull_points);
+            built[i] = quickhull(part_hull_points, settings.hull, result.hulls[i]);
+        }
+    });
+
+    // Parts too thin to have a hull (a single sheet of surface voxels) are dropped
+    size_t kept = 0;
+    for(size_t i = 0; i < parts.size(); i++)
+    {
+        result.concavity += parts[i].concavity;
+        if(!built[i]) continue;
+        if(kept != i) result.hulls[kept] = std::move(result.hulls[i]);
+        kept++;
+    }
+    result.hulls.resize(kept);
+}
+
+bool decomp_save(const std::string& path, const Model& model, const DecompSettings& settings, const std::vector<ConvexHull>& hulls)
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    uint32_t header[7] = { DECOMP_CACHE_MAGIC, DECOMP_CACHE_VERSION, settings.resolution, settings.max_hulls,
+                           settings.plane_samples, settings.hull.max_vertices, (uint32_t)hulls.size() };
+    float values[3] = { settings.max_concavity, settings.balance_weight, settings.hull.merge_angle };
+    int64_t time = model_source_time(model.path);
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)values, sizeof(values));
+    file.write((const char*)&time, sizeof(time));
+    for(const ConvexHull& hull : hulls) hull_write(file, hull);
+    return (bool)file;
+}
+
+bool decomp_load(const std::string& path, const Model& model, const DecompSettings& settings, std::vector<ConvexHull>& hulls)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    uint32_t header[7];
+    float values[3];
+    int64_t time;
+    if(!file.read((char*)header, sizeof(header)) || !file.read((char*)values, sizeof(values)) || !file.read((char*)&time, sizeof(time)))
+    {
+        return false;
+    }
+
+    if(header[0] != DECOMP_CACHE_MAGIC || header[1] != DECOMP_CACHE_VERSION) return false;
+    if(header[2] != settings.resolution || header[3] != settings.max_hulls || header[4] != settings.plane_samples ||
+       header[5] != settings.hull.max_vertices)
+    {
+        return false;
+    }
+    if(values[0] != settings.max_concavity || values[1] != settings.balance_weight || values[2] != settings.hull.merge_angle) return false;
+
+    // Baked files get checked in next to the model, so a checkout can easily shuffle the file times around. Still better
+    // than no pieces, just say it might be stale.
+    if(time != model_source_time(model.path))
+    {
+        std::cerr << "DECOMP: collision asset might be older than the model, rebake with --bake-collision <path: " << path << ">" << std::endl;
+    }
+
+    hulls.resize(header[6]);
+    for(ConvexHull& hull : hulls)
+    {
+        if(!hull_read(file, hull)) return false;
+    }
+    return true;
+}
+
+void model_load_decomposition(Model& model, const DecompSettings& settings)
+{
+    std::string cache_path = model.path + ".collision";
+    if(!model.path.empty() && decomp_load(cache_path, model, settings, model.pieces)) return;
+
+    // A half read file leaves some pieces behind
+    model.pieces.clear();
+    std::cerr << "DECOMP: no baked collision for the model, only its hulls are loaded <path: " << cache_path << ">" << std::endl;
+}
+
+bool model_bake_decomposition(Model& model, const DecompSettings& settings, ThreadPool* pool)
+{
+    Decomposition result;
+    decompose_model(model, settings, pool, result);
+    model.pieces = std::move(result.hulls);
+
+    std::string cache_path = model.path + ".collision";
+    if(model.path.empty() || !decomp_save(cache_path, model, settings, model.pieces))
+    {
+        std::cerr << "DECOMP: could not write collision asset <path: " << cache_path << ">" << std::endl;
+        return false;
+    }
+    return true;
+}
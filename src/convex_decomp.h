@@ -0,0 +1,54 @@
+#pragma once
+#include "quickhull.h"
+#include "ThreadPool.h"
+
+/*
+    Approximate convex decomposition (V-HACD style) for concave models that one hull per mesh would fill in.
+
+    The whole model (every node, in the root node's space) gets voxelized: triangles mark the voxels they touch, then a
+    flood fill from the outside of the grid marks everything it can reach, and whatever it couldn't reach is inside.
+    That solid voxel set is the starting part.
+
+    Concavity of a part is how much its convex hull overshoots the voxels it covers, as a fraction of the whole model's
+    volume. The part with the most concavity keeps getting cut in two by an axis aligned plane until every part is under
+    max_concavity or there are max_hulls of them. Candidate planes are spread through the part's bounds on all three
+    axes, each one costs two hulls, and the one leaving the least concavity in the halves wins. That's where all the
+    time goes so the candidates run across the pool.
+
+    Final hulls use the centers of surface voxels (the mesh goes through them) and the corners of the voxels along cut
+    faces, so the pieces hug the mesh to within half a voxel and still meet each other along the cuts.
+
+    This is way too slow to do at every load, so the pieces get baked offline into <model path>.collision (run the
+    sandbox with --bake-collision <model paths>) and shipped next to the model. Loading never decomposes.
+*/
+
+struct DecompSettings
+{
+    uint32_t resolution = 64;           // Voxels along the longest side of the model
+    uint32_t max_hulls = 16;
+    float max_concavity = 0.005;        // Parts under this (fraction of the model volume) don't get cut any further
+    uint32_t plane_samples = 8;         // Candidate cutting planes per axis
+    float balance_weight = 0.05;        // Nudges cuts towards splitting parts into even halves
+    HullSettings hull = { 32, 3.0, false };
+};
+
+struct Decomposition
+{
+    std::vector<ConvexHull> hulls;      // In the root node's space
+    uint32_t voxel_count = 0;
+    float concavity = 0.0;              // Sum over the final parts
+};
+
+// Runs the decomposition, pool can be nullptr to do it all on the calling thread
+void decompose_model(const Model& model, const DecompSettings& settings, ThreadPool* pool, Decomposition& result);
+
+// Fills model.pieces from the baked <model path>.collision. If there's no bake (or it was baked with other settings)
+// this logs it and leaves pieces empty. Nothing builds rigid body shapes out of pieces or hulls yet, whoever does
+// (shape_hull per piece) should use model.hulls when pieces is empty.
+void model_load_decomposition(Model& model, const DecompSettings& settings);
+
+// Decomposes the model and writes <model path>.collision, returns false if the file couldn't be written
+bool model_bake_decomposition(Model& model, const DecompSettings& settings, ThreadPool* pool);
+
+bool decomp_save(const std::string& path, const Model& model, const DecompSettings& settings, const std::vector<ConvexHull>& hulls);
+bool decomp_load(const std::string& path, const Model& model, const DecompSettings& settings, std::vector<ConvexHull>& hulls);
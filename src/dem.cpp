@@ -0,0 +1,853 @@
+#include "dem.h"
+#include "physics_simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#define DEM_CELL_CHUNK 64       // Cells per job when building the list
+#define DEM_MAX_SPLIT 4096      // Most steps dem_step splits delta into
+
+ParticleHandle dem_add_grain(DemGranular& dem, ParticleWorld& world, const glm::vec3& position, float radius, float density,
+                             const glm::vec3& velocity)
+{
+    PhysicsParticle particle;
+    particle.position = position;
+    particle.velocity = velocity;
+    particle.radius = radius;
+    particle.mass_inv = 1.0f / (density * 4.0f / 3.0f * glm::pi<float>() * radius * radius * radius);
+
+    dem.angular_velocity.push_back(glm::vec3(0.0));
+    dem.torque.push_back(glm::vec3(0.0));
+    dem.rebuild = true;
+    return phys_world_add(world, particle);
+}
+
+void dem_remove_grain(DemGranular& dem, ParticleWorld& world, ParticleHandle handle)
+{
+    uint32_t slot = phys_world_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+
+    // The handle can get reused before the next build, which shouldn't inherit this grain's contacts
+    if(handle < dem.handle_old_slot.size()) dem.handle_old_slot[handle] = UINT32_MAX;
+
+    phys_world_remove(world, handle);
+    dem.angular_velocity.swap_remove(slot);
+    dem.torque.swap_remove(slot);
+    dem.rebuild = true;
+}
+
+float dem_rayleigh_step(const DemMaterial& material, float radius, float density)
+{
+    float shear_modulus = material.youngs_modulus / (2.0f * (1.0f + material.poisson_ratio));
+    return glm::pi<float>() * radius * sqrtf(density / shear_modulus) / (0.1631f * material.poisson_ratio + 0.8766f);
+}
+
+// Where the grain was at the last build, UINT32_MAX for grains added since
+static inline uint32_t old_slot(const DemGranular& dem, ParticleHandle handle)
+{
+    return handle < dem.handle_old_slot.size() ? dem.handle_old_slot[handle] : UINT32_MAX;
+}
+
+// Keeps the spin in step with a world that just got reordered
+static void reorder_spin(DemGranular& dem, const ParticleWorld& world, const std::vector<uint32_t>& order)
+{
+    Vec3Array spin;
+    spin.resize(order.size());
+    phys_parallel_for(world.pool, order.size(), world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) spin.set(i, dem.angular_velocity.get(order[i]));
+    });
+    dem.angular_velocity.swap(spin);
+}
+
+void dem_build(DemGranular& dem, ParticleWorld& world)
+{
+    size_t count = phys_world_count(world);
+    dem.torque.resize(count);
+
+    float max_radius = 0.0;
+    dem.stable_step = INFINITY;
+    for(size_t i = 0; i < count; i++)
+    {
+        float r = world.radius[i];
+        max_radius = std::max(max_radius, r);
+        if(r > 0.0f && world.mass_inv[i] > 0.0f)
+        {
+            float density = 1.0f / (world.mass_inv[i] * 4.0f / 3.0f * glm::pi<float>() * r * r * r);
+            dem.stable_step = std::min(dem.stable_step, dem.step_fraction * dem_rayleigh_step(dem.material, r, density));
+        }
+    }
+    dem.built_skin = dem.skin > 0.0f ? dem.skin : max_radius * 0.5f;
+    float skin = dem.built_skin;
+
+    // Old lists get looked up by handle so the histories survive the reorder and any grains that came and went
+    dem.old_start.swap(dem.neighbour_start);
+    dem.old_handle.swap(dem.neighbour_handle);
+    dem.old_tangential.swap(dem.tangential);
+
+    if(cell_list_build(dem.cells, world, 2.0f * max_radius + skin)) reorder_spin(dem, world, dem.cells.order);
+
+    // Count every grain's neighbours, then fill them in where the counts say
+    const FloatArray& px = world.position.x;
+    const FloatArray& py = world.position.y;
+    const FloatArray& pz = world.position.z;
+    dem.neighbour_start.assign(count + 1, 0);
+    cell_list_for_each(dem.cells, world, DEM_CELL_CHUNK, [&](uint32_t first, uint32_t end, const CellRun* runs, uint32_t run_count) {
+        for(uint32_t i = first; i < end; i++)
+        {
+            uint32_t n = 0;
+            for(uint32_t r = 0; r < run_count; r++)
+            {
+                for(uint32_t j = runs[r].begin; j < runs[r].end; j++)
+                {
+                    float dx = px[i] - px[j], dy = py[i] - py[j], dz = pz[i] - pz[j];
+                    float reach = world.radius[i] + world.radius[j] + skin;
+                    n += (j != i && dx * dx + dy * dy + dz * dz < reach * reach);
+                }
+            }
+            dem.neighbour_start[i + 1] = n;
+        }
+    });
+    for(size_t i = 0; i < count; i++) dem.neighbour_start[i + 1] += dem.neighbour_start[i];
+
+    size_t total = dem.neighbour_start[count];
+    dem.neighbour.resize(total);
+    dem.neighbour_handle.resize(total);
+    dem.tangential.resize(total);
+    cell_list_for_each(dem.cells, world, DEM_CELL_CHUNK, [&](uint32_t first, uint32_t end, const CellRun* runs, uint32_t run_count) {
+        for(uint32_t i = first; i < end; i++)
+        {
+            uint32_t e = dem.neighbour_start[i];
+            for(uint32_t r = 0; r < run_count; r++)
+            {
+                for(uint32_t j = runs[r].begin; j < runs[r].end; j++)
+                {
+                    float dx = px[i] - px[j], dy = py[i] - py[j], dz = pz[i] - pz[j];
+                    float reach = world.radius[i] + world.radius[j] + skin;
+                    if(j == i || dx * dx + dy * dy + dz * dz >= reach * reach) continue;
+
+                    dem.neighbour[e] = j;
+                    dem.neighbour_handle[e] = world.handles.slot_to_handle[j];
+                    e++;
+                }
+            }
+
+            // Carry over the history of every contact this grain already had with a grain that was there last time
+            uint32_t old = old_slot(dem, world.handles.slot_to_handle[i]);
+            for(e = dem.neighbour_start[i]; e < dem.neighbour_start[i + 1]; e++)
+            {
+                glm::vec3 spring(0.0);
+                if(old != UINT32_MAX && old_slot(dem, dem.neighbour_handle[e]) != UINT32_MAX)
+                {
+                    for(uint32_t o = dem.old_start[old]; o < dem.old_start[old + 1]; o++)
+                    {
+                        if(dem.old_handle[o] == dem.neighbour_handle[e])
+                        {
+                            spring = dem.old_tangential.get(o);
+                            break;
+                        }
+                    }
+                }
+                dem.tangential.set(e, spring);
+            }
+        }
+    });
+
+    // Where every entry shows up in the other grain's list
+    dem.mirror.resize(total);
+    dem.contact_force.resize(total);
+    dem.contact_torque_a.resize(total);
+    dem.contact_torque_b.resize(total);
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            for(uint32_t e = dem.neighbour_start[i]; e < dem.neighbour_start[i + 1]; e++)
+            {
+                uint32_t j = dem.neighbour[e];
+                uint32_t m = dem.neighbour_start[j];
+                while(dem.neighbour[m] != i) m++;
+                dem.mirror[e] = m;
+            }
+        }
+    });
+
+    // The entries that work their contact out, flat so the contact pass can take them a SIMD block at a time
+    const std::vector<uint32_t>& handle = world.handles.slot_to_handle;
+    dem.pair_entry.clear();
+    dem.pair_a.clear();
+    dem.pair_b.clear();
+    for(size_t i = 0; i < count; i++)
+    {
+        for(uint32_t e = dem.neighbour_start[i]; e < dem.neighbour_start[i + 1]; e++)
+        {
+            if(handle[dem.neighbour[e]] < handle[i]) continue;
+            dem.pair_entry.push_back(e);
+            dem.pair_a.push_back((uint32_t)i);
+            dem.pair_b.push_back(dem.neighbour[e]);
+        }
+    }
+
+    dem.built_position = world.position;
+    dem.handle_old_slot.assign(world.handles.handle_to_slot.size(), UINT32_MAX);
+    for(size_t i = 0; i < count; i++) dem.handle_old_slot[world.handles.slot_to_handle[i]] = (uint32_t)i;
+    dem.rebuild = false;
+}
+
+// Rebuild once anything moved far enough that a pair outside the list could be touching
+static bool needs_rebuild(const DemGranular& dem, const ParticleWorld& world)
+{
+    size_t count = phys_world_count(world);
+    if(dem.rebuild || dem.built_position.size() != count) return true;
+
+    float limit_sq = dem.built_skin * dem.built_skin * 0.25f;
+    std::atomic<bool> moved(false);
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        bool any = false;
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 d = world.position.get(i) - dem.built_position.get(i);
+            any |= glm::dot(d, d) > limit_sq;
+        }
+        if(any) moved.store(true, std::memory_order_relaxed);
+    });
+    return moved.load();
+}
+
+struct DemCoefficients
+{
+    float e_star;           // Effective Young's modulus
+    float g_star;           // Effective shear modulus
+    float beta;             // Damping ratio out of the restitution
+    float friction;
+    float rolling_friction;
+};
+
+static DemCoefficients dem_coefficients(const DemMaterial& material)
+{
+    DemCoefficients c;
+    float nu = material.poisson_ratio;
+    float shear_modulus = material.youngs_modulus / (2.0f * (1.0f + nu));
+    c.e_star = material.youngs_modulus / (2.0f * (1.0f - nu * nu));
+    c.g_star = shear_modulus / (2.0f * (2.0f - nu));
+    float log_e = logf(std::max(material.restitution, 1e-6f));
+    c.beta = -log_e / sqrtf(log_e * log_e + glm::pi<float>() * glm::pi<float>());
+    c.friction = material.friction;
+    c.rolling_friction = material.rolling_friction;
+    return c;
+}
+
+/*
+    Force and torque on grain a from a Hertz-Mindlin contact with grain b (or a wall when b's mass_inv and radius are 0).
+    n points from b to a, spring is the tangential history and gets updated. Grain b gets -force and its own torque.
+*/
+struct DemBody
+{
+    glm::vec3 velocity;
+    glm::vec3 spin;
+    float radius;
+    float mass_inv;
+    float inertia_inv;
+};
+
+struct DemContactResult
+{
+    glm::vec3 force;
+    glm::vec3 torque_a;
+    glm::vec3 torque_b;
+};
+
+static inline DemContactResult dem_contact(const DemCoefficients& c, const DemBody& a, const DemBody& b, const glm::vec3& n,
+                                           float overlap, float effective_radius, glm::vec3* spring, float delta)
+{
+    DemContactResult result = { glm::vec3(0.0), glm::vec3(0.0), glm::vec3(0.0) };
+    float mass = 1.0f / (a.mass_inv + b.mass_inv);
+    float root = sqrtf(effective_radius * overlap);
+    float kn = 4.0f / 3.0f * c.e_star * root;
+    float kt = 8.0f * c.g_star * root;
+    float damping = 2.0f * sqrtf(5.0f / 6.0f) * c.beta * sqrtf(root * mass);
+    float damping_n = damping * sqrtf(2.0f * c.e_star);
+    float damping_t = damping * sqrtf(8.0f * c.g_star);
+
+    // Velocity of a's surface relative to b's at the contact point
+    glm::vec3 relative = a.velocity - b.velocity - glm::cross(a.spin * a.radius + b.spin * b.radius, n);
+    float vn = glm::dot(relative, n);
+    glm::vec3 vt = relative - n * vn;
+
+    // Springs don't pull, a contact pulling apart faster than the damping allows just lets go
+    float fn = std::max(kn * overlap - damping_n * vn, 0.0f);
+
+    // The old spring gets turned into the current tangent plane, keeping its length
+    glm::vec3 xi = *spring;
+    float length_sq = glm::dot(xi, xi);
+    if(length_sq > 0.0f)
+    {
+        xi -= n * glm::dot(xi, n);
+        float projected_sq = glm::dot(xi, xi);
+        if(projected_sq > 0.0f) xi *= sqrtf(length_sq / projected_sq);
+    }
+    xi += vt * delta;
+
+    glm::vec3 ft = -kt * xi - damping_t * vt;
+    float ft_len = glm::length(ft);
+    float slide = c.friction * fn;
+    if(ft_len > slide)
+    {
+        // Sliding, the spring only keeps as much stretch as the friction can hold
+        ft *= slide / ft_len;
+        xi = kt > 0.0f ? -(ft + damping_t * vt) / kt : glm::vec3(0.0);
+    }
+    *spring = xi;
+
+    result.force = n * fn + ft;
+    glm::vec3 arm = glm::cross(ft, n);
+    result.torque_a = arm * a.radius;
+    result.torque_b = arm * b.radius;
+
+    // Rolling resistance, capped at what stops the relative spin dead this step
+    glm::vec3 spin = a.spin - b.spin;
+    float spin_len = glm::length(spin);
+    float inertia_inv = a.inertia_inv + b.inertia_inv;
+    if(spin_len > 1e-9f && inertia_inv > 0.0f)
+    {
+        float roll = std::min(c.rolling_friction * effective_radius * fn, spin_len / (inertia_inv * delta));
+        glm::vec3 resist = spin * (-roll / spin_len);
+        result.torque_a += resist;
+        result.torque_b -= resist;
+    }
+    return result;
+}
+
+static inline DemBody dem_body(const DemGranular& dem, const ParticleWorld& world, uint32_t i)
+{
+    float r = world.radius[i];
+    float inertia_inv = r > 0.0f ? 2.5f * world.mass_inv[i] / (r * r) : 0.0f;       // Solid sphere, I = 2/5 m r^2
+    return { world.velocity.get(i), dem.angular_velocity.get(i), r, world.mass_inv[i], inertia_inv };
+}
+
+// What the pair kernels read and write. Grain arrays are indexed by slot, springs and results by entry.
+struct DemPairArgs
+{
+    DemCoefficients c;
+    float delta;
+    const uint32_t* entry;
+    const uint32_t* a;
+    const uint32_t* b;
+    const float* px; const float* py; const float* pz;
+    const float* vx; const float* vy; const float* vz;
+    const float* wx; const float* wy; const float* wz;      // Spin
+    const float* radius;
+    const float* mass_inv;
+    float* sx; float* sy; float* sz;                        // Tangential springs
+    float* fx; float* fy; float* fz;
+    float* tax; float* tay; float* taz;
+    float* tbx; float* tby; float* tbz;
+};
+
+static inline DemBody pair_body(const DemPairArgs& args, uint32_t i)
+{
+    float r = args.radius[i];
+    float inertia_inv = r > 0.0f ? 2.5f * args.mass_inv[i] / (r * r) : 0.0f;
+    return { glm::vec3(args.vx[i], args.vy[i], args.vz[i]), glm::vec3(args.wx[i], args.wy[i], args.wz[i]), r, args.mass_inv[i], inertia_inv };
+}
+
+static inline void store_pair(const DemPairArgs& args, uint32_t e, const glm::vec3& spring, const DemContactResult& contact)
+{
+    args.sx[e] = spring.x; args.sy[e] = spring.y; args.sz[e] = spring.z;
+    args.fx[e] = contact.force.x; args.fy[e] = contact.force.y; args.fz[e] = contact.force.z;
+    args.tax[e] = contact.torque_a.x; args.tay[e] = contact.torque_a.y; args.taz[e] = contact.torque_a.z;
+    args.tbx[e] = contact.torque_b.x; args.tby[e] = contact.torque_b.y; args.tbz[e] = contact.torque_b.z;
+}
+
+// Scalar reference, the vector kernels use it for whatever doesn't fill a whole register
+static void dem_pairs_scalar(const DemPairArgs& args, size_t begin, size_t end)
+{
+    for(size_t p = begin; p < end; p++)
+    {
+        uint32_t e = args.entry[p];
+        uint32_t i = args.a[p];
+        uint32_t j = args.b[p];
+
+        glm::vec3 d(args.px[i] - args.px[j], args.py[i] - args.py[j], args.pz[i] - args.pz[j]);
+        float r = args.radius[i];
+        float reach = r + args.radius[j];
+        float dist_sq = glm::dot(d, d);
+        if(dist_sq >= reach * reach || dist_sq == 0.0f || args.mass_inv[i] + args.mass_inv[j] == 0.0f)
+        {
+            store_pair(args, e, glm::vec3(0.0), { glm::vec3(0.0), glm::vec3(0.0), glm::vec3(0.0) });
+            continue;
+        }
+
+        float dist = sqrtf(dist_sq);
+        glm::vec3 spring(args.sx[e], args.sy[e], args.sz[e]);
+        DemContactResult contact = dem_contact(args.c, pair_body(args, i), pair_body(args, j), d / dist, reach - dist,
+                                               r * args.radius[j] / reach, &spring, args.delta);
+        store_pair(args, e, spring, contact);
+    }
+}
+
+#if PHYS_X86
+
+/*
+    dem_contact a register of pairs at a time. Every branch of the scalar version is computed for every lane and the
+    right one picked with a mask, with the operations in the same order so the results match it bit for bit.
+    Results go into a small block and get scattered out to the entries from there.
+*/
+
+static inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 dot_sse(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static inline __m128 gather_sse(const float* base, const uint32_t* index)
+{
+    return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+}
+
+static void dem_pairs_sse(const DemPairArgs& args, size_t begin, size_t end)
+{
+    const DemCoefficients& c = args.c;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 delta = _mm_set1_ps(args.delta);
+    const __m128 kn_scale = _mm_set1_ps(4.0f / 3.0f * c.e_star);
+    const __m128 kt_scale = _mm_set1_ps(8.0f * c.g_star);
+    const __m128 damping_scale = _mm_set1_ps(2.0f * sqrtf(5.0f / 6.0f) * c.beta);
+    const __m128 damping_n_scale = _mm_set1_ps(sqrtf(2.0f * c.e_star));
+    const __m128 damping_t_scale = _mm_set1_ps(sqrtf(8.0f * c.g_star));
+    const __m128 friction = _mm_set1_ps(c.friction);
+    const __m128 rolling_friction = _mm_set1_ps(c.rolling_friction);
+    const __m128 sphere_inertia = _mm_set1_ps(2.5f);
+    const __m128 spin_epsilon = _mm_set1_ps(1e-9f);
+
+    alignas(16) float out[12][4];
+    size_t p = begin;
+    for(; p + 4 <= end; p += 4)
+    {
+        const uint32_t* ia = args.a + p;
+        const uint32_t* ib = args.b + p;
+        const uint32_t* ie = args.entry + p;
+
+        __m128 ra = gather_sse(args.radius, ia), rb = gather_sse(args.radius, ib);
+        __m128 ma = gather_sse(args.mass_inv, ia), mb = gather_sse(args.mass_inv, ib);
+        __m128 dx = _mm_sub_ps(gather_sse(args.px, ia), gather_sse(args.px, ib));
+        __m128 dy = _mm_sub_ps(gather_sse(args.py, ia), gather_sse(args.py, ib));
+        __m128 dz = _mm_sub_ps(gather_sse(args.pz, ia), gather_sse(args.pz, ib));
+        __m128 reach = _mm_add_ps(ra, rb);
+        __m128 dist_sq = dot_sse(dx, dy, dz, dx, dy, dz);
+        __m128 mass_sum = _mm_add_ps(ma, mb);
+
+        // Lanes that aren't touching (or are two walls / the same spot) end up with nothing, like the scalar early out
+        __m128 touching = _mm_and_ps(_mm_and_ps(_mm_cmpnge_ps(dist_sq, _mm_mul_ps(reach, reach)), _mm_cmpneq_ps(dist_sq, zero)),
+                                     _mm_cmpneq_ps(mass_sum, zero));
+
+        __m128 dist = _mm_sqrt_ps(dist_sq);
+        __m128 nx = _mm_div_ps(dx, dist), ny = _mm_div_ps(dy, dist), nz = _mm_div_ps(dz, dist);
+        __m128 overlap = _mm_sub_ps(reach, dist);
+        __m128 effective = _mm_div_ps(_mm_mul_ps(ra, rb), reach);
+        __m128 mass = _mm_div_ps(one, mass_sum);
+        __m128 root = _mm_sqrt_ps(_mm_mul_ps(effective, overlap));
+        __m128 kn = _mm_mul_ps(kn_scale, root);
+        __m128 kt = _mm_mul_ps(kt_scale, root);
+        __m128 damping = _mm_mul_ps(damping_scale, _mm_sqrt_ps(_mm_mul_ps(root, mass)));
+        __m128 damping_n = _mm_mul_ps(damping, damping_n_scale);
+        __m128 damping_t = _mm_mul_ps(damping, damping_t_scale);
+
+        // Relative surface velocity
+        __m128 wax = gather_sse(args.wx, ia), way = gather_sse(args.wy, ia), waz = gather_sse(args.wz, ia);
+        __m128 wbx = gather_sse(args.wx, ib), wby = gather_sse(args.wy, ib), wbz = gather_sse(args.wz, ib);
+        __m128 wx = _mm_add_ps(_mm_mul_ps(wax, ra), _mm_mul_ps(wbx, rb));
+        __m128 wy = _mm_add_ps(_mm_mul_ps(way, ra), _mm_mul_ps(wby, rb));
+        __m128 wz = _mm_add_ps(_mm_mul_ps(waz, ra), _mm_mul_ps(wbz, rb));
+        __m128 rel_x = _mm_sub_ps(_mm_sub_ps(gather_sse(args.vx, ia), gather_sse(args.vx, ib)), _mm_sub_ps(_mm_mul_ps(wy, nz), _mm_mul_ps(ny, wz)));
+        __m128 rel_y = _mm_sub_ps(_mm_sub_ps(gather_sse(args.vy, ia), gather_sse(args.vy, ib)), _mm_sub_ps(_mm_mul_ps(wz, nx), _mm_mul_ps(nz, wx)));
+        __m128 rel_z = _mm_sub_ps(_mm_sub_ps(gather_sse(args.vz, ia), gather_sse(args.vz, ib)), _mm_sub_ps(_mm_mul_ps(wx, ny), _mm_mul_ps(nx, wy)));
+        __m128 vn = dot_sse(rel_x, rel_y, rel_z, nx, ny, nz);
+        __m128 vt_x = _mm_sub_ps(rel_x, _mm_mul_ps(nx, vn));
+        __m128 vt_y = _mm_sub_ps(rel_y, _mm_mul_ps(ny, vn));
+        __m128 vt_z = _mm_sub_ps(rel_z, _mm_mul_ps(nz, vn));
+
+        __m128 fn = _mm_max_ps(zero, _mm_sub_ps(_mm_mul_ps(kn, overlap), _mm_mul_ps(damping_n, vn)));
+
+        // Spring turned into the tangent plane, keeping its length
+        __m128 xi_x = gather_sse(args.sx, ie), xi_y = gather_sse(args.sy, ie), xi_z = gather_sse(args.sz, ie);
+        __m128 length_sq = dot_sse(xi_x, xi_y, xi_z, xi_x, xi_y, xi_z);
+        __m128 along = dot_sse(xi_x, xi_y, xi_z, nx, ny, nz);
+        __m128 flat_x = _mm_sub_ps(xi_x, _mm_mul_ps(nx, along));
+        __m128 flat_y = _mm_sub_ps(xi_y, _mm_mul_ps(ny, along));
+        __m128 flat_z = _mm_sub_ps(xi_z, _mm_mul_ps(nz, along));
+        __m128 projected_sq = dot_sse(flat_x, flat_y, flat_z, flat_x, flat_y, flat_z);
+        __m128 stretch = _mm_sqrt_ps(_mm_div_ps(length_sq, projected_sq));
+        __m128 rescale = _mm_cmpgt_ps(projected_sq, zero);
+        flat_x = select_sse(rescale, _mm_mul_ps(flat_x, stretch), flat_x);
+        flat_y = select_sse(rescale, _mm_mul_ps(flat_y, stretch), flat_y);
+        flat_z = select_sse(rescale, _mm_mul_ps(flat_z, stretch), flat_z);
+        __m128 had_spring = _mm_cmpgt_ps(length_sq, zero);
+        xi_x = _mm_add_ps(select_sse(had_spring, flat_x, xi_x), _mm_mul_ps(vt_x, delta));
+        xi_y = _mm_add_ps(select_sse(had_spring, flat_y, xi_y), _mm_mul_ps(vt_y, delta));
+        xi_z = _mm_add_ps(select_sse(had_spring, flat_z, xi_z), _mm_mul_ps(vt_z, delta));
+
+        // Coulomb cap, sliding lanes keep only the stretch friction can hold
+        __m128 neg_kt = _mm_xor_ps(kt, sign);
+        __m128 ft_x = _mm_sub_ps(_mm_mul_ps(neg_kt, xi_x), _mm_mul_ps(damping_t, vt_x));
+        __m128 ft_y = _mm_sub_ps(_mm_mul_ps(neg_kt, xi_y), _mm_mul_ps(damping_t, vt_y));
+        __m128 ft_z = _mm_sub_ps(_mm_mul_ps(neg_kt, xi_z), _mm_mul_ps(damping_t, vt_z));
+        __m128 ft_len = _mm_sqrt_ps(dot_sse(ft_x, ft_y, ft_z, ft_x, ft_y, ft_z));
+        __m128 slide = _mm_mul_ps(friction, fn);
+        __m128 sliding = _mm_cmpgt_ps(ft_len, slide);
+        __m128 cap = _mm_div_ps(slide, ft_len);
+        ft_x = select_sse(sliding, _mm_mul_ps(ft_x, cap), ft_x);
+        ft_y = select_sse(sliding, _mm_mul_ps(ft_y, cap), ft_y);
+        ft_z = select_sse(sliding, _mm_mul_ps(ft_z, cap), ft_z);
+        __m128 stiff = _mm_cmpgt_ps(kt, zero);
+        __m128 held_x = select_sse(stiff, _mm_div_ps(_mm_xor_ps(_mm_add_ps(ft_x, _mm_mul_ps(damping_t, vt_x)), sign), kt), zero);
+        __m128 held_y = select_sse(stiff, _mm_div_ps(_mm_xor_ps(_mm_add_ps(ft_y, _mm_mul_ps(damping_t, vt_y)), sign), kt), zero);
+        __m128 held_z = select_sse(stiff, _mm_div_ps(_mm_xor_ps(_mm_add_ps(ft_z, _mm_mul_ps(damping_t, vt_z)), sign), kt), zero);
+        xi_x = select_sse(sliding, held_x, xi_x);
+        xi_y = select_sse(sliding, held_y, xi_y);
+        xi_z = select_sse(sliding, held_z, xi_z);
+
+        __m128 f_x = _mm_add_ps(_mm_mul_ps(nx, fn), ft_x);
+        __m128 f_y = _mm_add_ps(_mm_mul_ps(ny, fn), ft_y);
+        __m128 f_z = _mm_add_ps(_mm_mul_ps(nz, fn), ft_z);
+        __m128 arm_x = _mm_sub_ps(_mm_mul_ps(ft_y, nz), _mm_mul_ps(ny, ft_z));
+        __m128 arm_y = _mm_sub_ps(_mm_mul_ps(ft_z, nx), _mm_mul_ps(nz, ft_x));
+        __m128 arm_z = _mm_sub_ps(_mm_mul_ps(ft_x, ny), _mm_mul_ps(nx, ft_y));
+        __m128 ta_x = _mm_mul_ps(arm_x, ra), ta_y = _mm_mul_ps(arm_y, ra), ta_z = _mm_mul_ps(arm_z, ra);
+        __m128 tb_x = _mm_mul_ps(arm_x, rb), tb_y = _mm_mul_ps(arm_y, rb), tb_z = _mm_mul_ps(arm_z, rb);
+
+        // Rolling resistance
+        __m128 spin_x = _mm_sub_ps(wax, wbx), spin_y = _mm_sub_ps(way, wby), spin_z = _mm_sub_ps(waz, wbz);
+        __m128 spin_len = _mm_sqrt_ps(dot_sse(spin_x, spin_y, spin_z, spin_x, spin_y, spin_z));
+        __m128 inertia_a = select_sse(_mm_cmpgt_ps(ra, zero), _mm_div_ps(_mm_mul_ps(sphere_inertia, ma), _mm_mul_ps(ra, ra)), zero);
+        __m128 inertia_b = select_sse(_mm_cmpgt_ps(rb, zero), _mm_div_ps(_mm_mul_ps(sphere_inertia, mb), _mm_mul_ps(rb, rb)), zero);
+        __m128 inertia_inv = _mm_add_ps(inertia_a, inertia_b);
+        __m128 rolling = _mm_and_ps(_mm_cmpgt_ps(spin_len, spin_epsilon), _mm_cmpgt_ps(inertia_inv, zero));
+        __m128 roll = _mm_min_ps(_mm_div_ps(spin_len, _mm_mul_ps(inertia_inv, delta)), _mm_mul_ps(_mm_mul_ps(rolling_friction, effective), fn));
+        __m128 resist = _mm_div_ps(_mm_xor_ps(roll, sign), spin_len);
+        __m128 resist_x = _mm_mul_ps(spin_x, resist), resist_y = _mm_mul_ps(spin_y, resist), resist_z = _mm_mul_ps(spin_z, resist);
+        ta_x = select_sse(rolling, _mm_add_ps(ta_x, resist_x), ta_x);
+        ta_y = select_sse(rolling, _mm_add_ps(ta_y, resist_y), ta_y);
+        ta_z = select_sse(rolling, _mm_add_ps(ta_z, resist_z), ta_z);
+        tb_x = select_sse(rolling, _mm_sub_ps(tb_x, resist_x), tb_x);
+        tb_y = select_sse(rolling, _mm_sub_ps(tb_y, resist_y), tb_y);
+        tb_z = select_sse(rolling, _mm_sub_ps(tb_z, resist_z), tb_z);
+
+        __m128 results[12] = { xi_x, xi_y, xi_z, f_x, f_y, f_z, ta_x, ta_y, ta_z, tb_x, tb_y, tb_z };
+        for(int k = 0; k < 12; k++) _mm_store_ps(out[k], _mm_and_ps(touching, results[k]));
+
+        float* targets[12] = { args.sx, args.sy, args.sz, args.fx, args.fy, args.fz, args.tax, args.tay, args.taz, args.tbx, args.tby, args.tbz };
+        for(int k = 0; k < 12; k++)
+        {
+            for(int lane = 0; lane < 4; lane++) targets[k][ie[lane]] = out[k][lane];
+        }
+    }
+    dem_pairs_scalar(args, p, end);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 dot_avx2(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 gather_avx2(const float* base, __m256i index)
+{
+    return _mm256_i32gather_ps(base, index, 4);
+}
+
+SIMD_TARGET("avx2")
+static void dem_pairs_avx2(const DemPairArgs& args, size_t begin, size_t end)
+{
+    const DemCoefficients& c = args.c;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 delta = _mm256_set1_ps(args.delta);
+    const __m256 kn_scale = _mm256_set1_ps(4.0f / 3.0f * c.e_star);
+    const __m256 kt_scale = _mm256_set1_ps(8.0f * c.g_star);
+    const __m256 damping_scale = _mm256_set1_ps(2.0f * sqrtf(5.0f / 6.0f) * c.beta);
+    const __m256 damping_n_scale = _mm256_set1_ps(sqrtf(2.0f * c.e_star));
+    const __m256 damping_t_scale = _mm256_set1_ps(sqrtf(8.0f * c.g_star));
+    const __m256 friction = _mm256_set1_ps(c.friction);
+    const __m256 rolling_friction = _mm256_set1_ps(c.rolling_friction);
+    const __m256 sphere_inertia = _mm256_set1_ps(2.5f);
+    const __m256 spin_epsilon = _mm256_set1_ps(1e-9f);
+
+    alignas(32) float out[12][8];
+    size_t p = begin;
+    for(; p + 8 <= end; p += 8)
+    {
+        __m256i ia = _mm256_loadu_si256((const __m256i*)(args.a + p));
+        __m256i ib = _mm256_loadu_si256((const __m256i*)(args.b + p));
+        __m256i ie = _mm256_loadu_si256((const __m256i*)(args.entry + p));
+
+        __m256 ra = gather_avx2(args.radius, ia), rb = gather_avx2(args.radius, ib);
+        __m256 ma = gather_avx2(args.mass_inv, ia), mb = gather_avx2(args.mass_inv, ib);
+        __m256 dx = _mm256_sub_ps(gather_avx2(args.px, ia), gather_avx2(args.px, ib));
+        __m256 dy = _mm256_sub_ps(gather_avx2(args.py, ia), gather_avx2(args.py, ib));
+        __m256 dz = _mm256_sub_ps(gather_avx2(args.pz, ia), gather_avx2(args.pz, ib));
+        __m256 reach = _mm256_add_ps(ra, rb);
+        __m256 dist_sq = dot_avx2(dx, dy, dz, dx, dy, dz);
+        __m256 mass_sum = _mm256_add_ps(ma, mb);
+
+        __m256 touching = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(dist_sq, _mm256_mul_ps(reach, reach), _CMP_NGE_UQ),
+                                                      _mm256_cmp_ps(dist_sq, zero, _CMP_NEQ_UQ)),
+                                        _mm256_cmp_ps(mass_sum, zero, _CMP_NEQ_UQ));
+
+        __m256 dist = _mm256_sqrt_ps(dist_sq);
+        __m256 nx = _mm256_div_ps(dx, dist), ny = _mm256_div_ps(dy, dist), nz = _mm256_div_ps(dz, dist);
+        __m256 overlap = _mm256_sub_ps(reach, dist);
+        __m256 effective = _mm256_div_ps(_mm256_mul_ps(ra, rb), reach);
+        __m256 mass = _mm256_div_ps(one, mass_sum);
+        __m256 root = _mm256_sqrt_ps(_mm256_mul_ps(effective, overlap));
+        __m256 kn = _mm256_mul_ps(kn_scale, root);
+        __m256 kt = _mm256_mul_ps(kt_scale, root);
+        __m256 damping = _mm256_mul_ps(damping_scale, _mm256_sqrt_ps(_mm256_mul_ps(root, mass)));
+        __m256 damping_n = _mm256_mul_ps(damping, damping_n_scale);
+        __m256 damping_t = _mm256_mul_ps(damping, damping_t_scale);
+
+        __m256 wax = gather_avx2(args.wx, ia), way = gather_avx2(args.wy, ia), waz = gather_avx2(args.wz, ia);
+        __m256 wbx = gather_avx2(args.wx, ib), wby = gather_avx2(args.wy, ib), wbz = gather_avx2(args.wz, ib);
+        __m256 wx = _mm256_add_ps(_mm256_mul_ps(wax, ra), _mm256_mul_ps(wbx, rb));
+        __m256 wy = _mm256_add_ps(_mm256_mul_ps(way, ra), _mm256_mul_ps(wby, rb));
+        __m256 wz = _mm256_add_ps(_mm256_mul_ps(waz, ra), _mm256_mul_ps(wbz, rb));
+        __m256 rel_x = _mm256_sub_ps(_mm256_sub_ps(gather_avx2(args.vx, ia), gather_avx2(args.vx, ib)), _mm256_sub_ps(_mm256_mul_ps(wy, nz), _mm256_mul_ps(ny, wz)));
+        __m256 rel_y = _mm256_sub_ps(_mm256_sub_ps(gather_avx2(args.vy, ia), gather_avx2(args.vy, ib)), _mm256_sub_ps(_mm256_mul_ps(wz, nx), _mm256_mul_ps(nz, wx)));
+        __m256 rel_z = _mm256_sub_ps(_mm256_sub_ps(gather_avx2(args.vz, ia), gather_avx2(args.vz, ib)), _mm256_sub_ps(_mm256_mul_ps(wx, ny), _mm256_mul_ps(nx, wy)));
+        __m256 vn = dot_avx2(rel_x, rel_y, rel_z, nx, ny, nz);
+        __m256 vt_x = _mm256_sub_ps(rel_x, _mm256_mul_ps(nx, vn));
+        __m256 vt_y = _mm256_sub_ps(rel_y, _mm256_mul_ps(ny, vn));
+        __m256 vt_z = _mm256_sub_ps(rel_z, _mm256_mul_ps(nz, vn));
+
+        __m256 fn = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_mul_ps(kn, overlap), _mm256_mul_ps(damping_n, vn)));
+
+        __m256 xi_x = gather_avx2(args.sx, ie), xi_y = gather_avx2(args.sy, ie), xi_z = gather_avx2(args.sz, ie);
+        __m256 length_sq = dot_avx2(xi_x, xi_y, xi_z, xi_x, xi_y, xi_z);
+        __m256 along = dot_avx2(xi_x, xi_y, xi_z, nx, ny, nz);
+        __m256 flat_x = _mm256_sub_ps(xi_x, _mm256_mul_ps(nx, along));
+        __m256 flat_y = _mm256_sub_ps(xi_y, _mm256_mul_ps(ny, along));
+        __m256 flat_z = _mm256_sub_ps(xi_z, _mm256_mul_ps(nz, along));
+        __m256 projected_sq = dot_avx2(flat_x, flat_y, flat_z, flat_x, flat_y, flat_z);
+        __m256 stretch = _mm256_sqrt_ps(_mm256_div_ps(length_sq, projected_sq));
+        __m256 rescale = _mm256_cmp_ps(projected_sq, zero, _CMP_GT_OQ);
+        flat_x = _mm256_blendv_ps(flat_x, _mm256_mul_ps(flat_x, stretch), rescale);
+        flat_y = _mm256_blendv_ps(flat_y, _mm256_mul_ps(flat_y, stretch), rescale);
+        flat_z = _mm256_blendv_ps(flat_z, _mm256_mul_ps(flat_z, stretch), rescale);
+        __m256 had_spring = _mm256_cmp_ps(length_sq, zero, _CMP_GT_OQ);
+        xi_x = _mm256_add_ps(_mm256_blendv_ps(xi_x, flat_x, had_spring), _mm256_mul_ps(vt_x, delta));
+        xi_y = _mm256_add_ps(_mm256_blendv_ps(xi_y, flat_y, had_spring), _mm256_mul_ps(vt_y, delta));
+        xi_z = _mm256_add_ps(_mm256_blendv_ps(xi_z, flat_z, had_spring), _mm256_mul_ps(vt_z, delta));
+
+        __m256 neg_kt = _mm256_xor_ps(kt, sign);
+        __m256 ft_x = _mm256_sub_ps(_mm256_mul_ps(neg_kt, xi_x), _mm256_mul_ps(damping_t, vt_x));
+        __m256 ft_y = _mm256_sub_ps(_mm256_mul_ps(neg_kt, xi_y), _mm256_mul_ps(damping_t, vt_y));
+        __m256 ft_z = _mm256_sub_ps(_mm256_mul_ps(neg_kt, xi_z), _mm256_mul_ps(damping_t, vt_z));
+        __m256 ft_len = _mm256_sqrt_ps(dot_avx2(ft_x, ft_y, ft_z, ft_x, ft_y, ft_z));
+        __m256 slide = _mm256_mul_ps(friction, fn);
+        __m256 sliding = _mm256_cmp_ps(ft_len, slide, _CMP_GT_OQ);
+        __m256 cap = _mm256_div_ps(slide, ft_len);
+        ft_x = _mm256_blendv_ps(ft_x, _mm256_mul_ps(ft_x, cap), sliding);
+        ft_y = _mm256_blendv_ps(ft_y, _mm256_mul_ps(ft_y, cap), sliding);
+        ft_z = _mm256_blendv_ps(ft_z, _mm256_mul_ps(ft_z, cap), sliding);
+        __m256 stiff = _mm256_cmp_ps(kt, zero, _CMP_GT_OQ);
+        __m256 held_x = _mm256_and_ps(stiff, _mm256_div_ps(_mm256_xor_ps(_mm256_add_ps(ft_x, _mm256_mul_ps(damping_t, vt_x)), sign), kt));
+        __m256 held_y = _mm256_and_ps(stiff, _mm256_div_ps(_mm256_xor_ps(_mm256_add_ps(ft_y, _mm256_mul_ps(damping_t, vt_y)), sign), kt));
+        __m256 held_z = _mm256_and_ps(stiff, _mm256_div_ps(_mm256_xor_ps(_mm256_add_ps(ft_z, _mm256_mul_ps(damping_t, vt_z)), sign), kt));
+        xi_x = _mm256_blendv_ps(xi_x, held_x, sliding);
+        xi_y = _mm256_blendv_ps(xi_y, held_y, sliding);
+        xi_z = _mm256_blendv_ps(xi_z, held_z, sliding);
+
+        __m256 f_x = _mm256_add_ps(_mm256_mul_ps(nx, fn), ft_x);
+        __m256 f_y = _mm256_add_ps(_mm256_mul_ps(ny, fn), ft_y);
+        __m256 f_z = _mm256_add_ps(_mm256_mul_ps(nz, fn), ft_z);
+        __m256 arm_x = _mm256_sub_ps(_mm256_mul_ps(ft_y, nz), _mm256_mul_ps(ny, ft_z));
+        __m256 arm_y = _mm256_sub_ps(_mm256_mul_ps(ft_z, nx), _mm256_mul_ps(nz, ft_x));
+        __m256 arm_z = _mm256_sub_ps(_mm256_mul_ps(ft_x, ny), _mm256_mul_ps(nx, ft_y));
+        __m256 ta_x = _mm256_mul_ps(arm_x, ra), ta_y = _mm256_mul_ps(arm_y, ra), ta_z = _mm256_mul_ps(arm_z, ra);
+        __m256 tb_x = _mm256_mul_ps(arm_x, rb), tb_y = _mm256_mul_ps(arm_y, rb), tb_z = _mm256_mul_ps(arm_z, rb);
+
+        __m256 spin_x = _mm256_sub_ps(wax, wbx), spin_y = _mm256_sub_ps(way, wby), spin_z = _mm256_sub_ps(waz, wbz);
+        __m256 spin_len = _mm256_sqrt_ps(dot_avx2(spin_x, spin_y, spin_z, spin_x, spin_y, spin_z));
+        __m256 inertia_a = _mm256_and_ps(_mm256_cmp_ps(ra, zero, _CMP_GT_OQ), _mm256_div_ps(_mm256_mul_ps(sphere_inertia, ma), _mm256_mul_ps(ra, ra)));
+        __m256 inertia_b = _mm256_and_ps(_mm256_cmp_ps(rb, zero, _CMP_GT_OQ), _mm256_div_ps(_mm256_mul_ps(sphere_inertia, mb), _mm256_mul_ps(rb, rb)));
+        __m256 inertia_inv = _mm256_add_ps(inertia_a, inertia_b);
+        __m256 rolling = _mm256_and_ps(_mm256_cmp_ps(spin_len, spin_epsilon, _CMP_GT_OQ), _mm256_cmp_ps(inertia_inv, zero, _CMP_GT_OQ));
+        __m256 roll = _mm256_min_ps(_mm256_div_ps(spin_len, _mm256_mul_ps(inertia_inv, delta)), _mm256_mul_ps(_mm256_mul_ps(rolling_friction, effective), fn));
+        __m256 resist = _mm256_div_ps(_mm256_xor_ps(roll, sign), spin_len);
+        __m256 resist_x = _mm256_mul_ps(spin_x, resist), resist_y = _mm256_mul_ps(spin_y, resist), resist_z = _mm256_mul_ps(spin_z, resist);
+        ta_x = _mm256_blendv_ps(ta_x, _mm256_add_ps(ta_x, resist_x), rolling);
+        ta_y = _mm256_blendv_ps(ta_y, _mm256_add_ps(ta_y, resist_y), rolling);
+        ta_z = _mm256_blendv_ps(ta_z, _mm256_add_ps(ta_z, resist_z), rolling);
+        tb_x = _mm256_blendv_ps(tb_x, _mm256_sub_ps(tb_x, resist_x), rolling);
+        tb_y = _mm256_blendv_ps(tb_y, _mm256_sub_ps(tb_y, resist_y), rolling);
+        tb_z = _mm256_blendv_ps(tb_z, _mm256_sub_ps(tb_z, resist_z), rolling);
+
+        __m256 results[12] = { xi_x, xi_y, xi_z, f_x, f_y, f_z, ta_x, ta_y, ta_z, tb_x, tb_y, tb_z };
+        for(int k = 0; k < 12; k++) _mm256_store_ps(out[k], _mm256_and_ps(touching, results[k]));
+
+        const uint32_t* entries = args.entry + p;
+        float* targets[12] = { args.sx, args.sy, args.sz, args.fx, args.fy, args.fz, args.tax, args.tay, args.taz, args.tbx, args.tby, args.tbz };
+        for(int k = 0; k < 12; k++)
+        {
+            for(int lane = 0; lane < 8; lane++) targets[k][entries[lane]] = out[k][lane];
+        }
+    }
+    dem_pairs_scalar(args, p, end);
+}
+
+#endif
+
+typedef void (*DemPairsFn)(const DemPairArgs& args, size_t begin, size_t end);
+
+static DemPairsFn dem_pairs_fn(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: return dem_pairs_avx2;
+        case SIMD_SSE: return dem_pairs_sse;
+        default: break;
+    }
+#endif
+    return dem_pairs_scalar;
+}
+
+static void dem_contacts(DemGranular& dem, ParticleWorld& world, float delta, const std::vector<ContactPlane>& walls)
+{
+    DemCoefficients c = dem_coefficients(dem.material);
+    size_t count = phys_world_count(world);
+    const std::vector<uint32_t>& handle = world.handles.slot_to_handle;
+
+    // Every contact once, from the entry on the lower handle's side
+    DemPairArgs args = {
+        c, delta, dem.pair_entry.data(), dem.pair_a.data(), dem.pair_b.data(),
+        world.position.x.data(), world.position.y.data(), world.position.z.data(),
+        world.velocity.x.data(), world.velocity.y.data(), world.velocity.z.data(),
+        dem.angular_velocity.x.data(), dem.angular_velocity.y.data(), dem.angular_velocity.z.data(),
+        world.radius.data(), world.mass_inv.data(),
+        dem.tangential.x.data(), dem.tangential.y.data(), dem.tangential.z.data(),
+        dem.contact_force.x.data(), dem.contact_force.y.data(), dem.contact_force.z.data(),
+        dem.contact_torque_a.x.data(), dem.contact_torque_a.y.data(), dem.contact_torque_a.z.data(),
+        dem.contact_torque_b.x.data(), dem.contact_torque_b.y.data(), dem.contact_torque_b.z.data()
+    };
+    DemPairsFn pairs = dem_pairs_fn(simd_level());
+    phys_parallel_for(world.pool, dem.pair_entry.size(), 0, [&](size_t begin, size_t end) {
+        pairs(args, begin, end);
+    });
+
+    // Every grain sums its own contacts, taking the other side's result flipped where the other grain worked it out
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 force(0.0), torque(0.0);
+            for(uint32_t e = dem.neighbour_start[i]; e < dem.neighbour_start[i + 1]; e++)
+            {
+                if(handle[i] < handle[dem.neighbour[e]])
+                {
+                    force += dem.contact_force.get(e);
+                    torque += dem.contact_torque_a.get(e);
+                }
+                else
+                {
+                    uint32_t m = dem.mirror[e];
+                    force -= dem.contact_force.get(m);
+                    torque += dem.contact_torque_b.get(m);
+                }
+            }
+
+            // Walls are infinitely heavy and never spin, they don't keep a spring so friction is just the damping
+            glm::vec3 p = world.position.get(i);
+            float r = world.radius[i];
+            DemBody grain = dem_body(dem, world, (uint32_t)i);
+            DemBody wall = { glm::vec3(0.0), glm::vec3(0.0), 0.0, 0.0, 0.0 };
+            for(const ContactPlane& plane : walls)
+            {
+                float overlap = r - (glm::dot(plane.normal, p) - plane.offset);
+                if(overlap <= 0.0f || grain.mass_inv == 0.0f) continue;
+
+                glm::vec3 spring(0.0);
+                DemContactResult contact = dem_contact(c, grain, wall, plane.normal, overlap, r, &spring, delta);
+                force += contact.force;
+                torque += contact.torque_a;
+            }
+
+            world.force.set(i, world.force.get(i) + force);
+            dem.torque.set(i, torque);
+        }
+    });
+}
+
+static void dem_spin(DemGranular& dem, ParticleWorld& world, float delta)
+{
+    phys_parallel_for(world.pool, phys_world_count(world), world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            float r = world.radius[i];
+            if(r <= 0.0f) continue;
+
+            float inertia_inv = 2.5f * world.mass_inv[i] / (r * r);
+            dem.angular_velocity.set(i, dem.angular_velocity.get(i) + dem.torque.get(i) * (inertia_inv * delta));
+        }
+    });
+}
+
+void dem_step(DemGranular& dem, ParticleWorld& world, float delta, const std::vector<ContactPlane>& walls)
+{
+    if(needs_rebuild(dem, world)) dem_build(dem, world);
+
+    uint32_t steps = 1;
+    if(dem.stable_step > 0.0f && delta > dem.stable_step)
+    {
+        steps = std::min((uint32_t)ceilf(delta / dem.stable_step), (uint32_t)DEM_MAX_SPLIT);
+    }
+
+    float sub_delta = delta / steps;
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i > 0 && needs_rebuild(dem, world)) dem_build(dem, world);
+
+        dem_contacts(dem, world, sub_delta, walls);
+        phys_world_step(world, sub_delta);
+        dem_spin(dem, world, sub_delta);
+    }
+}
+
+uint64_t dem_checksum(const DemGranular& dem, const ParticleWorld& world)
+{
+    uint64_t hash = phys_world_checksum(world);
+    for(const Vec3Array* v : { &dem.angular_velocity, &dem.tangential })
+    {
+        hash = phys_checksum(hash, v->x.data(), v->size() * sizeof(float));
+        hash = phys_checksum(hash, v->y.data(), v->size() * sizeof(float));
+        hash = phys_checksum(hash, v->z.data(), v->size() * sizeof(float));
+    }
+    return hash;
+}
+
+void dem_update(DemGranular& dem, ParticleWorld& world, FixedStepper& stepper, double frame_delta, const std::vector<ContactPlane>& walls)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            dem_step(dem, world, sub_delta, walls);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(dem_checksum(dem, world));
+    }
+}
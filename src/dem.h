@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+#include "narrowphase.h"
+#include "cell_list.h"
+
+/*
+    Discrete element method for granular stuff (sand, gravel, grain) made of spheres. Every particle in the world is one
+    grain, the particle radius is the grain's radius. Grains also spin, angular velocity and torque live in here next to
+    the world's arrays and follow the world's slots.
+
+    Contacts are Hertz-Mindlin (the no-slip version LIGGGHTS and friends use): the normal spring stiffens with the square
+    root of the overlap, the tangential spring stretches with how far the contact has slid since it started and is
+    capped by Coulomb friction, and both get damped so bounces lose the right amount of energy for the restitution.
+    The tangential spring is the contact's history, it gets kept per contact for as long as the two grains touch.
+    Rolling resistance is a torque against the grains' relative spin, as big as rolling_friction * R * normal force but
+    never big enough to reverse the spin in one step. Walls are planes with the same normal force and plain Coulomb
+    friction without any history.
+
+    Neighbours are a Verlet list: every grain lists every other grain within r1 + r2 + skin, found with a cell list (see
+    cell_list.h, which also keeps grains that are close in space close in memory). The list only gets rebuilt once some
+    grain has moved more than skin / 2 since the last build, which with DEM's tiny steps is every few dozen steps. The
+    contact histories are stored per list entry and carried over into the new list by handle.
+
+    Both grains list every pair, but only the entry on the lower handle's side works the contact out and keeps its
+    history. Those entries also go in a flat pair list at every build, and the contact pass runs over that list in
+    SSE / AVX2 blocks (AVX-512 machines use the AVX2 kernel) picked by simd_level(): every lane gathers its two grains,
+    lanes that aren't touching get masked to no force and no history, and the scalar dem_contact is the reference the
+    leftovers at the end of a range go through. The kernels do the same operations in the same order, so every level
+    gives the same bits. A second pass has every grain sum its entries, reading the other side's result (flipped)
+    through mirror where the other grain did the work. Both passes are spread across world.pool with every job only
+    writing its own entries / grains, so nothing needs locking, both grains see exactly opposite forces and the result
+    doesn't depend on the thread count.
+
+    DEM needs really small steps, dem_step splits delta so no step is longer than step_fraction of the Rayleigh time of
+    the smallest grain (see dem_rayleigh_step). Stiffer material means smaller steps, which is why the default
+    youngs_modulus is a lot softer than real rock.
+
+    Add and remove grains with dem_add_grain / dem_remove_grain so the spin arrays stay in step with the world.
+*/
+
+struct DemMaterial
+{
+    float youngs_modulus = 1e7;         // Pa
+    float poisson_ratio = 0.3;
+    float restitution = 0.5;
+    float friction = 0.5;               // Sliding friction coefficient
+    float rolling_friction = 0.02;      // Rolling resistance coefficient
+};
+
+struct DemGranular
+{
+    DemMaterial material;
+    float skin = 0.0;                   // Extra neighbour distance, 0 = half the biggest radius
+    float step_fraction = 0.2;          // Of the smallest grain's Rayleigh time
+
+    // Per grain, in world slot order
+    Vec3Array angular_velocity;
+    Vec3Array torque;
+
+    // Verlet list, neighbour_start has grain count + 1 offsets into the rest
+    CellList cells;
+    std::vector<uint32_t> neighbour_start;
+    std::vector<uint32_t> neighbour;            // Slot of the other grain
+    std::vector<uint32_t> neighbour_handle;     // Handle of the other grain
+    std::vector<uint32_t> mirror;               // The same pair's entry in the other grain's list
+    std::vector<uint32_t> pair_entry;           // Every entry on the lower handle's side, in entry order
+    std::vector<uint32_t> pair_a;               // Slot of the grain that entry belongs to
+    std::vector<uint32_t> pair_b;               // Slot of the other grain
+    Vec3Array tangential;                       // Tangential spring of every contact, 0 when not touching
+    Vec3Array built_position;                   // Grain positions when the list was built
+    std::vector<uint32_t> handle_old_slot;      // Slot of every handle when the list was built
+    float built_skin = 0.0;
+    float stable_step = 0.0;                    // Longest step the grains allow, worked out at every build
+    bool rebuild = true;
+
+    // Scratch
+    std::vector<uint32_t> old_start;
+    std::vector<uint32_t> old_handle;
+    Vec3Array old_tangential;
+    Vec3Array contact_force;                    // Per entry, only filled in on the lower handle's side
+    Vec3Array contact_torque_a;
+    Vec3Array contact_torque_b;
+};
+
+// Adds a solid sphere of the given density (kg / m^3). Falls with the usual gravity.
+ParticleHandle dem_add_grain(DemGranular& dem, ParticleWorld& world, const glm::vec3& position, float radius, float density,
+                             const glm::vec3& velocity = glm::vec3(0.0));
+void dem_remove_grain(DemGranular& dem, ParticleWorld& world, ParticleHandle handle);
+
+// pi * r * sqrt(density / shear modulus) / (0.1631 * poisson + 0.8766), how long a surface wave takes to get across the
+// grain. Explicit DEM is only stable for a fraction of this.
+float dem_rayleigh_step(const DemMaterial& material, float radius, float density);
+
+// Sorts the grains and builds the Verlet list. dem_step does this whenever it's needed.
+void dem_build(DemGranular& dem, ParticleWorld& world);
+
+// Contacts, walls, integrate. delta gets split into steps short enough to be stable (see step_fraction).
+void dem_step(DemGranular& dem, ParticleWorld& world, float delta, const std::vector<ContactPlane>& walls);
+
+// phys_world_checksum plus the grains' spin and the contact histories
+uint64_t dem_checksum(const DemGranular& dem, const ParticleWorld& world);
+
+// Fixed step driver, same as phys_world_update
+void dem_update(DemGranular& dem, ParticleWorld& world, FixedStepper& stepper, double frame_delta, const std::vector<ContactPlane>& walls);
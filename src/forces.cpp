@@ -0,0 +1,148 @@
+#include "forces.h"
+#include <algorithm>
+
+static inline void add_force(ParticleWorld& world, uint32_t slot, const glm::vec3& f)
+{
+    world.force.x[slot] += f.x;
+    world.force.y[slot] += f.y;
+    world.force.z[slot] += f.z;
+}
+
+static void apply_gravity(const std::vector<GravityForce>& gens, ParticleWorld& world)
+{
+    for(const GravityForce& g : gens)
+    {
+        uint32_t slot = phys_world_slot(world, g.particle);
+        if(slot == UINT32_MAX) continue;
+
+        float mass_inv = world.mass_inv[slot];
+        if(mass_inv == 0.0) continue;
+
+        add_force(world, slot, g.gravity / mass_inv);
+    }
+}
+
+static void apply_drag(const std::vector<DragForce>& gens, ParticleWorld& world)
+{
+    for(const DragForce& d : gens)
+    {
+        uint32_t slot = phys_world_slot(world, d.particle);
+        if(slot == UINT32_MAX) continue;
+
+        glm::vec3 v = world.velocity.get(slot);
+        float speed = glm::length(v);
+        if(speed == 0.0) continue;
+
+        float magnitude = d.k1 * speed + d.k2 * speed * speed;
+        add_force(world, slot, v * (-magnitude / speed));
+    }
+}
+
+// Shared by springs and bungees. Returns the force on a (b gets the negative).
+static inline glm::vec3 spring_force(const glm::vec3& a, const glm::vec3& b, float stiffness, float rest_length, bool pull_only)
+{
+    glm::vec3 d = a - b;
+    float length = glm::length(d);
+    if(length == 0.0) return glm::vec3(0.0);
+    if(pull_only && length <= rest_length) return glm::vec3(0.0);
+
+    return d * (-stiffness * (length - rest_length) / length);
+}
+
+static void apply_springs(const std::vector<SpringForce>& gens, ParticleWorld& world)
+{
+    for(const SpringForce& s : gens)
+    {
+        uint32_t a = phys_world_slot(world, s.a);
+        uint32_t b = phys_world_slot(world, s.b);
+        if(a == UINT32_MAX || b == UINT32_MAX) continue;
+
+        glm::vec3 f = spring_force(world.position.get(a), world.position.get(b), s.stiffness, s.rest_length, false);
+        add_force(world, a, f);
+        add_force(world, b, -f);
+    }
+}
+
+static void apply_anchored_springs(const std::vector<AnchoredSpringForce>& gens, ParticleWorld& world)
+{
+    for(const AnchoredSpringForce& s : gens)
+    {
+        uint32_t slot = phys_world_slot(world, s.particle);
+        if(slot == UINT32_MAX) continue;
+
+        add_force(world, slot, spring_force(world.position.get(slot), s.anchor, s.stiffness, s.rest_length, false));
+    }
+}
+
+static void apply_bungees(const std::vector<BungeeForce>& gens, ParticleWorld& world)
+{
+    for(const BungeeForce& s : gens)
+    {
+        uint32_t a = phys_world_slot(world, s.a);
+        uint32_t b = phys_world_slot(world, s.b);
+        if(a == UINT32_MAX || b == UINT32_MAX) continue;
+
+        glm::vec3 f = spring_force(world.position.get(a), world.position.get(b), s.stiffness, s.rest_length, true);
+        add_force(world, a, f);
+        add_force(world, b, -f);
+    }
+}
+
+static void apply_buoyancy(const std::vector<BuoyancyForce>& gens, ParticleWorld& world)
+{
+    for(const BuoyancyForce& b : gens)
+    {
+        uint32_t slot = phys_world_slot(world, b.particle);
+        if(slot == UINT32_MAX) continue;
+
+        float y = world.position.y[slot];
+        float submerged = (b.liquid_height + b.max_depth - y) / (2.0f * b.max_depth);
+        if(submerged <= 0.0) continue;
+        if(submerged > 1.0) submerged = 1.0;
+
+        // Archimedes: weight of the displaced liquid
+        world.force.y[slot] += b.liquid_density * b.volume * submerged * (float)grav;
+    }
+}
+
+void force_registry_apply(const ForceRegistry& registry, ParticleWorld& world)
+{
+    apply_gravity(registry.gravity, world);
+    apply_drag(registry.drag, world);
+    apply_springs(registry.springs, world);
+    apply_anchored_springs(registry.anchored_springs, world);
+    apply_bungees(registry.bungees, world);
+    apply_buoyancy(registry.buoyancy, world);
+}
+
+template <typename T>
+static void remove_single(std::vector<T>& gens, ParticleHandle particle)
+{
+    gens.erase(std::remove_if(gens.begin(), gens.end(), [particle](const T& g) { return g.particle == particle; }), gens.end());
+}
+
+template <typename T>
+static void remove_pair(std::vector<T>& gens, ParticleHandle particle)
+{
+    gens.erase(std::remove_if(gens.begin(), gens.end(), [particle](const T& g) { return g.a == particle || g.b == particle; }), gens.end());
+}
+
+void force_registry_remove(ForceRegistry& registry, ParticleHandle particle)
+{
+    remove_single(registry.gravity, particle);
+    remove_single(registry.drag, particle);
+    remove_pair(registry.springs, particle);
+    remove_single(registry.anchored_springs, particle);
+    remove_pair(registry.bungees, particle);
+    remove_single(registry.buoyancy, particle);
+}
+
+void force_registry_clear(ForceRegistry& registry)
+{
+    registry.gravity.clear();
+    registry.drag.clear();
+    registry.springs.clear();
+    registry.anchored_springs.clear();
+    registry.bungees.clear();
+    registry.buoyancy.clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+
+/*
+    Force generators.
+    Instead of a list of generator objects with a virtual update each, every kind of generator gets its own array
+    and force_registry_apply runs one tight loop per kind. Each entry references particles by handle so they survive
+    particles getting shuffled around inside the world.
+
+    Forces get summed into ParticleWorld::force and turned into acceleration (a = f * mass_inv) during the step,
+    so particles with mass_inv = 0 (infinite mass) are not affected by any of these.
+*/
+
+// f = g * m
+// Note this is the same thing as setting the particle's acceleration to g, so don't do both.
+struct GravityForce
+{
+    ParticleHandle particle;
+    glm::vec3 gravity = glm::vec3(0.0, -grav, 0.0);
+};
+
+// f = -normalize(v) * (k1 * |v| + k2 * |v|^2)
+struct DragForce
+{
+    ParticleHandle particle;
+    float k1 = 0.0;     // linear coefficient
+    float k2 = 0.0;     // quadratic coefficient
+};
+
+// Hooke's law between two particles, applied to both ends
+struct SpringForce
+{
+    ParticleHandle a;
+    ParticleHandle b;
+    float stiffness = 1.0;
+    float rest_length = 1.0;
+};
+
+// Spring with one end nailed to a point in the world
+struct AnchoredSpringForce
+{
+    ParticleHandle particle;
+    glm::vec3 anchor = glm::vec3(0.0);
+    float stiffness = 1.0;
+    float rest_length = 1.0;
+};
+
+// Spring that only pulls (like a rubber band). Does nothing when compressed.
+struct BungeeForce
+{
+    ParticleHandle a;
+    ParticleHandle b;
+    float stiffness = 1.0;
+    float rest_length = 1.0;
+};
+
+// Buoyancy against a flat liquid surface at y = liquid_height.
+// The particle is treated as a volume that is fully submerged max_depth below its position
+// and fully out max_depth above it, with a linear ramp in between.
+struct BuoyancyForce
+{
+    ParticleHandle particle;
+    float max_depth = 0.5;
+    float volume = 1.0;
+    float liquid_height = 0.0;
+    float liquid_density = 1000.0;
+};
+
+struct ForceRegistry
+{
+    std::vector<GravityForce> gravity;
+    std::vector<DragForce> drag;
+    std::vector<SpringForce> springs;
+    std::vector<AnchoredSpringForce> anchored_springs;
+    std::vector<BungeeForce> bungees;
+    std::vector<BuoyancyForce> buoyancy;
+};
+
+// Sums every generator's force into world.force
+void force_registry_apply(const ForceRegistry& registry, ParticleWorld& world);
+
+// Drops every generator that references the particle. Call this when removing a particle since handles get reused.
+void force_registry_remove(ForceRegistry& registry, ParticleHandle particle);
+
+void force_registry_clear(ForceRegistry& registry);
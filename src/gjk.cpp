@@ -0,0 +1,460 @@
+#include "gjk.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#define GJK_MAX_ITERATIONS 32
+#define EPA_MAX_ITERATIONS 64
+#define EPA_TOLERANCE 1e-4f
+
+struct SimplexVertex
+{
+    glm::vec3 a;        // Support point on A
+    glm::vec3 b;        // Support point on B
+    glm::vec3 w;        // a - b
+    float weight;       // Barycentric weight of this vertex in the closest point
+};
+
+struct Simplex
+{
+    SimplexVertex v[4];
+    int count = 0;
+};
+
+static SimplexVertex support(const ConvexProxy& a, const ConvexProxy& b, const glm::vec3& dir, GjkCache& cache, bool with_radius)
+{
+    SimplexVertex sv;
+    sv.a = shape_support_world(*a.shape, a.position, a.orientation, dir, cache.hint_a);
+    sv.b = shape_support_world(*b.shape, b.position, b.orientation, -dir, cache.hint_b);
+
+    if(with_radius)
+    {
+        float len = glm::length(dir);
+        if(len > 0.0f)
+        {
+            glm::vec3 n = dir / len;
+            sv.a += n * a.shape->radius;
+            sv.b -= n * b.shape->radius;
+        }
+    }
+
+    sv.w = sv.a - sv.b;
+    sv.weight = 1.0;
+    return sv;
+}
+
+static glm::vec3 simplex_closest(const Simplex& s)
+{
+    glm::vec3 p(0.0);
+    for(int i = 0; i < s.count; i++) p += s.v[i].w * s.v[i].weight;
+    return p;
+}
+
+static void simplex_points(const Simplex& s, glm::vec3& pa, glm::vec3& pb)
+{
+    pa = glm::vec3(0.0);
+    pb = glm::vec3(0.0);
+    for(int i = 0; i < s.count; i++)
+    {
+        pa += s.v[i].a * s.v[i].weight;
+        pb += s.v[i].b * s.v[i].weight;
+    }
+}
+
+static void keep_one(Simplex& s, int i)
+{
+    s.v[0] = s.v[i];
+    s.v[0].weight = 1.0;
+    s.count = 1;
+}
+
+static void keep_two(Simplex& s, int i, int j, float t)
+{
+    SimplexVertex a = s.v[i];
+    SimplexVertex b = s.v[j];
+    s.v[0] = a;
+    s.v[1] = b;
+    s.v[0].weight = 1.0f - t;
+    s.v[1].weight = t;
+    s.count = 2;
+}
+
+static void solve_segment(Simplex& s)
+{
+    glm::vec3 a = s.v[0].w;
+    glm::vec3 ab = s.v[1].w - a;
+    float len2 = glm::dot(ab, ab);
+    float t = len2 > 0.0f ? glm::dot(-a, ab) / len2 : 0.0f;
+
+    if(t <= 0.0f) keep_one(s, 0);
+    else if(t >= 1.0f) keep_one(s, 1);
+    else keep_two(s, 0, 1, t);
+}
+
+// Closest point on triangle v[i], v[j], v[k] to the origin by Voronoi region (Ericson, Real-Time Collision Detection 5.1.5).
+// The simplex gets reduced to just the vertices whose region the origin is in.
+static void solve_triangle(Simplex& s, int i, int j, int k)
+{
+    glm::vec3 a = s.v[i].w, b = s.v[j].w, c = s.v[k].w;
+    glm::vec3 ab = b - a, ac = c - a;
+
+    float d1 = glm::dot(ab, -a);
+    float d2 = glm::dot(ac, -a);
+    if(d1 <= 0.0f && d2 <= 0.0f) { keep_one(s, i); return; }
+
+    float d3 = glm::dot(ab, -b);
+    float d4 = glm::dot(ac, -b);
+    if(d3 >= 0.0f && d4 <= d3) { keep_one(s, j); return; }
+
+    float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) { keep_two(s, i, j, d1 / (d1 - d3)); return; }
+
+    float d5 = glm::dot(ab, -c);
+    float d6 = glm::dot(ac, -c);
+    if(d6 >= 0.0f && d5 <= d6) { keep_one(s, k); return; }
+
+    float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) { keep_two(s, i, k, d2 / (d2 - d6)); return; }
+
+    float va = d3 * d6 - d5 * d4;
+    if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+    {
+        keep_two(s, j, k, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        return;
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    float v = vb * denom;
+    float w = vc * denom;
+    SimplexVertex va_ = s.v[i], vb_ = s.v[j], vc_ = s.v[k];
+    s.v[0] = va_; s.v[0].weight = 1.0f - v - w;
+    s.v[1] = vb_; s.v[1].weight = v;
+    s.v[2] = vc_; s.v[2].weight = w;
+    s.count = 3;
+}
+
+// True if the origin is on the other side of plane abc from d (or the tetrahedron is too flat to tell)
+static bool origin_outside(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+{
+    glm::vec3 n = glm::cross(b - a, c - a);
+    float side_d = glm::dot(d - a, n);
+    if(side_d * side_d < 1e-12f * glm::dot(n, n)) return true;
+    return glm::dot(-a, n) * side_d < 0.0f;
+}
+
+// Returns true if the origin is inside the tetrahedron, otherwise reduces to the closest face / edge / vertex
+static bool solve_tetrahedron(Simplex& s)
+{
+    static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+
+    bool any_outside = false;
+    float best = FLT_MAX;
+    Simplex best_simplex;
+    for(const int* f : faces)
+    {
+        if(!origin_outside(s.v[f[0]].w, s.v[f[1]].w, s.v[f[2]].w, s.v[f[3]].w)) continue;
+        any_outside = true;
+
+        Simplex candidate = s;
+        solve_triangle(candidate, f[0], f[1], f[2]);
+        glm::vec3 p = simplex_closest(candidate);
+        float dist = glm::dot(p, p);
+        if(dist < best)
+        {
+            best = dist;
+            best_simplex = candidate;
+        }
+    }
+
+    if(!any_outside) return true;
+    s = best_simplex;
+    return false;
+}
+
+static GjkResult run_gjk(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, float max_distance, Simplex& s)
+{
+    GjkResult result;
+
+    glm::vec3 dir = cache.axis != glm::vec3(0.0) ? -cache.axis : b.position - a.position;
+    if(glm::dot(dir, dir) < 1e-12f) dir = glm::vec3(1.0, 0.0, 0.0);
+
+    s.count = 1;
+    s.v[0] = support(a, b, dir, cache, false);
+
+    // |v| only ever goes down in exact maths. Once rounding makes it stop doing that GJK starts cycling between the
+    // same few simplices, so it stops there with the closest one it found.
+    Simplex best;
+    float best_vv = FLT_MAX;
+
+    for(uint32_t it = 0; it < GJK_MAX_ITERATIONS; it++)
+    {
+        result.iterations = it + 1;
+
+        switch(s.count)
+        {
+            case 2: solve_segment(s); break;
+            case 3: solve_triangle(s, 0, 1, 2); break;
+            case 4:
+                if(solve_tetrahedron(s))
+                {
+                    result.overlap = true;
+                    cache.axis = glm::vec3(0.0);
+                    return result;
+                }
+                break;
+        }
+
+        glm::vec3 v = simplex_closest(s);
+        float vv = glm::dot(v, v);
+        if(vv < 1e-10f)
+        {
+            result.overlap = true;
+            cache.axis = glm::vec3(0.0);
+            return result;
+        }
+
+        if(vv >= best_vv)
+        {
+            s = best;
+            break;
+        }
+        best = s;
+        best_vv = vv;
+
+        SimplexVertex next = support(a, b, -v, cache, false);
+        float v_dot_w = glm::dot(v, next.w);
+
+        // Everything in A - B is at least this far along v, so if that's already past max_distance they can't be closer
+        float lower_bound = v_dot_w / sqrtf(vv);
+        if(lower_bound > max_distance)
+        {
+            cache.axis = v;
+            result.distance = lower_bound;
+            simplex_points(s, result.point_a, result.point_b);
+            return result;
+        }
+
+        // No real progress towards the origin, v is as close as it gets
+        bool duplicate = false;
+        for(int i = 0; i < s.count; i++) duplicate |= s.v[i].w == next.w;
+        if(duplicate || vv - v_dot_w <= 1e-6f * vv)
+        {
+            break;
+        }
+
+        s.v[s.count++] = next;
+    }
+
+    glm::vec3 v = simplex_closest(s);
+    cache.axis = v;
+    result.distance = glm::length(v);
+    simplex_points(s, result.point_a, result.point_b);
+    return result;
+}
+
+GjkResult gjk_distance(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, float max_distance)
+{
+    Simplex s;
+    return run_gjk(a, b, cache, max_distance, s);
+}
+
+struct EpaFace
+{
+    uint32_t v[3];
+    glm::vec3 normal;
+    float dist;
+};
+
+static bool make_face(const std::vector<SimplexVertex>& verts, uint32_t i, uint32_t j, uint32_t k, EpaFace& face)
+{
+    glm::vec3 n = glm::cross(verts[j].w - verts[i].w, verts[k].w - verts[i].w);
+    float len = glm::length(n);
+    if(len < 1e-12f) return false;
+
+    face.v[0] = i; face.v[1] = j; face.v[2] = k;
+    face.normal = n / len;
+    face.dist = glm::dot(face.normal, verts[i].w);
+    return true;
+}
+
+// Grows a 1-3 point simplex into a tetrahedron by searching in directions that add volume
+static bool blow_up_simplex(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, Simplex& s)
+{
+    const glm::vec3 axes[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+    if(s.count == 1)
+    {
+        for(const glm::vec3& d : axes)
+        {
+            SimplexVertex sv = support(a, b, d, cache, true);
+            if(glm::length(sv.w - s.v[0].w) > 1e-5f) { s.v[s.count++] = sv; break; }
+        }
+        if(s.count < 2) return false;
+    }
+
+    if(s.count == 2)
+    {
+        glm::vec3 line = glm::normalize(s.v[1].w - s.v[0].w);
+        glm::vec3 smallest = fabsf(line.x) < fabsf(line.y) ? (fabsf(line.x) < fabsf(line.z) ? axes[0] : axes[4])
+                                                             : (fabsf(line.y) < fabsf(line.z) ? axes[2] : axes[4]);
+        glm::vec3 perp = glm::normalize(glm::cross(line, smallest));
+
+        // Spin the search direction around the segment until something sticks out of the line
+        glm::quat turn = glm::angleAxis(glm::radians(60.0f), line);
+        for(int i = 0; i < 6; i++)
+        {
+            SimplexVertex sv = support(a, b, perp, cache, true);
+            glm::vec3 off = sv.w - s.v[0].w;
+            if(glm::length(off - line * glm::dot(off, line)) > 1e-5f) { s.v[s.count++] = sv; break; }
+            perp = turn * perp;
+        }
+        if(s.count < 3) return false;
+    }
+
+    if(s.count == 3)
+    {
+        glm::vec3 n = glm::cross(s.v[1].w - s.v[0].w, s.v[2].w - s.v[0].w);
+        if(glm::dot(n, n) < 1e-12f) return false;
+        n = glm::normalize(n);
+
+        SimplexVertex sv = support(a, b, n, cache, true);
+        if(fabsf(glm::dot(sv.w - s.v[0].w, n)) < 1e-5f) sv = support(a, b, -n, cache, true);
+        if(fabsf(glm::dot(sv.w - s.v[0].w, n)) < 1e-5f) return false;
+        s.v[s.count++] = sv;
+    }
+
+    return true;
+}
+
+// Penetration of the full (core + radius) shapes starting from the simplex GJK finished with
+static bool run_epa(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, Simplex& s, ConvexContact& contact)
+{
+    if(s.count < 4 && !blow_up_simplex(a, b, cache, s)) return false;
+
+    std::vector<SimplexVertex> verts(s.v, s.v + 4);
+    std::vector<EpaFace> faces;
+    faces.reserve(64);
+
+    // Wind the starting tetrahedron so every face normal points away from its center
+    glm::vec3 center = (verts[0].w + verts[1].w + verts[2].w + verts[3].w) * 0.25f;
+    static const uint32_t tetra[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 3, 2 } };
+    for(const uint32_t* t : tetra)
+    {
+        EpaFace face;
+        if(!make_face(verts, t[0], t[1], t[2], face)) return false;
+        if(glm::dot(face.normal, verts[t[0]].w - center) < 0.0f)
+        {
+            if(!make_face(verts, t[0], t[2], t[1], face)) return false;
+        }
+        faces.push_back(face);
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> horizon;
+    size_t closest = 0;
+    for(uint32_t it = 0; it < EPA_MAX_ITERATIONS; it++)
+    {
+        closest = 0;
+        for(size_t f = 1; f < faces.size(); f++)
+        {
+            if(faces[f].dist < faces[closest].dist) closest = f;
+        }
+
+        EpaFace face = faces[closest];
+        SimplexVertex sv = support(a, b, face.normal, cache, true);
+        if(glm::dot(sv.w, face.normal) - face.dist < EPA_TOLERANCE) break;
+
+        // Remove everything the new point can see, the edges that only belonged to one removed face form the horizon
+        uint32_t index = (uint32_t)verts.size();
+        verts.push_back(sv);
+        horizon.clear();
+        for(size_t f = 0; f < faces.size();)
+        {
+            if(glm::dot(faces[f].normal, sv.w - verts[faces[f].v[0]].w) <= 0.0f) { f++; continue; }
+
+            for(int e = 0; e < 3; e++)
+            {
+                std::pair<uint32_t, uint32_t> edge(faces[f].v[e], faces[f].v[(e + 1) % 3]);
+                auto twin = std::find(horizon.begin(), horizon.end(), std::make_pair(edge.second, edge.first));
+                if(twin != horizon.end()) horizon.erase(twin);
+                else horizon.push_back(edge);
+            }
+
+            faces[f] = faces.back();
+            faces.pop_back();
+        }
+
+        for(const auto& edge : horizon)
+        {
+            EpaFace new_face;
+            if(make_face(verts, edge.first, edge.second, index, new_face)) faces.push_back(new_face);
+        }
+
+        if(faces.empty()) return false;
+        closest = 0;
+    }
+
+    // Recompute in case the last iteration hit the cap
+    for(size_t f = 1; f < faces.size(); f++)
+    {
+        if(faces[f].dist < faces[closest].dist) closest = f;
+    }
+    const EpaFace& face = faces[closest];
+
+    // Barycentric coordinates of the origin's projection onto the face give the points on A and B
+    const SimplexVertex& v0 = verts[face.v[0]];
+    const SimplexVertex& v1 = verts[face.v[1]];
+    const SimplexVertex& v2 = verts[face.v[2]];
+    glm::vec3 p = face.normal * face.dist;
+    glm::vec3 e0 = v1.w - v0.w, e1 = v2.w - v0.w, e2 = p - v0.w;
+    float d00 = glm::dot(e0, e0), d01 = glm::dot(e0, e1), d11 = glm::dot(e1, e1);
+    float d20 = glm::dot(e2, e0), d21 = glm::dot(e2, e1);
+    float denom = d00 * d11 - d01 * d01;
+    float u = 1.0f, v = 0.0f, w = 0.0f;
+    if(fabsf(denom) > 1e-12f)
+    {
+        v = (d11 * d20 - d01 * d21) / denom;
+        w = (d00 * d21 - d01 * d20) / denom;
+        u = 1.0f - v - w;
+    }
+
+    glm::vec3 pa = v0.a * u + v1.a * v + v2.a * w;
+    glm::vec3 pb = v0.b * u + v1.b * v + v2.b * w;
+
+    contact.normal = face.normal;
+    contact.penetration = face.dist;
+    contact.point = (pa + pb) * 0.5f;
+    cache.axis = -face.normal;
+    return true;
+}
+
+bool gjk_collide(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, ConvexContact& contact, float margin)
+{
+    float radii = a.shape->radius + b.shape->radius;
+
+    Simplex s;
+    GjkResult result = run_gjk(a, b, cache, radii + margin, s);
+
+    if(!result.overlap)
+    {
+        if(result.distance > radii + margin) return false;
+
+        // Cores are apart, the closest points pushed out by the radii are the contact
+        glm::vec3 n = result.distance > 1e-6f ? (result.point_b - result.point_a) / result.distance : glm::vec3(0.0, 1.0, 0.0);
+        glm::vec3 surface_a = result.point_a + n * a.shape->radius;
+        glm::vec3 surface_b = result.point_b - n * b.shape->radius;
+        contact.normal = n;
+        contact.penetration = radii - result.distance;
+        contact.point = (surface_a + surface_b) * 0.5f;
+        return true;
+    }
+
+    if(run_epa(a, b, cache, s, contact)) return true;
+
+    // Degenerate overlap (flat shapes exactly touching), fall back to pushing apart along the centers
+    glm::vec3 d = b.position - a.position;
+    float len = glm::length(d);
+    contact.normal = len > 1e-6f ? d / len : glm::vec3(0.0, 1.0, 0.0);
+    contact.penetration = 0.0;
+    contact.point = (a.position + b.position) * 0.5f;
+    return true;
+}
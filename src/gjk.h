@@ -0,0 +1,55 @@
+#pragma once
+#include <cfloat>
+#include "shapes.h"
+
+/*
+    GJK + EPA between any two ConvexShapes.
+
+    GJK walks a simplex (up to a tetrahedron) of points on the Minkowski difference A - B towards the origin.
+    If it gets there the cores overlap, otherwise it ends with the closest points between the two cores and the distance.
+    The radii are added back on after that, so rounded shapes (spheres, capsules) only need EPA once their cores overlap.
+
+    EPA takes over from GJK's final simplex when the cores overlap and grows it into a polytope until the face closest
+    to the origin is on the surface of A - B, that face's normal and distance are the contact normal and depth.
+
+    GjkCache holds what last frame's query ended with for a pair: the axis it converged on and where hill climbing on
+    each hull stopped. The first support query along the old axis usually proves the pair is still apart on its own
+    (early out without running GJK at all), and if not GJK starts from the old direction instead of from scratch.
+*/
+
+struct ConvexProxy
+{
+    const ConvexShape* shape;
+    glm::vec3 position;
+    glm::quat orientation;
+};
+
+struct GjkCache
+{
+    glm::vec3 axis = glm::vec3(0.0);    // Closest point of A - B last time, 0 = nothing cached
+    uint32_t hint_a = 0;                // Hull vertices the support functions climbed to
+    uint32_t hint_b = 0;
+};
+
+struct GjkResult
+{
+    bool overlap = false;       // Cores overlap, distance and the points are meaningless
+    float distance = 0.0;       // Between the cores
+    glm::vec3 point_a = glm::vec3(0.0);
+    glm::vec3 point_b = glm::vec3(0.0);
+    uint32_t iterations = 0;
+};
+
+struct ConvexContact
+{
+    glm::vec3 normal;       // From A to B
+    glm::vec3 point;        // Halfway between the two surfaces
+    float penetration;      // > 0 when overlapping, negative is the gap
+};
+
+// Distance between the cores of a and b. Stops early once the pair is proven to be further apart than max_distance.
+GjkResult gjk_distance(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, float max_distance = FLT_MAX);
+
+// Full contact query including radii. Returns false if the shapes are more than margin apart, otherwise fills contact
+// (penetration goes negative down to -margin for shapes that are close but not touching).
+bool gjk_collide(const ConvexProxy& a, const ConvexProxy& b, GjkCache& cache, ConvexContact& contact, float margin = 0.0);
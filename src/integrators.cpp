@@ -0,0 +1,296 @@
+#include "integrators.h"
+#include "physics_simd.h"
+#include "forces.h"
+#include <cmath>
+#include <algorithm>
+
+// The loops below only ever look at one component at a time so they get run once for x, y and z.
+// Grouping the pointers up like this keeps the call sites from being a wall of .x.data()
+struct Axis
+{
+    float* p;
+    float* v;
+    const float* a;
+    float* f;
+    const float* m;
+    const float* drag;
+};
+
+static Axis axis(ParticleWorld& world, int i)
+{
+    Axis ax{};
+    ax.m = world.mass_inv.data();
+    ax.drag = world.drag.data();
+    switch(i)
+    {
+        case 0:
+            ax.p = world.position.x.data(); ax.v = world.velocity.x.data();
+            ax.a = world.acceleration.x.data(); ax.f = world.force.x.data();
+            break;
+        case 1:
+            ax.p = world.position.y.data(); ax.v = world.velocity.y.data();
+            ax.a = world.acceleration.y.data(); ax.f = world.force.y.data();
+            break;
+        default:
+            ax.p = world.position.z.data(); ax.v = world.velocity.z.data();
+            ax.a = world.acceleration.z.data(); ax.f = world.force.z.data();
+            break;
+    }
+    return ax;
+}
+
+static FloatArray& component(Vec3Array& arr, int i)
+{
+    return i == 0 ? arr.x : (i == 1 ? arr.y : arr.z);
+}
+
+static void resize(Vec3Array& arr, size_t count)
+{
+    arr.x.resize(count);
+    arr.y.resize(count);
+    arr.z.resize(count);
+}
+
+static void clear_forces(ParticleWorld& world, size_t begin, size_t end)
+{
+    std::fill(world.force.x.begin() + begin, world.force.x.begin() + end, 0.0f);
+    std::fill(world.force.y.begin() + begin, world.force.y.begin() + end, 0.0f);
+    std::fill(world.force.z.begin() + begin, world.force.z.begin() + end, 0.0f);
+}
+
+// Moves whatever was accumulated between steps out of the way so every stage can start from it
+static void snapshot_external_forces(ParticleWorld& world)
+{
+    resize(world.scratch.external_force, phys_world_count(world));
+    std::swap(world.force, world.scratch.external_force);
+}
+
+// force = external forces + generators evaluated at the world's current positions and velocities
+static void evaluate_forces(ParticleWorld& world)
+{
+    phys_for_each_chunk(world, [&world](size_t begin, size_t end) {
+        for(int c = 0; c < 3; c++)
+        {
+            const FloatArray& ext = component(world.scratch.external_force, c);
+            std::copy(ext.begin() + begin, ext.begin() + end, component(world.force, c).begin() + begin);
+        }
+    });
+
+    if(world.forces)
+    {
+        force_registry_apply(*world.forces, world);
+    }
+}
+
+void phys_world_prepare_step(ParticleWorld& world, float delta)
+{
+    if(delta == world.drag_delta) return;
+
+    world.drag_delta = delta;
+    phys_for_each_chunk(world, [&world, delta](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            world.drag[i] = powf(world.damping[i], delta);
+        }
+    });
+}
+
+const char* phys_integrator_name(Integrator integrator)
+{
+    switch(integrator)
+    {
+        case INTEGRATOR_EXPLICIT_EULER: return "explicit euler";
+        case INTEGRATOR_SYMPLECTIC_EULER: return "symplectic euler";
+        case INTEGRATOR_VELOCITY_VERLET: return "velocity verlet";
+        case INTEGRATOR_POSITION_VERLET: return "position verlet";
+        case INTEGRATOR_RK4: return "rk4";
+    }
+    return "unknown";
+}
+
+// Both Eulers only need one force evaluation at the start so they go straight through the simd kernel
+template <bool SYMPLECTIC>
+static void euler_step(ParticleWorld& world, float delta)
+{
+    if(world.forces)
+    {
+        force_registry_apply(*world.forces, world);
+    }
+
+    phys_for_each_chunk(world, [&world, delta](size_t begin, size_t end) {
+        ParticleKernelArgs args{};
+        args.px = world.position.x.data() + begin;
+        args.py = world.position.y.data() + begin;
+        args.pz = world.position.z.data() + begin;
+        args.vx = world.velocity.x.data() + begin;
+        args.vy = world.velocity.y.data() + begin;
+        args.vz = world.velocity.z.data() + begin;
+        args.ax = world.acceleration.x.data() + begin;
+        args.ay = world.acceleration.y.data() + begin;
+        args.az = world.acceleration.z.data() + begin;
+        args.fx = world.force.x.data() + begin;
+        args.fy = world.force.y.data() + begin;
+        args.fz = world.force.z.data() + begin;
+        args.mass_inv = world.mass_inv.data() + begin;
+        args.drag = world.drag.data() + begin;
+        args.count = end - begin;
+        args.symplectic = SYMPLECTIC;
+
+        simd_integrate(args, delta);
+        clear_forces(world, begin, end);
+    });
+}
+
+void ExplicitEuler::step(ParticleWorld& world, float delta)
+{
+    euler_step<false>(world, delta);
+}
+
+void SymplecticEuler::step(ParticleWorld& world, float delta)
+{
+    euler_step<true>(world, delta);
+}
+
+void VelocityVerlet::step(ParticleWorld& world, float delta)
+{
+    float half = delta * 0.5f;
+    snapshot_external_forces(world);
+
+    // Kick half a step with the forces at the start, then drift the whole step
+    evaluate_forces(world);
+    phys_for_each_chunk(world, [&world, delta, half](size_t begin, size_t end) {
+        for(int c = 0; c < 3; c++)
+        {
+            Axis ax = axis(world, c);
+            for(size_t i = begin; i < end; i++)
+            {
+                ax.v[i] += (ax.a[i] + ax.f[i] * ax.m[i]) * half;
+                ax.p[i] += ax.v[i] * delta;
+            }
+        }
+    });
+
+    // Second half kick with the forces at the new positions
+    evaluate_forces(world);
+    phys_for_each_chunk(world, [&world, half](size_t begin, size_t end) {
+        for(int c = 0; c < 3; c++)
+        {
+            Axis ax = axis(world, c);
+            for(size_t i = begin; i < end; i++)
+            {
+                ax.v[i] = (ax.v[i] + (ax.a[i] + ax.f[i] * ax.m[i]) * half) * ax.drag[i];
+            }
+        }
+        clear_forces(world, begin, end);
+    });
+}
+
+void PositionVerlet::step(ParticleWorld& world, float delta)
+{
+    float half = delta * 0.5f;
+
+    // Drift half a step
+    phys_for_each_chunk(world, [&world, half](size_t begin, size_t end) {
+        for(int c = 0; c < 3; c++)
+        {
+            Axis ax = axis(world, c);
+            for(size_t i = begin; i < end; i++)
+            {
+                ax.p[i] += ax.v[i] * half;
+            }
+        }
+    });
+
+    // Only one force evaluation so the external forces can just stay in the accumulator
+    if(world.forces)
+    {
+        force_registry_apply(*world.forces, world);
+    }
+
+    // Kick a whole step at the midpoint, drift the rest of the way
+    phys_for_each_chunk(world, [&world, delta, half](size_t begin, size_t end) {
+        for(int c = 0; c < 3; c++)
+        {
+            Axis ax = axis(world, c);
+            for(size_t i = begin; i < end; i++)
+            {
+                ax.v[i] = (ax.v[i] + (ax.a[i] + ax.f[i] * ax.m[i]) * delta) * ax.drag[i];
+                ax.p[i] += ax.v[i] * half;
+            }
+        }
+        clear_forces(world, begin, end);
+    });
+}
+
+// Classic RK4 on x' = v, v' = a(x, v).
+// After evaluating stage k at the world's current state it gets added to the weighted sums
+// and the world is moved to the state stage k + 1 is evaluated at.
+template <int STAGE>
+static void rk4_stage(ParticleWorld& world, float delta)
+{
+    static const float weights[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+    static const float offsets[4] = { 0.5f, 0.5f, 1.0f, 0.0f };
+    const float weight = weights[STAGE];
+    const float offset = offsets[STAGE] * delta;
+    const float sixth = delta / 6.0f;
+
+    evaluate_forces(world);
+    phys_for_each_chunk(world, [&world, weight, offset, sixth](size_t begin, size_t end) {
+        IntegratorScratch& scratch = world.scratch;
+        for(int c = 0; c < 3; c++)
+        {
+            Axis ax = axis(world, c);
+            float* x0 = component(scratch.start_position, c).data();
+            float* v0 = component(scratch.start_velocity, c).data();
+            float* sum_x = component(scratch.sum_position, c).data();
+            float* sum_v = component(scratch.sum_velocity, c).data();
+
+            for(size_t i = begin; i < end; i++)
+            {
+                float dv = ax.a[i] + ax.f[i] * ax.m[i];
+                float dx = ax.v[i];
+
+                if(STAGE == 0)
+                {
+                    x0[i] = ax.p[i];
+                    v0[i] = ax.v[i];
+                    sum_x[i] = dx;
+                    sum_v[i] = dv;
+                }
+                else
+                {
+                    sum_x[i] += weight * dx;
+                    sum_v[i] += weight * dv;
+                }
+
+                if(STAGE < 3)
+                {
+                    ax.p[i] = x0[i] + dx * offset;
+                    ax.v[i] = v0[i] + dv * offset;
+                }
+                else
+                {
+                    ax.p[i] = x0[i] + sum_x[i] * sixth;
+                    ax.v[i] = (v0[i] + sum_v[i] * sixth) * ax.drag[i];
+                }
+            }
+        }
+
+        if(STAGE == 3) clear_forces(world, begin, end);
+    });
+}
+
+void RK4::step(ParticleWorld& world, float delta)
+{
+    size_t count = phys_world_count(world);
+    resize(world.scratch.start_position, count);
+    resize(world.scratch.start_velocity, count);
+    resize(world.scratch.sum_position, count);
+    resize(world.scratch.sum_velocity, count);
+
+    snapshot_external_forces(world);
+    rk4_stage<0>(world, delta);
+    rk4_stage<1>(world, delta);
+    rk4_stage<2>(world, delta);
+    rk4_stage<3>(world, delta);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "physics.h"
+
+/*
+    The integration schemes a ParticleWorld can step with.
+    Each scheme is a struct with a static step function so phys_world_step_with<Scheme> picks the scheme at compile time
+    and every loop inside it is branch free. phys_world_step just switches on world.integrator once and calls into here.
+
+    All of them:
+        - treat a = acceleration + force * mass_inv
+        - re-run the force generators for every stage that needs a new force evaluation
+        - apply drag to the velocity once at the end of the step
+        - leave the force accumulator cleared
+*/
+
+struct ExplicitEuler { static void step(ParticleWorld& world, float delta); };
+struct SymplecticEuler { static void step(ParticleWorld& world, float delta); };
+struct VelocityVerlet { static void step(ParticleWorld& world, float delta); };
+struct PositionVerlet { static void step(ParticleWorld& world, float delta); };
+struct RK4 { static void step(ParticleWorld& world, float delta); };
+
+// Refreshes the cached damping^delta if delta changed since the last step
+void phys_world_prepare_step(ParticleWorld& world, float delta);
+
+template <typename Scheme>
+void phys_world_step_with(ParticleWorld& world, float delta)
+{
+    phys_world_prepare_step(world, delta);
+    Scheme::step(world, delta);
+}
+
+const char* phys_integrator_name(Integrator integrator);
+
+// Runs kernel(begin, end) over all of the world's particles, split into chunks across world.pool if it has one
+template <typename Kernel>
+void phys_for_each_chunk(ParticleWorld& world, const Kernel& kernel)
+{
+    phys_parallel_for(world.pool, phys_world_count(world), world.chunk_size, kernel);
+}
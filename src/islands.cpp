@@ -0,0 +1,218 @@
+#include "islands.h"
+#include <algorithm>
+
+static uint32_t find_root(IslandSet& islands, uint32_t i)
+{
+    // Path halving, every node on the way ends up pointing at its grandparent
+    while(islands.parent[i] != i)
+    {
+        islands.parent[i] = islands.parent[islands.parent[i]];
+        i = islands.parent[i];
+    }
+    return i;
+}
+
+static void unite(IslandSet& islands, uint32_t a, uint32_t b)
+{
+    a = find_root(islands, a);
+    b = find_root(islands, b);
+    if(a == b) return;
+
+    if(islands.rank[a] < islands.rank[b]) std::swap(a, b);
+    islands.parent[b] = a;
+    if(islands.rank[a] == islands.rank[b]) islands.rank[a]++;
+}
+
+// Sleeping bodies sit out of the island graph until something wakes them
+static inline bool is_dynamic(const RigidBodyWorld& world, uint32_t body)
+{
+    return body != CONTACT_WORLD && world.mass_inv[body] > 0.0f && world.awake[body];
+}
+
+void island_build(IslandSet& islands, const RigidBodyWorld& world, const ContactSet& contacts)
+{
+    uint32_t body_count = (uint32_t)rigid_count(world);
+    size_t count = contact_count(contacts);
+
+    islands.parent.resize(body_count);
+    islands.rank.assign(body_count, 0);
+    for(uint32_t i = 0; i < body_count; i++) islands.parent[i] = i;
+
+    for(size_t c = 0; c < count; c++)
+    {
+        uint32_t a = contacts.body_a[c];
+        uint32_t b = contacts.body_b[c];
+        if(is_dynamic(world, a) && is_dynamic(world, b)) unite(islands, a, b);
+    }
+
+    // Number the islands in order of their lowest body slot
+    islands.body_island.assign(body_count, ISLAND_NONE);
+    uint32_t island_total = 0;
+    for(uint32_t i = 0; i < body_count; i++)
+    {
+        if(!is_dynamic(world, i)) continue;
+
+        uint32_t root = find_root(islands, i);
+        if(islands.body_island[root] == ISLAND_NONE) islands.body_island[root] = island_total++;
+        islands.body_island[i] = islands.body_island[root];
+    }
+
+    // Counting sort the bodies by island
+    islands.body_start.assign(island_total + 1, 0);
+    for(uint32_t i = 0; i < body_count; i++)
+    {
+        if(islands.body_island[i] != ISLAND_NONE) islands.body_start[islands.body_island[i] + 1]++;
+    }
+    for(uint32_t i = 0; i < island_total; i++) islands.body_start[i + 1] += islands.body_start[i];
+
+    islands.bodies.resize(islands.body_start[island_total]);
+    std::vector<uint32_t> cursor(islands.body_start.begin(), islands.body_start.end() - 1);
+    for(uint32_t i = 0; i < body_count; i++)
+    {
+        if(islands.body_island[i] != ISLAND_NONE) islands.bodies[cursor[islands.body_island[i]]++] = i;
+    }
+
+    // Same for the contacts, each one goes with whichever of its bodies is dynamic
+    islands.contact_start.assign(island_total + 1, 0);
+    for(size_t c = 0; c < count; c++)
+    {
+        uint32_t a = contacts.body_a[c];
+        uint32_t body = is_dynamic(world, a) ? a : contacts.body_b[c];
+        if(is_dynamic(world, body)) islands.contact_start[islands.body_island[body] + 1]++;
+    }
+    for(uint32_t i = 0; i < island_total; i++) islands.contact_start[i + 1] += islands.contact_start[i];
+
+    islands.contacts.resize(islands.contact_start[island_total]);
+    cursor.assign(islands.contact_start.begin(), islands.contact_start.end() - 1);
+    for(size_t c = 0; c < count; c++)
+    {
+        uint32_t a = contacts.body_a[c];
+        uint32_t body = is_dynamic(world, a) ? a : contacts.body_b[c];
+        if(is_dynamic(world, body)) islands.contacts[cursor[islands.body_island[body]]++] = (uint32_t)c;
+    }
+}
+
+void island_schedule(IslandSet& islands, uint32_t bin_count)
+{
+    uint32_t total = island_count(islands);
+
+    std::vector<uint32_t> order;
+    for(uint32_t i = 0; i < total; i++)
+    {
+        if(islands.contact_start[i + 1] > islands.contact_start[i]) order.push_back(i);
+    }
+
+    bin_count = std::max(1u, std::min(bin_count, (uint32_t)order.size()));
+
+    // Biggest first, ties broken by island index so the packing is the same every run
+    auto cost = [&islands](uint32_t i) { return islands.contact_start[i + 1] - islands.contact_start[i]; };
+    std::sort(order.begin(), order.end(), [&cost](uint32_t a, uint32_t b) {
+        return cost(a) != cost(b) ? cost(a) > cost(b) : a < b;
+    });
+
+    // Greedy: every island goes into the bin with the least work so far. bin_count is the thread count so a linear scan is fine.
+    islands.bin_cost.assign(bin_count, 0);
+    std::vector<uint32_t> island_bin(order.size());
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        uint32_t best = 0;
+        for(uint32_t b = 1; b < bin_count; b++)
+        {
+            if(islands.bin_cost[b] < islands.bin_cost[best]) best = b;
+        }
+        islands.bin_cost[best] += cost(order[i]);
+        island_bin[i] = best;
+    }
+
+    islands.bin_start.assign(bin_count + 1, 0);
+    for(uint32_t bin : island_bin) islands.bin_start[bin + 1]++;
+    for(uint32_t b = 0; b < bin_count; b++) islands.bin_start[b + 1] += islands.bin_start[b];
+
+    islands.bin_islands.resize(order.size());
+    std::vector<uint32_t> cursor(islands.bin_start.begin(), islands.bin_start.end() - 1);
+    for(size_t i = 0; i < order.size(); i++) islands.bin_islands[cursor[island_bin[i]]++] = order[i];
+}
+
+static void solve_bins(IslandSet& islands, ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts,
+                       size_t begin, size_t end, float delta)
+{
+    for(size_t bin = begin; bin < end; bin++)
+    {
+        for(uint32_t i = islands.bin_start[bin]; i < islands.bin_start[bin + 1]; i++)
+        {
+            uint32_t island = islands.bin_islands[i];
+            uint32_t first = islands.contact_start[island];
+            uint32_t last = islands.contact_start[island + 1];
+            contact_solver_solve(solver, world, contacts, islands.contacts.data() + first, last - first, delta);
+        }
+    }
+}
+
+void island_solve(IslandSet& islands, ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, ThreadPool* pool, float delta)
+{
+    size_t bin_count = islands.bin_start.empty() ? 0 : islands.bin_start.size() - 1;
+
+    if(!pool || bin_count <= 1)
+    {
+        solve_bins(islands, solver, world, contacts, 0, bin_count, delta);
+        return;
+    }
+
+    // One bin per chunk, the bins are already balanced so there's nothing to gain from the cache line rounding in phys_parallel_for
+    pool->parallel_for(bin_count, 1, [&](size_t begin, size_t end) {
+        solve_bins(islands, solver, world, contacts, begin, end, delta);
+    });
+}
+
+void island_wake_touched(RigidBodyWorld& world, const ContactSet& contacts)
+{
+    size_t count = contact_count(contacts);
+    for(size_t c = 0; c < count; c++)
+    {
+        uint32_t a = contacts.body_a[c];
+        uint32_t b = contacts.body_b[c];
+        if(b == CONTACT_WORLD) continue;
+
+        if(is_dynamic(world, a) && !world.awake[b]) rigid_wake_slot(world, b);
+        else if(is_dynamic(world, b) && !world.awake[a]) rigid_wake_slot(world, a);
+    }
+}
+
+void island_update_sleep(IslandSet& islands, RigidBodyWorld& world)
+{
+    if(!world.allow_sleep) return;
+
+    uint32_t total = island_count(islands);
+    for(uint32_t island = 0; island < total; island++)
+    {
+        uint32_t first = islands.body_start[island];
+        uint32_t last = islands.body_start[island + 1];
+
+        // The island sleeps once its least rested body has been resting long enough
+        bool resting = true;
+        for(uint32_t i = first; i < last && resting; i++)
+        {
+            float timer = world.sleep_timer[islands.bodies[i]];
+            resting = timer >= 0.0f && timer >= world.time_to_sleep;
+        }
+
+        if(resting) rigid_sleep_slots(world, islands.bodies.data() + first, last - first);
+    }
+}
+
+void rigid_step_islands(IslandSet& islands, ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta)
+{
+    island_wake_touched(world, contacts);
+    rigid_integrate_velocities(world, delta);
+
+    contact_solver_begin(solver, world, contacts);
+    island_build(islands, world, contacts);
+    island_schedule(islands, world.pool ? world.pool->size() + 1 : 1);
+    island_solve(islands, solver, world, contacts, world.pool, delta);
+
+    rigid_integrate_positions(world, delta);
+    if(solver.split_impulse) contact_solver_apply_split(solver, world, delta);
+
+    contact_solver_store(solver, world, contacts);
+    island_update_sleep(islands, world);
+}
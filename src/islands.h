@@ -0,0 +1,67 @@
+#pragma once
+#include "contact_solver.h"
+
+/*
+    Simulation islands. Every step the contacts are treated as edges between bodies and a union-find over the body slots
+    groups everything that touches (directly or through other bodies) into one island. Static bodies and world geometry
+    don't join islands, otherwise the floor would glue every pile in the scene into one island.
+
+    Islands never share a dynamic body, so each one is an independent little solver problem and they can all run on
+    different threads at the same time without locks.
+
+    Islands get spread over the threads with longest-processing-time-first bin packing (biggest island goes to the
+    least loaded bin) so one huge pile gets a bin to itself while the small ones get shared out around it.
+
+    Islands are also the unit of sleeping: once every body in an island has been resting for world.time_to_sleep the
+    whole island goes to sleep together, and touching or pushing any of them wakes all of them. Sleeping bodies are
+    left out of the islands (and out of integration, pair finding and the solver) until then.
+
+    Everything is flat arrays grouped by island with a counting sort, same as the spatial hash.
+    Island numbers, and the order of bodies / contacts inside an island, only depend on slot order so the result doesn't
+    change with the thread count.
+*/
+
+#define ISLAND_NONE UINT32_MAX
+
+struct IslandSet
+{
+    // Union-find over body slots
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> rank;
+
+    std::vector<uint32_t> body_island;      // Island of every body slot, ISLAND_NONE for static bodies
+    std::vector<uint32_t> body_start;       // island_count + 1 offsets into bodies
+    std::vector<uint32_t> bodies;           // Body slots grouped by island
+    std::vector<uint32_t> contact_start;    // island_count + 1 offsets into contacts
+    std::vector<uint32_t> contacts;         // Contact indices grouped by island
+
+    // Built by island_schedule
+    std::vector<uint32_t> bin_start;        // bin_count + 1 offsets into bin_islands
+    std::vector<uint32_t> bin_islands;
+    std::vector<uint64_t> bin_cost;
+};
+
+inline uint32_t island_count(const IslandSet& islands)
+{
+    return islands.body_start.empty() ? 0 : (uint32_t)islands.body_start.size() - 1;
+}
+
+// Groups bodies and contacts into islands. Every awake dynamic body ends up in an island, even ones with no contacts.
+void island_build(IslandSet& islands, const RigidBodyWorld& world, const ContactSet& contacts);
+
+// Packs the islands that have contacts into at most bin_count bins, balancing the contact counts
+void island_schedule(IslandSet& islands, uint32_t bin_count);
+
+// Runs contact_solver_solve on every island, one bin per job across pool (or all on this thread without one).
+// contact_solver_begin has to be called first.
+void island_solve(IslandSet& islands, ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, ThreadPool* pool, float delta);
+
+// Wakes the sleeping side of every contact between an awake dynamic body and a sleeping one
+void island_wake_touched(RigidBodyWorld& world, const ContactSet& contacts);
+
+// Puts every island whose bodies have all been resting for world.time_to_sleep to sleep
+void island_update_sleep(IslandSet& islands, RigidBodyWorld& world);
+
+// contact_solver_step but with the contacts solved per island across world.pool
+// and sleeping handled per island
+void rigid_step_islands(IslandSet& islands, ContactSolver& solver, RigidBodyWorld& world, ContactSet& contacts, float delta);
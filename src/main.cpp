@@ -24,42 +24,19 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "mesh.h"
+#include "quickhull.h"
+#include "convex_decomp.h"
 #include "physics.h"
+#include "rigid_pipeline.h"
+#include "forces.h"
+#include "cloth.h"
+#include "physics_bench.h"
 #include "json.hpp"
 
 #define LOG_DEBUG(str) do { std::cout << str << std::endl; } while(0);
 
 double cam_radius = 5.0;
-struct Vertex
-{
-    glm::vec3 position;
-    glm::vec3 normal;
-    //glm::vec4 color;
-    glm::vec2 tex_coords;
-};
-
-enum TextureType
-{
-    DIFFUSE,
-    SPECULAR,
-    NORMAL
-};
-
-struct Texture
-{
-    uint32_t width, height, channels;
-    uint32_t id = UINT32_MAX;
-    std::string path;
-    TextureType type;
-};
-
-struct MeshGeometry
-{
-    uint32_t vert_arr, vert_buf, indx_buf;
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
-};
 
 struct BlinnPhongMaterial
 {
@@ -75,28 +52,14 @@ struct PBRMaterial
     // More stuff that is needed
 };
 
-// Note if it's laid out like this a model is essentially a collection of other models itself...
-// This allows you to do cool things like wrap a collection of models in a model itself and then just do a draw_model call on that one model 
-// to draw all of the models in that collection
-struct Model
-{
-    glm::mat4 world_matrix = glm::mat4(1.0);
-    std::vector<MeshGeometry> meshes;
-    std::vector<Model> children;
-    std::string path;
-    /*
-    std::vector<Vertex> vertices;   // Can probably throw this stuff out once we are done with it?
-    std::vector<unsigned int> indices;  // Can probably throw this out once we are done with it?
-    uint32_t vert_arr = UINT32_MAX, vert_buf = UINT32_MAX, indx_buf = UINT32_MAX;
-    */
-};
-
 const uint32_t WIN_WIDTH = 1920;
 const uint32_t WIN_HEIGHT = 1080;
 std::map<int, int> key_map;
 
 static void draw_model(glm::mat4& world_matrix, Model& m);
 static void load_model_gpu(Model& m);
+static void upload_mesh_vertices(const MeshGeometry& mesh);
+static MeshGeometry plane_geometry(uint32_t resolution, float size);
 static void load_scene(const std::string& path);
 static Texture load_texture(const std::string& path);
 static Model load_model(Assimp::Importer& importer, const std::string& path);
@@ -121,15 +84,45 @@ uint32_t model_loc;
 uint32_t transpose_inverse_model_loc;
 
 
-struct Transform
+int main(int argc, char** argv)
 {
-    glm::vec3 position;
-    glm::vec3 scale;
-    glm::quat rotation;
-};
+    if(argc > 1 && std::string(argv[1]) == "--bench-integrators")
+    {
+        uint32_t particle_count = argc > 2 ? (uint32_t)std::stoul(argv[2]) : 100000;
+        uint32_t steps = argc > 3 ? (uint32_t)std::stoul(argv[3]) : 600;
+        return phys_bench_integrators(particle_count, steps);
+    }
+
+    // Offline collision bake: hull caches and convex decompositions for every model given (or the lion by default),
+    // written next to the models so the sandbox itself only ever loads them
+    if(argc > 1 && std::string(argv[1]) == "--bake-collision")
+    {
+        std::vector<std::string> paths(argv + 2, argv + argc);
+        if(paths.empty()) paths.push_back("../assets/lion/Sig.gltf");
+
+        ThreadPool pool(4);
+        Assimp::Importer importer;
+        int failed = 0;
+        for(const std::string& path : paths)
+        {
+            Model model = load_model(importer, path);
+            if(model.path.empty())
+            {
+                failed++;
+                continue;
+            }
+
+            model_load_hulls(model, HullSettings());
+            if(!model_bake_decomposition(model, DecompSettings(), &pool))
+            {
+                failed++;
+                continue;
+            }
+            LOG_DEBUG("DEBUG: BAKED COLLISION <path: " + path + ".collision, pieces: " + std::to_string(model.pieces.size()) + ">");
+        }
+        return failed;
+    }
 
-int main()
-{
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
@@ -222,8 +215,6 @@ int main()
 
     glm::mat4 projection = glm::perspective(glm::radians(45.0), (double)WIN_WIDTH / (double)WIN_HEIGHT, 0.1, 100.0);
     glm::mat4 model = glm::mat4(1.0);
-    model = glm::scale(model, glm::vec3(0.5));
-    model = glm::translate(model, glm::vec3(2.0, 0.0, 0.0));
     previous_time = glfwGetTime();
 
     float delta_time = 0.0;
@@ -267,6 +258,13 @@ int main()
         importer_stack.push(importer);
         lock.unlock();
 
+        // Collision hulls come from the cache next to the model unless it's out of date
+        model_load_hulls(model, HullSettings());
+
+        // Convex pieces of concave models are baked offline (--bake-collision). Only loaded for now, no body in the scene
+        // is built from them (or from the hulls) yet.
+        model_load_decomposition(model, DecompSettings());
+
         std::unique_lock<std::mutex> model_lock(model_mutex);
         models_to_process.push(model);
         model_lock.unlock();
@@ -301,7 +299,46 @@ int main()
     transform.rotation = glm::angleAxis(0.0f, glm::vec3(0.0, 1.0, 0.0));
     glm::mat4 rotation = glm::toMat4(transform.rotation);
 
+    ParticleWorld particles;
+    ForceRegistry forces;
+    particles.forces = &forces;
+    particles.pool = &pool;
+
+    // Gravity comes from a generator now instead of the particle's constant acceleration
     PhysicsParticle particle;
+    particle.acceleration = glm::vec3(0.0);
+    particle.mass_inv = 1.0;
+    ParticleHandle particle_handle = phys_world_add(particles, particle);
+    forces.gravity.push_back({ particle_handle });
+    FixedStepper stepper;
+
+    // The cube is a rigid body now. No gravity for it yet since there's nothing for it to land on.
+    RigidBodyWorld bodies;
+    bodies.gravity = glm::vec3(0.0);
+    RigidBodyDesc cube_desc;
+    cube_desc.position = glm::vec3(1.0, 0.0, 0.0);
+    cube_desc.mass_inv = 1.0;
+    cube_desc.inertia_inv = rigid_box_inertia_inv(1.0, glm::vec3(0.25));
+    cube_desc.angular_velocity = glm::vec3(0.3, 1.0, 0.0);
+    BodyHandle cube = rigid_add(bodies, cube_desc);
+    FixedStepper body_stepper;
+
+    // Contacts and caches for the bodies, lives as long as the world does. No static geometry in the scene yet.
+    RigidPipeline body_pipeline;
+
+    // Flag hanging off its two top corners, flapping in the wind. Positions come back in world space every frame.
+    Model flag;
+    flag.meshes.push_back(plane_geometry(64, 2.0));
+    load_model_gpu(flag);
+    Cloth cloth;
+    ClothSettings cloth_settings;
+    cloth_settings.thickness = 2.0 / 63.0;
+    glm::mat4 flag_transform = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 1.5, -1.0));
+    flag_transform = glm::rotate(flag_transform, glm::radians(90.0f), glm::vec3(1.0, 0.0, 0.0));
+    cloth_from_geometry(cloth, flag.meshes[0], flag_transform, cloth_settings, &pool);
+    cloth_pin(cloth, 0);
+    cloth_pin(cloth, 63);
+    FixedStepper cloth_stepper;
 
     while(!glfwWindowShouldClose(window))
     {
@@ -368,7 +405,17 @@ int main()
 
         view = glm::lookAt(cam_pos, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0));
 
-        phys_integrate(particle, delta_time);
+        phys_world_update(particles, stepper, delta_time);
+        rigid_pipeline_update(body_pipeline, bodies, body_stepper, delta_time);
+
+        cloth.wind = glm::vec3(0.0, 0.0, 4.0 + 2.0 * sin(current_time));
+        cloth_update(cloth, cloth_stepper, delta_time);
+        cloth_write_vertices(cloth, flag.meshes[0], cloth_stepper.alpha);
+        upload_mesh_vertices(flag.meshes[0]);
+
+        Transform cube_transform = rigid_transform(bodies, cube, body_stepper.alpha);
+        cube_transform.scale = glm::vec3(0.5);
+        model = transform_matrix(cube_transform);
         
         // Render
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -400,6 +447,9 @@ int main()
             //glBindTexture(GL_TEXTURE_2D, marcus_aurelius_tex.id);
             draw_model(model2, loaded_model);
         }
+
+        glm::mat4 identity(1.0);
+        draw_model(identity, flag);
         glfwSwapBuffers(window);
     }
 
@@ -559,20 +609,42 @@ static void load_model_gpu(Model& m)
     }
 }
 
-static void calculate_aabb(std::vector<glm::vec3>& vertices)
+// Replaces the whole vertex buffer. Orphaning it first means the driver hands us fresh memory instead of waiting for
+// the GPU to finish drawing last frame's vertices.
+static void upload_mesh_vertices(const MeshGeometry& mesh)
+{
+    size_t size = mesh.vertices.size() * sizeof(Vertex);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vert_buf);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, mesh.vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// resolution x resolution grid of vertices in the xz plane, centered on the origin, facing up
+static MeshGeometry plane_geometry(uint32_t resolution, float size)
 {
-    glm::vec3 min = vertices[0];
-    glm::vec3 max = vertices[0];
-    for(glm::vec3& pos : vertices)
+    MeshGeometry mesh;
+    for(uint32_t z = 0; z < resolution; z++)
     {
-        if (pos.x < min.x) min.x = pos.x;
-        if (pos.y < min.y) min.y = pos.y;
-        if (pos.z < min.z) min.z = pos.z;
+        for(uint32_t x = 0; x < resolution; x++)
+        {
+            Vertex v;
+            v.tex_coords = glm::vec2(x, z) / (float)(resolution - 1);
+            v.position = glm::vec3(v.tex_coords.x - 0.5, 0.0, v.tex_coords.y - 0.5) * size;
+            v.normal = glm::vec3(0.0, 1.0, 0.0);
+            mesh.vertices.push_back(v);
+        }
+    }
 
-        if (pos.x > max.x) max.x = pos.x;
-        if (pos.y > max.y) max.y = pos.y;
-        if (pos.z > max.z) max.z = pos.z;
+    for(uint32_t z = 0; z + 1 < resolution; z++)
+    {
+        for(uint32_t x = 0; x + 1 < resolution; x++)
+        {
+            uint32_t i = z * resolution + x;
+            mesh.indices.insert(mesh.indices.end(), { i, i + resolution, i + 1, i + 1, i + resolution, i + resolution + 1 });
+        }
     }
+    return mesh;
 }
 
 static void load_scene(const std::string& path)
@@ -733,6 +805,7 @@ static Model load_model(Assimp::Importer& importer, const std::string& path)
     }
 
     Model model{};
+    model.path = path;
 
     std::string directory = path.substr(0, path.find_last_of('/'));
     process_node(model, scene->mRootNode, scene, directory);
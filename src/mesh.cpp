@@ -0,0 +1,15 @@
+#include "mesh.h"
+
+void model_triangles(const Model& model, const glm::mat4& parent, std::vector<glm::vec3>& out)
+{
+    glm::mat4 transform = parent * model.world_matrix;
+    for(const MeshGeometry& mesh : model.meshes)
+    {
+        for(unsigned int index : mesh.indices)
+        {
+            out.push_back(glm::vec3(transform * glm::vec4(mesh.vertices[index].position, 1.0)));
+        }
+    }
+
+    for(const Model& child : model.children) model_triangles(child, transform, out);
+}
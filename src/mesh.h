@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+    Geometry that comes out of the model loader. Lives in its own header so the collision code can build shapes
+    out of the same meshes the renderer draws.
+*/
+
+struct Vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    //glm::vec4 color;
+    glm::vec2 tex_coords;
+};
+
+enum TextureType
+{
+    DIFFUSE,
+    SPECULAR,
+    NORMAL
+};
+
+struct Texture
+{
+    uint32_t width, height, channels;
+    uint32_t id = UINT32_MAX;
+    std::string path;
+    TextureType type;
+};
+
+// Convex collision hull built from a mesh (see quickhull.h). Shapes only need the vertices, the faces are there for
+// debug drawing and anything that wants the planes.
+struct ConvexHull
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> adjacency_start;  // vertices.size() + 1 offsets into adjacency, empty = no adjacency
+    std::vector<uint32_t> adjacency;        // Neighbouring vertex indices
+    std::vector<uint32_t> face_start;       // Face count + 1 offsets into face_indices
+    std::vector<uint32_t> face_indices;     // Counter clockwise (seen from outside) polygon of every face
+    std::vector<glm::vec4> planes;          // Outward normal + offset, dot(normal, x) = offset on the face
+};
+
+struct MeshGeometry
+{
+    uint32_t vert_arr, vert_buf, indx_buf;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Texture> textures;
+};
+
+// Note if it's laid out like this a model is essentially a collection of other models itself...
+// This allows you to do cool things like wrap a collection of models in a model itself and then just do a draw_model call on that one model 
+// to draw all of the models in that collection
+struct Model
+{
+    glm::mat4 world_matrix = glm::mat4(1.0);
+    std::vector<MeshGeometry> meshes;
+    std::vector<Model> children;
+    std::vector<ConvexHull> hulls;      // Collision hulls in this node's space, one per mesh or one for the whole node
+    std::vector<ConvexHull> pieces;     // Convex decomposition of the whole model (see convex_decomp.h), root node only
+    std::string path;
+    /*
+    std::vector<Vertex> vertices;   // Can probably throw this stuff out once we are done with it?
+    std::vector<unsigned int> indices;  // Can probably throw this out once we are done with it?
+    uint32_t vert_arr = UINT32_MAX, vert_buf = UINT32_MAX, indx_buf = UINT32_MAX;
+    */
+};
+
+// Appends 3 corners per triangle for every mesh of the model and its children, moved by the world_matrix of every node
+// on the way down (the root's included)
+void model_triangles(const Model& model, const glm::mat4& parent, std::vector<glm::vec3>& out);
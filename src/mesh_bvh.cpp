@@ -0,0 +1,568 @@
+#include "mesh_bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#define BVH_SAH_DEPTH 48        // Past this splits go down the middle by count, which caps the depth
+#define BVH_PARALLEL_RANGE 4096 // Ranges bigger than this get their binning split over the pool
+
+struct BvhBin
+{
+    AABB box;
+    uint32_t count = 0;
+};
+
+struct BvhBuild
+{
+    const MeshCollider& mesh;
+    std::vector<AABB> boxes;            // Per original triangle
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> order;        // Triangles get partitioned in here, leaves end up as ranges of it
+};
+
+// Top of the tree, built before the subtrees exist
+struct BvhTopNode
+{
+    AABB box;
+    uint32_t left = UINT32_MAX;
+    uint32_t right = UINT32_MAX;
+    uint32_t task = UINT32_MAX;     // Subtree built separately
+    uint32_t begin, end;            // Leaf range if it's neither
+};
+
+struct BvhTask
+{
+    uint32_t begin, end, depth;
+    std::vector<BvhNode> nodes;
+};
+
+static inline AABB empty_box()
+{
+    return AABB{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+}
+
+static inline void grow(AABB& box, const AABB& other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+static inline float half_area(const AABB& box)
+{
+    glm::vec3 d = box.max - box.min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Node bounds and centroid bounds of a range, summed over chunks in order when there's a pool
+static void range_bounds(const BvhBuild& build, uint32_t begin, uint32_t end, ThreadPool* pool, AABB& box, AABB& centroid_box)
+{
+    size_t chunks = pool ? (end - begin + BVH_PARALLEL_RANGE - 1) / BVH_PARALLEL_RANGE : 1;
+    std::vector<AABB> boxes(chunks, empty_box()), centroid_boxes(chunks, empty_box());
+
+    auto kernel = [&](size_t first, size_t last) {
+        for(size_t c = first; c < last; c++)
+        {
+            uint32_t from = begin + (uint32_t)(chunks == 1 ? 0 : c * BVH_PARALLEL_RANGE);
+            uint32_t to = chunks == 1 ? end : std::min(end, from + BVH_PARALLEL_RANGE);
+            for(uint32_t i = from; i < to; i++)
+            {
+                uint32_t t = build.order[i];
+                grow(boxes[c], build.boxes[t]);
+                grow(centroid_boxes[c], AABB{ build.centroids[t], build.centroids[t] });
+            }
+        }
+    };
+    if(pool && chunks > 1) pool->parallel_for(chunks, 1, kernel);
+    else kernel(0, chunks);
+
+    box = empty_box();
+    centroid_box = empty_box();
+    for(size_t c = 0; c < chunks; c++)
+    {
+        grow(box, boxes[c]);
+        grow(centroid_box, centroid_boxes[c]);
+    }
+}
+
+static inline uint32_t bin_of(const glm::vec3& centroid, const AABB& centroid_box, int axis, uint32_t bin_count)
+{
+    float extent = centroid_box.max[axis] - centroid_box.min[axis];
+    int bin = (int)((centroid[axis] - centroid_box.min[axis]) / extent * bin_count);
+    return (uint32_t)std::min(std::max(bin, 0), (int)bin_count - 1);
+}
+
+// Picks where to cut [begin, end). Returns false if it should stay a leaf, otherwise partitions order and sets mid.
+static bool split_range(BvhBuild& build, uint32_t begin, uint32_t end, uint32_t depth, const AABB& box, const AABB& centroid_box,
+                        ThreadPool* pool, uint32_t& mid)
+{
+    uint32_t count = end - begin;
+    uint32_t bin_count = build.mesh.bin_count;
+    if(count <= 1) return false;
+
+    int best_axis = -1;
+    uint32_t best_bin = 0;
+    float best_cost = FLT_MAX;
+
+    if(depth < BVH_SAH_DEPTH)
+    {
+        // Bins for all three axes at once, one set per chunk so threads never share one
+        size_t chunks = pool ? (count + BVH_PARALLEL_RANGE - 1) / BVH_PARALLEL_RANGE : 1;
+        std::vector<BvhBin> bins(chunks * 3 * bin_count);
+        for(BvhBin& bin : bins) bin.box = empty_box();
+
+        auto kernel = [&](size_t first, size_t last) {
+            for(size_t c = first; c < last; c++)
+            {
+                uint32_t from = begin + (uint32_t)(chunks == 1 ? 0 : c * BVH_PARALLEL_RANGE);
+                uint32_t to = chunks == 1 ? end : std::min(end, from + BVH_PARALLEL_RANGE);
+                BvhBin* chunk_bins = &bins[c * 3 * bin_count];
+                for(uint32_t i = from; i < to; i++)
+                {
+                    uint32_t t = build.order[i];
+                    for(int axis = 0; axis < 3; axis++)
+                    {
+                        if(centroid_box.max[axis] <= centroid_box.min[axis]) continue;
+                        BvhBin& bin = chunk_bins[axis * bin_count + bin_of(build.centroids[t], centroid_box, axis, bin_count)];
+                        grow(bin.box, build.boxes[t]);
+                        bin.count++;
+                    }
+                }
+            }
+        };
+        if(pool && chunks > 1) pool->parallel_for(chunks, 1, kernel);
+        else kernel(0, chunks);
+
+        for(size_t c = 1; c < chunks; c++)
+        {
+            for(uint32_t b = 0; b < 3 * bin_count; b++)
+            {
+                grow(bins[b].box, bins[c * 3 * bin_count + b].box);
+                bins[b].count += bins[c * 3 * bin_count + b].count;
+            }
+        }
+
+        // Sweep from both ends, cost of cutting after bin b is area * count of each side
+        std::vector<float> right_cost(bin_count);
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(centroid_box.max[axis] <= centroid_box.min[axis]) continue;
+            const BvhBin* axis_bins = &bins[axis * bin_count];
+
+            AABB right = empty_box();
+            uint32_t right_count = 0;
+            for(uint32_t b = bin_count - 1; b > 0; b--)
+            {
+                grow(right, axis_bins[b].box);
+                right_count += axis_bins[b].count;
+                right_cost[b] = right_count ? half_area(right) * right_count : FLT_MAX;
+            }
+
+            AABB left = empty_box();
+            uint32_t left_count = 0;
+            for(uint32_t b = 0; b + 1 < bin_count; b++)
+            {
+                grow(left, axis_bins[b].box);
+                left_count += axis_bins[b].count;
+                if(left_count == 0 || left_count == count) continue;
+
+                float cost = half_area(left) * left_count + right_cost[b + 1];
+                if(cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+
+        // Not splitting costs testing every triangle, splitting costs about one extra box test on top of the children
+        float leaf_cost = half_area(box) * count;
+        if(count <= build.mesh.max_leaf_size && (best_axis < 0 || half_area(box) + best_cost >= leaf_cost)) return false;
+    }
+    else if(count <= build.mesh.max_leaf_size)
+    {
+        return false;
+    }
+
+    if(best_axis >= 0)
+    {
+        auto first = build.order.begin() + begin;
+        auto split = std::partition(first, build.order.begin() + end, [&](uint32_t t) {
+            return bin_of(build.centroids[t], centroid_box, best_axis, bin_count) <= best_bin;
+        });
+        mid = (uint32_t)(split - build.order.begin());
+        return true;
+    }
+
+    // Every centroid in the same spot (or too deep for SAH), halve by count along the longest axis instead
+    glm::vec3 extent = centroid_box.max - centroid_box.min;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    mid = begin + count / 2;
+    std::nth_element(build.order.begin() + begin, build.order.begin() + mid, build.order.begin() + end, [&](uint32_t a, uint32_t b) {
+        float ca = build.centroids[a][axis], cb = build.centroids[b][axis];
+        return ca != cb ? ca < cb : a < b;
+    });
+    return true;
+}
+
+static void build_subtree(BvhBuild& build, uint32_t begin, uint32_t end, uint32_t depth, std::vector<BvhNode>& out)
+{
+    AABB box, centroid_box;
+    range_bounds(build, begin, end, nullptr, box, centroid_box);
+
+    uint32_t index = (uint32_t)out.size();
+    out.push_back(BvhNode{ box.min, begin, box.max, end - begin });
+
+    uint32_t mid;
+    if(!split_range(build, begin, end, depth, box, centroid_box, nullptr, mid)) return;
+
+    out[index].count = 0;
+    build_subtree(build, begin, mid, depth + 1, out);
+    out[index].offset = (uint32_t)out.size();
+    build_subtree(build, mid, end, depth + 1, out);
+}
+
+static uint32_t build_top(BvhBuild& build, uint32_t begin, uint32_t end, uint32_t depth, uint32_t task_size, ThreadPool* pool,
+                          std::vector<BvhTopNode>& top, std::vector<BvhTask>& tasks)
+{
+    uint32_t index = (uint32_t)top.size();
+    top.emplace_back();
+
+    if(end - begin <= task_size)
+    {
+        top[index].task = (uint32_t)tasks.size();
+        tasks.push_back(BvhTask{ begin, end, depth, {} });
+        return index;
+    }
+
+    AABB box, centroid_box;
+    range_bounds(build, begin, end, pool, box, centroid_box);
+    top[index].box = box;
+    top[index].begin = begin;
+    top[index].end = end;
+
+    uint32_t mid;
+    if(!split_range(build, begin, end, depth, box, centroid_box, pool, mid)) return index;
+
+    uint32_t left = build_top(build, begin, mid, depth + 1, task_size, pool, top, tasks);
+    uint32_t right = build_top(build, mid, end, depth + 1, task_size, pool, top, tasks);
+    top[index].left = left;
+    top[index].right = right;
+    return index;
+}
+
+// Lays the top nodes and the finished subtrees out depth first into one array
+static void emit_top(const std::vector<BvhTopNode>& top, const std::vector<BvhTask>& tasks, uint32_t index, std::vector<BvhNode>& out)
+{
+    const BvhTopNode& node = top[index];
+    if(node.task != UINT32_MAX)
+    {
+        uint32_t base = (uint32_t)out.size();
+        for(BvhNode n : tasks[node.task].nodes)
+        {
+            if(n.count == 0) n.offset += base;
+            out.push_back(n);
+        }
+        return;
+    }
+
+    uint32_t at = (uint32_t)out.size();
+    out.push_back(BvhNode{ node.box.min, node.begin, node.box.max, node.end - node.begin });
+    if(node.left == UINT32_MAX) return;
+
+    out[at].count = 0;
+    emit_top(top, tasks, node.left, out);
+    out[at].offset = (uint32_t)out.size();
+    emit_top(top, tasks, node.right, out);
+}
+
+void mesh_collider_build(MeshCollider& mesh, const std::vector<glm::vec3>& triangles, ThreadPool* pool)
+{
+    uint32_t count = (uint32_t)(triangles.size() / 3);
+    mesh.corners.clear();
+    mesh.triangle_ids.clear();
+    mesh.nodes.clear();
+    if(count == 0) return;
+
+    BvhBuild build{ mesh, std::vector<AABB>(count), std::vector<glm::vec3>(count), std::vector<uint32_t>(count) };
+    phys_parallel_for(pool, count, 0, [&](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++)
+        {
+            const glm::vec3& a = triangles[t * 3];
+            const glm::vec3& b = triangles[t * 3 + 1];
+            const glm::vec3& c = triangles[t * 3 + 2];
+            build.boxes[t] = AABB{ glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) };
+            build.centroids[t] = (a + b + c) / 3.0f;
+            build.order[t] = (uint32_t)t;
+        }
+    });
+
+    // Enough subtrees for every thread to get a few, but not so small that they aren't worth handing out
+    uint32_t threads = pool ? pool->size() + 1 : 1;
+    uint32_t task_size = pool ? std::max(count / (threads * 4), (uint32_t)BVH_PARALLEL_RANGE) : count;
+
+    std::vector<BvhTopNode> top;
+    std::vector<BvhTask> tasks;
+    build_top(build, 0, count, 0, task_size, pool, top, tasks);
+
+    auto kernel = [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) build_subtree(build, tasks[i].begin, tasks[i].end, tasks[i].depth, tasks[i].nodes);
+    };
+    if(pool) pool->parallel_for(tasks.size(), 1, kernel);
+    else kernel(0, tasks.size());
+
+    emit_top(top, tasks, 0, mesh.nodes);
+
+    // Corners in leaf order
+    mesh.corners.resize(triangles.size());
+    mesh.triangle_ids = build.order;
+    phys_parallel_for(pool, count, 0, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            uint32_t t = build.order[i];
+            mesh.corners[i * 3] = triangles[t * 3];
+            mesh.corners[i * 3 + 1] = triangles[t * 3 + 1];
+            mesh.corners[i * 3 + 2] = triangles[t * 3 + 2];
+        }
+    });
+}
+
+void mesh_collider_from_geometry(MeshCollider& mesh, const MeshGeometry& geometry, const glm::mat4& transform, ThreadPool* pool)
+{
+    std::vector<glm::vec3> triangles;
+    triangles.reserve(geometry.indices.size());
+    for(unsigned int index : geometry.indices)
+    {
+        triangles.push_back(glm::vec3(transform * glm::vec4(geometry.vertices[index].position, 1.0)));
+    }
+    mesh_collider_build(mesh, triangles, pool);
+}
+
+void mesh_collider_from_model(MeshCollider& mesh, const Model& model, ThreadPool* pool)
+{
+    std::vector<glm::vec3> triangles;
+    model_triangles(model, glm::mat4(1.0), triangles);
+    mesh_collider_build(mesh, triangles, pool);
+}
+
+AABB mesh_bounds(const MeshCollider& mesh)
+{
+    if(mesh.nodes.empty()) return AABB();
+    return AABB{ mesh.nodes[0].min, mesh.nodes[0].max };
+}
+
+void mesh_query(const MeshCollider& mesh, const AABB& box, std::vector<uint32_t>& out)
+{
+    if(mesh.nodes.empty()) return;
+
+    TraversalStack stack;
+    stack.push(0);
+    while(!stack.empty())
+    {
+        const BvhNode& node = mesh.nodes[stack.pop()];
+        if(glm::any(glm::greaterThan(box.min, node.max)) || glm::any(glm::lessThan(box.max, node.min))) continue;
+
+        if(node.count > 0)
+        {
+            for(uint32_t t = node.offset; t < node.offset + node.count; t++) out.push_back(t);
+            continue;
+        }
+
+        uint32_t index = (uint32_t)(&node - mesh.nodes.data());
+        stack.push(node.offset);
+        stack.push(index + 1);
+    }
+}
+
+// Moller-Trumbore, returns the distance along dir or -1
+static inline float ray_triangle(const glm::vec3& origin, const glm::vec3& dir, const glm::vec3* tri, float max_t)
+{
+    glm::vec3 e1 = tri[1] - tri[0];
+    glm::vec3 e2 = tri[2] - tri[0];
+    glm::vec3 p = glm::cross(dir, e2);
+    float det = glm::dot(e1, p);
+    if(fabsf(det) < 1e-12f) return -1.0f;
+
+    float inv_det = 1.0f / det;
+    glm::vec3 s = origin - tri[0];
+    float u = glm::dot(s, p) * inv_det;
+    if(u < 0.0f || u > 1.0f) return -1.0f;
+
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(dir, q) * inv_det;
+    if(v < 0.0f || u + v > 1.0f) return -1.0f;
+
+    float t = glm::dot(e2, q) * inv_det;
+    return t >= 0.0f && t <= max_t ? t : -1.0f;
+}
+
+bool mesh_raycast(const MeshCollider& mesh, const glm::vec3& origin, const glm::vec3& dir, float max_t, MeshRayHit& hit)
+{
+    if(mesh.nodes.empty()) return false;
+
+    glm::vec3 inv_dir = 1.0f / dir;
+    uint32_t best = UINT32_MAX;
+
+    TraversalStack stack;
+    stack.push(0);
+    while(!stack.empty())
+    {
+        uint32_t index = stack.pop();
+        const BvhNode& node = mesh.nodes[index];
+        if(ray_aabb(origin, inv_dir, AABB{ node.min, node.max }, max_t) < 0.0f) continue;
+
+        if(node.count > 0)
+        {
+            for(uint32_t t = node.offset; t < node.offset + node.count; t++)
+            {
+                float dist = ray_triangle(origin, dir, &mesh.corners[t * 3], max_t);
+                if(dist < 0.0f) continue;
+                max_t = dist;
+                best = t;
+            }
+            continue;
+        }
+
+        // Nearer child goes on top so it gets searched first and shrinks max_t for the other one
+        const BvhNode& first = mesh.nodes[index + 1];
+        const BvhNode& second = mesh.nodes[node.offset];
+        float t_first = ray_aabb(origin, inv_dir, AABB{ first.min, first.max }, max_t);
+        float t_second = ray_aabb(origin, inv_dir, AABB{ second.min, second.max }, max_t);
+        if(t_first >= 0.0f && t_second >= 0.0f)
+        {
+            bool first_nearer = t_first <= t_second;
+            stack.push(first_nearer ? node.offset : index + 1);
+            stack.push(first_nearer ? index + 1 : node.offset);
+        }
+        else if(t_first >= 0.0f)
+        {
+            stack.push(index + 1);
+        }
+        else if(t_second >= 0.0f)
+        {
+            stack.push(node.offset);
+        }
+    }
+
+    if(best == UINT32_MAX) return false;
+
+    const glm::vec3* tri = &mesh.corners[best * 3];
+    glm::vec3 normal = glm::normalize(glm::cross(tri[1] - tri[0], tri[2] - tri[0]));
+    hit.t = max_t;
+    hit.normal = glm::dot(normal, dir) > 0.0f ? -normal : normal;
+    hit.triangle = mesh.triangle_ids[best];
+    return true;
+}
+
+// Ericson, Real-Time Collision Detection 5.1.5
+glm::vec3 closest_point_triangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if(d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if(d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if(d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+bool above_triangle(const glm::vec3& p, const glm::vec3* tri, const glm::vec3& n)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        if(glm::dot(glm::cross(tri[(i + 1) % 3] - tri[i], p - tri[i]), n) < 0.0f) return false;
+    }
+    return true;
+}
+
+void mesh_collide_shape(const MeshCollider& mesh, const ConvexProxy& proxy, uint32_t body, ContactSet& contacts, float margin,
+                        std::vector<uint32_t>& scratch)
+{
+    const ConvexShape& shape = *proxy.shape;
+    float reach = shape_bounding_radius(shape) + margin;
+    AABB box{ proxy.position - glm::vec3(reach), proxy.position + glm::vec3(reach) };
+
+    scratch.clear();
+    mesh_query(mesh, box, scratch);
+
+    for(uint32_t t : scratch)
+    {
+        const glm::vec3* tri = &mesh.corners[t * 3];
+        uint64_t feature = (uint64_t)mesh.triangle_ids[t] << 32;
+
+        glm::vec3 face = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+        float face_len = glm::length(face);
+        if(face_len <= 0.0f) continue;
+
+        // Both sides collide, up is whichever side the body's center is on
+        glm::vec3 up = face / face_len;
+        if(glm::dot(up, proxy.position - tri[0]) < 0.0f) up = -up;
+
+        if(shape.type == SHAPE_SPHERE)
+        {
+            glm::vec3 closest = closest_point_triangle(proxy.position, tri[0], tri[1], tri[2]);
+            glm::vec3 d = closest - proxy.position;
+            float dist = glm::length(d);
+            if(dist >= shape.radius + margin) continue;
+
+            glm::vec3 n = dist > 1e-6f ? d / dist : -up;
+            float penetration = shape.radius - dist;
+            contact_add(contacts, body, CONTACT_WORLD, feature, proxy.position + n * (shape.radius - 0.5f * penetration), n, penetration);
+            continue;
+        }
+
+        ConvexShape tri_shape = shape_triangle(tri);
+        ConvexProxy tri_proxy{ &tri_shape, glm::vec3(0.0), glm::quat(1.0, 0.0, 0.0, 0.0) };
+        GjkCache cache;
+        ConvexContact contact;
+        if(!gjk_collide(proxy, tri_proxy, cache, contact, margin)) continue;
+
+        // Resting on the face, give every core vertex over the triangle its own contact
+        if(glm::dot(contact.normal, -up) > 0.95f)
+        {
+            uint32_t emitted = 0;
+            uint32_t vertex_count = shape_core_vertex_count(shape);
+            for(uint32_t v = 0; v < vertex_count; v++)
+            {
+                glm::vec3 point = proxy.position + proxy.orientation * shape_core_vertex(shape, v);
+                float dist = glm::dot(up, point - tri[0]);
+                if(dist >= shape.radius + margin || !above_triangle(point, tri, face)) continue;
+
+                contact_add(contacts, body, CONTACT_WORLD, feature | v, point - up * shape.radius, -up, shape.radius - dist);
+                emitted++;
+            }
+            if(emitted > 0) continue;
+        }
+
+        contact_add(contacts, body, CONTACT_WORLD, feature | UINT32_MAX, contact.point, contact.normal, contact.penetration);
+    }
+}
+
+void collide_mesh(const RigidBodyWorld& world, const MeshCollider& mesh, ContactSet& contacts, float margin)
+{
+    std::vector<uint32_t> scratch;
+    size_t count = rigid_count(world);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(world.radius[i] <= 0.0f || world.mass_inv[i] == 0.0f || !world.awake[i]) continue;
+
+        ConvexProxy proxy{ &world.shape[i], world.position.get(i), world.orientation[i] };
+        mesh_collide_shape(mesh, proxy, (uint32_t)i, contacts, margin + world.ccd_margin[i], scratch);
+    }
+}
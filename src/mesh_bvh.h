@@ -0,0 +1,79 @@
+#pragma once
+#include "narrowphase.h"
+#include "aabb_tree.h"
+#include "mesh.h"
+#include "ThreadPool.h"
+
+/*
+    Static triangle mesh collider, so level geometry can be collided against as is instead of through hulls.
+
+    The triangles sit in a BVH built once with binned SAH: every split looks at bin_count buckets of triangle centroids
+    along each axis and picks the boundary that minimizes area * triangle count on both sides. The top of the tree is
+    built on the calling thread with the binning spread over the pool, and once there are enough independent subtrees
+    they get built in parallel and stitched back together. The result doesn't depend on the pool.
+
+    Nodes are 32 bytes (two to a cache line) and laid out depth first: an interior node's first child is the next node
+    and it stores where the second child is, a leaf stores where its triangles start. Triangle corners are stored in
+    leaf order so a leaf's triangles sit next to each other in memory.
+
+    Spheres get an exact closest point per triangle. Everything else goes through GJK against the triangle, and when the
+    contact normal is close to the face normal every core vertex of the body above the triangle gets its own contact
+    the same way collide_planes does it, so boxes rest flat on floors made of triangles.
+*/
+
+struct BvhNode
+{
+    glm::vec3 min;
+    uint32_t offset;    // Leaf: first triangle, interior: second child (the first one is always the next node)
+    glm::vec3 max;
+    uint32_t count;     // Triangles in the leaf, 0 for interior nodes
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode is meant to be half a cache line");
+
+struct MeshCollider
+{
+    uint32_t max_leaf_size = 4;
+    uint32_t bin_count = 16;
+
+    std::vector<glm::vec3> corners;         // 3 per triangle in leaf order
+    std::vector<uint32_t> triangle_ids;     // Index of each triangle in whatever it was built from
+    std::vector<BvhNode> nodes;
+};
+
+struct MeshRayHit
+{
+    float t = 0.0;
+    glm::vec3 normal = glm::vec3(0.0);      // Face normal, facing back along the ray
+    uint32_t triangle = UINT32_MAX;         // Original triangle id
+};
+
+// Builds the collider from 3 corners per triangle. pool can be nullptr.
+void mesh_collider_build(MeshCollider& mesh, const std::vector<glm::vec3>& triangles, ThreadPool* pool);
+
+// Every triangle of the geometry moved by transform
+void mesh_collider_from_geometry(MeshCollider& mesh, const MeshGeometry& geometry, const glm::mat4& transform, ThreadPool* pool);
+
+// Every triangle of every node of the model (see model_triangles), triangle ids count up over the nodes depth first
+void mesh_collider_from_model(MeshCollider& mesh, const Model& model, ThreadPool* pool);
+
+AABB mesh_bounds(const MeshCollider& mesh);
+
+// Appends the index (into corners / 3) of every triangle whose leaf overlaps box
+void mesh_query(const MeshCollider& mesh, const AABB& box, std::vector<uint32_t>& out);
+
+// Closest hit along origin + t * dir for t in [0, max_t], both sides of every triangle count
+bool mesh_raycast(const MeshCollider& mesh, const glm::vec3& origin, const glm::vec3& dir, float max_t, MeshRayHit& hit);
+
+// Closest point on triangle abc to p
+glm::vec3 closest_point_triangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+// Is p above the triangle, i.e. inside the prism the triangle sweeps along its normal n (any length)
+bool above_triangle(const glm::vec3& p, const glm::vec3* tri, const glm::vec3& n);
+
+// Contacts between every awake dynamic body and the mesh, body_b is CONTACT_WORLD. Bodies closer than margin (plus their
+// ccd_margin) get contacts with negative penetration. Feature is triangle id << 32 | core vertex (UINT32_MAX for the single GJK contact).
+void collide_mesh(const RigidBodyWorld& world, const MeshCollider& mesh, ContactSet& contacts, float margin = 0.0);
+
+// Same as collide_mesh for a single shape, body is just what goes in the contacts' body_a
+void mesh_collide_shape(const MeshCollider& mesh, const ConvexProxy& proxy, uint32_t body, ContactSet& contacts, float margin,
+                        std::vector<uint32_t>& scratch);
@@ -0,0 +1,413 @@
+#include "narrowphase.h"
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+
+void rigid_find_pairs(const RigidBodyWorld& world, RigidBroadphase& broadphase, std::vector<CollisionPair>& pairs)
+{
+    // Who's moving only changes when something falls asleep, wakes up, or gets added / removed
+    if(!broadphase.built || broadphase.version != world.sleep_version)
+    {
+        broadphase.moving_bodies.clear();
+        broadphase.resting_bodies.clear();
+        size_t count = rigid_count(world);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(world.radius[i] <= 0.0f) continue;
+            bool moving = world.awake[i] && world.mass_inv[i] > 0.0f;
+            (moving ? broadphase.moving_bodies : broadphase.resting_bodies).push_back(i);
+        }
+        grid_build_subset(broadphase.resting, world.position, world.swept_radius, broadphase.resting_bodies);
+        broadphase.version = world.sleep_version;
+        broadphase.built = true;
+    }
+
+    size_t first = pairs.size();
+    grid_build_subset(broadphase.moving, world.position, world.swept_radius, broadphase.moving_bodies);
+    grid_find_pairs_subset(broadphase.moving, world.position, world.swept_radius, broadphase.moving_bodies, pairs);
+    grid_find_pairs_between(broadphase.resting, world.position, world.swept_radius, broadphase.moving_bodies, pairs);
+
+    // Both lists come out grouped by the moving body, one sort makes the order only depend on the slots
+    std::sort(pairs.begin() + first, pairs.end(), [](const CollisionPair& a, const CollisionPair& b) {
+        return a.a != b.a ? a.a < b.a : a.b < b.b;
+    });
+}
+
+// Something has to be awake and able to move for the contact to matter
+static inline bool pair_active(const RigidBodyWorld& world, uint32_t a, uint32_t b)
+{
+    bool a_moves = world.mass_inv[a] > 0.0f && world.awake[a];
+    bool b_moves = world.mass_inv[b] > 0.0f && world.awake[b];
+    return a_moves || b_moves;
+}
+
+// Speculative distance for a pair, whichever of the two is moving fast enough to need it
+static inline float pair_margin(const RigidBodyWorld& world, uint32_t a, uint32_t b)
+{
+    return std::max(world.ccd_margin[a], world.ccd_margin[b]);
+}
+
+static void sphere_contact(const RigidBodyWorld& world, uint32_t a, uint32_t b, ContactSet& contacts)
+{
+    float radius_a = world.shape[a].radius;
+    float radius_b = world.shape[b].radius;
+
+    glm::vec3 d = world.position.get(b) - world.position.get(a);
+    float r = radius_a + radius_b;
+    float reach = r + pair_margin(world, a, b);
+    float dist2 = glm::dot(d, d);
+    if(dist2 >= reach * reach) return;
+
+    // Exactly on top of each other, any direction works
+    float dist = sqrtf(dist2);
+    glm::vec3 n = dist > 1e-6f ? d / dist : glm::vec3(0.0, 1.0, 0.0);
+    float penetration = r - dist;
+
+    // Halfway between the two surfaces
+    glm::vec3 point = world.position.get(a) + n * (radius_a - 0.5f * penetration);
+    contact_add(contacts, a, b, 0, point, n, penetration);
+}
+
+void collide_spheres(const RigidBodyWorld& world, const std::vector<CollisionPair>& pairs, ContactSet& contacts)
+{
+    for(const CollisionPair& pair : pairs)
+    {
+        if(!pair_active(world, pair.a, pair.b)) continue;
+        if(world.shape[pair.a].type != SHAPE_SPHERE || world.shape[pair.b].type != SHAPE_SPHERE) continue;
+        sphere_contact(world, pair.a, pair.b, contacts);
+    }
+}
+
+// A core vertex that's part of the touching feature, feature is what the contact it ends up in gets tagged with
+struct ManifoldVertex
+{
+    glm::vec3 point;
+    uint64_t feature;
+};
+
+// Core vertices of the proxy within MANIFOLD_TOLERANCE of its furthest point along dir. Returns 0 when there are more
+// than MANIFOLD_MAX_FACE of them (a rounded hull side on), the caller falls back to the single GJK contact then.
+// Hulls with adjacency climb to the support vertex from hint and grow the face out from there along the adjacency (the
+// vertices above any plane are connected on a convex hull), so big hulls don't get scanned vertex by vertex every pair.
+static uint32_t touching_face(const ConvexProxy& proxy, const glm::vec3& dir, uint32_t hint, ManifoldVertex* out)
+{
+    const ConvexShape& shape = *proxy.shape;
+    if(shape.type == SHAPE_HULL && shape.hull && !shape.hull->adjacency_start.empty())
+    {
+        const ConvexHull& hull = *shape.hull;
+        glm::vec3 local_dir = glm::conjugate(proxy.orientation) * dir;
+        uint32_t start = hint;
+        float limit = glm::dot(shape_support_core(shape, local_dir, start), local_dir) - MANIFOLD_TOLERANCE;
+
+        // Vertices found so far, doubles as the queue
+        uint32_t found[MANIFOLD_MAX_FACE];
+        uint32_t count = 0;
+        found[count++] = start;
+        for(uint32_t next = 0; next < count; next++)
+        {
+            uint32_t v = found[next];
+            for(uint32_t i = hull.adjacency_start[v]; i < hull.adjacency_start[v + 1]; i++)
+            {
+                uint32_t w = hull.adjacency[i];
+                if(glm::dot(hull.vertices[w], local_dir) < limit) continue;
+                if(std::find(found, found + count, w) != found + count) continue;
+                if(count == MANIFOLD_MAX_FACE) return 0;
+                found[count++] = w;
+            }
+        }
+
+        for(uint32_t i = 0; i < count; i++) out[i] = { proxy.position + proxy.orientation * hull.vertices[found[i]], found[i] };
+        return count;
+    }
+
+    uint32_t vertex_count = shape_core_vertex_count(shape);
+    float best = -FLT_MAX;
+    for(uint32_t v = 0; v < vertex_count; v++)
+    {
+        best = std::max(best, glm::dot(proxy.orientation * shape_core_vertex(shape, v), dir));
+    }
+
+    uint32_t count = 0;
+    for(uint32_t v = 0; v < vertex_count; v++)
+    {
+        glm::vec3 local = proxy.orientation * shape_core_vertex(shape, v);
+        if(glm::dot(local, dir) < best - MANIFOLD_TOLERANCE) continue;
+        if(count == MANIFOLD_MAX_FACE) return 0;
+        out[count++] = { proxy.position + local, v };
+    }
+    return count;
+}
+
+// Puts a (roughly planar, convex) face in counter clockwise order around n
+static void sort_face(ManifoldVertex* face, uint32_t count, const glm::vec3& n)
+{
+    glm::vec3 center(0.0);
+    for(uint32_t i = 0; i < count; i++) center += face[i].point;
+    center /= (float)count;
+
+    glm::vec3 t1 = fabsf(n.x) >= 0.57735f ? glm::vec3(n.y, -n.x, 0.0) : glm::vec3(0.0, n.z, -n.y);
+    glm::vec3 t2 = glm::cross(n, t1);
+
+    float angle[MANIFOLD_MAX_FACE];
+    for(uint32_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = face[i].point - center;
+        angle[i] = atan2f(glm::dot(d, t2), glm::dot(d, t1));
+    }
+
+    // Insertion sort, faces are tiny
+    for(uint32_t i = 1; i < count; i++)
+    {
+        ManifoldVertex v = face[i];
+        float a = angle[i];
+        uint32_t j = i;
+        for(; j > 0 && angle[j - 1] > a; j--)
+        {
+            face[j] = face[j - 1];
+            angle[j] = angle[j - 1];
+        }
+        face[j] = v;
+        angle[j] = a;
+    }
+}
+
+// Sutherland-Hodgman: cuts the incident polygon (or segment when count is 2) down to the part inside the side plane
+// of reference edge `edge`. Points made by the cut get the edge folded into their feature so they stay tied to it.
+static uint32_t clip_side(const ManifoldVertex* in, uint32_t count, const glm::vec3& edge_start, const glm::vec3& side,
+                          uint32_t edge, ManifoldVertex* out)
+{
+    bool closed = count > 2;
+    uint32_t out_count = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const ManifoldVertex& cur = in[i];
+        float d_cur = glm::dot(cur.point - edge_start, side);
+        if(d_cur <= 0.0f) out[out_count++] = cur;
+
+        if(!closed && i + 1 == count) break;
+        const ManifoldVertex& next = in[(i + 1) % count];
+        float d_next = glm::dot(next.point - edge_start, side);
+        if((d_cur <= 0.0f) == (d_next <= 0.0f)) continue;
+
+        float t = d_cur / (d_cur - d_next);
+        uint64_t feature = ((uint64_t)(edge + 1) << 32) | (cur.feature & 0xffffffffu);
+        out[out_count++] = { cur.point + (next.point - cur.point) * t, feature };
+    }
+    return out_count;
+}
+
+// Keeps the deepest point and the 3 that span the most area with it, so a face resting on a face stays on its corners
+static uint32_t reduce_manifold(ManifoldVertex* points, float* depth, uint32_t count, const glm::vec3& n)
+{
+    if(count <= 4) return count;
+
+    uint32_t keep[4];
+    keep[0] = 0;
+    for(uint32_t i = 1; i < count; i++) if(depth[i] > depth[keep[0]]) keep[0] = i;
+
+    // Furthest from the first one
+    float best = -1.0f;
+    keep[1] = keep[0];
+    for(uint32_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = points[i].point - points[keep[0]].point;
+        float dist2 = glm::dot(d, d);
+        if(dist2 > best) { best = dist2; keep[1] = i; }
+    }
+
+    // Biggest triangle with the first two
+    best = -1.0f;
+    keep[2] = keep[0];
+    glm::vec3 p0 = points[keep[0]].point;
+    glm::vec3 p1 = points[keep[1]].point;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        float area = fabsf(glm::dot(glm::cross(p1 - p0, points[i].point - p0), n));
+        if(area > best) { best = area; keep[2] = i; }
+    }
+
+    // Whatever sticks out furthest past one of the triangle's edges
+    glm::vec3 p2 = points[keep[2]].point;
+    float winding = glm::dot(glm::cross(p1 - p0, p2 - p0), n) >= 0.0f ? 1.0f : -1.0f;
+    best = 0.0f;
+    keep[3] = keep[0];
+    for(uint32_t i = 0; i < count; i++)
+    {
+        glm::vec3 q = points[i].point;
+        float outside = std::min({ glm::dot(glm::cross(p1 - p0, q - p0), n), glm::dot(glm::cross(p2 - p1, q - p1), n),
+                                   glm::dot(glm::cross(p0 - p2, q - p2), n) }) * winding;
+        if(outside < best) { best = outside; keep[3] = i; }
+    }
+
+    uint32_t kept = keep[3] == keep[0] ? 3 : 4;
+    ManifoldVertex reduced[4];
+    float reduced_depth[4];
+    for(uint32_t i = 0; i < kept; i++)
+    {
+        reduced[i] = points[keep[i]];
+        reduced_depth[i] = depth[keep[i]];
+    }
+    for(uint32_t i = 0; i < kept; i++)
+    {
+        points[i] = reduced[i];
+        depth[i] = reduced_depth[i];
+    }
+    return kept;
+}
+
+// Face / edge contacts between two convex shapes. The side with the bigger touching face is the reference, the other
+// side's touching face gets clipped against it and every clipped point closer than margin is a contact. Returns false
+// if there's no face on either side (vertex or rounded contacts), the single GJK point is used for those.
+static bool convex_manifold(uint32_t a, uint32_t b, const ConvexProxy& proxy_a, const ConvexProxy& proxy_b,
+                           const GjkCache& gjk, const glm::vec3& n, float margin, ContactSet& contacts)
+{
+    ManifoldVertex face_a[MANIFOLD_MAX_FACE];
+    ManifoldVertex face_b[MANIFOLD_MAX_FACE];
+    uint32_t count_a = touching_face(proxy_a, n, gjk.hint_a, face_a);
+    uint32_t count_b = touching_face(proxy_b, -n, gjk.hint_b, face_b);
+    if(count_a < 2 || count_b < 2 || (count_a < 3 && count_b < 3)) return false;
+
+    // Ties go to A so the reference doesn't flip between frames and the feature ids stay put for warm starting
+    bool reference_a = count_a >= count_b;
+    ManifoldVertex* reference = reference_a ? face_a : face_b;
+    ManifoldVertex* incident = reference_a ? face_b : face_a;
+    uint32_t reference_count = reference_a ? count_a : count_b;
+    uint32_t incident_count = reference_a ? count_b : count_a;
+
+    sort_face(reference, reference_count, n);
+    if(incident_count > 2) sort_face(incident, incident_count, n);
+
+    ManifoldVertex buffer[2][MANIFOLD_MAX_FACE * 2];
+    uint32_t count = incident_count;
+    std::copy(incident, incident + incident_count, buffer[0]);
+    uint32_t current = 0;
+    for(uint32_t e = 0; e < reference_count && count > 0; e++)
+    {
+        glm::vec3 start = reference[e].point;
+        glm::vec3 edge = reference[(e + 1) % reference_count].point - start;
+        glm::vec3 side = glm::cross(edge, n);
+        if(glm::dot(side, side) < 1e-12f) continue;
+
+        // Every cut adds at most one point, anything past the buffer is dropped (only possible for very busy hulls)
+        count = std::min(clip_side(buffer[current], count, start, side, reference[e].feature, buffer[current ^ 1]),
+                         (uint32_t)MANIFOLD_MAX_FACE * 2 - 1);
+        current ^= 1;
+    }
+    if(count == 0) return false;
+
+    // Depth is measured from the reference face (its furthest point towards the other shape) to each clipped point
+    glm::vec3 towards = reference_a ? n : -n;
+    float reference_support = -FLT_MAX;
+    for(uint32_t i = 0; i < reference_count; i++)
+    {
+        reference_support = std::max(reference_support, glm::dot(reference[i].point, towards));
+    }
+
+    float radius_a = proxy_a.shape->radius;
+    float radius_b = proxy_b.shape->radius;
+    ManifoldVertex* points = buffer[current];
+    float depth[MANIFOLD_MAX_FACE * 2];
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        float penetration = reference_support - glm::dot(points[i].point, towards) + radius_a + radius_b;
+        if(penetration <= -margin) continue;
+        points[kept] = points[i];
+        depth[kept] = penetration;
+        kept++;
+    }
+    if(kept == 0) return false;
+
+    kept = reduce_manifold(points, depth, kept, n);
+    uint64_t side_bit = reference_a ? 0 : (1ull << 63);
+    for(uint32_t i = 0; i < kept; i++)
+    {
+        // Halfway between the two surfaces like the GJK contact
+        glm::vec3 on_incident = points[i].point;
+        glm::vec3 on_reference = on_incident + towards * (reference_support - glm::dot(on_incident, towards));
+        glm::vec3 surface_a = (reference_a ? on_reference : on_incident) + n * radius_a;
+        glm::vec3 surface_b = (reference_a ? on_incident : on_reference) - n * radius_b;
+        contact_add(contacts, a, b, side_bit | points[i].feature, 0.5f * (surface_a + surface_b), n, depth[i]);
+    }
+    return true;
+}
+
+void collide_convex(const RigidBodyWorld& world, const std::vector<CollisionPair>& pairs, ContactSet& contacts, ConvexPairCache& cache)
+{
+    cache.next.clear();
+
+    for(const CollisionPair& pair : pairs)
+    {
+        uint32_t a = pair.a;
+        uint32_t b = pair.b;
+        if(!pair_active(world, a, b)) continue;
+
+        if(world.shape[a].type == SHAPE_SPHERE && world.shape[b].type == SHAPE_SPHERE)
+        {
+            sphere_contact(world, a, b, contacts);
+            continue;
+        }
+
+        uint64_t key = pair_key(world.handles.slot_to_handle[a], world.handles.slot_to_handle[b]);
+        auto cached = cache.pairs.find(key);
+        GjkCache& gjk = cache.next[key];
+        if(cached != cache.pairs.end()) gjk = cached->second;
+
+        ConvexProxy proxy_a{ &world.shape[a], world.position.get(a), world.orientation[a] };
+        ConvexProxy proxy_b{ &world.shape[b], world.position.get(b), world.orientation[b] };
+
+        // Fast pairs keep contacts that are still apart (speculative), the solver only lets them close the gap
+        float margin = pair_margin(world, a, b);
+        ConvexContact contact;
+        if(gjk_collide(proxy_a, proxy_b, gjk, contact, margin) && (contact.penetration > 0.0f || margin > 0.0f))
+        {
+            if(!convex_manifold(a, b, proxy_a, proxy_b, gjk, contact.normal, margin, contacts))
+            {
+                contact_add(contacts, a, b, UINT32_MAX, contact.point, contact.normal, contact.penetration);
+            }
+        }
+    }
+
+    // Pairs the broadphase stopped reporting drop out of the cache here
+    std::swap(cache.pairs, cache.next);
+}
+
+// Appends a contact for a core point of the body (a corner, capsule end, hull vertex...) that's within radius of the plane
+static inline void plane_point_contact(ContactSet& contacts, uint32_t body, uint64_t feature, const ContactPlane& plane,
+                                       const glm::vec3& point, float radius, float margin)
+{
+    float dist = glm::dot(plane.normal, point) - plane.offset;
+    if(dist >= radius + margin) return;
+
+    // Normal points from the body into the plane
+    contact_add(contacts, body, CONTACT_WORLD, feature, point - plane.normal * radius, -plane.normal, radius - dist);
+}
+
+void collide_planes(const RigidBodyWorld& world, const std::vector<ContactPlane>& planes, ContactSet& contacts)
+{
+    size_t count = rigid_count(world);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(world.radius[i] <= 0.0f || world.mass_inv[i] == 0.0f || !world.awake[i]) continue;
+
+        uint32_t body = (uint32_t)i;
+        const ConvexShape& shape = world.shape[i];
+        glm::vec3 pos = world.position.get(i);
+        const glm::quat& q = world.orientation[i];
+
+        for(uint32_t p = 0; p < planes.size(); p++)
+        {
+            const ContactPlane& plane = planes[p];
+            if(glm::dot(plane.normal, pos) - plane.offset >= world.swept_radius[i]) continue;
+
+            // One contact per core vertex touching the plane so flat things rest on more than one point
+            uint64_t feature = (uint64_t)p << 32;
+            uint32_t vertex_count = shape_core_vertex_count(shape);
+            for(uint32_t v = 0; v < vertex_count; v++)
+            {
+                plane_point_contact(contacts, body, feature | v, plane, pos + q * shape_core_vertex(shape, v), shape.radius,
+                                    world.ccd_margin[i]);
+            }
+        }
+    }
+}
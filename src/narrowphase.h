@@ -0,0 +1,62 @@
+#pragma once
+#include "contact_solver.h"
+#include "broadphase_grid.h"
+#include "gjk.h"
+#include <unordered_map>
+
+/*
+    Contact generation for rigid bodies. Contacts get appended to a ContactSet with the normal pointing from body_a to body_b.
+
+    Sphere pairs are handled directly, everything else goes through GJK / EPA for the normal and depth. When both sides
+    have an edge or face along that normal (the core vertices within MANIFOLD_TOLERANCE of the contact plane) the
+    incident one gets clipped against the reference one and the pair gets up to 4 contacts, otherwise it's the single
+    deepest point. Planes get one contact per core vertex that touches them so boxes and hulls rest flat on the ground.
+
+    Bodies with a ccd_margin (see ccd.h) also get contacts for things up to that far away, with negative penetration.
+*/
+
+#define MANIFOLD_TOLERANCE 0.02f        // How far (m) behind the deepest core vertex another one can be and still be part of the touching face
+#define MANIFOLD_MAX_FACE 16            // More core vertices than that on the touching face and the pair just gets one contact
+
+// Infinite static plane, everything with dot(normal, x) < offset is inside
+struct ContactPlane
+{
+    glm::vec3 normal = glm::vec3(0.0, 1.0, 0.0);
+    float offset = 0.0;
+};
+
+// Broadphase state for a RigidBodyWorld. Awake dynamic bodies go in a grid that's rebuilt every step, sleeping and static
+// ones sit in a second grid that's only rebuilt when world.sleep_version changes, so a resting pile costs nothing per
+// step. Move static bodies with rigid_set_transform, which bumps world.sleep_version (see rigid_body.h).
+struct RigidBroadphase
+{
+    SpatialHashGrid moving;
+    SpatialHashGrid resting;
+    std::vector<uint32_t> moving_bodies;        // Slots of the awake dynamic bodies
+    std::vector<uint32_t> resting_bodies;       // Slots of everything else that collides
+    uint32_t version = 0;                       // world.sleep_version the lists were made for
+    bool built = false;
+};
+
+// Pairs between moving bodies plus pairs of a moving body and a resting one, using the bodies' collision spheres
+// (swept_radius). Pairs are body slots sorted by (a, b). Two resting bodies are never tested.
+void rigid_find_pairs(const RigidBodyWorld& world, RigidBroadphase& broadphase, std::vector<CollisionPair>& pairs);
+
+// Last frame's GJK state for every pair, keyed by pair_key of the two body handles
+struct ConvexPairCache
+{
+    std::unordered_map<uint64_t, GjkCache> pairs;
+    std::unordered_map<uint64_t, GjkCache> next;
+};
+
+// One contact per overlapping pair of spheres (other shapes are skipped), skips pairs where neither body is awake and dynamic.
+// A contact between an awake body and a sleeping one is kept, island_wake_touched uses it to wake the sleeper.
+void collide_spheres(const RigidBodyWorld& world, const std::vector<CollisionPair>& pairs, ContactSet& contacts);
+
+// Same as collide_spheres but for every shape type. Manifold points are tagged with the core vertex they came from
+// (plus the reference edge for clipped ones and the top bit when B is the reference), the single GJK point uses UINT32_MAX.
+void collide_convex(const RigidBodyWorld& world, const std::vector<CollisionPair>& pairs, ContactSet& contacts, ConvexPairCache& cache);
+
+// Contacts between every awake body and the planes, body_b is CONTACT_WORLD.
+// The feature is plane index << 32 | core vertex (box corner, capsule end, hull vertex).
+void collide_planes(const RigidBodyWorld& world, const std::vector<ContactPlane>& planes, ContactSet& contacts);
@@ -0,0 +1,397 @@
+#include "nbody.h"
+#include "spatial_sort.h"
+#include <algorithm>
+#include <cmath>
+
+#define NBODY_CHUNK 256         // Bodies per job in the direct sum
+#define NBODY_GROUP 64          // Bodies that share one tree walk
+#define NBODY_GROUP_CHUNK 16    // Groups per job, walks take wildly different amounts of time so keep them small
+#define NBODY_STACK 256         // 7 siblings left behind per level at most, 21 levels
+
+/*
+    Pull on a point from a run of bodies, sum of m * d / (|d|^2 + softening^2)^(3/2), G gets multiplied in later.
+    Bodies exactly on the point (the body itself when there's no softening) get skipped.
+*/
+typedef glm::vec3 (*PullFn)(const float* x, const float* y, const float* z, const float* m, size_t count, const glm::vec3& p, float eps_sq);
+
+static glm::vec3 pull_scalar(const float* x, const float* y, const float* z, const float* m, size_t count, const glm::vec3& p, float eps_sq)
+{
+    glm::vec3 acc(0.0);
+    for(size_t j = 0; j < count; j++)
+    {
+        float dx = x[j] - p.x, dy = y[j] - p.y, dz = z[j] - p.z;
+        float r_sq = dx * dx + dy * dy + dz * dz + eps_sq;
+        if(r_sq <= 0.0f) continue;
+
+        float inv = 1.0f / sqrtf(r_sq);
+        float s = m[j] * inv * inv * inv;
+        acc += glm::vec3(dx, dy, dz) * s;
+    }
+    return acc;
+}
+
+#if PHYS_X86
+
+static inline float hsum_sse(__m128 v)
+{
+    __m128 shuf = _mm_movehl_ps(v, v);
+    __m128 sum = _mm_add_ps(v, shuf);
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+static glm::vec3 pull_sse(const float* x, const float* y, const float* z, const float* m, size_t count, const glm::vec3& p, float eps_sq)
+{
+    __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z), eps = _mm_set1_ps(eps_sq);
+    __m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps();
+    size_t j = 0;
+    for(; j + 4 <= count; j += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + j), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + j), py);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + j), pz);
+        __m128 r_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), eps));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(r_sq));
+        __m128 s = _mm_mul_ps(_mm_mul_ps(inv, inv), _mm_mul_ps(inv, _mm_loadu_ps(m + j)));
+        s = _mm_and_ps(s, _mm_cmpgt_ps(r_sq, _mm_setzero_ps()));     // inf * 0 on the body itself
+        ax = _mm_add_ps(ax, _mm_mul_ps(dx, s));
+        ay = _mm_add_ps(ay, _mm_mul_ps(dy, s));
+        az = _mm_add_ps(az, _mm_mul_ps(dz, s));
+    }
+    glm::vec3 acc(hsum_sse(ax), hsum_sse(ay), hsum_sse(az));
+    return acc + pull_scalar(x + j, y + j, z + j, m + j, count - j, p, eps_sq);
+}
+
+SIMD_TARGET("avx2")
+static inline float hsum_avx2(__m256 v)
+{
+    return hsum_sse(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+SIMD_TARGET("avx2")
+static glm::vec3 pull_avx2(const float* x, const float* y, const float* z, const float* m, size_t count, const glm::vec3& p, float eps_sq)
+{
+    __m256 px = _mm256_set1_ps(p.x), py = _mm256_set1_ps(p.y), pz = _mm256_set1_ps(p.z), eps = _mm256_set1_ps(eps_sq);
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+    size_t j = 0;
+    for(; j + 8 <= count; j += 8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), px);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), py);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), pz);
+        __m256 r_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_add_ps(_mm256_mul_ps(dz, dz), eps));
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(r_sq));
+        __m256 s = _mm256_mul_ps(_mm256_mul_ps(inv, inv), _mm256_mul_ps(inv, _mm256_loadu_ps(m + j)));
+        s = _mm256_and_ps(s, _mm256_cmp_ps(r_sq, _mm256_setzero_ps(), _CMP_GT_OQ));
+        ax = _mm256_add_ps(ax, _mm256_mul_ps(dx, s));
+        ay = _mm256_add_ps(ay, _mm256_mul_ps(dy, s));
+        az = _mm256_add_ps(az, _mm256_mul_ps(dz, s));
+    }
+    glm::vec3 acc(hsum_avx2(ax), hsum_avx2(ay), hsum_avx2(az));
+    return acc + pull_scalar(x + j, y + j, z + j, m + j, count - j, p, eps_sq);
+}
+
+SIMD_TARGET("avx512f")
+static glm::vec3 pull_avx512(const float* x, const float* y, const float* z, const float* m, size_t count, const glm::vec3& p, float eps_sq)
+{
+    __m512 px = _mm512_set1_ps(p.x), py = _mm512_set1_ps(p.y), pz = _mm512_set1_ps(p.z), eps = _mm512_set1_ps(eps_sq);
+    __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps();
+    size_t j = 0;
+    for(; j + 16 <= count; j += 16)
+    {
+        __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), px);
+        __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), py);
+        __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), pz);
+        __m512 r_sq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_add_ps(_mm512_mul_ps(dz, dz), eps));
+        __m512 inv = _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(r_sq));
+        __m512 s = _mm512_mul_ps(_mm512_mul_ps(inv, inv), _mm512_mul_ps(inv, _mm512_loadu_ps(m + j)));
+        s = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(r_sq, _mm512_setzero_ps(), _CMP_GT_OQ), s);
+        ax = _mm512_add_ps(ax, _mm512_mul_ps(dx, s));
+        ay = _mm512_add_ps(ay, _mm512_mul_ps(dy, s));
+        az = _mm512_add_ps(az, _mm512_mul_ps(dz, s));
+    }
+    glm::vec3 acc(_mm512_reduce_add_ps(ax), _mm512_reduce_add_ps(ay), _mm512_reduce_add_ps(az));
+    return acc + pull_scalar(x + j, y + j, z + j, m + j, count - j, p, eps_sq);
+}
+
+#endif
+
+static PullFn pull_fn(SimdLevel level)
+{
+    if(level > simd_level()) level = simd_level();
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512: return pull_avx512;
+        case SIMD_AVX2: return pull_avx2;
+        case SIMD_SSE: return pull_sse;
+        default: break;
+    }
+#endif
+    return pull_scalar;
+}
+
+// Copies every body with mass into the body arrays in slot order
+static void gather_bodies(NBodyGravity& gravity, const ParticleWorld& world)
+{
+    size_t count = phys_world_count(world);
+    gravity.body_slot.clear();
+    for(size_t i = 0; i < count; i++)
+    {
+        if(world.mass_inv[i] > 0.0f) gravity.body_slot.push_back((uint32_t)i);
+    }
+}
+
+static void copy_bodies(NBodyGravity& gravity, const ParticleWorld& world)
+{
+    size_t count = gravity.body_slot.size();
+    gravity.body_x.resize(count);
+    gravity.body_y.resize(count);
+    gravity.body_z.resize(count);
+    gravity.body_mass.resize(count);
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t k = begin; k < end; k++)
+        {
+            uint32_t slot = gravity.body_slot[k];
+            gravity.body_x[k] = world.position.x[slot];
+            gravity.body_y[k] = world.position.y[slot];
+            gravity.body_z[k] = world.position.z[slot];
+            gravity.body_mass[k] = 1.0f / world.mass_inv[slot];
+        }
+    });
+}
+
+void nbody_build(NBodyGravity& gravity, const ParticleWorld& world)
+{
+    gravity.nodes.clear();
+    gather_bodies(gravity, world);
+    size_t count = gravity.body_slot.size();
+    if(count == 0) return;
+
+    // Bounding cube of everything with mass
+    glm::vec3 lo = world.position.get(gravity.body_slot[0]), hi = lo;
+    for(uint32_t slot : gravity.body_slot)
+    {
+        glm::vec3 p = world.position.get(slot);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    float size = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    if(size <= 0.0f) size = 1.0;
+
+    // Morton keys over the full 21 bits per axis so the tree can go all the way down
+    const float cells = (float)(1u << MORTON_AXIS_BITS);
+    float scale = cells / size;
+    gravity.keys.resize(count);
+    for(size_t k = 0; k < count; k++)
+    {
+        glm::vec3 cell = glm::min((world.position.get(gravity.body_slot[k]) - lo) * scale, glm::vec3(cells - 1.0f));
+        gravity.keys[k] = morton_encode(glm::uvec3(cell));
+    }
+    morton_sort(gravity.keys, gravity.body_slot, MORTON_AXIS_BITS * 3, gravity.key_scratch, gravity.slot_scratch);
+    copy_bodies(gravity, world);
+
+    // Breadth first, so every node's children get pushed together. Node corners and depths only matter while building.
+    std::vector<glm::vec4> corner;
+    gravity.nodes.push_back({ glm::vec3(0.0), 0.0, size, 0.0, 0, 0, 0, (uint32_t)count });
+    corner.push_back(glm::vec4(lo, 0.0));
+    for(size_t n = 0; n < gravity.nodes.size(); n++)
+    {
+        NBodyNode node = gravity.nodes[n];
+        uint32_t depth = (uint32_t)corner[n].w;
+        if(node.body_end - node.body_begin <= gravity.leaf_size || depth == MORTON_AXIS_BITS) continue;
+
+        // Bodies under the node share the key's top 3 * depth bits, the next 3 pick the child
+        uint32_t shift = 3 * (MORTON_AXIS_BITS - depth - 1);
+        float half = node.size * 0.5f;
+        gravity.nodes[n].first_child = (uint32_t)gravity.nodes.size();
+        for(uint32_t begin = node.body_begin; begin < node.body_end;)
+        {
+            uint64_t prefix = gravity.keys[begin] >> shift;
+            uint32_t end = (uint32_t)(std::partition_point(gravity.keys.begin() + begin, gravity.keys.begin() + node.body_end,
+                                                           [&](uint64_t key) { return key >> shift == prefix; }) - gravity.keys.begin());
+            uint32_t octant = (uint32_t)(prefix & 7);
+            glm::vec3 offset = glm::vec3(octant & 1, (octant >> 1) & 1, (octant >> 2) & 1) * half;
+
+            gravity.nodes.push_back({ glm::vec3(0.0), 0.0, half, 0.0, 0, 0, begin, end });
+            corner.push_back(glm::vec4(glm::vec3(corner[n]) + offset, depth + 1));
+            gravity.nodes[n].child_count++;
+            begin = end;
+        }
+    }
+
+    // Children always come after their parent so going backwards sums everything bottom up. Doubles because
+    // mass * position runs out of float range fast with planet sized numbers.
+    float theta = gravity.theta;
+    for(size_t n = gravity.nodes.size(); n-- > 0;)
+    {
+        NBodyNode& node = gravity.nodes[n];
+        double mass = 0.0;
+        glm::dvec3 moment(0.0);
+        if(node.child_count == 0)
+        {
+            for(uint32_t k = node.body_begin; k < node.body_end; k++)
+            {
+                mass += gravity.body_mass[k];
+                moment += glm::dvec3(gravity.body_x[k], gravity.body_y[k], gravity.body_z[k]) * (double)gravity.body_mass[k];
+            }
+        }
+        else
+        {
+            for(uint32_t c = node.first_child; c < node.first_child + node.child_count; c++)
+            {
+                mass += gravity.nodes[c].mass;
+                moment += glm::dvec3(gravity.nodes[c].center_of_mass) * (double)gravity.nodes[c].mass;
+            }
+        }
+        node.mass = (float)mass;
+        node.center_of_mass = mass > 0.0 ? glm::vec3(moment / mass) : glm::vec3(corner[n]) + node.size * 0.5f;
+
+        // Open when closer than size / theta plus however far the center of mass is off the middle of the cube (Barnes
+        // 1994), so a node whose mass is all bunched up in the near corner still gets opened. Keeps a body's own node from
+        // being treated as one lump for theta up to about 1.
+        float offset = glm::length(node.center_of_mass - (glm::vec3(corner[n]) + node.size * 0.5f));
+        float open = theta > 0.0f ? node.size / theta + offset : INFINITY;
+        node.open_sq = open * open;
+    }
+
+    // Walk groups: the biggest nodes with at most NBODY_GROUP bodies, in body order
+    gravity.groups.clear();
+    uint32_t stack[NBODY_STACK];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while(top > 0)
+    {
+        const NBodyNode& node = gravity.nodes[stack[--top]];
+        if(node.child_count == 0 || node.body_end - node.body_begin <= NBODY_GROUP)
+        {
+            gravity.groups.push_back((uint32_t)(&node - gravity.nodes.data()));
+            continue;
+        }
+        for(uint32_t c = node.child_count; c-- > 0;) stack[top++] = node.first_child + c;
+    }
+}
+
+// Squared distance from p to the box, 0 inside it
+static inline float box_dist_sq(const glm::vec3& p, const glm::vec3& lo, const glm::vec3& hi)
+{
+    glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0));
+    return glm::dot(d, d);
+}
+
+void nbody_apply_tree(NBodyGravity& gravity, ParticleWorld& world)
+{
+    nbody_build(gravity, world);
+    if(gravity.nodes.empty()) return;
+
+    PullFn pull = pull_fn(simd_level());
+    float eps_sq = gravity.softening * gravity.softening;
+    const float* x = gravity.body_x.data();
+    const float* y = gravity.body_y.data();
+    const float* z = gravity.body_z.data();
+    const float* m = gravity.body_mass.data();
+
+    // Every group walks the tree once for all of its bodies, opening nodes by the distance to the group's bounds (so
+    // it's never less accurate than walking per body). Accepted nodes are just one more body to pull on, so they
+    // and the bodies of every leaf reached go into one list that the SIMD kernel runs over for each body.
+    phys_parallel_for(world.pool, gravity.groups.size(), NBODY_GROUP_CHUNK, [&](size_t begin, size_t end) {
+        uint32_t stack[NBODY_STACK];
+        FloatArray lx, ly, lz, lm;
+        for(size_t g = begin; g < end; g++)
+        {
+            const NBodyNode& group = gravity.nodes[gravity.groups[g]];
+            glm::vec3 lo(x[group.body_begin], y[group.body_begin], z[group.body_begin]), hi = lo;
+            for(uint32_t k = group.body_begin + 1; k < group.body_end; k++)
+            {
+                lo = glm::min(lo, glm::vec3(x[k], y[k], z[k]));
+                hi = glm::max(hi, glm::vec3(x[k], y[k], z[k]));
+            }
+
+            lx.clear(); ly.clear(); lz.clear(); lm.clear();
+            uint32_t top = 0;
+            stack[top++] = 0;
+            while(top > 0)
+            {
+                const NBodyNode& node = gravity.nodes[stack[--top]];
+                if(node.child_count == 0)
+                {
+                    lx.insert(lx.end(), x + node.body_begin, x + node.body_end);
+                    ly.insert(ly.end(), y + node.body_begin, y + node.body_end);
+                    lz.insert(lz.end(), z + node.body_begin, z + node.body_end);
+                    lm.insert(lm.end(), m + node.body_begin, m + node.body_end);
+                }
+                else if(box_dist_sq(node.center_of_mass, lo, hi) > node.open_sq)
+                {
+                    lx.push_back(node.center_of_mass.x);
+                    ly.push_back(node.center_of_mass.y);
+                    lz.push_back(node.center_of_mass.z);
+                    lm.push_back(node.mass);
+                }
+                else
+                {
+                    for(uint32_t c = 0; c < node.child_count; c++) stack[top++] = node.first_child + c;
+                }
+            }
+
+            for(uint32_t k = group.body_begin; k < group.body_end; k++)
+            {
+                glm::vec3 acc = pull(lx.data(), ly.data(), lz.data(), lm.data(), lx.size(), glm::vec3(x[k], y[k], z[k]), eps_sq);
+                uint32_t slot = gravity.body_slot[k];
+                world.force.set(slot, world.force.get(slot) + acc * (gravity.G * m[k]));
+            }
+        }
+    });
+}
+
+void nbody_apply_direct(NBodyGravity& gravity, ParticleWorld& world, SimdLevel level)
+{
+    gather_bodies(gravity, world);
+    copy_bodies(gravity, world);
+
+    PullFn pull = pull_fn(level);
+    float eps_sq = gravity.softening * gravity.softening;
+    size_t count = gravity.body_slot.size();
+    phys_parallel_for(world.pool, count, NBODY_CHUNK, [&](size_t begin, size_t end) {
+        for(size_t k = begin; k < end; k++)
+        {
+            glm::vec3 p(gravity.body_x[k], gravity.body_y[k], gravity.body_z[k]);
+            glm::vec3 acc = pull(gravity.body_x.data(), gravity.body_y.data(), gravity.body_z.data(), gravity.body_mass.data(), count, p, eps_sq);
+
+            uint32_t slot = gravity.body_slot[k];
+            world.force.set(slot, world.force.get(slot) + acc * (gravity.G * gravity.body_mass[k]));
+        }
+    });
+}
+
+void nbody_apply_direct(NBodyGravity& gravity, ParticleWorld& world)
+{
+    nbody_apply_direct(gravity, world, simd_level());
+}
+
+void nbody_apply(NBodyGravity& gravity, ParticleWorld& world)
+{
+    if(phys_world_count(world) < gravity.direct_below) nbody_apply_direct(gravity, world);
+    else nbody_apply_tree(gravity, world);
+}
+
+void nbody_update(NBodyGravity& gravity, ParticleWorld& world, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            nbody_apply(gravity, world);
+            phys_world_step(world, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(phys_world_checksum(world));
+    }
+}
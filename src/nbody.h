@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+#include "physics_simd.h"
+
+/*
+    Real gravity between particles, f = G * m1 * m2 / r^2, for the case physics.h's note at the top leaves out.
+
+    Summing every pair is O(n^2), which stops being an option somewhere in the tens of thousands of bodies. Barnes-Hut
+    gets that down to O(n log n): every step the bodies go into an octree, every node knows the total mass and center of
+    mass of everything under it, and a body only looks inside a node when the node looks big from where the body is
+    (size / distance > theta). Anything further away gets pulled on by the node's center of mass as one body.
+    theta = 0 opens every node and gives the same answer as summing every pair, 0.5 - 0.7 is the usual range.
+
+    The tree is built out of Morton sorted bodies (see spatial_sort.h): the bodies under any node of the octree are one
+    contiguous run of the sorted order, so building it is just splitting runs wherever the next 3 key bits change. Nodes
+    live in one flat array in breadth first order with the children of every node next to each other, and the bodies get
+    copied into the tree in sorted order so the leaves are read front to back. The force pass doesn't walk the tree per
+    body: the bodies are cut into groups (the biggest nodes with at most NBODY_GROUP bodies) and every group walks it
+    once, opening nodes by the distance to the group's bounds. That gives one interaction list of accepted nodes and leaf
+    bodies shared by the whole group, which the SIMD kernel then runs over for each body. Groups spread across
+    world.pool in sorted order.
+
+    nbody_apply_direct is the plain O(n^2) sum with SSE / AVX2 / AVX-512 kernels (same levels as physics_simd.h). It's
+    the reference the tree gets checked against, and faster than the tree anyway for a few thousand bodies or less.
+
+    Only particles with mass pull on anything, infinite mass particles (mass_inv = 0) neither pull nor get pulled.
+    softening gets added to every distance as r^2 + softening^2 so close encounters don't fling bodies off at
+    ridiculous speeds.
+*/
+
+// One octree node. Leaves have no children and at most leaf_size bodies, unless every body in them is in the same spot.
+struct NBodyNode
+{
+    glm::vec3 center_of_mass;
+    float mass;
+    float size;                 // Edge length of the node's cube
+    float open_sq;              // Bodies closer to the center of mass than sqrt(open_sq) look inside
+    uint32_t first_child;       // Children are next to each other in the node array
+    uint32_t child_count;       // 0 = leaf
+    uint32_t body_begin;        // Sorted bodies under this node
+    uint32_t body_end;
+};
+
+struct NBodyGravity
+{
+    float G = 6.674e-11;
+    float theta = 0.5;                  // Opening angle, 0 = exact
+    float softening = 0.0;
+    uint32_t leaf_size = 8;             // Most bodies a leaf holds
+    uint32_t direct_below = 2048;       // nbody_apply sums every pair instead of building a tree for fewer bodies than this
+
+    // The tree, rebuilt by nbody_build
+    std::vector<NBodyNode> nodes;       // nodes[0] is the root
+    std::vector<uint32_t> groups;       // Nodes that walk the tree together, in body order
+    FloatArray body_x;                  // Bodies with mass in sorted order
+    FloatArray body_y;
+    FloatArray body_z;
+    FloatArray body_mass;
+    std::vector<uint32_t> body_slot;    // World slot of every sorted body
+
+    // Scratch
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> key_scratch;
+    std::vector<uint32_t> slot_scratch;
+};
+
+// Sorts the bodies and builds the tree
+void nbody_build(NBodyGravity& gravity, const ParticleWorld& world);
+
+// Adds the pull of every other body to world.force using the tree (builds it first)
+void nbody_apply_tree(NBodyGravity& gravity, ParticleWorld& world);
+
+// Same but summing every pair, level picks the kernel (gets clamped to what the cpu supports)
+void nbody_apply_direct(NBodyGravity& gravity, ParticleWorld& world);
+void nbody_apply_direct(NBodyGravity& gravity, ParticleWorld& world, SimdLevel level);
+
+// Direct below direct_below bodies, tree from there on
+void nbody_apply(NBodyGravity& gravity, ParticleWorld& world);
+
+// Fixed step driver, same as phys_world_update with nbody_apply before every step. Bodies usually want their
+// acceleration set to 0, otherwise they fall towards -y on top of pulling on each other.
+void nbody_update(NBodyGravity& gravity, ParticleWorld& world, FixedStepper& stepper, double frame_delta);
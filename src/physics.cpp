@@ -1,5 +1,10 @@
 #include "physics.h"
+#include "integrators.h"
+#include "ccd.h"
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
 
 void phys_integrate(PhysicsParticle& p, float delta)
 {
@@ -15,4 +20,303 @@ void phys_integrate(PhysicsParticle& p, float delta)
 
     // apply drag
     p.velocity *= powf(p.damping, delta);
-}
\ No newline at end of file
+}
+
+void phys_world_reserve(ParticleWorld& world, size_t count)
+{
+    world.position.reserve(count);
+    world.velocity.reserve(count);
+    world.acceleration.reserve(count);
+    world.damping.reserve(count);
+    world.mass_inv.reserve(count);
+    world.radius.reserve(count);
+    world.force.reserve(count);
+    world.drag.reserve(count);
+    world.previous_position.reserve(count);
+    world.handles.slot_to_handle.reserve(count);
+}
+
+uint32_t handle_table_add(HandleTable& table)
+{
+    uint32_t slot = (uint32_t)table.slot_to_handle.size();
+
+    uint32_t handle;
+    if(!table.free_handles.empty())
+    {
+        handle = table.free_handles.back();
+        table.free_handles.pop_back();
+        table.handle_to_slot[handle] = slot;
+    }
+    else
+    {
+        handle = (uint32_t)table.handle_to_slot.size();
+        table.handle_to_slot.push_back(slot);
+    }
+
+    table.slot_to_handle.push_back(handle);
+    return handle;
+}
+
+uint32_t handle_table_remove(HandleTable& table, uint32_t handle)
+{
+    uint32_t slot = handle_table_slot(table, handle);
+    if(slot == UINT32_MAX) return UINT32_MAX;
+
+    uint32_t moved = table.slot_to_handle.back();
+    swap_remove(table.slot_to_handle, slot);
+
+    table.handle_to_slot[moved] = slot;
+    table.handle_to_slot[handle] = UINT32_MAX;
+    table.free_handles.push_back(handle);
+    return slot;
+}
+
+ParticleHandle phys_world_add(ParticleWorld& world, const PhysicsParticle& particle)
+{
+    ParticleHandle handle = handle_table_add(world.handles);
+
+    world.position.push_back(particle.position);
+    world.previous_position.push_back(particle.position);
+    world.velocity.push_back(particle.velocity);
+    world.acceleration.push_back(particle.acceleration);
+    world.damping.push_back(particle.damping);
+    world.mass_inv.push_back(particle.mass_inv);
+    world.radius.push_back(particle.radius);
+    world.ccd_threshold.push_back(particle.ccd_threshold);
+    world.force.push_back(glm::vec3(0.0));
+    world.drag.push_back(powf(particle.damping, world.drag_delta));
+    world.slot_version++;
+
+    return handle;
+}
+
+void phys_world_remove(ParticleWorld& world, ParticleHandle handle)
+{
+    // Fill the hole with the last particle so the arrays stay packed
+    uint32_t slot = handle_table_remove(world.handles, handle);
+    if(slot == UINT32_MAX)
+    {
+        std::cerr << "PHYSICS: tried to remove invalid particle <handle: " << handle << ">" << std::endl;
+        return;
+    }
+
+    world.position.swap_remove(slot);
+    world.previous_position.swap_remove(slot);
+    world.velocity.swap_remove(slot);
+    world.acceleration.swap_remove(slot);
+    world.force.swap_remove(slot);
+    swap_remove(world.damping, slot);
+    swap_remove(world.mass_inv, slot);
+    swap_remove(world.radius, slot);
+    swap_remove(world.ccd_threshold, slot);
+    swap_remove(world.drag, slot);
+    world.slot_version++;
+}
+
+uint32_t phys_world_slot(const ParticleWorld& world, ParticleHandle handle)
+{
+    return handle_table_slot(world.handles, handle);
+}
+
+// arr[i] = arr[order[i]] through scratch, which ends up holding the old array
+static void gather(ThreadPool* pool, size_t chunk_size, FloatArray& arr, FloatArray& scratch, const std::vector<uint32_t>& order)
+{
+    scratch.resize(arr.size());
+    phys_parallel_for(pool, order.size(), chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) scratch[i] = arr[order[i]];
+    });
+    arr.swap(scratch);
+}
+
+void phys_world_reorder(ParticleWorld& world, const std::vector<uint32_t>& order)
+{
+    size_t count = phys_world_count(world);
+    if(order.size() != count) return;
+
+    FloatArray scratch;
+    Vec3Array* vectors[] = { &world.position, &world.previous_position, &world.velocity, &world.acceleration, &world.force };
+    for(Vec3Array* v : vectors)
+    {
+        gather(world.pool, world.chunk_size, v->x, scratch, order);
+        gather(world.pool, world.chunk_size, v->y, scratch, order);
+        gather(world.pool, world.chunk_size, v->z, scratch, order);
+    }
+    FloatArray* floats[] = { &world.damping, &world.mass_inv, &world.radius, &world.ccd_threshold, &world.drag };
+    for(FloatArray* f : floats) gather(world.pool, world.chunk_size, *f, scratch, order);
+
+    std::vector<uint32_t> slot_to_handle(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        slot_to_handle[i] = world.handles.slot_to_handle[order[i]];
+        world.handles.handle_to_slot[slot_to_handle[i]] = (uint32_t)i;
+    }
+    world.handles.slot_to_handle.swap(slot_to_handle);
+    world.slot_version++;
+}
+
+PhysicsParticle phys_world_get(const ParticleWorld& world, ParticleHandle handle)
+{
+    PhysicsParticle p{};
+    uint32_t slot = phys_world_slot(world, handle);
+    if(slot == UINT32_MAX) return p;
+
+    p.position = world.position.get(slot);
+    p.velocity = world.velocity.get(slot);
+    p.acceleration = world.acceleration.get(slot);
+    p.damping = world.damping[slot];
+    p.mass_inv = world.mass_inv[slot];
+    p.radius = world.radius[slot];
+    p.ccd_threshold = world.ccd_threshold[slot];
+    return p;
+}
+
+size_t phys_world_count(const ParticleWorld& world)
+{
+    return handle_table_count(world.handles);
+}
+
+void phys_world_add_force(ParticleWorld& world, ParticleHandle handle, const glm::vec3& force)
+{
+    uint32_t slot = phys_world_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+
+    world.force.x[slot] += force.x;
+    world.force.y[slot] += force.y;
+    world.force.z[slot] += force.z;
+}
+
+size_t phys_chunk_size(size_t count, uint32_t thread_count)
+{
+    const size_t floats_per_line = PHYS_CACHE_LINE / sizeof(float);
+    const size_t min_chunk = 4096;
+
+    // Aim for a few chunks per thread so a slow thread doesn't hold everybody else up at the barrier
+    size_t workers = (size_t)thread_count + 1;
+    size_t chunk = count / (workers * 4);
+    if(chunk < min_chunk) chunk = min_chunk;
+
+    return (chunk + floats_per_line - 1) / floats_per_line * floats_per_line;
+}
+
+void phys_world_step(ParticleWorld& world, float delta)
+{
+    switch(world.integrator)
+    {
+        case INTEGRATOR_EXPLICIT_EULER: phys_world_step_with<ExplicitEuler>(world, delta); break;
+        case INTEGRATOR_SYMPLECTIC_EULER: phys_world_step_with<SymplecticEuler>(world, delta); break;
+        case INTEGRATOR_VELOCITY_VERLET: phys_world_step_with<VelocityVerlet>(world, delta); break;
+        case INTEGRATOR_POSITION_VERLET: phys_world_step_with<PositionVerlet>(world, delta); break;
+        case INTEGRATOR_RK4: phys_world_step_with<RK4>(world, delta); break;
+    }
+
+    if(world.statics)
+    {
+        phys_world_collide_static(world, world.statics->mesh, world.statics->planes, delta, world.statics->restitution);
+    }
+}
+
+uint32_t phys_stepper_advance(FixedStepper& stepper, double frame_delta)
+{
+    if(frame_delta < 0.0) frame_delta = 0.0;
+    if(frame_delta > stepper.max_frame) frame_delta = stepper.max_frame;
+
+    stepper.accumulator += frame_delta;
+    stepper.checksums.clear();
+
+    uint32_t steps = (uint32_t)(stepper.accumulator / stepper.step);
+    stepper.accumulator -= steps * (double)stepper.step;
+
+    // Spiral of death guard. If a step costs more than it simulates we'd fall further behind every frame,
+    // so just drop the extra time and let the sim run slow for a bit.
+    if(steps > stepper.max_steps)
+    {
+        stepper.dropped_steps += steps - stepper.max_steps;
+        steps = stepper.max_steps;
+    }
+
+    stepper.alpha = (float)(stepper.accumulator / stepper.step);
+    return steps;
+}
+
+void phys_world_update(ParticleWorld& world, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        // Only the state right before the last step matters for interpolation
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            phys_world_step(world, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(phys_world_checksum(world));
+    }
+}
+
+uint64_t phys_checksum(uint64_t hash, const void* data, size_t bytes)
+{
+    const uint64_t prime = 1099511628211ull;
+    const unsigned char* bytes_in = (const unsigned char*)data;
+
+    // A word at a time instead of a byte, hashing a big world every step shouldn't cost more than the step
+    size_t i = 0;
+    for(; i + 4 <= bytes; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, bytes_in + i, 4);
+        hash = (hash ^ word) * prime;
+    }
+    for(; i < bytes; i++) hash = (hash ^ bytes_in[i]) * prime;
+    return hash;
+}
+
+static uint64_t checksum_floats(uint64_t hash, const FloatArray& arr)
+{
+    return phys_checksum(hash, arr.data(), arr.size() * sizeof(float));
+}
+
+static uint64_t checksum_vec3s(uint64_t hash, const Vec3Array& arr)
+{
+    hash = checksum_floats(hash, arr.x);
+    hash = checksum_floats(hash, arr.y);
+    return checksum_floats(hash, arr.z);
+}
+
+uint64_t phys_world_checksum(const ParticleWorld& world)
+{
+    const std::vector<uint32_t>& handles = world.handles.slot_to_handle;
+    uint64_t hash = phys_checksum(PHYS_CHECKSUM_SEED, handles.data(), handles.size() * sizeof(uint32_t));
+    hash = checksum_vec3s(hash, world.position);
+    hash = checksum_vec3s(hash, world.velocity);
+    hash = checksum_vec3s(hash, world.acceleration);
+    hash = checksum_vec3s(hash, world.force);
+    hash = checksum_floats(hash, world.damping);
+    hash = checksum_floats(hash, world.mass_inv);
+    return checksum_floats(hash, world.radius);
+}
+
+glm::vec3 phys_world_interpolate(const ParticleWorld& world, ParticleHandle handle, float alpha)
+{
+    uint32_t slot = phys_world_slot(world, handle);
+    if(slot == UINT32_MAX) return glm::vec3(0.0);
+
+    return glm::mix(world.previous_position.get(slot), world.position.get(slot), alpha);
+}
+
+void phys_world_interpolate(const ParticleWorld& world, float alpha, std::vector<glm::vec3>& out)
+{
+    size_t count = phys_world_count(world);
+    out.resize(count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        out[i] = glm::mix(world.previous_position.get(i), world.position.get(i), alpha);
+    }
+}
@@ -1,17 +1,25 @@
 #pragma once
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "ThreadPool.h"
 
 /*
     Important Assumptions:
     Right now just treating gravity like it is on earth.
     If we wanted to simulate gravitational force between two objects (not just earth and any object)
     then we would need to use the classic f = G(m1m2)/r^2 equation.
+    (nbody.h does that between every particle with mass, give those particles 0 acceleration.)
 */
 
 #define grav 9.8
 
+// Description of a single particle. The simulation itself doesn't store these anymore (see ParticleWorld)
+// but it's still the easiest way to describe a particle when adding it to a world.
 struct PhysicsParticle
 {
     glm::vec3 position = glm::vec3(0.0);
@@ -19,7 +27,299 @@ struct PhysicsParticle
     glm::vec3 acceleration = glm::vec3(0.0, -grav, 0.0);
     float damping = 1.0;    // Might want to make this less than 1 to account for accuracy issues that might add more to v than we want
     float mass_inv = 0;     // store the inverse of the math so we can easily represent infinite mass (mass_inv = 0);
+    float radius = 0;       // Collision radius. 0 means the particle never collides with anything.
+    float ccd_threshold = 1.0;  // Moving further than this * radius in one step gets swept instead of tested where it ends up (see ccd.h), 0 = never
 };
 
+// Handle to a particle inside a ParticleWorld.
+// The particle's slot in the arrays moves around when other particles get removed (we swap the last one into the hole)
+// but the handle stays the same until the particle itself is removed.
+typedef uint32_t ParticleHandle;
+#define INVALID_PARTICLE UINT32_MAX
 
-void phys_integrate(PhysicsParticle& particle, float delta);
\ No newline at end of file
+// Cache line size we line the particle arrays up to. Chunks handed to different threads start on a multiple of this
+// so two threads never write to the same line.
+#define PHYS_CACHE_LINE 64
+
+template <typename T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        // aligned_alloc wants the size to be a multiple of the alignment
+        size_t bytes = (n * sizeof(T) + PHYS_CACHE_LINE - 1) / PHYS_CACHE_LINE * PHYS_CACHE_LINE;
+#if defined(_MSC_VER)
+        void* ptr = _aligned_malloc(bytes, PHYS_CACHE_LINE);
+#else
+        void* ptr = std::aligned_alloc(PHYS_CACHE_LINE, bytes);
+#endif
+        if(!ptr) throw std::bad_alloc();
+        return (T*)ptr;
+    }
+
+    void deallocate(T* ptr, size_t)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float>> FloatArray;
+
+// A vec3 per element but stored as three separate float arrays so loops over one component
+// walk memory linearly (and can be vectorized later on).
+struct Vec3Array
+{
+    FloatArray x;
+    FloatArray y;
+    FloatArray z;
+
+    size_t size() const { return x.size(); }
+
+    glm::vec3 get(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    void set(size_t i, const glm::vec3& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+
+    void push_back(const glm::vec3& v)
+    {
+        x.push_back(v.x);
+        y.push_back(v.y);
+        z.push_back(v.z);
+    }
+
+    // Moves the last element into slot i and shrinks the array by one
+    void swap_remove(size_t i)
+    {
+        x[i] = x.back(); x.pop_back();
+        y[i] = y.back(); y.pop_back();
+        z[i] = z.back(); z.pop_back();
+    }
+
+    void reserve(size_t count)
+    {
+        x.reserve(count);
+        y.reserve(count);
+        z.reserve(count);
+    }
+
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+
+    void swap(Vec3Array& other)
+    {
+        x.swap(other.x);
+        y.swap(other.y);
+        z.swap(other.z);
+    }
+};
+
+// Moves the last element into slot i and shrinks the array by one
+template <typename T, typename A>
+void swap_remove(std::vector<T, A>& arr, size_t i)
+{
+    arr[i] = arr.back();
+    arr.pop_back();
+}
+
+// Maps stable handles onto slots in tightly packed arrays.
+// Removing something moves the last element into its slot so the arrays never have holes,
+// the table keeps track of where every handle ended up.
+struct HandleTable
+{
+    std::vector<uint32_t> slot_to_handle;
+    std::vector<uint32_t> handle_to_slot;       // UINT32_MAX if the handle is free
+    std::vector<uint32_t> free_handles;
+};
+
+// Hands out a handle for a new element at the end of the arrays (slot = count before the add)
+uint32_t handle_table_add(HandleTable& table);
+
+// Frees handle and returns the slot it was in. The caller has to swap_remove that slot in all of its arrays
+// (the table already assumes the last element moved into it). Returns UINT32_MAX if the handle isn't valid.
+uint32_t handle_table_remove(HandleTable& table, uint32_t handle);
+
+inline uint32_t handle_table_slot(const HandleTable& table, uint32_t handle)
+{
+    if(handle >= table.handle_to_slot.size()) return UINT32_MAX;
+    return table.handle_to_slot[handle];
+}
+
+inline size_t handle_table_count(const HandleTable& table)
+{
+    return table.slot_to_handle.size();
+}
+
+struct ForceRegistry;
+struct StaticCollision;
+
+// Which integration scheme a world steps with. Each one is its own template instantiation (see integrators.h)
+// so the choice gets made once per step, not once per particle.
+enum Integrator
+{
+    INTEGRATOR_EXPLICIT_EULER,      // What phys_integrate does. Cheapest but gains energy, only here as a reference.
+    INTEGRATOR_SYMPLECTIC_EULER,    // Same cost as explicit but doesn't blow up orbits / springs
+    INTEGRATOR_VELOCITY_VERLET,     // Kick-drift-kick, 2 force evaluations
+    INTEGRATOR_POSITION_VERLET,     // Drift-kick-drift (Stormer), 1 force evaluation
+    INTEGRATOR_RK4                  // 4 force evaluations, most accurate per step but not symplectic
+};
+
+// Temporary arrays the multi-stage integrators need. Only get sized when an integrator actually uses them.
+struct IntegratorScratch
+{
+    Vec3Array external_force;       // Forces added between steps, held constant across the stages of one step
+    Vec3Array start_position;       // RK4 state at the beginning of the step
+    Vec3Array start_velocity;
+    Vec3Array sum_position;         // RK4 weighted sum of the stage derivatives
+    Vec3Array sum_velocity;
+};
+
+// All of the particles in a simulation stored as a structure of arrays.
+// Index i in every array belongs to the same particle.
+struct ParticleWorld
+{
+    Vec3Array position;
+    Vec3Array velocity;
+    Vec3Array acceleration;
+    FloatArray damping;
+    FloatArray mass_inv;
+    FloatArray radius;
+    FloatArray ccd_threshold;
+
+    // Force accumulator. Generators and phys_world_add_force sum into this, the step turns it into acceleration and clears it.
+    Vec3Array force;
+    ForceRegistry* forces = nullptr;    // Optional force generators run at the start of every step (see forces.h)
+
+    // damping^delta for every particle. Only changes when delta does so we keep it around instead of
+    // calling pow for every particle every step.
+    FloatArray drag;
+    float drag_delta = 0.0;
+
+    // Positions at the start of the last step of the previous update, used to blend between states when rendering
+    Vec3Array previous_position;
+
+    Integrator integrator = INTEGRATOR_SYMPLECTIC_EULER;
+    IntegratorScratch scratch;
+
+    // Optional static geometry every step collides the particles with (see ccd.h). Not owned by the world.
+    StaticCollision* statics = nullptr;
+
+    // If set the step gets split into chunks of chunk_size particles that run across the pool.
+    // chunk_size = 0 picks one based on particle count (see phys_chunk_size).
+    ThreadPool* pool = nullptr;
+    size_t chunk_size = 0;
+
+    HandleTable handles;
+    uint32_t slot_version = 0;      // Bumped whenever particles get added, removed or reordered, so anything holding slots knows to look them up again
+};
+
+// Drives the simulation at a fixed rate no matter what the frame rate is doing.
+// Frame time goes into an accumulator and gets spent in fixed size steps, whatever is left over becomes alpha
+// so the renderer can blend between the previous and current state.
+struct FixedStepper
+{
+    float step = 1.0 / 60.0;        // Length of one simulation step in seconds
+    uint32_t substeps = 1;          // Each step gets split into this many integrations
+    uint32_t max_steps = 5;         // Max steps per frame. If we fall further behind than this we drop time instead of spiralling
+    double max_frame = 0.25;        // Frame deltas bigger than this (breakpoints, window drags) get clamped
+
+    double accumulator = 0.0;
+    float alpha = 0.0;              // [0, 1) how far between the previous and current state we are
+    uint32_t dropped_steps = 0;     // Running total of steps thrown away by the max_steps guard
+
+    // If set every update function hashes the whole state after each step it runs into checksums (see
+    // phys_world_checksum), cleared at the start of every update. Compare them to catch two runs drifting apart.
+    bool record_checksums = false;
+    std::vector<uint64_t> checksums;
+};
+
+// Adds frame_delta to the accumulator and returns how many fixed steps should be run this frame
+uint32_t phys_stepper_advance(FixedStepper& stepper, double frame_delta);
+
+void phys_world_reserve(ParticleWorld& world, size_t count);
+ParticleHandle phys_world_add(ParticleWorld& world, const PhysicsParticle& particle);
+void phys_world_remove(ParticleWorld& world, ParticleHandle handle);
+uint32_t phys_world_slot(const ParticleWorld& world, ParticleHandle handle);
+
+// Shuffles the particles so slot i ends up holding whatever was in slot order[i] (order has every slot exactly once).
+// Handles keep pointing at the same particles. Used to keep particles that are close in space close in memory.
+void phys_world_reorder(ParticleWorld& world, const std::vector<uint32_t>& order);
+PhysicsParticle phys_world_get(const ParticleWorld& world, ParticleHandle handle);
+size_t phys_world_count(const ParticleWorld& world);
+
+// Chunk size for splitting count particles over thread_count threads. Always a whole number of cache lines
+// and big enough that the cost of handing out a chunk doesn't matter.
+size_t phys_chunk_size(size_t count, uint32_t thread_count);
+
+// Runs kernel(begin, end) over [0, count). With a pool the range gets split into cache line multiples of chunk_size
+// (0 = phys_chunk_size) and spread over the workers, returning once every chunk is done.
+template <typename Kernel>
+void phys_parallel_for(ThreadPool* pool, size_t count, size_t chunk_size, const Kernel& kernel)
+{
+    if(!pool)
+    {
+        kernel((size_t)0, count);
+        return;
+    }
+
+    // Keep chunk boundaries on cache lines even if somebody asked for an odd size
+    const size_t floats_per_line = PHYS_CACHE_LINE / sizeof(float);
+    size_t chunk = chunk_size ? chunk_size : phys_chunk_size(count, pool->size());
+    chunk = (chunk + floats_per_line - 1) / floats_per_line * floats_per_line;
+
+    pool->parallel_for(count, chunk, kernel);
+}
+
+// Adds a force that will be applied during the next step
+void phys_world_add_force(ParticleWorld& world, ParticleHandle handle, const glm::vec3& force);
+
+// Integrates every particle in the world by delta using world.integrator
+void phys_world_step(ParticleWorld& world, float delta);
+
+// Advances the world by frame_delta using the stepper. Runs however many fixed steps fit
+// and keeps previous_position up to date for interpolation.
+void phys_world_update(ParticleWorld& world, FixedStepper& stepper, double frame_delta);
+
+/*
+    Determinism:
+    The same scene with the same inputs steps to bit for bit the same state no matter how many threads world.pool has,
+    so regression runs and lockstep replays can use every thread. There's no switch for it, it's how everything works:
+    every job only writes its own slots, sums always run in slot (or sorted) order, pairs come out of the broadphases in
+    an order that only depends on the scene, and nothing adds up per thread results in whatever order the threads finish.
+    The build turns off FMA contraction (see CMakeLists.txt) so the integrators round exactly the same in the scalar and
+    every SIMD path.
+
+    What can still change the bits is the SIMD level: kernels that sum across lanes (nbody.cpp) add in a different order
+    at every level. Runs that have to match across different cpus should simd_set_level the same level everywhere.
+
+    The checksums hash the raw bits of the state in slot order, so -0 vs 0 and different NaNs count as different. The hash
+    is FNV style but not FNV-1a: it starts at the FNV-1a offset basis and does hash = (hash ^ word) * 1099511628211 for
+    every 32-bit word (native byte order), only the bytes left over at the end go in one at a time.
+*/
+#define PHYS_CHECKSUM_SEED 14695981039346656037ull
+
+// Folds bytes into hash, a 32-bit word at a time (see above)
+uint64_t phys_checksum(uint64_t hash, const void* data, size_t bytes);
+
+// Handles, position, velocity, acceleration, force, damping, mass and radius of every particle
+uint64_t phys_world_checksum(const ParticleWorld& world);
+
+// Blends between previous_position and position (alpha = 0 is previous, alpha = 1 is current)
+glm::vec3 phys_world_interpolate(const ParticleWorld& world, ParticleHandle handle, float alpha);
+void phys_world_interpolate(const ParticleWorld& world, float alpha, std::vector<glm::vec3>& out);
+
+// Single particle version. Kept around as the reference INTEGRATOR_EXPLICIT_EULER should match.
+void phys_integrate(PhysicsParticle& particle, float delta);
@@ -0,0 +1,101 @@
+#include "physics_bench.h"
+#include "integrators.h"
+#include "forces.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+
+static const float bench_stiffness = 40.0;
+static const float bench_mass = 1.0;
+static const float bench_delta = 1.0 / 60.0;
+
+// Every particle hangs off its own spring so the exact energy is easy to work out:
+// kinetic + spring potential + gravitational potential. With no damping it should stay constant.
+static void bench_scene(ParticleWorld& world, ForceRegistry& forces, uint32_t particle_count)
+{
+    phys_world_reserve(world, particle_count);
+    world.forces = &forces;
+
+    for(uint32_t i = 0; i < particle_count; i++)
+    {
+        glm::vec3 anchor = glm::vec3((float)(i % 1000), 0.0, (float)(i / 1000));
+
+        PhysicsParticle p;
+        p.acceleration = glm::vec3(0.0);
+        p.mass_inv = 1.0f / bench_mass;
+        p.position = anchor + glm::vec3(0.0, -1.0f - 0.001f * (i % 97), 0.0);
+        p.velocity = glm::vec3(0.1f * (i % 13), 0.0, 0.0);
+
+        ParticleHandle h = phys_world_add(world, p);
+        forces.gravity.push_back({ h });
+
+        AnchoredSpringForce spring;
+        spring.particle = h;
+        spring.anchor = anchor;
+        spring.stiffness = bench_stiffness;
+        spring.rest_length = 0.0;
+        forces.anchored_springs.push_back(spring);
+    }
+}
+
+static double bench_energy(const ParticleWorld& world, const ForceRegistry& forces)
+{
+    double energy = 0.0;
+    for(const AnchoredSpringForce& spring : forces.anchored_springs)
+    {
+        uint32_t slot = phys_world_slot(world, spring.particle);
+        glm::vec3 x = world.position.get(slot);
+        glm::vec3 v = world.velocity.get(slot);
+        glm::vec3 stretch = x - spring.anchor;
+
+        energy += 0.5 * bench_mass * glm::dot(v, v);
+        energy += 0.5 * bench_stiffness * glm::dot(stretch, stretch);
+        energy += bench_mass * grav * x.y;
+    }
+    return energy;
+}
+
+template <typename Scheme>
+static void bench_scheme(Integrator integrator, uint32_t particle_count, uint32_t steps)
+{
+    ParticleWorld world;
+    ForceRegistry forces;
+    bench_scene(world, forces, particle_count);
+
+    double start_energy = bench_energy(world, forces);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        phys_world_step_with<Scheme>(world, bench_delta);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    double drift = (bench_energy(world, forces) - start_energy) / std::fabs(start_energy);
+
+    std::cout << std::left << std::setw(20) << phys_integrator_name(integrator)
+              << std::right << std::setw(12) << std::fixed << std::setprecision(2) << ns / ((double)particle_count * steps)
+              << std::setw(16) << std::scientific << std::setprecision(3) << drift << std::endl;
+}
+
+int phys_bench_integrators(uint32_t particle_count, uint32_t steps)
+{
+    if(particle_count == 0 || steps == 0)
+    {
+        std::cerr << "BENCH: particle count and steps need to be more than 0" << std::endl;
+        return -1;
+    }
+
+    std::cout << "BENCH: integrators <particles: " << particle_count << ", steps: " << steps << ", delta: " << bench_delta << ">" << std::endl;
+    std::cout << std::left << std::setw(20) << "integrator" << std::right << std::setw(12) << "ns/particle" << std::setw(16) << "energy drift" << std::endl;
+
+    bench_scheme<ExplicitEuler>(INTEGRATOR_EXPLICIT_EULER, particle_count, steps);
+    bench_scheme<SymplecticEuler>(INTEGRATOR_SYMPLECTIC_EULER, particle_count, steps);
+    bench_scheme<VelocityVerlet>(INTEGRATOR_VELOCITY_VERLET, particle_count, steps);
+    bench_scheme<PositionVerlet>(INTEGRATOR_POSITION_VERLET, particle_count, steps);
+    bench_scheme<RK4>(INTEGRATOR_RK4, particle_count, steps);
+
+    return 0;
+}
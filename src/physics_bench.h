@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+
+/*
+    Benchmarks that don't need a window. Run with:
+        box --bench-integrators [particle count] [steps]
+*/
+
+// Steps a field of particles on anchored springs under gravity with every integrator and prints
+// ns per particle per step and how far the total energy drifted. Returns 0 on success so main can return it.
+int phys_bench_integrators(uint32_t particle_count, uint32_t steps);
@@ -0,0 +1,185 @@
+#include "physics_simd.h"
+
+static bool level_forced = false;
+static SimdLevel forced_level = SIMD_SCALAR;
+
+SimdLevel simd_detect()
+{
+#if PHYS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if(!osxsave || !avx) return SIMD_SSE;
+
+    // Make sure the OS actually saves the ymm / zmm registers on a context switch
+    unsigned long long xcr0 = _xgetbv(0);
+    if((xcr0 & 0x6) != 0x6 || max_leaf < 7) return SIMD_SSE;
+
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+
+    if(avx512f && (xcr0 & 0xe6) == 0xe6) return SIMD_AVX512;
+    if(avx2) return SIMD_AVX2;
+    return SIMD_SSE;
+#else
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if(__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse2")) return SIMD_SSE;
+    return SIMD_SCALAR;
+#endif
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel simd_level()
+{
+    static const SimdLevel detected = simd_detect();
+    if(level_forced) return forced_level;
+    return detected;
+}
+
+void simd_set_level(SimdLevel level)
+{
+    level_forced = false;
+    SimdLevel best = simd_level();
+    forced_level = level > best ? best : level;
+    level_forced = true;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch(level)
+    {
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE: return "sse";
+        case SIMD_AVX2: return "avx2";
+        case SIMD_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+// Scalar reference. The vector versions use it to finish off whatever doesn't fill a whole register.
+// SYMPLECTIC moves the particle with the new velocity instead of the old one (semi-implicit Euler).
+template <bool SYMPLECTIC>
+static void integrate_scalar(float* p, float* v, const float* a, const float* f, const float* m, const float* drag, size_t begin, size_t end, float delta)
+{
+    for(size_t i = begin; i < end; i++)
+    {
+        if(!SYMPLECTIC) p[i] += v[i] * delta;
+        v[i] = (v[i] + (a[i] + f[i] * m[i]) * delta) * drag[i];
+        if(SYMPLECTIC) p[i] += v[i] * delta;
+    }
+}
+
+#if PHYS_X86
+
+template <bool SYMPLECTIC>
+static void integrate_sse(float* p, float* v, const float* a, const float* f, const float* m, const float* drag, size_t count, float delta)
+{
+    __m128 dt = _mm_set1_ps(delta);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 vel = _mm_loadu_ps(v + i);
+        __m128 pos = _mm_loadu_ps(p + i);
+        if(!SYMPLECTIC) pos = _mm_add_ps(pos, _mm_mul_ps(vel, dt));
+        __m128 acc = _mm_add_ps(_mm_loadu_ps(a + i), _mm_mul_ps(_mm_loadu_ps(f + i), _mm_loadu_ps(m + i)));
+        vel = _mm_add_ps(vel, _mm_mul_ps(acc, dt));
+        vel = _mm_mul_ps(vel, _mm_loadu_ps(drag + i));
+        if(SYMPLECTIC) pos = _mm_add_ps(pos, _mm_mul_ps(vel, dt));
+        _mm_storeu_ps(p + i, pos);
+        _mm_storeu_ps(v + i, vel);
+    }
+    integrate_scalar<SYMPLECTIC>(p, v, a, f, m, drag, i, count, delta);
+}
+
+template <bool SYMPLECTIC>
+SIMD_TARGET("avx2")
+static void integrate_avx2(float* p, float* v, const float* a, const float* f, const float* m, const float* drag, size_t count, float delta)
+{
+    __m256 dt = _mm256_set1_ps(delta);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 vel = _mm256_loadu_ps(v + i);
+        __m256 pos = _mm256_loadu_ps(p + i);
+        if(!SYMPLECTIC) pos = _mm256_add_ps(pos, _mm256_mul_ps(vel, dt));
+        __m256 acc = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_mul_ps(_mm256_loadu_ps(f + i), _mm256_loadu_ps(m + i)));
+        vel = _mm256_add_ps(vel, _mm256_mul_ps(acc, dt));
+        vel = _mm256_mul_ps(vel, _mm256_loadu_ps(drag + i));
+        if(SYMPLECTIC) pos = _mm256_add_ps(pos, _mm256_mul_ps(vel, dt));
+        _mm256_storeu_ps(p + i, pos);
+        _mm256_storeu_ps(v + i, vel);
+    }
+    integrate_scalar<SYMPLECTIC>(p, v, a, f, m, drag, i, count, delta);
+}
+
+template <bool SYMPLECTIC>
+SIMD_TARGET("avx512f")
+static void integrate_avx512(float* p, float* v, const float* a, const float* f, const float* m, const float* drag, size_t count, float delta)
+{
+    __m512 dt = _mm512_set1_ps(delta);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512 vel = _mm512_loadu_ps(v + i);
+        __m512 pos = _mm512_loadu_ps(p + i);
+        if(!SYMPLECTIC) pos = _mm512_add_ps(pos, _mm512_mul_ps(vel, dt));
+        __m512 acc = _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_mul_ps(_mm512_loadu_ps(f + i), _mm512_loadu_ps(m + i)));
+        vel = _mm512_add_ps(vel, _mm512_mul_ps(acc, dt));
+        vel = _mm512_mul_ps(vel, _mm512_loadu_ps(drag + i));
+        if(SYMPLECTIC) pos = _mm512_add_ps(pos, _mm512_mul_ps(vel, dt));
+        _mm512_storeu_ps(p + i, pos);
+        _mm512_storeu_ps(v + i, vel);
+    }
+    integrate_scalar<SYMPLECTIC>(p, v, a, f, m, drag, i, count, delta);
+}
+
+#endif
+
+typedef void (*IntegrateFn)(float*, float*, const float*, const float*, const float*, const float*, size_t, float);
+
+template <bool SYMPLECTIC>
+static void integrate_scalar_all(float* p, float* v, const float* a, const float* f, const float* m, const float* drag, size_t count, float delta)
+{
+    integrate_scalar<SYMPLECTIC>(p, v, a, f, m, drag, 0, count, delta);
+}
+
+template <bool SYMPLECTIC>
+static IntegrateFn integrate_fn(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512: return integrate_avx512<SYMPLECTIC>;
+        case SIMD_AVX2: return integrate_avx2<SYMPLECTIC>;
+        case SIMD_SSE: return integrate_sse<SYMPLECTIC>;
+        default: break;
+    }
+#endif
+    return integrate_scalar_all<SYMPLECTIC>;
+}
+
+void simd_integrate(const ParticleKernelArgs& args, float delta, SimdLevel level)
+{
+    if(level > simd_level()) level = simd_level();
+    IntegrateFn fn = args.symplectic ? integrate_fn<true>(level) : integrate_fn<false>(level);
+
+    // Each component is independent so just run the kernel once per axis
+    fn(args.px, args.vx, args.ax, args.fx, args.mass_inv, args.drag, args.count, delta);
+    fn(args.py, args.vy, args.ay, args.fy, args.mass_inv, args.drag, args.count, delta);
+    fn(args.pz, args.vz, args.az, args.fz, args.mass_inv, args.drag, args.count, delta);
+}
+
+void simd_integrate(const ParticleKernelArgs& args, float delta)
+{
+    simd_integrate(args, delta, simd_level());
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PHYS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang only let us use the wider instructions inside functions that are marked for them.
+// MSVC lets you use any intrinsic anywhere so it just gets nothing.
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+/*
+    Vectorized versions of the hot particle loops.
+    Every kernel has a scalar reference version and SSE / AVX2 / AVX-512 versions that do 4 / 8 / 16 particles at a time.
+    The best level the cpu supports gets picked the first time a kernel is called, but it can be forced
+    with simd_set_level (handy for benchmarking or checking a kernel against the scalar path).
+
+    Other files with their own kernels (scene_query.cpp, nbody.cpp) use the same levels and SIMD_TARGET.
+*/
+
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+// Pointers into the particle arrays a kernel works on. Everything is indexed [0, count).
+struct ParticleKernelArgs
+{
+    float* px; float* py; float* pz;
+    float* vx; float* vy; float* vz;
+    const float* ax; const float* ay; const float* az;
+    const float* fx; const float* fy; const float* fz;      // accumulated forces
+    const float* mass_inv;
+    const float* drag;      // damping^delta, precomputed per particle so the kernel never calls pow
+    size_t count;
+    bool symplectic = false;    // Move with the updated velocity (semi-implicit Euler) instead of the old one
+};
+
+SimdLevel simd_detect();
+SimdLevel simd_level();
+void simd_set_level(SimdLevel level);     // Gets clamped to what the cpu actually supports
+const char* simd_level_name(SimdLevel level);
+
+// position += velocity * delta
+// velocity = (velocity + (acceleration + force * mass_inv) * delta) * drag
+// (the other way around when args.symplectic is set)
+void simd_integrate(const ParticleKernelArgs& args, float delta);
+void simd_integrate(const ParticleKernelArgs& args, float delta, SimdLevel level);
@@ -0,0 +1,746 @@
+#include "quickhull.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#define HULL_CACHE_MAGIC 0x4C4C5548u     // "HULL"
+#define HULL_CACHE_VERSION 1u
+
+struct QhFace
+{
+    uint32_t v[3];
+    uint32_t adj[3];                    // Face on the other side of edge v[i] -> v[i + 1]
+    glm::vec3 normal;
+    float offset;
+    std::vector<uint32_t> outside;      // Points above this face that haven't been added yet
+    uint32_t furthest = UINT32_MAX;
+    float furthest_dist = 0.0;
+    bool alive = true;
+    bool visible = false;
+};
+
+struct QhHorizonEdge
+{
+    uint32_t a, b;
+    uint32_t face;      // The face that stays, on the other side of a -> b
+};
+
+struct QhState
+{
+    const std::vector<glm::vec3>& points;
+    std::vector<QhFace> faces;
+    std::vector<uint32_t> visible;
+    std::vector<QhHorizonEdge> horizon;
+    float eps;
+};
+
+static inline float face_distance(const QhState& qh, const QhFace& face, uint32_t point)
+{
+    return glm::dot(face.normal, qh.points[point]) - face.offset;
+}
+
+static uint32_t add_face(QhState& qh, uint32_t a, uint32_t b, uint32_t c)
+{
+    QhFace face;
+    face.v[0] = a; face.v[1] = b; face.v[2] = c;
+    face.adj[0] = face.adj[1] = face.adj[2] = UINT32_MAX;
+
+    const std::vector<glm::vec3>& p = qh.points;
+    glm::vec3 n = glm::cross(p[b] - p[a], p[c] - p[a]);
+    float len = glm::length(n);
+    face.normal = len > 0.0f ? n / len : glm::vec3(0.0);
+    face.offset = glm::dot(face.normal, p[a]);
+
+    qh.faces.push_back(std::move(face));
+    return (uint32_t)qh.faces.size() - 1;
+}
+
+// Puts the point on whichever of the faces it's furthest above, drops it if it's not above any of them
+static void assign_point(QhState& qh, const uint32_t* faces, size_t face_count, uint32_t point)
+{
+    uint32_t best = UINT32_MAX;
+    float best_dist = qh.eps;
+    for(size_t i = 0; i < face_count; i++)
+    {
+        float dist = face_distance(qh, qh.faces[faces[i]], point);
+        if(dist > best_dist) { best_dist = dist; best = faces[i]; }
+    }
+    if(best == UINT32_MAX) return;
+
+    QhFace& face = qh.faces[best];
+    face.outside.push_back(point);
+    if(best_dist > face.furthest_dist)
+    {
+        face.furthest_dist = best_dist;
+        face.furthest = point;
+    }
+}
+
+static bool initial_tetrahedron(QhState& qh, uint32_t out[4])
+{
+    const std::vector<glm::vec3>& p = qh.points;
+
+    // Extreme points along each axis, the axis where they're furthest apart gives the first edge
+    uint32_t extremes[6] = { 0, 0, 0, 0, 0, 0 };
+    for(uint32_t i = 1; i < p.size(); i++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            if(p[i][k] < p[extremes[k * 2]][k]) extremes[k * 2] = i;
+            if(p[i][k] > p[extremes[k * 2 + 1]][k]) extremes[k * 2 + 1] = i;
+        }
+    }
+
+    float best = -1.0;
+    for(int k = 0; k < 3; k++)
+    {
+        float d = glm::length(p[extremes[k * 2 + 1]] - p[extremes[k * 2]]);
+        if(d > best) { best = d; out[0] = extremes[k * 2]; out[1] = extremes[k * 2 + 1]; }
+    }
+    if(best <= qh.eps) return false;
+
+    // Furthest from that line
+    glm::vec3 dir = glm::normalize(p[out[1]] - p[out[0]]);
+    best = 0.0;
+    for(uint32_t i = 0; i < p.size(); i++)
+    {
+        glm::vec3 off = p[i] - p[out[0]];
+        float d = glm::length(off - dir * glm::dot(off, dir));
+        if(d > best) { best = d; out[2] = i; }
+    }
+    if(best <= qh.eps) return false;
+
+    // Furthest from that plane
+    glm::vec3 n = glm::normalize(glm::cross(p[out[1]] - p[out[0]], p[out[2]] - p[out[0]]));
+    best = 0.0;
+    float signed_best = 0.0;
+    for(uint32_t i = 0; i < p.size(); i++)
+    {
+        float d = glm::dot(n, p[i] - p[out[0]]);
+        if(fabsf(d) > best) { best = fabsf(d); signed_best = d; out[3] = i; }
+    }
+    if(best <= qh.eps) return false;
+
+    // Base has to face away from the apex
+    if(signed_best > 0.0f) std::swap(out[1], out[2]);
+    return true;
+}
+
+// Walks out from face across every edge to faces the eye can also see. Edges to faces it can't see make up the horizon,
+// and since every face is entered through one edge and then walked around from the next one, they come out in order.
+static void find_horizon(QhState& qh, uint32_t face_index, uint32_t entry_edge, uint32_t eye)
+{
+    QhFace& face = qh.faces[face_index];
+    face.visible = true;
+    qh.visible.push_back(face_index);
+
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        uint32_t e = (entry_edge + i) % 3;
+        uint32_t neighbour = qh.faces[face_index].adj[e];
+        QhFace& other = qh.faces[neighbour];
+        if(other.visible) continue;
+
+        if(face_distance(qh, other, eye) > qh.eps)
+        {
+            uint32_t twin = 0;
+            while(other.adj[twin] != face_index) twin++;
+            find_horizon(qh, neighbour, twin, eye);
+        }
+        else
+        {
+            qh.horizon.push_back({ qh.faces[face_index].v[e], qh.faces[face_index].v[(e + 1) % 3], neighbour });
+        }
+    }
+}
+
+static bool horizon_is_loop(const QhState& qh)
+{
+    size_t n = qh.horizon.size();
+    if(n < 3) return false;
+    for(size_t i = 0; i < n; i++)
+    {
+        if(qh.horizon[i].b != qh.horizon[(i + 1) % n].a) return false;
+    }
+    return true;
+}
+
+static void add_point(QhState& qh, uint32_t face_index, uint32_t eye)
+{
+    qh.visible.clear();
+    qh.horizon.clear();
+    find_horizon(qh, face_index, 0, eye);
+
+    // Round off made the visible region something other than a disc. Skip this point rather than risk a broken hull.
+    if(!horizon_is_loop(qh))
+    {
+        for(uint32_t f : qh.visible) qh.faces[f].visible = false;
+        QhFace& face = qh.faces[face_index];
+        face.outside.erase(std::find(face.outside.begin(), face.outside.end(), eye));
+        face.furthest = UINT32_MAX;
+        face.furthest_dist = 0.0;
+        for(uint32_t p : face.outside)
+        {
+            float dist = face_distance(qh, face, p);
+            if(dist > face.furthest_dist) { face.furthest_dist = dist; face.furthest = p; }
+        }
+        return;
+    }
+
+    // Fan of new faces from the horizon to the eye
+    uint32_t first = (uint32_t)qh.faces.size();
+    uint32_t count = (uint32_t)qh.horizon.size();
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const QhHorizonEdge& edge = qh.horizon[i];
+        uint32_t index = add_face(qh, edge.a, edge.b, eye);
+
+        QhFace& face = qh.faces[index];
+        face.adj[0] = edge.face;
+        face.adj[1] = first + (i + 1) % count;
+        face.adj[2] = first + (i + count - 1) % count;
+
+        QhFace& other = qh.faces[edge.face];
+        for(int e = 0; e < 3; e++)
+        {
+            if(other.v[e] == edge.b && other.v[(e + 1) % 3] == edge.a) other.adj[e] = index;
+        }
+    }
+
+    // Everything that was outside the removed faces gets handed to the new ones
+    std::vector<uint32_t> new_faces(count);
+    for(uint32_t i = 0; i < count; i++) new_faces[i] = first + i;
+
+    for(uint32_t f : qh.visible)
+    {
+        QhFace& face = qh.faces[f];
+        for(uint32_t p : face.outside)
+        {
+            if(p != eye) assign_point(qh, new_faces.data(), count, p);
+        }
+        face.alive = false;
+        face.outside.clear();
+        face.outside.shrink_to_fit();
+    }
+}
+
+// Union of triangles into flat polygons. Groups grow from the biggest triangles outwards and only take neighbours within
+// merge_angle of the seed (or lying within merge_distance of its plane, which catches the slivers noise leaves along the
+// edges of flat faces), so a finely tessellated curve can't chain into one giant face.
+static void merge_faces(QhState& qh, const std::vector<uint32_t>& tris, float merge_angle, float merge_distance, ConvexHull& hull)
+{
+    const std::vector<glm::vec3>& p = qh.points;
+    float cos_limit = cosf(glm::radians(merge_angle));
+
+    std::vector<uint32_t> group(qh.faces.size(), UINT32_MAX);
+    std::vector<float> area(qh.faces.size(), 0.0f);
+    for(uint32_t t : tris)
+    {
+        const QhFace& f = qh.faces[t];
+        area[t] = glm::length(glm::cross(p[f.v[1]] - p[f.v[0]], p[f.v[2]] - p[f.v[0]]));
+    }
+
+    std::vector<uint32_t> order = tris;
+    std::sort(order.begin(), order.end(), [&area](uint32_t a, uint32_t b) { return area[a] != area[b] ? area[a] > area[b] : a < b; });
+
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<uint32_t> stack;
+    for(uint32_t seed : order)
+    {
+        if(group[seed] != UINT32_MAX) continue;
+
+        uint32_t id = (uint32_t)groups.size();
+        groups.emplace_back();
+        group[seed] = id;
+        stack.push_back(seed);
+        while(!stack.empty())
+        {
+            uint32_t t = stack.back();
+            stack.pop_back();
+            groups[id].push_back(t);
+            for(uint32_t n : qh.faces[t].adj)
+            {
+                if(group[n] != UINT32_MAX) continue;
+
+                const QhFace& other = qh.faces[n];
+                bool flat = glm::dot(other.normal, qh.faces[seed].normal) >= cos_limit;
+                for(int k = 0; k < 3; k++)
+                {
+                    if(fabsf(face_distance(qh, qh.faces[seed], other.v[k])) > merge_distance) break;
+                    if(k == 2) flat = true;
+                }
+                if(!flat) continue;
+                group[n] = id;
+                stack.push_back(n);
+            }
+        }
+    }
+
+    // Boundary of every group, chained into a polygon. A group whose boundary isn't one simple loop gets split back into
+    // its triangles.
+    std::vector<uint32_t> vertex_map(p.size(), UINT32_MAX);
+    std::vector<std::vector<uint32_t>> polygons;
+    std::vector<glm::vec4> planes;
+    std::vector<std::pair<uint32_t, uint32_t>> boundary;
+    for(const std::vector<uint32_t>& members : groups)
+    {
+        boundary.clear();
+        glm::vec3 normal(0.0);
+        for(uint32_t t : members)
+        {
+            const QhFace& f = qh.faces[t];
+            normal += f.normal * area[t];
+            for(int e = 0; e < 3; e++)
+            {
+                if(group[f.adj[e]] != group[t]) boundary.push_back({ f.v[e], f.v[(e + 1) % 3] });
+            }
+        }
+
+        std::vector<uint32_t> loop;
+        bool simple = members.size() == 1;
+        if(!simple)
+        {
+            std::sort(boundary.begin(), boundary.end());
+            bool unique_starts = std::adjacent_find(boundary.begin(), boundary.end(),
+                [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first == b.first; }) == boundary.end();
+
+            if(unique_starts)
+            {
+                uint32_t current = boundary[0].first;
+                for(size_t i = 0; i < boundary.size(); i++)
+                {
+                    loop.push_back(current);
+                    auto next = std::lower_bound(boundary.begin(), boundary.end(), std::make_pair(current, 0u));
+                    if(next == boundary.end() || next->first != current) break;
+                    current = next->second;
+                    if(current == loop[0]) break;
+                }
+                simple = loop.size() == boundary.size() && current == loop[0];
+            }
+        }
+
+        if(simple && members.size() > 1)
+        {
+            // Pushed out to the furthest vertex of the group, including the ones inside that are about to be dropped,
+            // so the plane never cuts into the hull
+            normal = glm::normalize(normal);
+            float offset = -FLT_MAX;
+            for(uint32_t t : members)
+            {
+                for(uint32_t v : qh.faces[t].v) offset = std::max(offset, glm::dot(normal, p[v]));
+            }
+            polygons.push_back(loop);
+            planes.push_back(glm::vec4(normal, offset));
+        }
+        else
+        {
+            for(uint32_t t : members)
+            {
+                const QhFace& f = qh.faces[t];
+                polygons.push_back({ f.v[0], f.v[1], f.v[2] });
+                planes.push_back(glm::vec4(f.normal, f.offset));
+            }
+        }
+    }
+
+    // Noise along the edge between two merged faces leaves vertices that are only barely off the line between their
+    // neighbours. They go too, but only if they're that close to a straight line in every face they're part of.
+    std::vector<uint32_t> uses(p.size(), 0), straight(p.size(), 0);
+    for(const std::vector<uint32_t>& poly : polygons)
+    {
+        for(size_t k = 0; k < poly.size(); k++)
+        {
+            const glm::vec3& prev = p[poly[(k + poly.size() - 1) % poly.size()]];
+            const glm::vec3& next = p[poly[(k + 1) % poly.size()]];
+            glm::vec3 dir = next - prev;
+            glm::vec3 off = p[poly[k]] - prev;
+            float len2 = glm::dot(dir, dir);
+            float dist = len2 > 0.0f ? glm::length(off - dir * (glm::dot(off, dir) / len2)) : glm::length(off);
+
+            uses[poly[k]]++;
+            if(poly.size() > 3 && dist <= merge_distance) straight[poly[k]]++;
+        }
+    }
+    for(std::vector<uint32_t>& poly : polygons)
+    {
+        if(poly.size() <= 3) continue;
+        std::vector<uint32_t> kept;
+        for(uint32_t v : poly)
+        {
+            if(straight[v] != uses[v]) kept.push_back(v);
+        }
+        if(kept.size() >= 3) poly = std::move(kept);
+    }
+
+    // Only vertices that are still on a polygon outline stay, the ones inside merged faces go
+    for(const std::vector<uint32_t>& poly : polygons)
+    {
+        for(uint32_t v : poly)
+        {
+            if(vertex_map[v] != UINT32_MAX) continue;
+            vertex_map[v] = (uint32_t)hull.vertices.size();
+            hull.vertices.push_back(p[v]);
+        }
+    }
+
+    // Merged faces are only flat to within merge_angle, so an outline vertex can be a local maximum along the outline
+    // while another vertex of the same face is further along. Linking every vertex of a face to every other one keeps
+    // hill climbing exact.
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    hull.face_start.push_back(0);
+    for(size_t i = 0; i < polygons.size(); i++)
+    {
+        const std::vector<uint32_t>& poly = polygons[i];
+        for(size_t k = 0; k < poly.size(); k++)
+        {
+            hull.face_indices.push_back(vertex_map[poly[k]]);
+            for(size_t j = 0; j < poly.size(); j++)
+            {
+                if(j != k) edges.push_back({ vertex_map[poly[k]], vertex_map[poly[j]] });
+            }
+        }
+        hull.face_start.push_back((uint32_t)hull.face_indices.size());
+    }
+    hull.planes = std::move(planes);
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    hull.adjacency_start.assign(hull.vertices.size() + 1, 0);
+    for(const auto& edge : edges) hull.adjacency_start[edge.first + 1]++;
+    for(size_t i = 0; i < hull.vertices.size(); i++) hull.adjacency_start[i + 1] += hull.adjacency_start[i];
+    hull.adjacency.resize(edges.size());
+    for(size_t i = 0; i < edges.size(); i++) hull.adjacency[i] = edges[i].second;
+}
+
+bool quickhull(const std::vector<glm::vec3>& points, const HullSettings& settings, ConvexHull& hull)
+{
+    hull = ConvexHull();
+    if(points.size() < 4) return false;
+
+    QhState qh{ points, {}, {}, {}, 0.0f };
+
+    // Tolerance relative to how far from the origin the points go, same idea as qhull's
+    glm::vec3 max_abs(0.0);
+    for(const glm::vec3& v : points) max_abs = glm::max(max_abs, glm::abs(v));
+    qh.eps = std::max(3.0f * FLT_EPSILON * (max_abs.x + max_abs.y + max_abs.z), 1e-6f);
+
+    uint32_t t[4] = { 0, 0, 0, 0 };
+    if(!initial_tetrahedron(qh, t)) return false;
+
+    add_face(qh, t[0], t[1], t[2]);
+    add_face(qh, t[1], t[0], t[3]);
+    add_face(qh, t[2], t[1], t[3]);
+    add_face(qh, t[0], t[2], t[3]);
+
+    // Hook the four faces up to each other through their shared edges
+    for(uint32_t f = 0; f < 4; f++)
+    {
+        for(int e = 0; e < 3; e++)
+        {
+            uint32_t a = qh.faces[f].v[e], b = qh.faces[f].v[(e + 1) % 3];
+            for(uint32_t g = 0; g < 4; g++)
+            {
+                for(int k = 0; k < 3; k++)
+                {
+                    if(qh.faces[g].v[k] == b && qh.faces[g].v[(k + 1) % 3] == a) qh.faces[f].adj[e] = g;
+                }
+            }
+        }
+    }
+
+    uint32_t first_faces[4] = { 0, 1, 2, 3 };
+    for(uint32_t i = 0; i < points.size(); i++)
+    {
+        if(i == t[0] || i == t[1] || i == t[2] || i == t[3]) continue;
+        assign_point(qh, first_faces, 4, i);
+    }
+
+    // Furthest first, the lower face index wins a tie
+    std::vector<std::pair<float, uint32_t>> furthest;
+    auto further = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+        return a.first < b.first || (a.first == b.first && a.second > b.second);
+    };
+    size_t queued = 0;
+
+    uint32_t vertex_count = 4;
+    while(settings.max_vertices == 0 || vertex_count < settings.max_vertices)
+    {
+        // Always the furthest point there is, so capping the vertex count cuts off the least volume. A face's furthest
+        // point never changes once its points are handed out, so every new face goes on a heap once and dead ones get
+        // skipped when they come up. Scanning the faces instead costs O(faces) per point.
+        for(; queued < qh.faces.size(); queued++)
+        {
+            if(qh.faces[queued].furthest == UINT32_MAX) continue;
+            furthest.push_back({ qh.faces[queued].furthest_dist, (uint32_t)queued });
+            std::push_heap(furthest.begin(), furthest.end(), further);
+        }
+        uint32_t best = UINT32_MAX;
+        while(!furthest.empty() && best == UINT32_MAX)
+        {
+            if(qh.faces[furthest.front().second].alive) best = furthest.front().second;
+            std::pop_heap(furthest.begin(), furthest.end(), further);
+            furthest.pop_back();
+        }
+        if(best == UINT32_MAX) break;
+
+        size_t faces_before = qh.faces.size();
+        add_point(qh, best, qh.faces[best].furthest);
+        if(qh.faces.size() != faces_before) vertex_count++;
+        else if(qh.faces[best].furthest != UINT32_MAX)
+        {
+            // Skipped point, the face goes back on with its next furthest
+            furthest.push_back({ qh.faces[best].furthest_dist, best });
+            std::push_heap(furthest.begin(), furthest.end(), further);
+        }
+    }
+
+    std::vector<uint32_t> tris;
+    for(uint32_t f = 0; f < qh.faces.size(); f++)
+    {
+        if(qh.faces[f].alive) tris.push_back(f);
+    }
+
+    merge_faces(qh, tris, settings.merge_angle, 4.0f * qh.eps, hull);
+    return true;
+}
+
+bool hull_from_mesh_quickhull(const MeshGeometry& mesh, const HullSettings& settings, ConvexHull& hull)
+{
+    std::vector<glm::vec3> points;
+    points.reserve(mesh.vertices.size());
+    for(const Vertex& v : mesh.vertices) points.push_back(v.position);
+    return quickhull(points, settings, hull);
+}
+
+void model_build_hulls(Model& model, const HullSettings& settings)
+{
+    model.hulls.clear();
+
+    if(settings.per_node && !model.meshes.empty())
+    {
+        std::vector<glm::vec3> points;
+        for(const MeshGeometry& mesh : model.meshes)
+        {
+            for(const Vertex& v : mesh.vertices) points.push_back(v.position);
+        }
+
+        model.hulls.emplace_back();
+        if(!quickhull(points, settings, model.hulls.back()))
+        {
+            std::cerr << "HULL: node is flat, no hull built <path: " << model.path << ">" << std::endl;
+        }
+    }
+    else
+    {
+        for(const MeshGeometry& mesh : model.meshes)
+        {
+            model.hulls.emplace_back();
+            if(!hull_from_mesh_quickhull(mesh, settings, model.hulls.back()))
+            {
+                std::cerr << "HULL: mesh is flat, no hull built <path: " << model.path << ">" << std::endl;
+            }
+        }
+    }
+
+    for(Model& child : model.children) model_build_hulls(child, settings);
+}
+
+float hull_volume(const ConvexHull& hull)
+{
+    if(hull.vertices.empty()) return 0.0;
+
+    // Fan every face from its first vertex into tetrahedra with the first hull vertex
+    const glm::vec3& origin = hull.vertices[0];
+    float volume = 0.0;
+    for(size_t f = 0; f + 1 < hull.face_start.size(); f++)
+    {
+        uint32_t first = hull.face_start[f];
+        const glm::vec3& a = hull.vertices[hull.face_indices[first]];
+        for(uint32_t i = first + 1; i + 1 < hull.face_start[f + 1]; i++)
+        {
+            const glm::vec3& b = hull.vertices[hull.face_indices[i]];
+            const glm::vec3& c = hull.vertices[hull.face_indices[i + 1]];
+            volume += glm::dot(a - origin, glm::cross(b - origin, c - origin));
+        }
+    }
+    return volume / 6.0f;
+}
+
+template <typename T>
+static void write_array(std::ofstream& file, const std::vector<T>& arr)
+{
+    uint32_t size = (uint32_t)arr.size();
+    file.write((const char*)&size, sizeof(size));
+    file.write((const char*)arr.data(), sizeof(T) * size);
+}
+
+// Bytes between the read position and the end of the file
+static uint64_t bytes_left(std::ifstream& file)
+{
+    std::streampos here = file.tellg();
+    if(here < 0) return 0;
+    file.seekg(0, std::ios::end);
+    std::streampos end = file.tellg();
+    file.seekg(here);
+    return end > here ? (uint64_t)(end - here) : 0;
+}
+
+template <typename T>
+static bool read_array(std::ifstream& file, std::vector<T>& arr)
+{
+    uint32_t size = 0;
+    if(!file.read((char*)&size, sizeof(size))) return false;
+
+    // A broken size would have us allocate gigabytes before the read fails
+    if((uint64_t)size * sizeof(T) > bytes_left(file)) return false;
+    arr.resize(size);
+    return (bool)file.read((char*)arr.data(), sizeof(T) * size);
+}
+
+// Offsets have to start at 0, never go backwards and end at the end of the array they point into
+static bool valid_offsets(const std::vector<uint32_t>& start, size_t total)
+{
+    if(start.empty()) return total == 0;
+    if(start.front() != 0 || start.back() != total) return false;
+    for(size_t i = 1; i < start.size(); i++)
+    {
+        if(start[i] < start[i - 1]) return false;
+    }
+    return true;
+}
+
+static bool valid_indices(const std::vector<uint32_t>& indices, size_t count)
+{
+    for(uint32_t i : indices)
+    {
+        if(i >= count) return false;
+    }
+    return true;
+}
+
+void hull_write(std::ofstream& file, const ConvexHull& hull)
+{
+    write_array(file, hull.vertices);
+    write_array(file, hull.adjacency_start);
+    write_array(file, hull.adjacency);
+    write_array(file, hull.face_start);
+    write_array(file, hull.face_indices);
+    write_array(file, hull.planes);
+}
+
+bool hull_read(std::ifstream& file, ConvexHull& hull)
+{
+    if(!read_array(file, hull.vertices) || !read_array(file, hull.adjacency_start) || !read_array(file, hull.adjacency) ||
+       !read_array(file, hull.face_start) || !read_array(file, hull.face_indices) || !read_array(file, hull.planes))
+    {
+        return false;
+    }
+
+    // Everything gets indexed without checks later on (support hill climbing, clipping), so nothing can point outside
+    size_t vertex_count = hull.vertices.size();
+    bool adjacency_ok = hull.adjacency_start.empty() ? hull.adjacency.empty() :
+                        hull.adjacency_start.size() == vertex_count + 1 && valid_offsets(hull.adjacency_start, hull.adjacency.size());
+    size_t face_count = hull.face_start.empty() ? 0 : hull.face_start.size() - 1;
+    return adjacency_ok && valid_indices(hull.adjacency, vertex_count) && valid_offsets(hull.face_start, hull.face_indices.size()) &&
+           valid_indices(hull.face_indices, vertex_count) && hull.planes.size() == face_count;
+}
+
+static void write_node(std::ofstream& file, const Model& model)
+{
+    uint32_t counts[2] = { (uint32_t)model.hulls.size(), (uint32_t)model.children.size() };
+    file.write((const char*)counts, sizeof(counts));
+    for(const ConvexHull& hull : model.hulls) hull_write(file, hull);
+    for(const Model& child : model.children) write_node(file, child);
+}
+
+static bool read_node(std::ifstream& file, Model& model)
+{
+    uint32_t counts[2];
+    if(!file.read((char*)counts, sizeof(counts))) return false;
+    if(counts[1] != model.children.size()) return false;
+
+    // Every hull is at least its six array sizes
+    if((uint64_t)counts[0] * 6 * sizeof(uint32_t) > bytes_left(file)) return false;
+
+    model.hulls.resize(counts[0]);
+    for(ConvexHull& hull : model.hulls)
+    {
+        if(!hull_read(file, hull)) return false;
+    }
+    for(Model& child : model.children)
+    {
+        if(!read_node(file, child)) return false;
+    }
+    return true;
+}
+
+int64_t model_source_time(const std::string& path)
+{
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    return error ? 0 : (int64_t)time.time_since_epoch().count();
+}
+
+bool hull_cache_save(const std::string& path, const Model& model, const HullSettings& settings)
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    uint32_t header[3] = { HULL_CACHE_MAGIC, HULL_CACHE_VERSION, settings.max_vertices };
+    int64_t time = model_source_time(model.path);
+    uint8_t per_node = settings.per_node;
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)&settings.merge_angle, sizeof(settings.merge_angle));
+    file.write((const char*)&per_node, sizeof(per_node));
+    file.write((const char*)&time, sizeof(time));
+    write_node(file, model);
+    return (bool)file;
+}
+
+bool hull_cache_load(const std::string& path, Model& model, const HullSettings& settings)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    uint32_t header[3];
+    float merge_angle;
+    uint8_t per_node;
+    int64_t time;
+    if(!file.read((char*)header, sizeof(header)) || !file.read((char*)&merge_angle, sizeof(merge_angle)) ||
+       !file.read((char*)&per_node, sizeof(per_node)) || !file.read((char*)&time, sizeof(time)))
+    {
+        return false;
+    }
+
+    if(header[0] != HULL_CACHE_MAGIC || header[1] != HULL_CACHE_VERSION) return false;
+    if(header[2] != settings.max_vertices || merge_angle != settings.merge_angle || per_node != (uint8_t)settings.per_node) return false;
+    if(time != model_source_time(model.path)) return false;
+
+    if(!read_node(file, model))
+    {
+        std::cerr << "HULL: hull cache is corrupt, rebuilding <path: " << path << ">" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void model_load_hulls(Model& model, const HullSettings& settings)
+{
+    if(model.path.empty())
+    {
+        model_build_hulls(model, settings);
+        return;
+    }
+
+    std::string cache_path = model.path + ".hulls";
+    if(hull_cache_load(cache_path, model, settings)) return;
+
+    model_build_hulls(model, settings);
+    if(!hull_cache_save(cache_path, model, settings))
+    {
+        std::cerr << "HULL: could not write hull cache <path: " << cache_path << ">" << std::endl;
+    }
+}
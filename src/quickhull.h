@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include "mesh.h"
+
+/*
+    3D quickhull for turning render meshes into collision hulls.
+
+    Starts from the biggest tetrahedron it can find in the points, then keeps taking the point furthest outside any face,
+    removing every face that point can see and stitching the hole (the horizon) shut with a fan of new faces to it.
+    Every distance test uses a tolerance scaled to the size of the input, points closer than that to a face count as
+    being on it. That's what keeps nearly coplanar input (which render meshes are full of) from producing flipped
+    or overlapping faces.
+
+    Because the furthest point is always added first, stopping at max_vertices still gives a hull that covers most of
+    the shape, it just cuts the smallest corners off.
+
+    Afterwards neighbouring triangles that are within merge_angle of each other get merged into polygons, so a box comes
+    out as 6 quads and 8 vertices instead of 12 triangles, and vertices that end up inside a merged face are dropped.
+
+    Hulls for a whole model get cached in a file next to it (<model path>.hulls) and only get rebuilt when the model file
+    is newer than the cache or the settings changed.
+*/
+
+struct HullSettings
+{
+    uint32_t max_vertices = 64;     // 0 = no cap
+    float merge_angle = 3.0;        // Degrees between face normals that still get merged into one face
+    bool per_node = false;          // One hull over every mesh in a node instead of one per mesh
+};
+
+// Returns false if the points are degenerate (fewer than 4 or all coplanar), hull is left empty then
+bool quickhull(const std::vector<glm::vec3>& points, const HullSettings& settings, ConvexHull& hull);
+
+// Hull around every vertex of the mesh
+bool hull_from_mesh_quickhull(const MeshGeometry& mesh, const HullSettings& settings, ConvexHull& hull);
+
+// Fills hulls for model and all of its children
+void model_build_hulls(Model& model, const HullSettings& settings);
+
+// Loads the hulls from the cache next to model.path if it's up to date, otherwise builds them and writes the cache
+void model_load_hulls(Model& model, const HullSettings& settings);
+
+// Volume enclosed by the hull's faces
+float hull_volume(const ConvexHull& hull);
+
+bool hull_cache_save(const std::string& path, const Model& model, const HullSettings& settings);
+bool hull_cache_load(const std::string& path, Model& model, const HullSettings& settings);
+
+// Raw hull data for the cache files (this one and the baked collision assets)
+void hull_write(std::ofstream& file, const ConvexHull& hull);
+bool hull_read(std::ifstream& file, ConvexHull& hull);
+
+// Last modified time of the source model, so a re-exported model invalidates any cache built from it. 0 if it's missing.
+int64_t model_source_time(const std::string& path);
@@ -0,0 +1,362 @@
+#include "rigid_body.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+glm::mat4 transform_matrix(const Transform& transform)
+{
+    glm::mat4 m = glm::translate(glm::mat4(1.0), transform.position);
+    m = m * glm::mat4_cast(transform.rotation);
+    return glm::scale(m, transform.scale);
+}
+
+static inline glm::mat3 world_inertia_inv(const glm::quat& orientation, const glm::vec3& d)
+{
+    // R * diag(d) * R^T, written out so it's just scaling R's columns instead of two full matrix multiplies
+    glm::mat3 r = glm::mat3_cast(orientation);
+    glm::mat3 scaled(r[0] * d.x, r[1] * d.y, r[2] * d.z);
+    return scaled * glm::transpose(r);
+}
+
+BodyHandle rigid_add(RigidBodyWorld& world, const RigidBodyDesc& desc)
+{
+    BodyHandle handle = handle_table_add(world.handles);
+
+    glm::quat q = glm::normalize(desc.orientation);
+    glm::mat3 r = glm::mat3_cast(q);
+
+    // Plain spheres can just be described by radius
+    ConvexShape shape = desc.shape;
+    if(shape.type == SHAPE_SPHERE && shape.radius == 0.0f) shape.radius = desc.radius;
+
+    world.position.push_back(desc.position);
+    world.orientation.push_back(q);
+    world.linear_velocity.push_back(desc.linear_velocity);
+    world.angular_velocity.push_back(desc.angular_velocity);
+    world.mass_inv.push_back(desc.mass_inv);
+    world.inertia_inv_local.push_back(desc.inertia_inv);
+    world.inertia_inv_world.push_back(r * glm::mat3(glm::vec3(desc.inertia_inv.x, 0, 0), glm::vec3(0, desc.inertia_inv.y, 0), glm::vec3(0, 0, desc.inertia_inv.z)) * glm::transpose(r));
+    world.linear_damping.push_back(desc.linear_damping);
+    world.angular_damping.push_back(desc.angular_damping);
+    world.shape.push_back(shape);
+    world.radius.push_back(std::max(desc.radius, shape_bounding_radius(shape)));
+    world.friction.push_back(desc.friction);
+    world.restitution.push_back(desc.restitution);
+    world.ccd_threshold.push_back(desc.ccd_threshold);
+    world.ccd_margin.push_back(0.0);
+    world.swept_radius.push_back(world.radius.back());
+    world.force.push_back(glm::vec3(0.0));
+    world.torque.push_back(glm::vec3(0.0));
+    world.previous_position.push_back(desc.position);
+    world.previous_orientation.push_back(q);
+    world.sleep_timer.push_back(desc.can_sleep ? 0.0f : -1.0f);
+    world.awake.push_back(1);
+    world.sleep_group.push_back(0);
+    world.sleep_version++;
+
+    return handle;
+}
+
+// Wakes every sleeping body whose bounding sphere reaches the one of slot. Static bodies aren't in any sleep group, so
+// this is the only way what rests on them finds out. Only happens on remove / teleport, rare enough for a scan.
+static void wake_touching(RigidBodyWorld& world, uint32_t slot)
+{
+    glm::vec3 p = world.position.get(slot);
+    float reach = world.swept_radius[slot] + WAKE_MARGIN;
+    size_t count = rigid_count(world);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(world.awake[i] || i == slot) continue;
+        glm::vec3 d = world.position.get(i) - p;
+        float r = reach + world.radius[i];
+        if(glm::dot(d, d) <= r * r) rigid_wake_slot(world, (uint32_t)i);
+    }
+}
+
+void rigid_remove(RigidBodyWorld& world, BodyHandle handle)
+{
+    uint32_t slot = handle_table_remove(world.handles, handle);
+    if(slot == UINT32_MAX)
+    {
+        std::cerr << "PHYSICS: tried to remove invalid rigid body <handle: " << handle << ">" << std::endl;
+        return;
+    }
+
+    // Anything that was resting on it has to notice it's gone
+    if(!world.awake[slot]) rigid_wake_slot(world, slot);
+    wake_touching(world, slot);
+
+    world.position.swap_remove(slot);
+    swap_remove(world.orientation, slot);
+    world.linear_velocity.swap_remove(slot);
+    world.angular_velocity.swap_remove(slot);
+    swap_remove(world.mass_inv, slot);
+    swap_remove(world.inertia_inv_local, slot);
+    swap_remove(world.inertia_inv_world, slot);
+    swap_remove(world.linear_damping, slot);
+    swap_remove(world.angular_damping, slot);
+    swap_remove(world.radius, slot);
+    swap_remove(world.shape, slot);
+    swap_remove(world.friction, slot);
+    swap_remove(world.restitution, slot);
+    swap_remove(world.ccd_threshold, slot);
+    swap_remove(world.ccd_margin, slot);
+    swap_remove(world.swept_radius, slot);
+    world.force.swap_remove(slot);
+    world.torque.swap_remove(slot);
+    world.previous_position.swap_remove(slot);
+    swap_remove(world.previous_orientation, slot);
+    swap_remove(world.sleep_timer, slot);
+    swap_remove(world.awake, slot);
+    swap_remove(world.sleep_group, slot);
+    world.sleep_version++;
+}
+
+uint32_t rigid_slot(const RigidBodyWorld& world, BodyHandle handle)
+{
+    return handle_table_slot(world.handles, handle);
+}
+
+size_t rigid_count(const RigidBodyWorld& world)
+{
+    return handle_table_count(world.handles);
+}
+
+glm::vec3 rigid_box_inertia_inv(float mass, const glm::vec3& half_extents)
+{
+    if(mass <= 0.0) return glm::vec3(0.0);
+
+    glm::vec3 s = half_extents * 2.0f;
+    glm::vec3 inertia = glm::vec3(s.y * s.y + s.z * s.z, s.x * s.x + s.z * s.z, s.x * s.x + s.y * s.y) * (mass / 12.0f);
+    return 1.0f / inertia;
+}
+
+glm::vec3 rigid_sphere_inertia_inv(float mass, float radius)
+{
+    if(mass <= 0.0) return glm::vec3(0.0);
+    return glm::vec3(1.0f / (0.4f * mass * radius * radius));
+}
+
+void rigid_add_force(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& force)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+    world.force.set(slot, world.force.get(slot) + force);
+    rigid_wake_slot(world, slot);
+}
+
+void rigid_add_torque(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& torque)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+    world.torque.set(slot, world.torque.get(slot) + torque);
+    rigid_wake_slot(world, slot);
+}
+
+void rigid_add_force_at_point(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& force, const glm::vec3& point)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+    world.force.set(slot, world.force.get(slot) + force);
+    world.torque.set(slot, world.torque.get(slot) + glm::cross(point - world.position.get(slot), force));
+    rigid_wake_slot(world, slot);
+}
+
+void rigid_wake_slot(RigidBodyWorld& world, uint32_t slot)
+{
+    if(world.awake[slot]) return;
+
+    // Groups are only looked up on wake up, which is rare enough that a scan beats keeping per group lists around
+    uint32_t group = world.sleep_group[slot];
+    size_t count = rigid_count(world);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(world.awake[i] || world.sleep_group[i] != group) continue;
+        world.awake[i] = 1;
+        world.sleep_timer[i] = 0.0;
+    }
+    world.sleep_version++;
+}
+
+void rigid_set_transform(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& position, const glm::quat& orientation)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+
+    wake_touching(world, slot);
+    glm::quat q = glm::normalize(orientation);
+    world.position.set(slot, position);
+    world.previous_position.set(slot, position);
+    world.orientation[slot] = q;
+    world.previous_orientation[slot] = q;
+    world.inertia_inv_world[slot] = world_inertia_inv(q, world.inertia_inv_local[slot]);
+    rigid_wake_slot(world, slot);
+    wake_touching(world, slot);
+    world.sleep_version++;
+}
+
+void rigid_wake(RigidBodyWorld& world, BodyHandle handle)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return;
+    rigid_wake_slot(world, slot);
+}
+
+bool rigid_is_awake(const RigidBodyWorld& world, BodyHandle handle)
+{
+    uint32_t slot = rigid_slot(world, handle);
+    return slot != UINT32_MAX && world.awake[slot];
+}
+
+void rigid_sleep_slots(RigidBodyWorld& world, const uint32_t* slots, size_t count)
+{
+    uint32_t group = world.next_sleep_group++;
+    world.sleep_version++;
+    for(size_t i = 0; i < count; i++)
+    {
+        uint32_t slot = slots[i];
+        world.awake[slot] = 0;
+        world.sleep_group[slot] = group;
+        world.linear_velocity.set(slot, glm::vec3(0.0));
+        world.angular_velocity.set(slot, glm::vec3(0.0));
+    }
+}
+
+static void update_inertia_range(RigidBodyWorld& world, size_t begin, size_t end)
+{
+    for(size_t i = begin; i < end; i++)
+    {
+        world.inertia_inv_world[i] = world_inertia_inv(world.orientation[i], world.inertia_inv_local[i]);
+    }
+}
+
+void rigid_update_inertia(RigidBodyWorld& world)
+{
+    phys_parallel_for(world.pool, rigid_count(world), world.chunk_size, [&world](size_t begin, size_t end) {
+        update_inertia_range(world, begin, end);
+    });
+}
+
+static void integrate_velocities_range(RigidBodyWorld& world, size_t begin, size_t end, float delta)
+{
+    for(size_t i = begin; i < end; i++)
+    {
+        if(!world.awake[i]) continue;
+
+        float mass_inv = world.mass_inv[i];
+        glm::vec3 v = world.linear_velocity.get(i);
+        glm::vec3 w = world.angular_velocity.get(i);
+
+        // Static bodies don't fall
+        if(mass_inv > 0.0f)
+        {
+            v += (world.gravity + world.force.get(i) * mass_inv) * delta;
+        }
+        v *= powf(world.linear_damping[i], delta);
+
+        w += world.inertia_inv_world[i] * world.torque.get(i) * delta;
+        w *= powf(world.angular_damping[i], delta);
+
+        world.linear_velocity.set(i, v);
+        world.angular_velocity.set(i, w);
+        world.force.set(i, glm::vec3(0.0));
+        world.torque.set(i, glm::vec3(0.0));
+    }
+}
+
+static void integrate_positions_range(RigidBodyWorld& world, size_t begin, size_t end, float delta)
+{
+    float linear_limit = world.sleep_linear_threshold * world.sleep_linear_threshold;
+    float angular_limit = world.sleep_angular_threshold * world.sleep_angular_threshold;
+
+    for(size_t i = begin; i < end; i++)
+    {
+        if(!world.awake[i]) continue;
+
+        glm::vec3 v = world.linear_velocity.get(i);
+        glm::vec3 w = world.angular_velocity.get(i);
+        world.position.set(i, world.position.get(i) + v * delta);
+
+        // dq/dt = 0.5 * w * q
+        glm::quat q = world.orientation[i];
+        q += glm::quat(0.0, w.x, w.y, w.z) * q * (0.5f * delta);
+        world.orientation[i] = glm::normalize(q);
+
+        // Sleeping bodies keep the same orientation so their world inertia doesn't need refreshing either
+        world.inertia_inv_world[i] = world_inertia_inv(world.orientation[i], world.inertia_inv_local[i]);
+
+        if(world.sleep_timer[i] < 0.0f) continue;
+        if(glm::dot(v, v) > linear_limit || glm::dot(w, w) > angular_limit) world.sleep_timer[i] = 0.0;
+        else world.sleep_timer[i] += delta;
+    }
+}
+
+void rigid_integrate_velocities(RigidBodyWorld& world, float delta)
+{
+    phys_parallel_for(world.pool, rigid_count(world), world.chunk_size, [&world, delta](size_t begin, size_t end) {
+        integrate_velocities_range(world, begin, end, delta);
+    });
+}
+
+void rigid_integrate_positions(RigidBodyWorld& world, float delta)
+{
+    phys_parallel_for(world.pool, rigid_count(world), world.chunk_size, [&world, delta](size_t begin, size_t end) {
+        integrate_positions_range(world, begin, end, delta);
+    });
+}
+
+void rigid_step(RigidBodyWorld& world, float delta)
+{
+    phys_parallel_for(world.pool, rigid_count(world), world.chunk_size, [&world, delta](size_t begin, size_t end) {
+        integrate_velocities_range(world, begin, end, delta);
+        integrate_positions_range(world, begin, end, delta);
+    });
+}
+
+uint64_t rigid_checksum(const RigidBodyWorld& world)
+{
+    const std::vector<uint32_t>& handles = world.handles.slot_to_handle;
+    uint64_t hash = phys_checksum(PHYS_CHECKSUM_SEED, handles.data(), handles.size() * sizeof(uint32_t));
+    for(const Vec3Array* v : { &world.position, &world.linear_velocity, &world.angular_velocity, &world.force, &world.torque })
+    {
+        hash = phys_checksum(hash, v->x.data(), v->size() * sizeof(float));
+        hash = phys_checksum(hash, v->y.data(), v->size() * sizeof(float));
+        hash = phys_checksum(hash, v->z.data(), v->size() * sizeof(float));
+    }
+    hash = phys_checksum(hash, world.orientation.data(), world.orientation.size() * sizeof(glm::quat));
+    hash = phys_checksum(hash, world.sleep_timer.data(), world.sleep_timer.size() * sizeof(float));
+    return phys_checksum(hash, world.awake.data(), world.awake.size());
+}
+
+void rigid_update(RigidBodyWorld& world, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+            world.previous_orientation = world.orientation;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            rigid_step(world, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(rigid_checksum(world));
+    }
+}
+
+Transform rigid_transform(const RigidBodyWorld& world, BodyHandle handle, float alpha)
+{
+    Transform t{};
+    uint32_t slot = rigid_slot(world, handle);
+    if(slot == UINT32_MAX) return t;
+
+    t.position = glm::mix(world.previous_position.get(slot), world.position.get(slot), alpha);
+    t.rotation = glm::slerp(world.previous_orientation[slot], world.orientation[slot], alpha);
+    return t;
+}
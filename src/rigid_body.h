@@ -0,0 +1,149 @@
+#pragma once
+#include "physics.h"
+#include "shapes.h"
+#include <glm/gtc/quaternion.hpp>
+
+/*
+    Rigid bodies. Same idea as ParticleWorld: every property is its own packed array, index i in all of them is one body,
+    and handles stay stable across removals.
+
+    The inverse inertia tensor is stored in body space as a diagonal (principal axes) and gets rotated into world space
+    for every body in one batched pass after the orientations change, so the solver and integrator can just read
+    inertia_inv_world without redoing R * I^-1 * R^T per use.
+*/
+
+typedef uint32_t BodyHandle;
+#define INVALID_BODY UINT32_MAX
+#define WAKE_MARGIN 0.01f          // Resting contacts can be a hair apart, bodies this close to a removed / moved one wake up
+
+// Position / rotation / scale of something that gets rendered. Rigid bodies write into these for the renderer.
+struct Transform
+{
+    glm::vec3 position = glm::vec3(0.0);
+    glm::vec3 scale = glm::vec3(1.0);
+    glm::quat rotation = glm::quat(1.0, 0.0, 0.0, 0.0);
+};
+
+glm::mat4 transform_matrix(const Transform& transform);
+
+// Description of a body when adding it to a world
+struct RigidBodyDesc
+{
+    glm::vec3 position = glm::vec3(0.0);
+    glm::quat orientation = glm::quat(1.0, 0.0, 0.0, 0.0);
+    glm::vec3 linear_velocity = glm::vec3(0.0);
+    glm::vec3 angular_velocity = glm::vec3(0.0);
+    float mass_inv = 0.0;                               // 0 = static / infinite mass
+    glm::vec3 inertia_inv = glm::vec3(0.0);             // Diagonal of the body space inverse inertia tensor
+    float linear_damping = 1.0;                         // Fraction of velocity kept per second, same as particles
+    float angular_damping = 1.0;
+    float radius = 0.0;                                 // Bounding sphere, 0 = doesn't collide (grown to fit shape)
+    ConvexShape shape;                                  // Defaults to a sphere of radius
+    float friction = 0.5;
+    float restitution = 0.0;
+    bool can_sleep = true;
+    float ccd_threshold = 1.0;                          // Moving further than this * radius in one step turns on CCD, 0 = never
+};
+
+struct RigidBodyWorld
+{
+    Vec3Array position;
+    std::vector<glm::quat> orientation;
+    Vec3Array linear_velocity;
+    Vec3Array angular_velocity;
+    FloatArray mass_inv;
+    std::vector<glm::vec3> inertia_inv_local;
+    std::vector<glm::mat3> inertia_inv_world;
+    FloatArray linear_damping;
+    FloatArray angular_damping;
+    FloatArray radius;                                  // Bounding sphere used by the broadphase
+    std::vector<ConvexShape> shape;
+    FloatArray friction;
+    FloatArray restitution;
+
+    // Continuous collision (see ccd.h). Bodies that move far enough in one step get speculative contacts out to
+    // ccd_margin, the broadphase sees them swept by that much. Both are 0 / radius for everything else.
+    FloatArray ccd_threshold;
+    FloatArray ccd_margin;
+    FloatArray swept_radius;
+
+    // Accumulators, cleared at the end of every step
+    Vec3Array force;
+    Vec3Array torque;
+
+    // State at the start of the last step, for interpolating when rendering
+    Vec3Array previous_position;
+    std::vector<glm::quat> previous_orientation;
+
+    // Sleeping. Sleeping bodies aren't integrated, don't look for pairs and don't get solved.
+    FloatArray sleep_timer;                 // Seconds spent below the sleep thresholds, < 0 = never sleeps
+    std::vector<uint8_t> awake;
+    std::vector<uint32_t> sleep_group;      // Bodies that fell asleep as one island wake up together
+    uint32_t next_sleep_group = 0;
+    // Bumped whenever bodies get added / removed / moved with rigid_set_transform or fall asleep / wake up. The broadphase
+    // only rebuilds its grid of sleeping and static bodies when this changes, so anything that moves a body by hand some
+    // other way (writing position directly) has to bump it as well.
+    uint32_t sleep_version = 0;
+
+    bool allow_sleep = true;
+    float sleep_linear_threshold = 0.05;    // Speed (m/s) a body has to stay under to count as resting
+    float sleep_angular_threshold = 0.05;   // rad/s
+    float time_to_sleep = 0.5;              // How long a whole island has to rest before it goes to sleep
+
+    glm::vec3 gravity = glm::vec3(0.0, -grav, 0.0);
+
+    ThreadPool* pool = nullptr;
+    size_t chunk_size = 0;
+
+    HandleTable handles;
+};
+
+BodyHandle rigid_add(RigidBodyWorld& world, const RigidBodyDesc& desc);
+// Also wakes every sleeping body touching it, so piles resting on a removed floor fall instead of hanging in the air
+void rigid_remove(RigidBodyWorld& world, BodyHandle handle);
+uint32_t rigid_slot(const RigidBodyWorld& world, BodyHandle handle);
+size_t rigid_count(const RigidBodyWorld& world);
+
+// Inverse inertia diagonals for common shapes
+glm::vec3 rigid_box_inertia_inv(float mass, const glm::vec3& half_extents);
+glm::vec3 rigid_sphere_inertia_inv(float mass, float radius);
+
+void rigid_add_force(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& force);
+void rigid_add_torque(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& torque);
+// Force applied at a world space point, adds the torque it causes about the center of mass
+void rigid_add_force_at_point(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& force, const glm::vec3& point);
+
+// Teleports the body, static ones included. Wakes it and every sleeping body touching it where it was or where it ends
+// up, and bumps sleep_version so the broadphase sees it move.
+void rigid_set_transform(RigidBodyWorld& world, BodyHandle handle, const glm::vec3& position, const glm::quat& orientation);
+
+// Wakes the body and every body that fell asleep with it. Adding forces / torques does this automatically.
+void rigid_wake(RigidBodyWorld& world, BodyHandle handle);
+void rigid_wake_slot(RigidBodyWorld& world, uint32_t slot);
+bool rigid_is_awake(const RigidBodyWorld& world, BodyHandle handle);
+
+// Puts the bodies to sleep as one group, zeroing their velocities
+void rigid_sleep_slots(RigidBodyWorld& world, const uint32_t* slots, size_t count);
+
+// Recomputes inertia_inv_world = R * diag(inertia_inv_local) * R^T for every body in one pass
+void rigid_update_inertia(RigidBodyWorld& world);
+
+// Symplectic Euler for both linear and angular state, then refreshes the world space inertia.
+// Same as rigid_integrate_velocities followed by rigid_integrate_positions, the contact solver runs in between the two.
+void rigid_step(RigidBodyWorld& world, float delta);
+
+// Applies gravity, forces, torques and damping to the velocities and clears the accumulators
+void rigid_integrate_velocities(RigidBodyWorld& world, float delta);
+
+// Moves and rotates every body by its velocity and refreshes the world space inertia.
+// Also bumps or resets every body's sleep timer depending on how fast it's moving.
+void rigid_integrate_positions(RigidBodyWorld& world, float delta);
+
+// Handles, position, orientation, velocities, sleep state and accumulators of every body (see phys_world_checksum)
+uint64_t rigid_checksum(const RigidBodyWorld& world);
+
+// Fixed step driver, same as phys_world_update. Only integrates, nothing collides (rigid_pipeline_update does the full step).
+void rigid_update(RigidBodyWorld& world, FixedStepper& stepper, double frame_delta);
+
+// Transform for rendering, blended between the previous and current step by alpha. Scale is left at 1.
+Transform rigid_transform(const RigidBodyWorld& world, BodyHandle handle, float alpha = 1.0);
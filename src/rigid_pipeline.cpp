@@ -0,0 +1,38 @@
+#include "rigid_pipeline.h"
+
+void rigid_pipeline_step(RigidPipeline& pipeline, RigidBodyWorld& world, float delta)
+{
+    rigid_update_ccd(world, delta);
+
+    pipeline.pairs.clear();
+    rigid_find_pairs(world, pipeline.broadphase, pipeline.pairs);
+
+    contact_set_clear(pipeline.contacts);
+    collide_convex(world, pipeline.pairs, pipeline.contacts, pipeline.convex_cache);
+    if(pipeline.mesh) collide_mesh(world, *pipeline.mesh, pipeline.contacts);
+    collide_planes(world, pipeline.planes, pipeline.contacts);
+
+    rigid_step_islands(pipeline.islands, pipeline.solver, world, pipeline.contacts, delta);
+}
+
+void rigid_pipeline_update(RigidPipeline& pipeline, RigidBodyWorld& world, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+            world.previous_orientation = world.orientation;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            rigid_pipeline_step(pipeline, world, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(rigid_checksum(world));
+    }
+}
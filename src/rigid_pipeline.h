@@ -0,0 +1,33 @@
+#pragma once
+#include "ccd.h"
+#include "islands.h"
+
+/*
+    The whole rigid body step in one place: CCD margins, broadphase, narrowphase against the other bodies, the mesh and
+    the planes, then the island solver (which integrates and handles sleeping).
+
+    Everything that has to live from one step to the next sits in a RigidPipeline next to the world: the GJK cache and
+    the solver's warm start impulses only help if they survive, and keeping the grid / pair / contact arrays around means
+    a step in a steady scene doesn't allocate. One pipeline per RigidBodyWorld.
+*/
+
+struct RigidPipeline
+{
+    // Static geometry bodies collide with
+    std::vector<ContactPlane> planes;
+    const MeshCollider* mesh = nullptr;     // Not owned, nullptr = no mesh
+
+    // Kept between steps
+    RigidBroadphase broadphase;
+    std::vector<CollisionPair> pairs;
+    ContactSet contacts;
+    ConvexPairCache convex_cache;
+    ContactSolver solver;
+    IslandSet islands;
+};
+
+// One step of delta: rigid_update_ccd, rigid_find_pairs, collide_convex, collide_mesh, collide_planes and rigid_step_islands
+void rigid_pipeline_step(RigidPipeline& pipeline, RigidBodyWorld& world, float delta);
+
+// Fixed step driver for the full pipeline, same as rigid_update otherwise (rigid_update only integrates)
+void rigid_pipeline_update(RigidPipeline& pipeline, RigidBodyWorld& world, FixedStepper& stepper, double frame_delta);
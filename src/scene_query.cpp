@@ -0,0 +1,637 @@
+#include "scene_query.h"
+#include "physics_simd.h"
+#include "ccd.h"
+#include <algorithm>
+#include <cmath>
+
+#define PACKET_SIZE 8
+
+// 8 rays side by side, one lane per ray. Unused lanes have t = -1 so nothing ever hits them.
+struct alignas(32) RayPacket
+{
+    float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+    float ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];   // 1 / dir
+    float t[PACKET_SIZE];                                       // Closest hit so far, starts at max_t
+};
+
+// Index of the lowest set bit, mask can't be 0
+static inline uint32_t lowest_lane(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+// Returns a bit per lane whose ray passes through the box before its t
+typedef uint32_t (*PacketSlabFn)(const RayPacket& packet, const glm::vec3& min, const glm::vec3& max);
+
+// Returns a bit per lane whose ray hits the triangle (either side) before its t, with the distance in t_out
+typedef uint32_t (*PacketTriangleFn)(const RayPacket& packet, const glm::vec3* tri, float* t_out);
+
+// Scalar reference, ray_aabb and the same maths as mesh_bvh's ray_triangle
+static uint32_t slab_scalar(const RayPacket& packet, const glm::vec3& min, const glm::vec3& max)
+{
+    uint32_t mask = 0;
+    for(int l = 0; l < PACKET_SIZE; l++)
+    {
+        glm::vec3 origin(packet.ox[l], packet.oy[l], packet.oz[l]);
+        glm::vec3 inv_dir(packet.ix[l], packet.iy[l], packet.iz[l]);
+        if(ray_aabb(origin, inv_dir, AABB{ min, max }, packet.t[l]) >= 0.0f) mask |= 1u << l;
+    }
+    return mask;
+}
+
+static uint32_t triangle_scalar(const RayPacket& packet, const glm::vec3* tri, float* t_out)
+{
+    glm::vec3 e1 = tri[1] - tri[0];
+    glm::vec3 e2 = tri[2] - tri[0];
+    uint32_t mask = 0;
+    for(int l = 0; l < PACKET_SIZE; l++)
+    {
+        glm::vec3 dir(packet.dx[l], packet.dy[l], packet.dz[l]);
+        glm::vec3 p = glm::cross(dir, e2);
+        float det = glm::dot(e1, p);
+        if(fabsf(det) < 1e-12f) continue;
+
+        float inv_det = 1.0f / det;
+        glm::vec3 s = glm::vec3(packet.ox[l], packet.oy[l], packet.oz[l]) - tri[0];
+        float u = glm::dot(s, p) * inv_det;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(dir, q) * inv_det;
+        float t = glm::dot(e2, q) * inv_det;
+        if(u < 0.0f || v < 0.0f || u + v > 1.0f || t < 0.0f || t >= packet.t[l]) continue;
+
+        t_out[l] = t;
+        mask |= 1u << l;
+    }
+    return mask;
+}
+
+#if PHYS_X86
+
+// Narrows [enter, exit] to one axis' slab. Lanes where 0 * inf gave a NaN (parallel ray right on a plane) are left
+// alone, same as ray_aabb.
+static inline void slab_axis_sse(__m128 t0, __m128 t1, __m128& enter, __m128& exit)
+{
+    __m128 ordered = _mm_cmpord_ps(t0, t1);
+    __m128 near = _mm_min_ps(t0, t1), far = _mm_max_ps(t0, t1);
+    enter = _mm_or_ps(_mm_and_ps(ordered, _mm_max_ps(enter, near)), _mm_andnot_ps(ordered, enter));
+    exit = _mm_or_ps(_mm_and_ps(ordered, _mm_min_ps(exit, far)), _mm_andnot_ps(ordered, exit));
+}
+
+// 4 lanes starting at lane, shifted into place in the mask
+static inline uint32_t slab_sse_half(const RayPacket& packet, const glm::vec3& min, const glm::vec3& max, int lane)
+{
+    __m128 ox = _mm_load_ps(packet.ox + lane), oy = _mm_load_ps(packet.oy + lane), oz = _mm_load_ps(packet.oz + lane);
+    __m128 ix = _mm_load_ps(packet.ix + lane), iy = _mm_load_ps(packet.iy + lane), iz = _mm_load_ps(packet.iz + lane);
+
+    __m128 enter = _mm_setzero_ps(), exit = _mm_load_ps(packet.t + lane);
+    slab_axis_sse(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.x), ox), ix), _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.x), ox), ix), enter, exit);
+    slab_axis_sse(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.y), oy), iy), _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.y), oy), iy), enter, exit);
+    slab_axis_sse(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.z), oz), iz), _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.z), oz), iz), enter, exit);
+    return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(enter, exit)) << lane;
+}
+
+static uint32_t slab_sse(const RayPacket& packet, const glm::vec3& min, const glm::vec3& max)
+{
+    return slab_sse_half(packet, min, max, 0) | slab_sse_half(packet, min, max, 4);
+}
+
+static inline uint32_t triangle_sse_half(const RayPacket& packet, const glm::vec3* tri, float* t_out, int lane)
+{
+    glm::vec3 e1 = tri[1] - tri[0];
+    glm::vec3 e2 = tri[2] - tri[0];
+    __m128 e1x = _mm_set1_ps(e1.x), e1y = _mm_set1_ps(e1.y), e1z = _mm_set1_ps(e1.z);
+    __m128 e2x = _mm_set1_ps(e2.x), e2y = _mm_set1_ps(e2.y), e2z = _mm_set1_ps(e2.z);
+    __m128 dx = _mm_load_ps(packet.dx + lane), dy = _mm_load_ps(packet.dy + lane), dz = _mm_load_ps(packet.dz + lane);
+
+    // p = dir x e2, det = e1 . p
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // s = origin - a, q = s x e1
+    __m128 sx = _mm_sub_ps(_mm_load_ps(packet.ox + lane), _mm_set1_ps(tri[0].x));
+    __m128 sy = _mm_sub_ps(_mm_load_ps(packet.oy + lane), _mm_set1_ps(tri[0].y));
+    __m128 sz = _mm_sub_ps(_mm_load_ps(packet.oz + lane), _mm_set1_ps(tri[0].z));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_cmpge_ps(abs_det, _mm_set1_ps(1e-12f));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_load_ps(packet.t + lane)));
+
+    _mm_storeu_ps(t_out + lane, t);
+    return (uint32_t)_mm_movemask_ps(hit) << lane;
+}
+
+static uint32_t triangle_sse(const RayPacket& packet, const glm::vec3* tri, float* t_out)
+{
+    return triangle_sse_half(packet, tri, t_out, 0) | triangle_sse_half(packet, tri, t_out, 4);
+}
+
+SIMD_TARGET("avx2")
+static inline void slab_axis_avx2(__m256 t0, __m256 t1, __m256& enter, __m256& exit)
+{
+    __m256 ordered = _mm256_cmp_ps(t0, t1, _CMP_ORD_Q);
+    enter = _mm256_blendv_ps(enter, _mm256_max_ps(enter, _mm256_min_ps(t0, t1)), ordered);
+    exit = _mm256_blendv_ps(exit, _mm256_min_ps(exit, _mm256_max_ps(t0, t1)), ordered);
+}
+
+SIMD_TARGET("avx2")
+static uint32_t slab_avx2(const RayPacket& packet, const glm::vec3& min, const glm::vec3& max)
+{
+    __m256 ox = _mm256_load_ps(packet.ox), oy = _mm256_load_ps(packet.oy), oz = _mm256_load_ps(packet.oz);
+    __m256 ix = _mm256_load_ps(packet.ix), iy = _mm256_load_ps(packet.iy), iz = _mm256_load_ps(packet.iz);
+
+    __m256 enter = _mm256_setzero_ps(), exit = _mm256_load_ps(packet.t);
+    slab_axis_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.x), ox), ix), _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.x), ox), ix), enter, exit);
+    slab_axis_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.y), oy), iy), _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.y), oy), iy), enter, exit);
+    slab_axis_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.z), oz), iz), _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.z), oz), iz), enter, exit);
+    return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ));
+}
+
+SIMD_TARGET("avx2")
+static uint32_t triangle_avx2(const RayPacket& packet, const glm::vec3* tri, float* t_out)
+{
+    glm::vec3 e1 = tri[1] - tri[0];
+    glm::vec3 e2 = tri[2] - tri[0];
+    __m256 e1x = _mm256_set1_ps(e1.x), e1y = _mm256_set1_ps(e1.y), e1z = _mm256_set1_ps(e1.z);
+    __m256 e2x = _mm256_set1_ps(e2.x), e2y = _mm256_set1_ps(e2.y), e2z = _mm256_set1_ps(e2.z);
+    __m256 dx = _mm256_load_ps(packet.dx), dy = _mm256_load_ps(packet.dy), dz = _mm256_load_ps(packet.dz);
+
+    __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    __m256 abs_det = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+    __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    __m256 sx = _mm256_sub_ps(_mm256_load_ps(packet.ox), _mm256_set1_ps(tri[0].x));
+    __m256 sy = _mm256_sub_ps(_mm256_load_ps(packet.oy), _mm256_set1_ps(tri[0].y));
+    __m256 sz = _mm256_sub_ps(_mm256_load_ps(packet.oz), _mm256_set1_ps(tri[0].z));
+    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv_det);
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+    __m256 zero = _mm256_setzero_ps();
+    __m256 hit = _mm256_cmp_ps(abs_det, _mm256_set1_ps(1e-12f), _CMP_GE_OQ);
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_load_ps(packet.t), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(t_out, t);
+    return (uint32_t)_mm256_movemask_ps(hit);
+}
+
+#endif
+
+struct PacketKernels
+{
+    PacketSlabFn slab;
+    PacketTriangleFn triangle;
+};
+
+// AVX-512 doesn't get its own, 8 lanes is already a whole ymm register
+static PacketKernels packet_kernels(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: return { slab_avx2, triangle_avx2 };
+        case SIMD_SSE: return { slab_sse, triangle_sse };
+        default: break;
+    }
+#endif
+    return { slab_scalar, triangle_scalar };
+}
+
+// Conservative advancement: a moves along displacement by however far apart the two are over how fast it's closing in,
+// which can never overshoot for convex shapes, until they're touching. t is in units of displacement.
+static bool cast_convex(const ConvexProxy& a, const glm::vec3& displacement, const ConvexProxy& b, float max_t,
+                        float& t_out, glm::vec3& point, glm::vec3& normal)
+{
+    const float tolerance = 1e-4f;
+    float radius = a.shape->radius + b.shape->radius;
+
+    ConvexProxy moving = a;
+    GjkCache cache;
+    float t = 0.0;
+    for(int i = 0; i < 64; i++)
+    {
+        moving.position = a.position + displacement * t;
+        GjkResult result = gjk_distance(moving, b, cache);
+        glm::vec3 offset = result.point_b - result.point_a;
+
+        // The cores touching means the last step landed right on the surface (or it started inside), either way that's it
+        if(result.overlap || result.distance <= 1e-9f || glm::dot(offset, offset) <= 1e-18f)
+        {
+            t_out = t;
+            if(i == 0)
+            {
+                point = moving.position;
+                normal = glm::length(displacement) > 0.0f ? -glm::normalize(displacement) : glm::vec3(0.0, 1.0, 0.0);
+            }
+            return true;
+        }
+
+        // From a to b. Dividing by the length of the offset itself, result.distance can be off from it in the last
+        // few bits which matters a lot once they get close.
+        glm::vec3 n = offset / glm::length(offset);
+        float gap = result.distance - radius;
+        point = result.point_b - n * b.shape->radius;
+        normal = -n;
+        if(gap <= tolerance)
+        {
+            t_out = t;
+            if(i == 0 && gap < 0.0f) normal = glm::length(displacement) > 0.0f ? -glm::normalize(displacement) : -n;
+            return true;
+        }
+
+        float closing = glm::dot(displacement, n);
+        if(closing <= 0.0f) return false;
+        t += gap / closing;
+        if(t > max_t) return false;
+    }
+    return false;
+}
+
+// Cast a shape (ray = sphere with no radius) against one body, only hits before hit.t count
+static bool cast_body(const RigidBodyWorld& world, uint32_t slot, const ConvexProxy& proxy, const glm::vec3& dir, float max_t,
+                      QueryHit& hit)
+{
+    if(world.radius[slot] <= 0.0f) return false;
+
+    ConvexProxy body{ &world.shape[slot], world.position.get(slot), world.orientation[slot] };
+    float t;
+    glm::vec3 point, normal;
+    if(proxy.shape->type == SHAPE_SPHERE && body.shape->type == SHAPE_SPHERE)
+    {
+        // Both are points with a radius so it's exact in one go, t comes back as a fraction of the whole cast
+        t = sweep_sphere_sphere(proxy.position, proxy.shape->radius, dir * max_t, body.position, body.shape->radius, glm::vec3(0.0));
+        if(t < 0.0f) return false;
+        t *= max_t;
+        glm::vec3 center = proxy.position + dir * t;
+        glm::vec3 away = center - body.position;
+        float dist = glm::length(away);
+        normal = dist > 1e-6f ? away / dist : -glm::normalize(dir);
+        point = body.position + normal * body.shape->radius;
+    }
+    else if(proxy.shape->type == SHAPE_SPHERE && proxy.shape->radius == 0.0f && body.shape->type == SHAPE_BOX && body.shape->radius == 0.0f)
+    {
+        // Plain ray against a plain box is just a slab test in the box's space, way cheaper than stepping with GJK
+        glm::quat inv = glm::conjugate(body.orientation);
+        glm::vec3 origin = inv * (proxy.position - body.position);
+        glm::vec3 local_dir = inv * dir;
+        const glm::vec3& e = body.shape->half_extents;
+        glm::vec3 t0 = (-e - origin) / local_dir;
+        glm::vec3 t1 = (e - origin) / local_dir;
+        glm::vec3 t_near = glm::min(t0, t1);
+        float enter = std::max(std::max(t_near.x, t_near.y), t_near.z);
+        t = ray_aabb(origin, 1.0f / local_dir, AABB{ -e, e }, max_t);
+        if(t < 0.0f) return false;
+
+        // Normal is the axis the ray came in through, or straight back along the ray when it starts inside
+        glm::vec3 local_normal(0.0);
+        if(enter < 0.0f) local_normal = -glm::normalize(local_dir);
+        else if(enter == t_near.x) local_normal.x = local_dir.x > 0.0f ? -1.0f : 1.0f;
+        else if(enter == t_near.y) local_normal.y = local_dir.y > 0.0f ? -1.0f : 1.0f;
+        else local_normal.z = local_dir.z > 0.0f ? -1.0f : 1.0f;
+        normal = body.orientation * local_normal;
+        point = proxy.position + dir * t;
+    }
+    else if(!cast_convex(proxy, dir, body, max_t, t, point, normal))
+    {
+        return false;
+    }
+
+    hit.t = t;
+    hit.point = point;
+    hit.normal = normal;
+    hit.body = world.handles.slot_to_handle[slot];
+    hit.triangle = UINT32_MAX;
+    return true;
+}
+
+// Calls fn(slot) for every body whose fat box overlaps box
+template <typename Fn>
+static void visit_bodies(const AABBTree& tree, const AABB& box, const Fn& fn)
+{
+    if(tree.root == TREE_NULL) return;
+
+    TraversalStack stack;
+    stack.push(tree.root);
+    while(!stack.empty())
+    {
+        const TreeNode& node = tree.nodes[stack.pop()];
+        if(!aabb_overlap(node.box, box)) continue;
+
+        if(node.child1 == TREE_NULL)
+        {
+            fn(node.user);
+            continue;
+        }
+
+        stack.push(node.child1);
+        stack.push(node.child2);
+    }
+}
+
+// Calls fn(triangle) with the index (into corners / 3) of every triangle in a leaf that overlaps box
+template <typename Fn>
+static void visit_triangles(const MeshCollider& mesh, const AABB& box, const Fn& fn)
+{
+    if(mesh.nodes.empty()) return;
+
+    TraversalStack stack;
+    stack.push(0);
+    while(!stack.empty())
+    {
+        uint32_t index = stack.pop();
+        const BvhNode& node = mesh.nodes[index];
+        if(glm::any(glm::greaterThan(box.min, node.max)) || glm::any(glm::lessThan(box.max, node.min))) continue;
+
+        if(node.count > 0)
+        {
+            for(uint32_t t = node.offset; t < node.offset + node.count; t++) fn(t);
+            continue;
+        }
+
+        stack.push(node.offset);
+        stack.push(index + 1);
+    }
+}
+
+// Every query is a whole tree walk, so jobs get a lot fewer of them than the particle loops' default chunks
+static size_t query_chunk_size(const SceneQuery& query)
+{
+    return query.chunk_size ? query.chunk_size : 16;
+}
+
+void scene_query_update(SceneQuery& query, const RigidBodyWorld& world)
+{
+    size_t count = rigid_count(world);
+
+    // Slots only ever get swap removed from the end, so the extra leaves are always the last ones
+    while(query.proxies.size() > count)
+    {
+        tree_remove(query.tree, query.proxies.back());
+        query.proxies.pop_back();
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        glm::vec3 position = world.position.get(i);
+        AABB box{ position - glm::vec3(world.radius[i]), position + glm::vec3(world.radius[i]) };
+        if(i < query.proxies.size()) tree_move(query.tree, query.proxies[i], box, glm::vec3(0.0));
+        else query.proxies.push_back(tree_insert(query.tree, box, (uint32_t)i));
+    }
+}
+
+// Up to 8 rays from the batch starting at first
+static void raycast_packet(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh, const PacketKernels& kernels,
+                           const RayQuery* rays, size_t first, size_t count, QueryHit* hits)
+{
+    RayPacket packet;
+    uint32_t lanes = (uint32_t)std::min<size_t>(PACKET_SIZE, count - first);
+    for(uint32_t l = 0; l < PACKET_SIZE; l++)
+    {
+        // Spare lanes copy the first ray but can never hit anything
+        const RayQuery& ray = rays[first + (l < lanes ? l : 0)];
+        packet.ox[l] = ray.origin.x; packet.oy[l] = ray.origin.y; packet.oz[l] = ray.origin.z;
+        packet.dx[l] = ray.dir.x; packet.dy[l] = ray.dir.y; packet.dz[l] = ray.dir.z;
+        packet.ix[l] = 1.0f / ray.dir.x; packet.iy[l] = 1.0f / ray.dir.y; packet.iz[l] = 1.0f / ray.dir.z;
+        packet.t[l] = l < lanes ? ray.max_t : -1.0f;
+    }
+    for(uint32_t l = 0; l < lanes; l++) hits[first + l] = QueryHit();
+
+    TraversalStack stack;
+    uint32_t best_triangle[PACKET_SIZE];
+    for(uint32_t l = 0; l < PACKET_SIZE; l++) best_triangle[l] = UINT32_MAX;
+
+    if(mesh && !mesh->nodes.empty())
+    {
+        stack.push(0);
+        while(!stack.empty())
+        {
+            uint32_t index = stack.pop();
+            const BvhNode& node = mesh->nodes[index];
+            if(!kernels.slab(packet, node.min, node.max)) continue;
+
+            if(node.count > 0)
+            {
+                for(uint32_t t = node.offset; t < node.offset + node.count; t++)
+                {
+                    alignas(32) float dist[PACKET_SIZE];
+                    uint32_t mask = kernels.triangle(packet, &mesh->corners[t * 3], dist);
+                    for(; mask; mask &= mask - 1)
+                    {
+                        uint32_t l = lowest_lane(mask);
+                        packet.t[l] = dist[l];
+                        best_triangle[l] = t;
+                    }
+                }
+                continue;
+            }
+
+            // Whichever child is nearer along the first ray goes on top, for a coherent packet that's nearer for all of them
+            const BvhNode& a = mesh->nodes[index + 1];
+            const BvhNode& b = mesh->nodes[node.offset];
+            glm::vec3 dir(packet.dx[0], packet.dy[0], packet.dz[0]);
+            bool a_nearer = glm::dot((a.min + a.max) - (b.min + b.max), dir) <= 0.0f;
+            stack.push(a_nearer ? node.offset : index + 1);
+            stack.push(a_nearer ? index + 1 : node.offset);
+        }
+    }
+
+    for(uint32_t l = 0; l < lanes; l++)
+    {
+        if(best_triangle[l] == UINT32_MAX) continue;
+
+        const glm::vec3* tri = &mesh->corners[best_triangle[l] * 3];
+        const RayQuery& ray = rays[first + l];
+        glm::vec3 normal = glm::normalize(glm::cross(tri[1] - tri[0], tri[2] - tri[0]));
+        QueryHit& hit = hits[first + l];
+        hit.t = packet.t[l];
+        hit.point = ray.origin + ray.dir * hit.t;
+        hit.normal = glm::dot(normal, ray.dir) > 0.0f ? -normal : normal;
+        hit.triangle = mesh->triangle_ids[best_triangle[l]];
+    }
+
+    if(query.tree.root == TREE_NULL) return;
+
+    ConvexShape point = shape_sphere(0.0);
+    stack.push(query.tree.root);
+    while(!stack.empty())
+    {
+        const TreeNode& node = query.tree.nodes[stack.pop()];
+        uint32_t mask = kernels.slab(packet, node.box.min, node.box.max);
+        if(!mask) continue;
+
+        if(node.child1 == TREE_NULL)
+        {
+            uint32_t handle = world.handles.slot_to_handle[node.user];
+            for(; mask; mask &= mask - 1)
+            {
+                uint32_t l = lowest_lane(mask);
+                const RayQuery& ray = rays[first + l];
+                if(handle == ray.ignore) continue;
+
+                ConvexProxy proxy{ &point, ray.origin, glm::quat(1.0, 0.0, 0.0, 0.0) };
+                if(cast_body(world, node.user, proxy, ray.dir, packet.t[l], hits[first + l])) packet.t[l] = hits[first + l].t;
+            }
+            continue;
+        }
+
+        stack.push(node.child1);
+        stack.push(node.child2);
+    }
+}
+
+void scene_raycast(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                   const RayQuery* rays, size_t count, QueryHit* hits)
+{
+    PacketKernels kernels = packet_kernels(simd_level());
+    size_t packets = (count + PACKET_SIZE - 1) / PACKET_SIZE;
+    phys_parallel_for(query.pool, packets, query_chunk_size(query), [&](size_t begin, size_t end) {
+        for(size_t p = begin; p < end; p++) raycast_packet(query, world, mesh, kernels, rays, p * PACKET_SIZE, count, hits);
+    });
+}
+
+// Box around everything the shape passes through on its way from start to start + displacement
+static AABB swept_box(const ConvexShape& shape, const glm::vec3& start, const glm::vec3& displacement)
+{
+    float radius = shape_bounding_radius(shape);
+    glm::vec3 end = start + displacement;
+    return AABB{ glm::min(start, end) - glm::vec3(radius), glm::max(start, end) + glm::vec3(radius) };
+}
+
+static void shape_cast_one(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                           const ShapeCastQuery& cast, QueryHit& hit)
+{
+    hit = QueryHit();
+    float max_t = cast.max_t;
+    ConvexProxy proxy{ &cast.shape, cast.position, cast.orientation };
+    AABB box = swept_box(cast.shape, cast.position, cast.dir * max_t);
+
+    if(mesh)
+    {
+        visit_triangles(*mesh, box, [&](uint32_t t) {
+            const glm::vec3* tri = &mesh->corners[t * 3];
+            if(cast.shape.type == SHAPE_SPHERE)
+            {
+                // Exact sweep, its t is a fraction of the whole cast
+                SweepHit sweep;
+                sweep.t = max_t / cast.max_t;
+                if(!sweep_sphere_triangle(cast.position, cast.shape.radius, cast.dir * cast.max_t, tri, sweep)) return;
+                max_t = sweep.t * cast.max_t;
+                hit.point = sweep.point;
+                hit.normal = sweep.normal;
+            }
+            else
+            {
+                ConvexShape triangle = shape_triangle(tri);
+                ConvexProxy other{ &triangle, glm::vec3(0.0), glm::quat(1.0, 0.0, 0.0, 0.0) };
+                float t;
+                glm::vec3 point, normal;
+                if(!cast_convex(proxy, cast.dir, other, max_t, t, point, normal) || t >= max_t) return;
+                max_t = t;
+                hit.point = point;
+                hit.normal = normal;
+            }
+            hit.t = max_t;
+            hit.triangle = mesh->triangle_ids[t];
+        });
+    }
+
+    visit_bodies(query.tree, box, [&](uint32_t slot) {
+        if(world.handles.slot_to_handle[slot] == cast.ignore) return;
+
+        QueryHit candidate;
+        if(cast_body(world, slot, proxy, cast.dir, max_t, candidate) && (hit.t < 0.0f || candidate.t < hit.t))
+        {
+            hit = candidate;
+            max_t = candidate.t;
+        }
+    });
+}
+
+void scene_shape_cast(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                      const ShapeCastQuery* casts, size_t count, QueryHit* hits)
+{
+    phys_parallel_for(query.pool, count, query_chunk_size(query), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) shape_cast_one(query, world, mesh, casts[i], hits[i]);
+    });
+}
+
+// Touching counts, same as the narrowphase
+static bool shapes_overlap(const ConvexProxy& a, const ConvexProxy& b)
+{
+    GjkCache cache;
+    float radius = a.shape->radius + b.shape->radius;
+    GjkResult result = gjk_distance(a, b, cache, radius);
+    return result.overlap || result.distance <= radius;
+}
+
+static uint32_t overlap_one(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                            const OverlapQuery& overlap, OverlapHit* results, uint32_t max_results)
+{
+    uint32_t found = 0;
+    ConvexProxy proxy{ &overlap.shape, overlap.position, overlap.orientation };
+    AABB box = swept_box(overlap.shape, overlap.position, glm::vec3(0.0));
+
+    if(mesh)
+    {
+        visit_triangles(*mesh, box, [&](uint32_t t) {
+            if(found >= max_results) return;
+            ConvexShape triangle = shape_triangle(&mesh->corners[t * 3]);
+            if(shapes_overlap(proxy, ConvexProxy{ &triangle, glm::vec3(0.0), glm::quat(1.0, 0.0, 0.0, 0.0) }))
+            {
+                results[found++] = { INVALID_BODY, mesh->triangle_ids[t] };
+            }
+        });
+    }
+
+    visit_bodies(query.tree, box, [&](uint32_t slot) {
+        BodyHandle handle = world.handles.slot_to_handle[slot];
+        if(found >= max_results || handle == overlap.ignore || world.radius[slot] <= 0.0f) return;
+        if(shapes_overlap(proxy, ConvexProxy{ &world.shape[slot], world.position.get(slot), world.orientation[slot] }))
+        {
+            results[found++] = { handle, UINT32_MAX };
+        }
+    });
+    return found;
+}
+
+void scene_overlap(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                   const OverlapQuery* overlaps, size_t count, OverlapHit* results, uint32_t max_results, uint32_t* counts)
+{
+    phys_parallel_for(query.pool, count, query_chunk_size(query), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            counts[i] = overlap_one(query, world, mesh, overlaps[i], results + i * max_results, max_results);
+        }
+    });
+}
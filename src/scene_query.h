@@ -0,0 +1,93 @@
+#pragma once
+#include "rigid_body.h"
+#include "aabb_tree.h"
+#include "mesh_bvh.h"
+#include "gjk.h"
+
+/*
+    Scene queries: rays, shape casts and overlaps against the rigid bodies and optionally a static mesh.
+
+    Everything works on batches, and every query writes its results into buffers the caller owns (one QueryHit per ray /
+    cast, up to max_results OverlapHits per overlap) so running queries never allocates. Batches get split over the pool.
+
+    Bodies are found through an AABBTree that scene_query_update keeps in sync with the world (leaf user value = body
+    slot). Rays go down the body tree and the mesh BVH 8 at a time: every node box gets slab tested against the whole
+    packet in one go (SSE / AVX2 picked with the levels from physics_simd.h) and the packet only goes further down where
+    at least one of its rays still hits, with each ray's far limit shrinking as it finds closer hits. Mesh triangles are
+    tested against all 8 rays at once as well. Rays that sit next to each other in the batch and start close together
+    pointing roughly the same way (sensor fans, line of sight checks from one agent) share nearly all of their traversal,
+    so order the batch that way.
+
+    Bodies get hit exactly: spheres analytically, rays against boxes with a slab test in the box's space, everything else
+    by conservative advancement with GJK, which is also what shape casts use (spheres cast against the mesh use the exact sweeps from ccd.h). Shape casts and overlaps are
+    one query at a time since their boxes are all different.
+*/
+
+struct SceneQuery
+{
+    AABBTree tree;                      // Bounding sphere box of every body
+    std::vector<uint32_t> proxies;      // Tree leaf of each body slot
+
+    ThreadPool* pool = nullptr;         // Optional, batches get split over it
+    size_t chunk_size = 0;              // Queries (ray packets for rays) per job, 0 = 16
+};
+
+struct RayQuery
+{
+    glm::vec3 origin = glm::vec3(0.0);
+    glm::vec3 dir = glm::vec3(0.0, 0.0, 1.0);  // Doesn't need to be normalized, t is in units of dir
+    float max_t = 1.0;
+    BodyHandle ignore = INVALID_BODY;           // Body this ray can't hit (whoever is doing the looking)
+};
+
+// Moves shape from position to position + dir * max_t
+struct ShapeCastQuery
+{
+    ConvexShape shape;
+    glm::vec3 position = glm::vec3(0.0);
+    glm::quat orientation = glm::quat(1.0, 0.0, 0.0, 0.0);
+    glm::vec3 dir = glm::vec3(0.0, 0.0, 1.0);
+    float max_t = 1.0;
+    BodyHandle ignore = INVALID_BODY;
+};
+
+struct OverlapQuery
+{
+    ConvexShape shape;
+    glm::vec3 position = glm::vec3(0.0);
+    glm::quat orientation = glm::quat(1.0, 0.0, 0.0, 0.0);
+    BodyHandle ignore = INVALID_BODY;
+};
+
+struct QueryHit
+{
+    float t = -1.0;                         // < 0 = nothing got hit
+    glm::vec3 point = glm::vec3(0.0);       // Where it touched
+    glm::vec3 normal = glm::vec3(0.0);      // Surface normal at point, facing the query
+    BodyHandle body = INVALID_BODY;         // INVALID_BODY for mesh hits
+    uint32_t triangle = UINT32_MAX;         // Mesh triangle id for mesh hits
+};
+
+// One of body / triangle is set
+struct OverlapHit
+{
+    BodyHandle body;
+    uint32_t triangle;
+};
+
+// Brings the tree up to date with the world, call after stepping and before querying.
+// Bodies that stay inside their fat boxes don't touch the tree at all.
+void scene_query_update(SceneQuery& query, const RigidBodyWorld& world);
+
+// Closest hit of every ray. mesh can be nullptr. Starting inside something is a hit at t = 0 facing back along the ray.
+void scene_raycast(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                   const RayQuery* rays, size_t count, QueryHit* hits);
+
+// Same with a shape instead of a ray, t is where it first touches something
+void scene_shape_cast(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                      const ShapeCastQuery* casts, size_t count, QueryHit* hits);
+
+// Everything each shape touches. Query q writes to results[q * max_results] onwards and counts[q] is how many it found,
+// anything past max_results gets dropped.
+void scene_overlap(const SceneQuery& query, const RigidBodyWorld& world, const MeshCollider* mesh,
+                   const OverlapQuery* overlaps, size_t count, OverlapHit* results, uint32_t max_results, uint32_t* counts);
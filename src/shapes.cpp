@@ -0,0 +1,283 @@
+#include "shapes.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+ConvexShape shape_sphere(float radius)
+{
+    ConvexShape shape;
+    shape.type = SHAPE_SPHERE;
+    shape.radius = radius;
+    return shape;
+}
+
+ConvexShape shape_box(const glm::vec3& half_extents)
+{
+    ConvexShape shape;
+    shape.type = SHAPE_BOX;
+    shape.half_extents = half_extents;
+    return shape;
+}
+
+ConvexShape shape_capsule(float half_height, float radius)
+{
+    ConvexShape shape;
+    shape.type = SHAPE_CAPSULE;
+    shape.half_height = half_height;
+    shape.radius = radius;
+    return shape;
+}
+
+ConvexShape shape_hull(const ConvexHull* hull, float radius)
+{
+    if(!hull || hull->vertices.empty())
+    {
+        std::cerr << "PHYSICS: shape_hull got " << (hull ? "an empty" : "no") << " hull, using a sphere instead" << std::endl;
+        return shape_sphere(radius);
+    }
+
+    ConvexShape shape;
+    shape.type = SHAPE_HULL;
+    shape.hull = hull;
+    shape.radius = radius;
+    return shape;
+}
+
+ConvexShape shape_triangle(const glm::vec3* corners)
+{
+    ConvexShape shape;
+    shape.type = SHAPE_TRIANGLE;
+    shape.triangle = corners;
+    return shape;
+}
+
+ConvexHull hull_from_points(const std::vector<glm::vec3>& points)
+{
+    ConvexHull hull;
+    hull.vertices = points;
+    return hull;
+}
+
+struct VertexKeyHash
+{
+    size_t operator()(const glm::vec3& v) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, &v, sizeof(bits));
+        return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+    }
+};
+
+ConvexHull hull_from_mesh(const MeshGeometry& mesh)
+{
+    ConvexHull hull;
+
+    // Render meshes split vertices along uv / normal seams, weld them back together by position
+    std::unordered_map<glm::vec3, uint32_t, VertexKeyHash> welded;
+    std::vector<uint32_t> remap(mesh.vertices.size());
+    for(size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        auto result = welded.emplace(mesh.vertices[i].position, (uint32_t)hull.vertices.size());
+        if(result.second) hull.vertices.push_back(mesh.vertices[i].position);
+        remap[i] = result.first->second;
+    }
+
+    // Every triangle edge in both directions, then dedupe
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(mesh.indices.size() * 2);
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        uint32_t tri[3] = { remap[mesh.indices[i]], remap[mesh.indices[i + 1]], remap[mesh.indices[i + 2]] };
+        for(int e = 0; e < 3; e++)
+        {
+            uint32_t a = tri[e];
+            uint32_t b = tri[(e + 1) % 3];
+            if(a == b) continue;
+            edges.push_back({ a, b });
+            edges.push_back({ b, a });
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    hull.adjacency_start.assign(hull.vertices.size() + 1, 0);
+    for(const auto& edge : edges) hull.adjacency_start[edge.first + 1]++;
+    for(size_t i = 0; i < hull.vertices.size(); i++) hull.adjacency_start[i + 1] += hull.adjacency_start[i];
+
+    hull.adjacency.resize(edges.size());
+    for(size_t i = 0; i < edges.size(); i++) hull.adjacency[i] = edges[i].second;    // Already grouped by first
+
+    return hull;
+}
+
+static glm::vec3 hull_support(const ConvexHull& hull, const glm::vec3& dir, uint32_t& hint)
+{
+    const std::vector<glm::vec3>& verts = hull.vertices;
+    if(verts.empty()) return glm::vec3(0.0);
+
+    if(hull.adjacency_start.empty())
+    {
+        uint32_t best = 0;
+        float best_dot = glm::dot(verts[0], dir);
+        for(uint32_t i = 1; i < verts.size(); i++)
+        {
+            float d = glm::dot(verts[i], dir);
+            if(d > best_dot) { best_dot = d; best = i; }
+        }
+        hint = best;
+        return verts[best];
+    }
+
+    // Walk to whichever neighbour is furthest along dir until nothing beats the current vertex.
+    // On a convex hull a local maximum is the global one.
+    uint32_t current = hint < verts.size() ? hint : 0;
+    float current_dot = glm::dot(verts[current], dir);
+    for(;;)
+    {
+        uint32_t next = current;
+        for(uint32_t i = hull.adjacency_start[current]; i < hull.adjacency_start[current + 1]; i++)
+        {
+            uint32_t n = hull.adjacency[i];
+            float d = glm::dot(verts[n], dir);
+            if(d > current_dot) { current_dot = d; next = n; }
+        }
+        if(next == current) break;
+        current = next;
+    }
+
+    hint = current;
+    return verts[current];
+}
+
+glm::vec3 shape_support_core(const ConvexShape& shape, const glm::vec3& dir, uint32_t& hint)
+{
+    switch(shape.type)
+    {
+        case SHAPE_SPHERE:
+            return glm::vec3(0.0);
+        case SHAPE_BOX:
+            return glm::vec3(dir.x >= 0.0f ? shape.half_extents.x : -shape.half_extents.x,
+                             dir.y >= 0.0f ? shape.half_extents.y : -shape.half_extents.y,
+                             dir.z >= 0.0f ? shape.half_extents.z : -shape.half_extents.z);
+        case SHAPE_CAPSULE:
+            return glm::vec3(0.0, dir.y >= 0.0f ? shape.half_height : -shape.half_height, 0.0);
+        case SHAPE_HULL:
+            return shape.hull ? hull_support(*shape.hull, dir, hint) : glm::vec3(0.0);
+        case SHAPE_TRIANGLE:
+        {
+            float d0 = glm::dot(shape.triangle[0], dir);
+            float d1 = glm::dot(shape.triangle[1], dir);
+            float d2 = glm::dot(shape.triangle[2], dir);
+            if(d0 >= d1 && d0 >= d2) return shape.triangle[0];
+            return d1 >= d2 ? shape.triangle[1] : shape.triangle[2];
+        }
+    }
+    return glm::vec3(0.0);
+}
+
+uint32_t shape_core_vertex_count(const ConvexShape& shape)
+{
+    switch(shape.type)
+    {
+        case SHAPE_SPHERE:
+            return 1;
+        case SHAPE_BOX:
+            return 8;
+        case SHAPE_CAPSULE:
+            return 2;
+        case SHAPE_HULL:
+            return shape.hull && !shape.hull->vertices.empty() ? (uint32_t)shape.hull->vertices.size() : 1;
+        case SHAPE_TRIANGLE:
+            return 3;
+    }
+    return 0;
+}
+
+glm::vec3 shape_core_vertex(const ConvexShape& shape, uint32_t index)
+{
+    switch(shape.type)
+    {
+        case SHAPE_SPHERE:
+            return glm::vec3(0.0);
+        case SHAPE_BOX:
+            return glm::vec3((index & 1) ? shape.half_extents.x : -shape.half_extents.x,
+                             (index & 2) ? shape.half_extents.y : -shape.half_extents.y,
+                             (index & 4) ? shape.half_extents.z : -shape.half_extents.z);
+        case SHAPE_CAPSULE:
+            return glm::vec3(0.0, index ? shape.half_height : -shape.half_height, 0.0);
+        case SHAPE_HULL:
+            return shape.hull && index < shape.hull->vertices.size() ? shape.hull->vertices[index] : glm::vec3(0.0);
+        case SHAPE_TRIANGLE:
+            return shape.triangle[index];
+    }
+    return glm::vec3(0.0);
+}
+
+glm::vec3 shape_support_world(const ConvexShape& shape, const glm::vec3& position, const glm::quat& orientation,
+                              const glm::vec3& dir, uint32_t& hint)
+{
+    glm::vec3 local_dir = glm::conjugate(orientation) * dir;
+    return position + orientation * shape_support_core(shape, local_dir, hint);
+}
+
+float shape_bounding_radius(const ConvexShape& shape)
+{
+    float core = 0.0;
+    switch(shape.type)
+    {
+        case SHAPE_SPHERE:
+            break;
+        case SHAPE_BOX:
+            core = glm::length(shape.half_extents);
+            break;
+        case SHAPE_CAPSULE:
+            core = shape.half_height;
+            break;
+        case SHAPE_HULL:
+            if(shape.hull)
+            {
+                for(const glm::vec3& v : shape.hull->vertices) core = std::max(core, glm::length(v));
+            }
+            break;
+        case SHAPE_TRIANGLE:
+            for(int i = 0; i < 3; i++) core = std::max(core, glm::length(shape.triangle[i]));
+            break;
+    }
+    return core + shape.radius;
+}
+
+glm::vec3 shape_inertia_inv(const ConvexShape& shape, float mass)
+{
+    if(mass <= 0.0f) return glm::vec3(0.0);
+
+    glm::vec3 half = shape.half_extents + glm::vec3(shape.radius);
+    switch(shape.type)
+    {
+        case SHAPE_SPHERE:
+            return glm::vec3(1.0f / (0.4f * mass * shape.radius * shape.radius));
+        case SHAPE_BOX:
+            break;
+        case SHAPE_CAPSULE:
+            // Close enough: the box around it
+            half = glm::vec3(shape.radius, shape.half_height + shape.radius, shape.radius);
+            break;
+        case SHAPE_HULL:
+        {
+            glm::vec3 extent(0.0);
+            if(shape.hull)
+            {
+                for(const glm::vec3& v : shape.hull->vertices) extent = glm::max(extent, glm::abs(v));
+            }
+            half = extent + glm::vec3(shape.radius);
+            break;
+        }
+        case SHAPE_TRIANGLE:
+            // Triangles never move
+            return glm::vec3(0.0);
+    }
+
+    glm::vec3 s = half * 2.0f;
+    glm::vec3 inertia = glm::vec3(s.y * s.y + s.z * s.z, s.x * s.x + s.z * s.z, s.x * s.x + s.y * s.y) * (mass / 12.0f);
+    return 1.0f / inertia;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "mesh.h"
+
+/*
+    Convex collision shapes, described by their support function (the point furthest along a direction).
+    That's all GJK / EPA need, so any convex thing that can answer "furthest point along d" can collide with any other.
+
+    Every shape is a core (point, box, segment or point cloud) grown by radius, so a sphere is a point with a radius and
+    a capsule is a segment with a radius. GJK works on the cores and adds the radii back on afterwards, which keeps
+    shallow contacts between rounded shapes exact without needing EPA at all.
+
+    Hulls are point clouds plus optional vertex adjacency. With adjacency the support function hill climbs from the last
+    answer to a neighbour that's further along d until none is, which only visits a handful of vertices per query when
+    the direction barely changes between calls (the usual case frame to frame). Without adjacency it's a linear scan.
+*/
+
+enum ShapeType
+{
+    SHAPE_SPHERE,
+    SHAPE_BOX,
+    SHAPE_CAPSULE,      // Segment along the local y axis
+    SHAPE_HULL,
+    SHAPE_TRIANGLE      // Static mesh triangles only (see mesh_bvh.h)
+};
+
+struct ConvexShape
+{
+    ShapeType type = SHAPE_SPHERE;
+    float radius = 0.0;                         // Added around the core for every type
+    glm::vec3 half_extents = glm::vec3(0.0);    // Box
+    float half_height = 0.0;                    // Capsule, half the length of the core segment
+    const ConvexHull* hull = nullptr;           // Hull (defined in mesh.h), not owned
+    const glm::vec3* triangle = nullptr;        // Triangle, 3 corners, not owned
+};
+
+ConvexShape shape_sphere(float radius);
+ConvexShape shape_box(const glm::vec3& half_extents);
+ConvexShape shape_capsule(float half_height, float radius);
+// A missing or empty hull falls back to a sphere of radius (and complains)
+ConvexShape shape_hull(const ConvexHull* hull, float radius = 0.0);
+ConvexShape shape_triangle(const glm::vec3* corners);
+
+// Hull over the points with no adjacency (support is a linear scan)
+ConvexHull hull_from_points(const std::vector<glm::vec3>& points);
+
+// Hull over a convex render mesh. Vertices that only differ by normal / uv get welded and the triangle edges become the
+// adjacency used for hill climbing. The mesh has to actually be convex, otherwise hill climbing can get stuck.
+ConvexHull hull_from_mesh(const MeshGeometry& mesh);
+
+// Furthest point of the core along dir in the shape's local space. hint is the hull vertex to start climbing from and
+// gets updated to the answer, ignored by the other types.
+glm::vec3 shape_support_core(const ConvexShape& shape, const glm::vec3& dir, uint32_t& hint);
+
+// Same as shape_support_core but for a shape at position / orientation, dir and result in world space
+glm::vec3 shape_support_world(const ConvexShape& shape, const glm::vec3& position, const glm::quat& orientation,
+                              const glm::vec3& dir, uint32_t& hint);
+
+// The points that make up the core: 1 for a sphere, 8 box corners, 2 capsule ends, every hull vertex, 3 triangle corners.
+// A hull shape with no hull behind it is a single point at the origin, same as its support.
+uint32_t shape_core_vertex_count(const ConvexShape& shape);
+glm::vec3 shape_core_vertex(const ConvexShape& shape, uint32_t index);
+
+// Radius of a sphere around the local origin that contains the whole shape
+float shape_bounding_radius(const ConvexShape& shape);
+
+// Diagonal of the inverse inertia tensor for a solid shape of the given mass (hulls use their bounding box)
+glm::vec3 shape_inertia_inv(const ConvexShape& shape, float mass);
@@ -0,0 +1,37 @@
+#include "spatial_sort.h"
+#include <algorithm>
+
+#define RADIX_BITS 11
+
+void morton_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, uint32_t bits,
+                 std::vector<uint64_t>& key_scratch, std::vector<uint32_t>& value_scratch)
+{
+    size_t count = keys.size();
+    key_scratch.resize(count);
+    value_scratch.resize(count);
+
+    const uint32_t buckets = 1u << RADIX_BITS;
+    std::vector<uint32_t> offsets(buckets);
+    for(uint32_t shift = 0; shift < bits; shift += RADIX_BITS)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for(size_t i = 0; i < count; i++) offsets[(keys[i] >> shift) & (buckets - 1)]++;
+
+        uint32_t sum = 0;
+        for(uint32_t b = 0; b < buckets; b++)
+        {
+            uint32_t n = offsets[b];
+            offsets[b] = sum;
+            sum += n;
+        }
+
+        for(size_t i = 0; i < count; i++)
+        {
+            uint32_t dst = offsets[(keys[i] >> shift) & (buckets - 1)]++;
+            key_scratch[dst] = keys[i];
+            value_scratch[dst] = values[i];
+        }
+        keys.swap(key_scratch);
+        values.swap(value_scratch);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/*
+    Z-order (Morton) keys and the radix sort that goes with them. Sorting things by the Morton key of the grid cell they
+    sit in puts things that are close in space close in memory, which is what the SPH neighbour search (sph.h) and the
+    Barnes-Hut octree (nbody.h) both build on.
+*/
+
+#define MORTON_AXIS_BITS 21     // 3 * 21 bits fit in a 64 bit key
+
+// Spreads the low 21 bits of x out to every third bit
+inline uint64_t morton_spread(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+// Interleaves x, y and z (each under 2^21) as ...zyxzyx
+inline uint64_t morton_encode(const glm::uvec3& cell)
+{
+    return morton_spread(cell.x) | morton_spread(cell.y) << 1 | morton_spread(cell.z) << 2;
+}
+
+// Stable LSD radix sort of keys, carrying values along, that only looks at the low bits of every key.
+// The scratch vectors just have to outlive the call, keep them around so nothing gets allocated every step.
+void morton_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, uint32_t bits,
+                 std::vector<uint64_t>& key_scratch, std::vector<uint32_t>& value_scratch);
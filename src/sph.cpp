@@ -0,0 +1,169 @@
+#include "sph.h"
+#include "ccd.h"
+#include <algorithm>
+#include <cmath>
+
+#define SPH_CELL_CHUNK 64       // Cells per job
+#define SPH_MAX_SPLIT 64        // Most steps sph_step splits delta into
+
+ParticleHandle sph_fill_box(const SphFluid& fluid, ParticleWorld& world, const glm::vec3& min, const glm::vec3& max, float spacing)
+{
+    glm::ivec3 counts = glm::max(glm::ivec3((max - min) / spacing), glm::ivec3(0));
+    phys_world_reserve(world, phys_world_count(world) + (size_t)counts.x * counts.y * counts.z);
+
+    PhysicsParticle particle;
+    particle.mass_inv = 1.0f / (fluid.rest_density * spacing * spacing * spacing);
+    particle.radius = spacing * 0.5f;
+
+    ParticleHandle first = INVALID_PARTICLE;
+    for(int32_t z = 0; z < counts.z; z++)
+    for(int32_t y = 0; y < counts.y; y++)
+    for(int32_t x = 0; x < counts.x; x++)
+    {
+        particle.position = min + (glm::vec3(x, y, z) + 0.5f) * spacing;
+        ParticleHandle handle = phys_world_add(world, particle);
+        if(first == INVALID_PARTICLE) first = handle;
+    }
+    return first;
+}
+
+void sph_sort(SphFluid& fluid, ParticleWorld& world)
+{
+    cell_list_build(fluid.cells, world, fluid.smoothing_radius);
+}
+
+static void compute_density(SphFluid& fluid, ParticleWorld& world)
+{
+    size_t count = phys_world_count(world);
+    fluid.mass.resize(count);
+    fluid.density.resize(count);
+    fluid.pressure.resize(count);
+    fluid.volume.resize(count);
+
+    // Infinite mass particles get 0 here and drop out of both passes
+    phys_parallel_for(world.pool, count, world.chunk_size, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) fluid.mass[i] = world.mass_inv[i] > 0.0f ? 1.0f / world.mass_inv[i] : 0.0f;
+    });
+
+    float h = fluid.smoothing_radius;
+    float h2 = h * h;
+    float poly6 = 315.0f / (64.0f * glm::pi<float>() * powf(h, 9.0f));
+    const float* px = world.position.x.data();
+    const float* py = world.position.y.data();
+    const float* pz = world.position.z.data();
+    const float* mass = fluid.mass.data();
+
+    cell_list_for_each(fluid.cells, world, SPH_CELL_CHUNK, [&](uint32_t first, uint32_t end, const CellRun* runs, uint32_t run_count) {
+        for(uint32_t i = first; i < end; i++)
+        {
+            float density = 0.0;
+            for(uint32_t r = 0; r < run_count; r++)
+            {
+                // Branch free so the compiler can vectorize it
+                for(uint32_t j = runs[r].begin; j < runs[r].end; j++)
+                {
+                    float dx = px[i] - px[j], dy = py[i] - py[j], dz = pz[i] - pz[j];
+                    float w = std::max(h2 - (dx * dx + dy * dy + dz * dz), 0.0f);
+                    density += w * w * w * mass[j];
+                }
+            }
+            density *= poly6;
+
+            // No negative pressure, otherwise particles clump up at the surface
+            fluid.density[i] = density;
+            fluid.pressure[i] = std::max(0.0f, fluid.stiffness * (density - fluid.rest_density));
+            fluid.volume[i] = density > 0.0f ? mass[i] / density : 0.0f;
+        }
+    });
+}
+
+static void compute_forces(SphFluid& fluid, ParticleWorld& world)
+{
+    float h = fluid.smoothing_radius;
+    float h2 = h * h;
+    float spiky = 45.0f / (glm::pi<float>() * powf(h, 6.0f));     // -grad spiky and the viscosity laplacian share this
+    const float* px = world.position.x.data();
+    const float* py = world.position.y.data();
+    const float* pz = world.position.z.data();
+    const float* vx = world.velocity.x.data();
+    const float* vy = world.velocity.y.data();
+    const float* vz = world.velocity.z.data();
+    const float* pressure = fluid.pressure.data();
+    const float* volume = fluid.volume.data();
+
+    cell_list_for_each(fluid.cells, world, SPH_CELL_CHUNK, [&](uint32_t first, uint32_t end, const CellRun* runs, uint32_t run_count) {
+        for(uint32_t i = first; i < end; i++)
+        {
+            if(volume[i] == 0.0f) continue;
+
+            glm::vec3 push(0.0), drag(0.0);
+            for(uint32_t r = 0; r < run_count; r++)
+            {
+                for(uint32_t j = runs[r].begin; j < runs[r].end; j++)
+                {
+                    float dx = px[i] - px[j], dy = py[i] - py[j], dz = pz[i] - pz[j];
+                    float r2 = dx * dx + dy * dy + dz * dz;
+                    if(r2 >= h2 || r2 < 1e-12f) continue;
+
+                    float len = sqrtf(r2);
+                    float hr = (h - len) * volume[j];
+
+                    push += glm::vec3(dx, dy, dz) * (0.5f * (pressure[i] + pressure[j]) * hr * (h - len) / len);
+                    drag += glm::vec3(vx[j] - vx[i], vy[j] - vy[i], vz[j] - vz[i]) * hr;
+                }
+            }
+
+            // Force per volume so far, times the particle's own volume to get the force on it
+            glm::vec3 force = (push + drag * fluid.viscosity) * (spiky * volume[i]);
+            world.force.set(i, world.force.get(i) + force);
+        }
+    });
+}
+
+void sph_step(SphFluid& fluid, ParticleWorld& world, float delta, const MeshCollider* mesh, const std::vector<ContactPlane>& planes)
+{
+    // Pressure waves travel at sqrt(stiffness) on top of however fast the particles are going, neither is allowed to
+    // cross more than courant * h in one step or the fluid blows up
+    float speed_sq = 0.0;
+    size_t count = phys_world_count(world);
+    for(size_t i = 0; i < count; i++)
+    {
+        speed_sq = std::max(speed_sq, glm::dot(world.velocity.get(i), world.velocity.get(i)));
+    }
+    float speed = sqrtf(fluid.stiffness) + sqrtf(speed_sq);
+    float limit = fluid.courant * fluid.smoothing_radius;
+    uint32_t steps = std::min((uint32_t)ceilf(delta * speed / limit), (uint32_t)SPH_MAX_SPLIT);
+    steps = std::max(steps, 1u);
+
+    float sub_delta = delta / steps;
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        sph_sort(fluid, world);
+        compute_density(fluid, world);
+        compute_forces(fluid, world);
+        phys_world_step(world, sub_delta);
+        phys_world_collide_static(world, mesh, planes, sub_delta, fluid.restitution);
+    }
+}
+
+void sph_update(SphFluid& fluid, ParticleWorld& world, FixedStepper& stepper, double frame_delta,
+                const MeshCollider* mesh, const std::vector<ContactPlane>& planes)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            sph_step(fluid, world, sub_delta, mesh, planes);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(phys_world_checksum(world));
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+#include "narrowphase.h"
+#include "mesh_bvh.h"
+#include "cell_list.h"
+
+/*
+    Smoothed particle hydrodynamics (Muller et al. 2003) on top of a ParticleWorld. Every particle in the world is a bit
+    of fluid: density is summed from its neighbours with the poly6 kernel, pressure comes from how far that is from
+    rest_density, and pressure (spiky kernel gradient) plus viscosity (viscosity kernel laplacian) go into world.force.
+    The world's own step then integrates that along with gravity and any generators, and the particles get pushed out of
+    the static mesh and planes with phys_world_collide_static. Particle radius is only used for that, give it about half
+    the spacing. Leave world.statics unset, the fluid's mesh and planes already get collided with fluid.restitution.
+
+    Neighbours come out of a cell list (see cell_list.h) with smoothing_radius sized cells, rebuilt every step. That
+    sorts the particles by the Z-order index of their cell and reorders the whole world to match, so the neighbour loops
+    read memory front to back instead of jumping all over it.
+
+    The density and force passes go over cells spread across world.pool. Every particle only writes its own density and
+    force, so there's nothing to synchronize and the results don't depend on the thread count.
+
+    Handles still work after the reorder, but slots change every step.
+*/
+
+struct SphFluid
+{
+    float smoothing_radius = 0.1;       // h, also the grid cell size
+    float rest_density = 1000.0;        // kg / m^3
+    float stiffness = 50.0;             // pressure = stiffness * (density - rest_density)
+    float viscosity = 5.0;              // Also what keeps it from splashing itself apart, much lower needs a smaller step
+    float restitution = 0.0;            // Against the static colliders
+    float courant = 0.4;                // sph_step splits delta so nothing travels further than this * h in one step
+
+    CellList cells;                     // Built every step
+
+    // Per particle, in sorted order
+    FloatArray mass;
+    FloatArray density;
+    FloatArray pressure;
+    FloatArray volume;                  // mass / density
+};
+
+// Fills the box with particles spacing apart, each weighing rest_density * spacing^3. Returns the first handle.
+ParticleHandle sph_fill_box(const SphFluid& fluid, ParticleWorld& world, const glm::vec3& min, const glm::vec3& max, float spacing);
+
+// Sorts and reorders the particles and builds the cells. sph_step does this first thing, it's only here for anything
+// that wants the ordering without stepping.
+void sph_sort(SphFluid& fluid, ParticleWorld& world);
+
+// One step: sort, densities, forces, integrate, collide. Gets split into smaller steps if delta is too long for the
+// stiffness and how fast the particles are moving (see courant). mesh can be nullptr.
+void sph_step(SphFluid& fluid, ParticleWorld& world, float delta, const MeshCollider* mesh, const std::vector<ContactPlane>& planes);
+
+// Fixed step driver, same as phys_world_update
+void sph_update(SphFluid& fluid, ParticleWorld& world, FixedStepper& stepper, double frame_delta,
+                const MeshCollider* mesh, const std::vector<ContactPlane>& planes);
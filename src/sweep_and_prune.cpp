@@ -0,0 +1,229 @@
+#include "sweep_and_prune.h"
+#include <iostream>
+#include <algorithm>
+
+#define SAP_MAX_BIT 0x80000000u
+
+static inline uint32_t endpoint_body(const SapEndpoint& e) { return e.data & ~SAP_MAX_BIT; }
+static inline bool endpoint_is_max(const SapEndpoint& e) { return (e.data & SAP_MAX_BIT) != 0; }
+
+// Ties put mins before maxes so boxes that are just touching count as overlapping, same as aabb_overlap
+static inline bool endpoint_less(const SapEndpoint& a, const SapEndpoint& b)
+{
+    return a.value < b.value || (a.value == b.value && !endpoint_is_max(a) && endpoint_is_max(b));
+}
+
+static void add_pair(SweepAndPrune& sap, uint32_t a, uint32_t b)
+{
+    if(sap.pairs.insert(pair_key(a, b)).second)
+    {
+        sap.events.push_back({ make_pair_sorted(a, b), true });
+    }
+}
+
+static void remove_pair(SweepAndPrune& sap, uint32_t a, uint32_t b)
+{
+    if(sap.pairs.erase(pair_key(a, b)))
+    {
+        sap.events.push_back({ make_pair_sorted(a, b), false });
+    }
+}
+
+static inline void set_index(SweepAndPrune& sap, uint32_t axis, uint32_t i)
+{
+    const SapEndpoint& e = sap.endpoints[axis][i];
+    if(endpoint_is_max(e)) sap.max_index[axis][endpoint_body(e)] = i;
+    else sap.min_index[axis][endpoint_body(e)] = i;
+}
+
+// Insertion sort. With track_pairs set (3 axis mode) it reports overlap changes as endpoints pass each other,
+// the 1 axis mode just sorts and sweeps afterwards.
+static void sort_axis(SweepAndPrune& sap, uint32_t axis, bool track_pairs)
+{
+    std::vector<SapEndpoint>& ep = sap.endpoints[axis];
+    for(uint32_t i = 1; i < ep.size(); i++)
+    {
+        SapEndpoint moving = ep[i];
+        uint32_t j = i;
+
+        while(j > 0 && endpoint_less(moving, ep[j - 1]))
+        {
+            const SapEndpoint& other = ep[j - 1];
+            if(track_pairs)
+            {
+                uint32_t a = endpoint_body(moving);
+                uint32_t b = endpoint_body(other);
+
+                // A min moving below a max: the intervals start overlapping on this axis
+                if(!endpoint_is_max(moving) && endpoint_is_max(other))
+                {
+                    if(aabb_overlap(sap.boxes[a], sap.boxes[b])) add_pair(sap, a, b);
+                }
+                // A max moving below a min: they stopped overlapping on this axis
+                else if(endpoint_is_max(moving) && !endpoint_is_max(other))
+                {
+                    remove_pair(sap, a, b);
+                }
+            }
+
+            ep[j] = other;
+            set_index(sap, axis, j);
+            j--;
+        }
+
+        if(j != i)
+        {
+            ep[j] = moving;
+            set_index(sap, axis, j);
+        }
+    }
+}
+
+// 1 axis mode: walk the sorted axis keeping a list of open intervals, anything still open when a min shows up overlaps on x
+static void sweep_axis(SweepAndPrune& sap)
+{
+    std::unordered_set<uint64_t> current;
+    std::vector<uint32_t> open;
+
+    for(const SapEndpoint& e : sap.endpoints[0])
+    {
+        uint32_t body = endpoint_body(e);
+        if(endpoint_is_max(e))
+        {
+            open.erase(std::find(open.begin(), open.end(), body));
+            continue;
+        }
+
+        for(uint32_t other : open)
+        {
+            if(aabb_overlap(sap.boxes[body], sap.boxes[other])) current.insert(pair_key(body, other));
+        }
+        open.push_back(body);
+    }
+
+    for(uint64_t key : sap.pairs)
+    {
+        if(!current.count(key)) sap.events.push_back({ { (uint32_t)(key >> 32), (uint32_t)key }, false });
+    }
+    for(uint64_t key : current)
+    {
+        if(!sap.pairs.count(key)) sap.events.push_back({ { (uint32_t)(key >> 32), (uint32_t)key }, true });
+    }
+    sap.pairs.swap(current);
+}
+
+static void write_box(SweepAndPrune& sap, uint32_t id)
+{
+    const AABB& box = sap.boxes[id];
+    for(uint32_t axis = 0; axis < sap.axis_count; axis++)
+    {
+        sap.endpoints[axis][sap.min_index[axis][id]].value = box.min[axis];
+        sap.endpoints[axis][sap.max_index[axis][id]].value = box.max[axis];
+    }
+}
+
+uint32_t sap_add(SweepAndPrune& sap, const AABB& box)
+{
+    if(sap.axis_count != 1) sap.axis_count = 3;
+
+    uint32_t id;
+    if(!sap.free_ids.empty())
+    {
+        id = sap.free_ids.back();
+        sap.free_ids.pop_back();
+    }
+    else
+    {
+        id = (uint32_t)sap.boxes.size();
+        sap.boxes.push_back(box);
+        sap.alive.push_back(0);
+        for(uint32_t axis = 0; axis < 3; axis++)
+        {
+            sap.min_index[axis].push_back(SAP_INVALID);
+            sap.max_index[axis].push_back(SAP_INVALID);
+        }
+    }
+
+    sap.boxes[id] = box;
+    sap.alive[id] = 1;
+
+    // New endpoints go on the end and the next sort pulls them into place, reporting overlaps on the way
+    for(uint32_t axis = 0; axis < sap.axis_count; axis++)
+    {
+        std::vector<SapEndpoint>& ep = sap.endpoints[axis];
+        sap.min_index[axis][id] = (uint32_t)ep.size();
+        ep.push_back({ box.min[axis], id });
+        sap.max_index[axis][id] = (uint32_t)ep.size();
+        ep.push_back({ box.max[axis], id | SAP_MAX_BIT });
+    }
+
+    return id;
+}
+
+void sap_remove(SweepAndPrune& sap, uint32_t id)
+{
+    if(id >= sap.alive.size() || !sap.alive[id])
+    {
+        std::cerr << "SAP: tried to remove invalid body <id: " << id << ">" << std::endl;
+        return;
+    }
+
+    std::vector<uint64_t> dead;
+    for(uint64_t key : sap.pairs)
+    {
+        if((uint32_t)(key >> 32) == id || (uint32_t)key == id) dead.push_back(key);
+    }
+    for(uint64_t key : dead)
+    {
+        remove_pair(sap, (uint32_t)(key >> 32), (uint32_t)key);
+    }
+
+    for(uint32_t axis = 0; axis < sap.axis_count; axis++)
+    {
+        std::vector<SapEndpoint>& ep = sap.endpoints[axis];
+        ep.erase(std::remove_if(ep.begin(), ep.end(), [id](const SapEndpoint& e) { return endpoint_body(e) == id; }), ep.end());
+        for(uint32_t i = 0; i < ep.size(); i++) set_index(sap, axis, i);
+
+        sap.min_index[axis][id] = SAP_INVALID;
+        sap.max_index[axis][id] = SAP_INVALID;
+    }
+
+    sap.alive[id] = 0;
+    sap.free_ids.push_back(id);
+}
+
+void sap_move(SweepAndPrune& sap, uint32_t id, const AABB& box)
+{
+    sap.boxes[id] = box;
+    write_box(sap, id);
+}
+
+void sap_update(SweepAndPrune& sap)
+{
+    // Drop what the last update already reported but keep anything sap_remove added since then
+    sap.events.erase(sap.events.begin(), sap.events.begin() + sap.events_reported);
+
+    if(sap.axis_count == 1)
+    {
+        sort_axis(sap, 0, false);
+        sweep_axis(sap);
+    }
+    else
+    {
+        for(uint32_t axis = 0; axis < 3; axis++)
+        {
+            sort_axis(sap, axis, true);
+        }
+    }
+
+    sap.events_reported = sap.events.size();
+}
+
+void sap_get_pairs(const SweepAndPrune& sap, std::vector<CollisionPair>& out)
+{
+    out.reserve(out.size() + sap.pairs.size());
+    for(uint64_t key : sap.pairs)
+    {
+        out.push_back({ (uint32_t)(key >> 32), (uint32_t)key });
+    }
+}
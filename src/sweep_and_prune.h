@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <unordered_set>
+#include "collision.h"
+
+/*
+    Incremental sweep and prune broadphase.
+
+    Every body has a min and max endpoint on each sorted axis. Bodies only move a little between frames so the endpoint
+    arrays are almost sorted already and an insertion sort fixes them up in close to O(n).
+
+    With 3 axes the overlapping pairs are tracked purely from the swaps the sort makes: a min passing a max means two
+    bodies might have started touching, a max passing a min means they stopped. With 1 axis (less memory, better for
+    scenes spread out along one direction) the sorted axis gets swept every update and compared against the last set.
+
+    Either way the output is a list of pair added / pair removed events so later stages only have to look at what changed.
+*/
+
+#define SAP_INVALID UINT32_MAX
+
+struct SapEndpoint
+{
+    float value;
+    uint32_t data;      // body id in the low 31 bits, top bit set if this is the max endpoint
+};
+
+struct SapPairEvent
+{
+    CollisionPair pair;
+    bool added;         // false = the pair stopped overlapping (or one of the bodies got removed)
+};
+
+struct SweepAndPrune
+{
+    uint32_t axis_count = 3;        // 1 or 3, set before adding anything
+
+    std::vector<SapEndpoint> endpoints[3];
+    std::vector<uint32_t> min_index[3];     // body -> where its min endpoint is in endpoints[axis]
+    std::vector<uint32_t> max_index[3];
+
+    std::vector<AABB> boxes;
+    std::vector<uint8_t> alive;
+    std::vector<uint32_t> free_ids;
+
+    std::unordered_set<uint64_t> pairs;     // Every pair currently overlapping (see pair_key)
+    std::vector<SapPairEvent> events;       // What changed during the last sap_update
+    size_t events_reported = 0;
+};
+
+uint32_t sap_add(SweepAndPrune& sap, const AABB& box);
+void sap_remove(SweepAndPrune& sap, uint32_t id);
+
+// Only stores the new box, call sap_update once all bodies have been moved
+void sap_move(SweepAndPrune& sap, uint32_t id, const AABB& box);
+
+// Re-sorts the endpoints and fills sap.events with every pair that started or stopped overlapping
+// since the previous sap_update (including ones caused by sap_add / sap_remove)
+void sap_update(SweepAndPrune& sap);
+
+// Appends every currently overlapping pair
+void sap_get_pairs(const SweepAndPrune& sap, std::vector<CollisionPair>& out);
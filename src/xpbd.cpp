@@ -0,0 +1,1009 @@
+#include "xpbd.h"
+#include "integrators.h"
+#include "forces.h"
+#include "physics_simd.h"
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#define XPBD_TYPE_SHIFT 30
+#define XPBD_INDEX_MASK ((1u << XPBD_TYPE_SHIFT) - 1)
+
+static inline glm::vec3 slot_position(const ParticleWorld& world, ParticleHandle handle)
+{
+    return world.position.get(phys_world_slot(world, handle));
+}
+
+// Signed angle around edge a-b between triangles (a, b, c) and (b, a, d), 0 when they're flat and the sign says which
+// way they're folded. Gradients are Bridson et al. 2003, they stay well behaved when flat
+// (unlike going through acos). Returns false if either triangle is degenerate.
+static bool dihedral(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d, float& angle, glm::vec3* grad)
+{
+    glm::vec3 e = b - a;
+    float e_len = glm::length(e);
+    glm::vec3 n1 = glm::cross(c - a, c - b);
+    glm::vec3 n2 = glm::cross(d - b, d - a);
+    float n1_sq = glm::dot(n1, n1);
+    float n2_sq = glm::dot(n2, n2);
+    if(e_len < 1e-9f || n1_sq < 1e-18f || n2_sq < 1e-18f) return false;
+
+    angle = atan2f(glm::dot(glm::cross(n2, n1), e) / e_len, glm::dot(n1, n2));
+    if(!grad) return true;
+
+    glm::vec3 m1 = n1 / n1_sq;
+    glm::vec3 m2 = n2 / n2_sq;
+    grad[0] = m1 * (glm::dot(c - b, e) / e_len) + m2 * (glm::dot(d - b, e) / e_len);
+    grad[1] = -m1 * (glm::dot(c - a, e) / e_len) - m2 * (glm::dot(d - a, e) / e_len);
+    grad[2] = m1 * e_len;
+    grad[3] = m2 * e_len;
+    return true;
+}
+
+uint32_t xpbd_add_distance(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle a, ParticleHandle b, float compliance)
+{
+    DistanceConstraint c;
+    c.a = a;
+    c.b = b;
+    c.rest_length = glm::length(slot_position(world, a) - slot_position(world, b));
+    c.compliance = compliance;
+    solver.distance.push_back(c);
+    solver.version++;
+    return (uint32_t)solver.distance.size() - 1;
+}
+
+uint32_t xpbd_add_bending(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle a, ParticleHandle b,
+                          ParticleHandle c, ParticleHandle d, float compliance)
+{
+    BendingConstraint bend;
+    bend.a = a;
+    bend.b = b;
+    bend.c = c;
+    bend.d = d;
+    bend.compliance = compliance;
+    dihedral(slot_position(world, a), slot_position(world, b), slot_position(world, c), slot_position(world, d),
+             bend.rest_angle, nullptr);
+    solver.bending.push_back(bend);
+    solver.version++;
+    return (uint32_t)solver.bending.size() - 1;
+}
+
+float xpbd_volume(const ParticleWorld& world, const ParticleHandle* triangles, size_t triangle_count)
+{
+    // Sum of the signed tetrahedra from the origin to every triangle
+    float volume = 0.0;
+    for(size_t t = 0; t < triangle_count; t++)
+    {
+        glm::vec3 p0 = slot_position(world, triangles[t * 3 + 0]);
+        glm::vec3 p1 = slot_position(world, triangles[t * 3 + 1]);
+        glm::vec3 p2 = slot_position(world, triangles[t * 3 + 2]);
+        volume += glm::dot(glm::cross(p0, p1), p2);
+    }
+    return volume / 6.0f;
+}
+
+uint32_t xpbd_add_volume(XpbdSolver& solver, const ParticleWorld& world, const ParticleHandle* triangles, size_t triangle_count,
+                         float compliance, float pressure)
+{
+    VolumeConstraint v;
+    v.triangles.assign(triangles, triangles + triangle_count * 3);
+    v.rest_volume = xpbd_volume(world, triangles, triangle_count);
+    v.pressure = pressure;
+    v.compliance = compliance;
+    solver.volume.push_back(std::move(v));
+    solver.version++;
+    return (uint32_t)solver.volume.size() - 1;
+}
+
+uint32_t xpbd_add_attachment(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle particle, float compliance)
+{
+    AttachmentConstraint c;
+    c.particle = particle;
+    c.anchor = slot_position(world, particle);
+    c.compliance = compliance;
+    solver.attachment.push_back(c);
+    solver.version++;
+    return (uint32_t)solver.attachment.size() - 1;
+}
+
+template <typename T>
+static void remove_constraint(XpbdSolver& solver, std::vector<T>& constraints, uint32_t index)
+{
+    if(index >= constraints.size())
+    {
+        std::cerr << "PHYSICS: tried to remove invalid constraint <index: " << index << ">" << std::endl;
+        return;
+    }
+    constraints[index] = std::move(constraints.back());
+    constraints.pop_back();
+    solver.version++;
+}
+
+void xpbd_remove_distance(XpbdSolver& solver, uint32_t index)
+{
+    remove_constraint(solver, solver.distance, index);
+}
+
+void xpbd_remove_bending(XpbdSolver& solver, uint32_t index)
+{
+    remove_constraint(solver, solver.bending, index);
+}
+
+void xpbd_remove_volume(XpbdSolver& solver, uint32_t index)
+{
+    remove_constraint(solver, solver.volume, index);
+}
+
+void xpbd_remove_attachment(XpbdSolver& solver, uint32_t index)
+{
+    remove_constraint(solver, solver.attachment, index);
+}
+
+// Index of the lowest clear bit, 64 if there isn't one
+static inline uint32_t first_free_color(uint64_t used)
+{
+    for(uint32_t c = 0; c < XPBD_MAX_COLORS; c++)
+    {
+        if(!(used & (1ull << c))) return c;
+    }
+    return XPBD_MAX_COLORS;
+}
+
+// Gives the constraint over slots the first color none of them is in yet, returns XPBD_MAX_COLORS if they're all taken
+static uint32_t assign_color(std::vector<uint64_t>& used, const uint32_t* slots, uint32_t count)
+{
+    uint64_t taken = 0;
+    for(uint32_t i = 0; i < count; i++) taken |= used[slots[i]];
+
+    uint32_t color = first_free_color(taken);
+    if(color == XPBD_MAX_COLORS) return color;
+
+    for(uint32_t i = 0; i < count; i++) used[slots[i]] |= 1ull << color;
+    return color;
+}
+
+static bool all_valid(const uint32_t* slots, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(slots[i] == UINT32_MAX) return false;
+    }
+    return true;
+}
+
+void xpbd_build(XpbdSolver& solver, const ParticleWorld& world)
+{
+    size_t particle_count = phys_world_count(world);
+
+    // Slots
+    solver.distance_slots.resize(solver.distance.size() * 2);
+    for(size_t i = 0; i < solver.distance.size(); i++)
+    {
+        solver.distance_slots[i * 2 + 0] = phys_world_slot(world, solver.distance[i].a);
+        solver.distance_slots[i * 2 + 1] = phys_world_slot(world, solver.distance[i].b);
+    }
+
+    solver.bending_slots.resize(solver.bending.size() * 4);
+    for(size_t i = 0; i < solver.bending.size(); i++)
+    {
+        const BendingConstraint& b = solver.bending[i];
+        solver.bending_slots[i * 4 + 0] = phys_world_slot(world, b.a);
+        solver.bending_slots[i * 4 + 1] = phys_world_slot(world, b.b);
+        solver.bending_slots[i * 4 + 2] = phys_world_slot(world, b.c);
+        solver.bending_slots[i * 4 + 3] = phys_world_slot(world, b.d);
+    }
+
+    solver.attachment_slots.resize(solver.attachment.size());
+    for(size_t i = 0; i < solver.attachment.size(); i++)
+    {
+        solver.attachment_slots[i] = phys_world_slot(world, solver.attachment[i].particle);
+    }
+
+    // Every volume's particles once each, the triangles point into that list
+    solver.volume_start.assign(1, 0);
+    solver.volume_triangle_start.assign(1, 0);
+    solver.volume_particles.clear();
+    solver.volume_triangles.clear();
+    std::vector<uint32_t> local(particle_count, UINT32_MAX);
+    for(const VolumeConstraint& v : solver.volume)
+    {
+        uint32_t start = (uint32_t)solver.volume_particles.size();
+        uint32_t triangle_start = (uint32_t)solver.volume_triangles.size();
+        bool valid = true;
+        for(ParticleHandle handle : v.triangles)
+        {
+            uint32_t slot = phys_world_slot(world, handle);
+            if(slot == UINT32_MAX)
+            {
+                valid = false;
+                break;
+            }
+            if(local[slot] == UINT32_MAX)
+            {
+                local[slot] = (uint32_t)solver.volume_particles.size() - start;
+                solver.volume_particles.push_back(slot);
+            }
+            solver.volume_triangles.push_back(local[slot]);
+        }
+        for(uint32_t i = start; i < solver.volume_particles.size(); i++) local[solver.volume_particles[i]] = UINT32_MAX;
+
+        // A mesh missing a particle ends up empty, which is what marks it as dead
+        if(!valid)
+        {
+            solver.volume_particles.resize(start);
+            solver.volume_triangles.resize(triangle_start);
+        }
+        solver.volume_start.push_back((uint32_t)solver.volume_particles.size());
+        solver.volume_triangle_start.push_back((uint32_t)solver.volume_triangles.size());
+    }
+    solver.volume_gradient.resize(solver.volume_particles.size());
+
+    // Lambdas
+    size_t counts[4] = { solver.distance.size(), solver.bending.size(), solver.volume.size(), solver.attachment.size() };
+    uint32_t total = 0;
+    for(int type = 0; type < 4; type++)
+    {
+        solver.lambda_start[type] = total;
+        total += (uint32_t)counts[type];
+    }
+    solver.lambda.assign(total, 0.0f);
+
+    // Greedy coloring in a fixed order, so the colors only depend on the constraints and not on any threading
+    std::vector<uint64_t> used(particle_count, 0);
+    std::vector<uint32_t> colors;           // Color of every entry
+    std::vector<uint32_t> entries;
+    solver.serial.clear();
+
+    auto color_constraint = [&](uint32_t type, uint32_t index, const uint32_t* slots, uint32_t count) {
+        if(count == 0 || !all_valid(slots, count)) return;
+
+        uint32_t entry = type << XPBD_TYPE_SHIFT | index;
+        uint32_t color = assign_color(used, slots, count);
+        if(color == XPBD_MAX_COLORS)
+        {
+            solver.serial.push_back(entry);
+            return;
+        }
+        entries.push_back(entry);
+        colors.push_back(color);
+    };
+
+    for(uint32_t i = 0; i < solver.distance.size(); i++) color_constraint(XPBD_DISTANCE, i, &solver.distance_slots[i * 2], 2);
+    for(uint32_t i = 0; i < solver.bending.size(); i++) color_constraint(XPBD_BENDING, i, &solver.bending_slots[i * 4], 4);
+    for(uint32_t i = 0; i < solver.attachment.size(); i++) color_constraint(XPBD_ATTACHMENT, i, &solver.attachment_slots[i], 1);
+    for(uint32_t i = 0; i < solver.volume.size(); i++)
+    {
+        uint32_t start = solver.volume_start[i];
+        color_constraint(XPBD_VOLUME, i, solver.volume_particles.data() + start, solver.volume_start[i + 1] - start);
+    }
+
+    // Counting sort by color, entries keep the order they were colored in
+    uint32_t color_count = 0;
+    for(uint32_t c : colors) color_count = std::max(color_count, c + 1);
+    solver.color_start.assign(color_count + 1, 0);
+    for(uint32_t c : colors) solver.color_start[c + 1]++;
+    for(uint32_t c = 0; c < color_count; c++) solver.color_start[c + 1] += solver.color_start[c];
+
+    solver.batches.resize(entries.size());
+    std::vector<uint32_t> fill(solver.color_start.begin(), solver.color_start.end() - 1);
+    for(size_t i = 0; i < entries.size(); i++) solver.batches[fill[colors[i]]++] = entries[i];
+
+    // Distance constraints got colored first, so they're at the front of every color
+    solver.distance_batch_start.assign(1, 0);
+    solver.distance_batch_a.clear();
+    solver.distance_batch_b.clear();
+    solver.distance_batch_rest.clear();
+    solver.distance_batch_compliance.clear();
+    for(uint32_t c = 0; c < color_count; c++)
+    {
+        for(uint32_t k = solver.color_start[c]; k < solver.color_start[c + 1]; k++)
+        {
+            uint32_t entry = solver.batches[k];
+            if(entry >> XPBD_TYPE_SHIFT != XPBD_DISTANCE) break;
+
+            uint32_t i = entry & XPBD_INDEX_MASK;
+            solver.distance_batch_a.push_back(solver.distance_slots[i * 2 + 0]);
+            solver.distance_batch_b.push_back(solver.distance_slots[i * 2 + 1]);
+            solver.distance_batch_rest.push_back(solver.distance[i].rest_length);
+            solver.distance_batch_compliance.push_back(solver.distance[i].compliance);
+        }
+        solver.distance_batch_start.push_back((uint32_t)solver.distance_batch_a.size());
+    }
+    solver.distance_batch_lambda.assign(solver.distance_batch_a.size(), 0.0f);
+
+    solver.built_version = solver.version;
+    solver.built_slot_version = world.slot_version;
+    solver.built = true;
+}
+
+static bool needs_build(const XpbdSolver& solver, const ParticleWorld& world)
+{
+    return !solver.built || solver.built_version != solver.version || solver.built_slot_version != world.slot_version;
+}
+
+static inline glm::vec3 get_position(const glm::vec4* x, uint32_t slot)
+{
+    return glm::vec3(x[slot]);
+}
+
+static inline void move_particle(glm::vec4* x, uint32_t slot, const glm::vec3& delta)
+{
+    x[slot] += glm::vec4(delta, 0.0);
+}
+
+// dlambda = (-C - alpha * lambda) / (sum w |grad|^2 + alpha), with alpha already divided by the substep squared
+static inline float lambda_step(float c, float w_sum, float alpha, float lambda)
+{
+    float denom = w_sum + alpha;
+    if(denom <= 0.0f) return 0.0f;
+    return (-c - alpha * lambda) / denom;
+}
+
+static void solve_distance(XpbdSolver& solver, glm::vec4* x, uint32_t i, float inv_h2)
+{
+    uint32_t a = solver.distance_slots[i * 2 + 0];
+    uint32_t b = solver.distance_slots[i * 2 + 1];
+    float w_a = x[a].w;
+    float w_b = x[b].w;
+    if(w_a + w_b == 0.0f) return;
+
+    glm::vec3 d = get_position(x, a) - get_position(x, b);
+    float len_sq = glm::dot(d, d);
+    if(len_sq < 1e-18f) return;
+    float len = sqrtf(len_sq);
+
+    float& lambda = solver.lambda[solver.lambda_start[XPBD_DISTANCE] + i];
+    float dl = lambda_step(len - solver.distance[i].rest_length, w_a + w_b, solver.distance[i].compliance * inv_h2, lambda);
+    lambda += dl;
+
+    // Gradient is d / len, folded into the one scale
+    glm::vec3 step = d * (dl / len);
+    move_particle(x, a, step * w_a);
+    move_particle(x, b, step * -w_b);
+}
+
+static void solve_bending(XpbdSolver& solver, glm::vec4* x, uint32_t i, float inv_h2)
+{
+    const uint32_t* slots = &solver.bending_slots[i * 4];
+    glm::vec3 p[4];
+    float w[4];
+    for(int k = 0; k < 4; k++)
+    {
+        p[k] = get_position(x, slots[k]);
+        w[k] = x[slots[k]].w;
+    }
+
+    float angle;
+    glm::vec3 grad[4];
+    if(!dihedral(p[0], p[1], p[2], p[3], angle, grad)) return;
+
+    // Shortest way round to the rest angle
+    float c = angle - solver.bending[i].rest_angle;
+    if(c > glm::pi<float>()) c -= 2.0f * glm::pi<float>();
+    if(c < -glm::pi<float>()) c += 2.0f * glm::pi<float>();
+
+    float w_sum = 0.0;
+    for(int k = 0; k < 4; k++) w_sum += w[k] * glm::dot(grad[k], grad[k]);
+    if(w_sum < 1e-12f) return;
+
+    float& lambda = solver.lambda[solver.lambda_start[XPBD_BENDING] + i];
+    float dl = lambda_step(c, w_sum, solver.bending[i].compliance * inv_h2, lambda);
+    lambda += dl;
+
+    for(int k = 0; k < 4; k++) move_particle(x, slots[k], grad[k] * (w[k] * dl));
+}
+
+static void solve_volume(XpbdSolver& solver, glm::vec4* x, uint32_t i, float inv_h2)
+{
+    uint32_t start = solver.volume_start[i];
+    uint32_t end = solver.volume_start[i + 1];
+    const VolumeConstraint& v = solver.volume[i];
+    const uint32_t* tris = solver.volume_triangles.data() + solver.volume_triangle_start[i];
+    uint32_t tri_count = solver.volume_triangle_start[i + 1] - solver.volume_triangle_start[i];
+
+    glm::vec3* grad = solver.volume_gradient.data() + start;
+    for(uint32_t k = 0; k < end - start; k++) grad[k] = glm::vec3(0.0);
+
+    float volume = 0.0;
+    for(uint32_t t = 0; t < tri_count; t += 3)
+    {
+        uint32_t l0 = tris[t], l1 = tris[t + 1], l2 = tris[t + 2];
+        glm::vec3 p0 = get_position(x, solver.volume_particles[start + l0]);
+        glm::vec3 p1 = get_position(x, solver.volume_particles[start + l1]);
+        glm::vec3 p2 = get_position(x, solver.volume_particles[start + l2]);
+        volume += glm::dot(glm::cross(p0, p1), p2);
+        grad[l0] += glm::cross(p1, p2);
+        grad[l1] += glm::cross(p2, p0);
+        grad[l2] += glm::cross(p0, p1);
+    }
+    volume /= 6.0f;
+
+    float w_sum = 0.0;
+    for(uint32_t k = 0; k < end - start; k++)
+    {
+        grad[k] /= 6.0f;
+        w_sum += x[solver.volume_particles[start + k]].w * glm::dot(grad[k], grad[k]);
+    }
+    if(w_sum < 1e-12f) return;
+
+    float& lambda = solver.lambda[solver.lambda_start[XPBD_VOLUME] + i];
+    float dl = lambda_step(volume - v.pressure * v.rest_volume, w_sum, v.compliance * inv_h2, lambda);
+    lambda += dl;
+
+    for(uint32_t k = 0; k < end - start; k++)
+    {
+        uint32_t slot = solver.volume_particles[start + k];
+        move_particle(x, slot, grad[k] * (x[slot].w * dl));
+    }
+}
+
+static void solve_attachment(XpbdSolver& solver, glm::vec4* x, uint32_t i, float inv_h2)
+{
+    uint32_t slot = solver.attachment_slots[i];
+    float w = x[slot].w;
+    if(w == 0.0f) return;
+
+    glm::vec3 d = get_position(x, slot) - solver.attachment[i].anchor;
+    float len = glm::length(d);
+    if(len < 1e-9f) return;
+
+    float& lambda = solver.lambda[solver.lambda_start[XPBD_ATTACHMENT] + i];
+    float dl = lambda_step(len, w, solver.attachment[i].compliance * inv_h2, lambda);
+    lambda += dl;
+
+    move_particle(x, slot, d * (w * dl / len));
+}
+
+static void solve_entry(XpbdSolver& solver, glm::vec4* x, uint32_t entry, float inv_h2)
+{
+    uint32_t index = entry & XPBD_INDEX_MASK;
+    switch(entry >> XPBD_TYPE_SHIFT)
+    {
+        case XPBD_DISTANCE: solve_distance(solver, x, index, inv_h2); break;
+        case XPBD_BENDING: solve_bending(solver, x, index, inv_h2); break;
+        case XPBD_VOLUME: solve_volume(solver, x, index, inv_h2); break;
+        case XPBD_ATTACHMENT: solve_attachment(solver, x, index, inv_h2); break;
+    }
+}
+
+// What the distance batch kernels read and write, indexed by position in the distance_batch_* arrays
+struct DistanceBatchArgs
+{
+    glm::vec4* x;
+    const uint32_t* a;
+    const uint32_t* b;
+    const float* rest;
+    const float* compliance;
+    float* lambda;
+    float inv_h2;
+};
+
+// Scalar reference, same as solve_distance. The vector kernels use it for whatever doesn't fill a whole register.
+static void distance_batch_scalar(const DistanceBatchArgs& args, size_t begin, size_t end)
+{
+    glm::vec4* x = args.x;
+    for(size_t k = begin; k < end; k++)
+    {
+        uint32_t a = args.a[k];
+        uint32_t b = args.b[k];
+        float w_a = x[a].w;
+        float w_b = x[b].w;
+        if(w_a + w_b == 0.0f) continue;
+
+        glm::vec3 d = get_position(x, a) - get_position(x, b);
+        float len_sq = glm::dot(d, d);
+        if(len_sq < 1e-18f) continue;
+        float len = sqrtf(len_sq);
+
+        float dl = lambda_step(len - args.rest[k], w_a + w_b, args.compliance[k] * args.inv_h2, args.lambda[k]);
+        args.lambda[k] += dl;
+
+        glm::vec3 step = d * (dl / len);
+        move_particle(x, a, step * w_a);
+        move_particle(x, b, step * -w_b);
+    }
+}
+
+#if PHYS_X86
+
+/*
+    A register of distance constraints at a time. Particles are vec4s so each one is a single load, and transposing
+    4 of them gives x, y, z and mass_inv in lanes. Nothing in a color shares a particle, so the corrections can be
+    transposed back and added to every particle without the lanes stepping on each other. Same operations in the same
+    order as the scalar version, skipped lanes get a correction of 0.
+*/
+
+static void distance_batch_sse(const DistanceBatchArgs& args, size_t begin, size_t end)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 min_len_sq = _mm_set1_ps(1e-18f);
+    const __m128 inv_h2 = _mm_set1_ps(args.inv_h2);
+    float* x = &args.x[0].x;
+
+    size_t k = begin;
+    for(; k + 4 <= end; k += 4)
+    {
+        const uint32_t* ia = args.a + k;
+        const uint32_t* ib = args.b + k;
+
+        __m128 ax = _mm_loadu_ps(x + ia[0] * 4), ay = _mm_loadu_ps(x + ia[1] * 4);
+        __m128 az = _mm_loadu_ps(x + ia[2] * 4), aw = _mm_loadu_ps(x + ia[3] * 4);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        __m128 bx = _mm_loadu_ps(x + ib[0] * 4), by = _mm_loadu_ps(x + ib[1] * 4);
+        __m128 bz = _mm_loadu_ps(x + ib[2] * 4), bw = _mm_loadu_ps(x + ib[3] * 4);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        __m128 w_sum = _mm_add_ps(aw, bw);
+        __m128 dx = _mm_sub_ps(ax, bx), dy = _mm_sub_ps(ay, by), dz = _mm_sub_ps(az, bz);
+        __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 len = _mm_sqrt_ps(len_sq);
+
+        __m128 alpha = _mm_mul_ps(_mm_loadu_ps(args.compliance + k), inv_h2);
+        __m128 lambda = _mm_loadu_ps(args.lambda + k);
+        __m128 c = _mm_sub_ps(len, _mm_loadu_ps(args.rest + k));
+        __m128 denom = _mm_add_ps(w_sum, alpha);
+        __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(w_sum, zero), _mm_cmpnlt_ps(len_sq, min_len_sq)), _mm_cmpnle_ps(denom, zero));
+        __m128 dl = _mm_and_ps(valid, _mm_div_ps(_mm_sub_ps(_mm_xor_ps(c, sign), _mm_mul_ps(alpha, lambda)), denom));
+        _mm_storeu_ps(args.lambda + k, _mm_add_ps(lambda, dl));
+
+        __m128 scale = _mm_and_ps(valid, _mm_div_ps(dl, len));
+        __m128 sx = _mm_mul_ps(dx, scale), sy = _mm_mul_ps(dy, scale), sz = _mm_mul_ps(dz, scale);
+        __m128 neg_w_b = _mm_xor_ps(bw, sign);
+
+        __m128 mx = _mm_mul_ps(sx, aw), my = _mm_mul_ps(sy, aw), mz = _mm_mul_ps(sz, aw), mw = zero;
+        _MM_TRANSPOSE4_PS(mx, my, mz, mw);
+        __m128 move_a[4] = { mx, my, mz, mw };
+        mx = _mm_mul_ps(sx, neg_w_b); my = _mm_mul_ps(sy, neg_w_b); mz = _mm_mul_ps(sz, neg_w_b); mw = zero;
+        _MM_TRANSPOSE4_PS(mx, my, mz, mw);
+        __m128 move_b[4] = { mx, my, mz, mw };
+
+        // a before b in every lane, like the scalar version
+        for(int lane = 0; lane < 4; lane++)
+        {
+            float* pa = x + ia[lane] * 4;
+            _mm_storeu_ps(pa, _mm_add_ps(_mm_loadu_ps(pa), move_a[lane]));
+            float* pb = x + ib[lane] * 4;
+            _mm_storeu_ps(pb, _mm_add_ps(_mm_loadu_ps(pb), move_b[lane]));
+        }
+    }
+    distance_batch_scalar(args, k, end);
+}
+
+// 4x4 transpose inside each 128 bit half, so rows (lane, lane + 4) become x, y, z, w of all 8 lanes and back again
+SIMD_TARGET("avx2")
+static inline void transpose_avx2(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+{
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+    r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 load_pair_avx2(const float* x, uint32_t lo, uint32_t hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(x + lo * 4)), _mm_loadu_ps(x + hi * 4), 1);
+}
+
+SIMD_TARGET("avx2")
+static void distance_batch_avx2(const DistanceBatchArgs& args, size_t begin, size_t end)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 min_len_sq = _mm256_set1_ps(1e-18f);
+    const __m256 inv_h2 = _mm256_set1_ps(args.inv_h2);
+    float* x = &args.x[0].x;
+
+    size_t k = begin;
+    for(; k + 8 <= end; k += 8)
+    {
+        const uint32_t* ia = args.a + k;
+        const uint32_t* ib = args.b + k;
+
+        __m256 ax = load_pair_avx2(x, ia[0], ia[4]), ay = load_pair_avx2(x, ia[1], ia[5]);
+        __m256 az = load_pair_avx2(x, ia[2], ia[6]), aw = load_pair_avx2(x, ia[3], ia[7]);
+        transpose_avx2(ax, ay, az, aw);
+        __m256 bx = load_pair_avx2(x, ib[0], ib[4]), by = load_pair_avx2(x, ib[1], ib[5]);
+        __m256 bz = load_pair_avx2(x, ib[2], ib[6]), bw = load_pair_avx2(x, ib[3], ib[7]);
+        transpose_avx2(bx, by, bz, bw);
+
+        __m256 w_sum = _mm256_add_ps(aw, bw);
+        __m256 dx = _mm256_sub_ps(ax, bx), dy = _mm256_sub_ps(ay, by), dz = _mm256_sub_ps(az, bz);
+        __m256 len_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        __m256 len = _mm256_sqrt_ps(len_sq);
+
+        __m256 alpha = _mm256_mul_ps(_mm256_loadu_ps(args.compliance + k), inv_h2);
+        __m256 lambda = _mm256_loadu_ps(args.lambda + k);
+        __m256 c = _mm256_sub_ps(len, _mm256_loadu_ps(args.rest + k));
+        __m256 denom = _mm256_add_ps(w_sum, alpha);
+        __m256 valid = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w_sum, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(len_sq, min_len_sq, _CMP_NLT_UQ)),
+                                     _mm256_cmp_ps(denom, zero, _CMP_NLE_UQ));
+        __m256 dl = _mm256_and_ps(valid, _mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(c, sign), _mm256_mul_ps(alpha, lambda)), denom));
+        _mm256_storeu_ps(args.lambda + k, _mm256_add_ps(lambda, dl));
+
+        __m256 scale = _mm256_and_ps(valid, _mm256_div_ps(dl, len));
+        __m256 sx = _mm256_mul_ps(dx, scale), sy = _mm256_mul_ps(dy, scale), sz = _mm256_mul_ps(dz, scale);
+        __m256 neg_w_b = _mm256_xor_ps(bw, sign);
+
+        __m256 a0 = _mm256_mul_ps(sx, aw), a1 = _mm256_mul_ps(sy, aw), a2 = _mm256_mul_ps(sz, aw), a3 = zero;
+        transpose_avx2(a0, a1, a2, a3);
+        __m256 b0 = _mm256_mul_ps(sx, neg_w_b), b1 = _mm256_mul_ps(sy, neg_w_b), b2 = _mm256_mul_ps(sz, neg_w_b), b3 = zero;
+        transpose_avx2(b0, b1, b2, b3);
+
+        alignas(32) float move_a[4][8], move_b[4][8];
+        _mm256_store_ps(move_a[0], a0); _mm256_store_ps(move_a[1], a1); _mm256_store_ps(move_a[2], a2); _mm256_store_ps(move_a[3], a3);
+        _mm256_store_ps(move_b[0], b0); _mm256_store_ps(move_b[1], b1); _mm256_store_ps(move_b[2], b2); _mm256_store_ps(move_b[3], b3);
+
+        // Row r holds lane r in its low half and lane r + 4 in its high half
+        for(int lane = 0; lane < 8; lane++)
+        {
+            const float* ma = &move_a[lane & 3][(lane >> 2) * 4];
+            const float* mb = &move_b[lane & 3][(lane >> 2) * 4];
+            float* pa = x + ia[lane] * 4;
+            _mm_storeu_ps(pa, _mm_add_ps(_mm_loadu_ps(pa), _mm_load_ps(ma)));
+            float* pb = x + ib[lane] * 4;
+            _mm_storeu_ps(pb, _mm_add_ps(_mm_loadu_ps(pb), _mm_load_ps(mb)));
+        }
+    }
+    distance_batch_scalar(args, k, end);
+}
+
+#endif
+
+typedef void (*DistanceBatchFn)(const DistanceBatchArgs& args, size_t begin, size_t end);
+
+static DistanceBatchFn distance_batch_fn(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: return distance_batch_avx2;
+        case SIMD_SSE: return distance_batch_sse;
+        default: break;
+    }
+#endif
+    return distance_batch_scalar;
+}
+
+// Both sides of every pair, grouped by particle so each particle can sum up its own pushes
+static void build_collisions(XpbdSolver& solver, size_t count)
+{
+    std::vector<CollisionPair>& pairs = solver.collisions;
+    pairs.erase(std::remove_if(pairs.begin(), pairs.end(), [count](const CollisionPair& pair) {
+        return pair.a >= count || pair.b >= count;
+    }), pairs.end());
+
+    solver.collision_start.assign(count + 1, 0);
+    for(const CollisionPair& pair : pairs)
+    {
+        solver.collision_start[pair.a + 1]++;
+        solver.collision_start[pair.b + 1]++;
+    }
+    for(size_t i = 0; i < count; i++) solver.collision_start[i + 1] += solver.collision_start[i];
+
+    solver.collision_side.resize(solver.collision_start[count]);
+    std::vector<uint32_t> fill(solver.collision_start.begin(), solver.collision_start.end() - 1);
+    for(uint32_t p = 0; p < pairs.size(); p++)
+    {
+        solver.collision_side[fill[pairs[p].a]++] = p << 1;
+        solver.collision_side[fill[pairs[p].b]++] = p << 1 | 1;
+    }
+
+    solver.collision_push_a.resize(pairs.size());
+    solver.collision_push_b.resize(pairs.size());
+    solver.collision_hit.resize(pairs.size());
+    solver.collision_delta.resize(count);
+}
+
+// What the collision pair kernels read and write, pushes and hits are indexed by pair. Pushes only get written for pairs
+// that hit, most candidates are out of reach so the sum never looks at the rest.
+struct CollisionBatchArgs
+{
+    const glm::vec4* x;
+    const CollisionPair* pairs;
+    float distance;
+    float* ax; float* ay; float* az;
+    float* bx; float* by; float* bz;
+    uint8_t* hit;
+};
+
+// Scalar reference. Each side gets pushed away from the other by its share (by inverse mass) of the overlap, worked out
+// the same way as from that side: the b side's d is just -d.
+static void collision_batch_scalar(const CollisionBatchArgs& args, size_t begin, size_t end)
+{
+    const glm::vec4* x = args.x;
+    float distance = args.distance;
+    for(size_t p = begin; p < end; p++)
+    {
+        uint32_t a = args.pairs[p].a;
+        uint32_t b = args.pairs[p].b;
+        float w_a = x[a].w;
+        float w_b = x[b].w;
+
+        glm::vec3 d = get_position(x, a) - get_position(x, b);
+        float len_sq = glm::dot(d, d);
+        glm::vec3 push_a(0.0), push_b(0.0);
+        uint8_t hit = 0;
+        if(len_sq < distance * distance && len_sq >= 1e-18f)
+        {
+            float len = sqrtf(len_sq);
+            float s = (distance - len) / len;
+            if(w_a > 0.0f)
+            {
+                push_a = d * (s * (w_a / (w_a + w_b)));
+                hit |= 1;
+            }
+            if(w_b > 0.0f)
+            {
+                push_b = -d * (s * (w_b / (w_b + w_a)));
+                hit |= 2;
+            }
+        }
+        args.hit[p] = hit;
+        if(!hit) continue;
+
+        args.ax[p] = push_a.x; args.ay[p] = push_a.y; args.az[p] = push_a.z;
+        args.bx[p] = push_b.x; args.by[p] = push_b.y; args.bz[p] = push_b.z;
+    }
+}
+
+#if PHYS_X86
+
+static void collision_batch_sse(const CollisionBatchArgs& args, size_t begin, size_t end)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 min_len_sq = _mm_set1_ps(1e-18f);
+    const __m128 distance = _mm_set1_ps(args.distance);
+    const __m128 distance_sq = _mm_set1_ps(args.distance * args.distance);
+    const float* x = &args.x[0].x;
+
+    size_t p = begin;
+    for(; p + 4 <= end; p += 4)
+    {
+        const CollisionPair* pairs = args.pairs + p;
+        __m128 ax = _mm_loadu_ps(x + pairs[0].a * 4), ay = _mm_loadu_ps(x + pairs[1].a * 4);
+        __m128 az = _mm_loadu_ps(x + pairs[2].a * 4), aw = _mm_loadu_ps(x + pairs[3].a * 4);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        __m128 bx = _mm_loadu_ps(x + pairs[0].b * 4), by = _mm_loadu_ps(x + pairs[1].b * 4);
+        __m128 bz = _mm_loadu_ps(x + pairs[2].b * 4), bw = _mm_loadu_ps(x + pairs[3].b * 4);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+        __m128 dx = _mm_sub_ps(ax, bx), dy = _mm_sub_ps(ay, by), dz = _mm_sub_ps(az, bz);
+        __m128 len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 touching = _mm_and_ps(_mm_cmplt_ps(len_sq, distance_sq), _mm_cmpge_ps(len_sq, min_len_sq));
+        __m128 hit_a = _mm_and_ps(touching, _mm_cmpgt_ps(aw, zero));
+        __m128 hit_b = _mm_and_ps(touching, _mm_cmpgt_ps(bw, zero));
+
+        int mask_a = _mm_movemask_ps(hit_a), mask_b = _mm_movemask_ps(hit_b);
+        for(int lane = 0; lane < 4; lane++) args.hit[p + lane] = (uint8_t)((mask_a >> lane & 1) | (mask_b >> lane & 1) << 1);
+        if(!(mask_a | mask_b)) continue;
+
+        __m128 len = _mm_sqrt_ps(len_sq);
+        __m128 s = _mm_div_ps(_mm_sub_ps(distance, len), len);
+        __m128 scale_a = _mm_and_ps(hit_a, _mm_mul_ps(s, _mm_div_ps(aw, _mm_add_ps(aw, bw))));
+        __m128 scale_b = _mm_and_ps(hit_b, _mm_mul_ps(s, _mm_div_ps(bw, _mm_add_ps(bw, aw))));
+        _mm_storeu_ps(args.ax + p, _mm_mul_ps(dx, scale_a));
+        _mm_storeu_ps(args.ay + p, _mm_mul_ps(dy, scale_a));
+        _mm_storeu_ps(args.az + p, _mm_mul_ps(dz, scale_a));
+        _mm_storeu_ps(args.bx + p, _mm_mul_ps(_mm_xor_ps(dx, sign), scale_b));
+        _mm_storeu_ps(args.by + p, _mm_mul_ps(_mm_xor_ps(dy, sign), scale_b));
+        _mm_storeu_ps(args.bz + p, _mm_mul_ps(_mm_xor_ps(dz, sign), scale_b));
+    }
+    collision_batch_scalar(args, p, end);
+}
+
+SIMD_TARGET("avx2")
+static void collision_batch_avx2(const CollisionBatchArgs& args, size_t begin, size_t end)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 min_len_sq = _mm256_set1_ps(1e-18f);
+    const __m256 distance = _mm256_set1_ps(args.distance);
+    const __m256 distance_sq = _mm256_set1_ps(args.distance * args.distance);
+    const float* x = &args.x[0].x;
+
+    size_t p = begin;
+    for(; p + 8 <= end; p += 8)
+    {
+        const CollisionPair* pairs = args.pairs + p;
+        __m256 ax = load_pair_avx2(x, pairs[0].a, pairs[4].a), ay = load_pair_avx2(x, pairs[1].a, pairs[5].a);
+        __m256 az = load_pair_avx2(x, pairs[2].a, pairs[6].a), aw = load_pair_avx2(x, pairs[3].a, pairs[7].a);
+        transpose_avx2(ax, ay, az, aw);
+        __m256 bx = load_pair_avx2(x, pairs[0].b, pairs[4].b), by = load_pair_avx2(x, pairs[1].b, pairs[5].b);
+        __m256 bz = load_pair_avx2(x, pairs[2].b, pairs[6].b), bw = load_pair_avx2(x, pairs[3].b, pairs[7].b);
+        transpose_avx2(bx, by, bz, bw);
+
+        __m256 dx = _mm256_sub_ps(ax, bx), dy = _mm256_sub_ps(ay, by), dz = _mm256_sub_ps(az, bz);
+        __m256 len_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        __m256 touching = _mm256_and_ps(_mm256_cmp_ps(len_sq, distance_sq, _CMP_LT_OQ), _mm256_cmp_ps(len_sq, min_len_sq, _CMP_GE_OQ));
+        __m256 hit_a = _mm256_and_ps(touching, _mm256_cmp_ps(aw, zero, _CMP_GT_OQ));
+        __m256 hit_b = _mm256_and_ps(touching, _mm256_cmp_ps(bw, zero, _CMP_GT_OQ));
+
+        int mask_a = _mm256_movemask_ps(hit_a), mask_b = _mm256_movemask_ps(hit_b);
+        for(int lane = 0; lane < 8; lane++) args.hit[p + lane] = (uint8_t)((mask_a >> lane & 1) | (mask_b >> lane & 1) << 1);
+        if(!(mask_a | mask_b)) continue;
+
+        __m256 len = _mm256_sqrt_ps(len_sq);
+        __m256 s = _mm256_div_ps(_mm256_sub_ps(distance, len), len);
+        __m256 scale_a = _mm256_and_ps(hit_a, _mm256_mul_ps(s, _mm256_div_ps(aw, _mm256_add_ps(aw, bw))));
+        __m256 scale_b = _mm256_and_ps(hit_b, _mm256_mul_ps(s, _mm256_div_ps(bw, _mm256_add_ps(bw, aw))));
+        _mm256_storeu_ps(args.ax + p, _mm256_mul_ps(dx, scale_a));
+        _mm256_storeu_ps(args.ay + p, _mm256_mul_ps(dy, scale_a));
+        _mm256_storeu_ps(args.az + p, _mm256_mul_ps(dz, scale_a));
+        _mm256_storeu_ps(args.bx + p, _mm256_mul_ps(_mm256_xor_ps(dx, sign), scale_b));
+        _mm256_storeu_ps(args.by + p, _mm256_mul_ps(_mm256_xor_ps(dy, sign), scale_b));
+        _mm256_storeu_ps(args.bz + p, _mm256_mul_ps(_mm256_xor_ps(dz, sign), scale_b));
+    }
+    collision_batch_scalar(args, p, end);
+}
+
+#endif
+
+typedef void (*CollisionBatchFn)(const CollisionBatchArgs& args, size_t begin, size_t end);
+
+static CollisionBatchFn collision_batch_fn(SimdLevel level)
+{
+#if PHYS_X86
+    switch(level)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: return collision_batch_avx2;
+        case SIMD_SSE: return collision_batch_sse;
+        default: break;
+    }
+#endif
+    return collision_batch_scalar;
+}
+
+static void solve_collisions(XpbdSolver& solver, ParticleWorld& world, size_t chunk)
+{
+    glm::vec4* x = solver.particles.data();
+    CollisionBatchArgs args = {
+        x, solver.collisions.data(), solver.collision_distance,
+        solver.collision_push_a.x.data(), solver.collision_push_a.y.data(), solver.collision_push_a.z.data(),
+        solver.collision_push_b.x.data(), solver.collision_push_b.y.data(), solver.collision_push_b.z.data(),
+        solver.collision_hit.data()
+    };
+    CollisionBatchFn batch = collision_batch_fn(simd_level());
+    phys_parallel_for(world.pool, solver.collisions.size(), chunk, [&args, batch](size_t begin, size_t end) {
+        batch(args, begin, end);
+    });
+
+    // Every particle only writes its own delta, positions don't change until all of them are done
+    phys_for_each_chunk(world, [&solver](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 delta(0.0);
+            uint32_t pushes = 0;
+            for(uint32_t k = solver.collision_start[i]; k < solver.collision_start[i + 1]; k++)
+            {
+                uint32_t side = solver.collision_side[k];
+                uint32_t p = side >> 1;
+                if(!(solver.collision_hit[p] >> (side & 1) & 1)) continue;
+
+                delta += (side & 1) ? solver.collision_push_b.get(p) : solver.collision_push_a.get(p);
+                pushes++;
+            }
+            if(pushes > 1) delta /= (float)pushes;
+            solver.collision_delta.set(i, delta);
+        }
+    });
+
+    phys_for_each_chunk(world, [&solver, x](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) move_particle(x, (uint32_t)i, solver.collision_delta.get(i));
+    });
+}
+
+void xpbd_step(XpbdSolver& solver, ParticleWorld& world, float delta)
+{
+    if(needs_build(solver, world)) xpbd_build(solver, world);
+
+    uint32_t substeps = solver.substeps > 0 ? solver.substeps : 1;
+    float h = delta / substeps;
+    float inv_h2 = 1.0f / (h * h);
+    size_t count = phys_world_count(world);
+    size_t chunk = solver.chunk_size ? solver.chunk_size : 256;
+
+    // Forces are evaluated once and held for the whole step, drag gets applied every substep
+    if(world.forces) force_registry_apply(*world.forces, world);
+    phys_world_prepare_step(world, h);
+    solver.particles.resize(count);
+    glm::vec4* x = solver.particles.data();
+
+    DistanceBatchArgs distance_args = {
+        x, solver.distance_batch_a.data(), solver.distance_batch_b.data(), solver.distance_batch_rest.data(),
+        solver.distance_batch_compliance.data(), solver.distance_batch_lambda.data(), inv_h2
+    };
+    DistanceBatchFn distance_solve = distance_batch_fn(simd_level());
+
+    bool collide = !solver.collisions.empty() && solver.collision_distance > 0.0f;
+    if(collide) build_collisions(solver, count);
+
+    for(uint32_t s = 0; s < substeps; s++)
+    {
+        // Predict into the solver's copy, world.position stays where the substep started
+        float max_speed = solver.max_speed;
+        phys_for_each_chunk(world, [&world, x, h, max_speed](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+            {
+                glm::vec3 p = world.position.get(i);
+                glm::vec3 a = world.acceleration.get(i) + world.force.get(i) * world.mass_inv[i];
+                glm::vec3 v = (world.velocity.get(i) + a * h) * world.drag[i];
+                if(max_speed > 0.0f)
+                {
+                    float speed_sq = glm::dot(v, v);
+                    if(speed_sq > max_speed * max_speed) v *= max_speed / sqrtf(speed_sq);
+                }
+                x[i] = glm::vec4(p + v * h, world.mass_inv[i]);
+            }
+        });
+
+        std::fill(solver.lambda.begin(), solver.lambda.end(), 0.0f);
+        std::fill(solver.distance_batch_lambda.begin(), solver.distance_batch_lambda.end(), 0.0f);
+
+        for(uint32_t it = 0; it < solver.iterations; it++)
+        {
+            for(uint32_t c = 0; c < xpbd_color_count(solver); c++)
+            {
+                // The color's distance constraints through the lanes, then whatever else is in it one at a time
+                uint32_t distance_first = solver.distance_batch_start[c];
+                uint32_t distance_count = solver.distance_batch_start[c + 1] - distance_first;
+                phys_parallel_for(world.pool, distance_count, chunk, [&distance_args, distance_solve, distance_first](size_t begin, size_t end) {
+                    distance_solve(distance_args, distance_first + begin, distance_first + end);
+                });
+
+                uint32_t first = solver.color_start[c] + distance_count;
+                uint32_t size = solver.color_start[c + 1] - first;
+                phys_parallel_for(world.pool, size, chunk, [&solver, x, first, inv_h2](size_t begin, size_t end) {
+                    for(size_t i = begin; i < end; i++) solve_entry(solver, x, solver.batches[first + i], inv_h2);
+                });
+            }
+
+            for(uint32_t entry : solver.serial) solve_entry(solver, x, entry, inv_h2);
+        }
+
+        if(collide) solve_collisions(solver, world, chunk);
+
+        // Whatever the constraints did to the positions becomes velocity
+        phys_for_each_chunk(world, [&world, x, h](size_t begin, size_t end) {
+            float inv_h = 1.0f / h;
+            for(size_t i = begin; i < end; i++)
+            {
+                glm::vec3 p = get_position(x, (uint32_t)i);
+                world.velocity.set(i, (p - world.position.get(i)) * inv_h);
+                world.position.set(i, p);
+            }
+        });
+    }
+
+    phys_for_each_chunk(world, [&world](size_t begin, size_t end) {
+        std::fill(world.force.x.begin() + begin, world.force.x.begin() + end, 0.0f);
+        std::fill(world.force.y.begin() + begin, world.force.y.begin() + end, 0.0f);
+        std::fill(world.force.z.begin() + begin, world.force.z.begin() + end, 0.0f);
+    });
+}
+
+void xpbd_update(XpbdSolver& solver, ParticleWorld& world, FixedStepper& stepper, double frame_delta)
+{
+    uint32_t steps = phys_stepper_advance(stepper, frame_delta);
+    uint32_t substeps = stepper.substeps > 0 ? stepper.substeps : 1;
+    float sub_delta = stepper.step / substeps;
+
+    for(uint32_t i = 0; i < steps; i++)
+    {
+        if(i == steps - 1)
+        {
+            world.previous_position = world.position;
+        }
+
+        for(uint32_t j = 0; j < substeps; j++)
+        {
+            xpbd_step(solver, world, sub_delta);
+        }
+        if(stepper.record_checksums) stepper.checksums.push_back(phys_world_checksum(world));
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+#include "physics.h"
+#include "collision.h"
+
+/*
+    Extended position based dynamics (XPBD) on top of a ParticleWorld, the base for cloth, ropes and soft bodies.
+
+    Every step gets split into substeps. Each substep predicts where the particles go under acceleration, forces and
+    drag, then walks every constraint once and moves its particles straight onto the constraint (weighted by inverse
+    mass), then sets the velocity to however far they actually moved. Compliance (inverse stiffness, 0 = rigid) is
+    what makes it XPBD instead of plain PBD: it's scaled by 1 / substep^2 and goes into every correction along with the
+    constraint's accumulated lambda, so how stiff something is doesn't depend on the substep or iteration count.
+    Lots of substeps with one iteration each converges a lot better than a few substeps with many iterations.
+
+    Same layout as the force generators: each kind of constraint has its own array, everything references particles
+    by handle, and the particles' slots get looked up once when the solver is built instead of every step.
+
+    Building also graph colors the constraints: no two constraints of the same color share a particle, so a whole
+    color can be solved at once across the pool without any atomics. It's still Gauss-Seidel (every constraint sees
+    what the ones before it did), the order is just by color. Colors are handed out greedily in constraint order, which
+    keeps the result the same for any thread count. There are at most 64 colors, anything that doesn't fit (a particle
+    in more than 64 constraints) goes into one last batch that runs on the calling thread. The same goes for SIMD lanes:
+    the distance constraints of a color get solved 4 or 8 at a time (see physics_simd.h for the levels), bit for bit the
+    same as one at a time.
+
+    Collisions between particles (cloth hitting itself) change every step, so coloring them isn't worth it. They go into
+    solver.collisions as slot pairs instead and get solved Jacobi style after the colors every substep: each particle adds
+    up the pushes from all of its pairs and then they all move by the average at once. Converges slower than the
+    colored constraints, but contacts don't need to be exact. The pushes get worked out once per pair through SIMD
+    lanes, then every particle sums its own in pair order.
+
+    Particles with mass_inv = 0 never get moved by a constraint. They still integrate like normal, so give them no
+    acceleration (or use an attachment) to pin them in place.
+*/
+
+#define XPBD_MAX_COLORS 64
+
+// Keeps a and b rest_length apart
+struct DistanceConstraint
+{
+    ParticleHandle a;
+    ParticleHandle b;
+    float rest_length = 1.0;
+    float compliance = 0.0;
+};
+
+// Keeps the angle between triangles (a, b, c) and (b, a, d) around their shared edge a-b at rest_angle
+struct BendingConstraint
+{
+    ParticleHandle a;
+    ParticleHandle b;
+    ParticleHandle c;
+    ParticleHandle d;
+    float rest_angle = 0.0;     // Signed, 0 = flat
+    float compliance = 0.0;
+};
+
+// Keeps the volume inside a closed triangle mesh at pressure * rest_volume. Triangles wind counter clockwise seen from
+// outside. The whole mesh is one constraint and gets solved on one thread.
+struct VolumeConstraint
+{
+    std::vector<ParticleHandle> triangles;  // 3 per triangle
+    float rest_volume = 0.0;
+    float pressure = 1.0;
+    float compliance = 0.0;
+};
+
+// Pulls a particle onto a point in the world. Move anchor every frame to drag the particle around.
+struct AttachmentConstraint
+{
+    ParticleHandle particle;
+    glm::vec3 anchor = glm::vec3(0.0);
+    float compliance = 0.0;
+};
+
+enum XpbdConstraintType
+{
+    XPBD_DISTANCE,
+    XPBD_BENDING,
+    XPBD_VOLUME,
+    XPBD_ATTACHMENT
+};
+
+struct XpbdSolver
+{
+    uint32_t substeps = 8;
+    uint32_t iterations = 1;        // Per substep
+    size_t chunk_size = 0;          // Constraints per job when solving a color across world.pool, 0 = 256
+    float max_speed = 0.0;          // Velocities get clamped to this before every substep, 0 = no limit
+
+    std::vector<DistanceConstraint> distance;
+    std::vector<BendingConstraint> bending;
+    std::vector<VolumeConstraint> volume;
+    std::vector<AttachmentConstraint> attachment;
+
+    // Built by xpbd_build. Every constraint's particles as slots, a constraint with a removed particle has none.
+    std::vector<uint32_t> distance_slots;       // 2 per constraint
+    std::vector<uint32_t> bending_slots;        // 4 per constraint
+    std::vector<uint32_t> attachment_slots;
+    std::vector<uint32_t> volume_start;         // volume.size() + 1 offsets into volume_particles
+    std::vector<uint32_t> volume_particles;     // Every particle of each mesh once
+    std::vector<uint32_t> volume_triangle_start; // volume.size() + 1 offsets into volume_triangles
+    std::vector<uint32_t> volume_triangles;     // 3 per triangle, indexing into that volume's volume_particles
+    std::vector<glm::vec3> volume_gradient;     // Scratch, one per volume_particles
+
+    // Lambda of every constraint, all kinds back to back starting at lambda_start[type]. Distance constraints in a
+    // color keep theirs in distance_batch_lambda instead.
+    FloatArray lambda;
+    uint32_t lambda_start[4] = {};
+
+    // Color batches. Entries are type << 30 | index, grouped by color and sorted inside each.
+    std::vector<uint32_t> color_start;          // color_count + 1 offsets into batches
+    std::vector<uint32_t> batches;
+    std::vector<uint32_t> serial;               // Didn't fit into any color
+
+    // The distance constraints at the front of every color again as SoA, so a whole color of them can go through SIMD
+    // lanes (cloth is nothing but distance constraints). Color c has distance_batch_start[c + 1] - distance_batch_start[c]
+    // of them and skips that many entries of its batch.
+    std::vector<uint32_t> distance_batch_start; // color_count + 1 offsets into the arrays below
+    std::vector<uint32_t> distance_batch_a;
+    std::vector<uint32_t> distance_batch_b;
+    FloatArray distance_batch_rest;
+    FloatArray distance_batch_compliance;
+    FloatArray distance_batch_lambda;
+
+    // Bumped by every xpbd_add_* / xpbd_remove_*. Bump it yourself after editing the constraint arrays directly.
+    uint32_t version = 0;
+
+    // What the solver was built for, xpbd_step rebuilds when either of these change
+    uint32_t built_version = 0;
+    uint32_t built_slot_version = 0;            // world.slot_version
+    bool built = false;
+
+    // Positions (w = mass_inv) the constraints work on during a substep. Every constraint reads a handful of particles
+    // all over the arrays, so one 16 byte load per particle beats four loads out of the SoA arrays.
+    std::vector<glm::vec4> particles;
+
+    // Particle pairs (slots) that have to stay at least collision_distance apart. Only used by the next xpbd_step,
+    // whoever fills it (see cloth.h) replaces it every step. Pairs with a slot past the particle count get dropped.
+    std::vector<CollisionPair> collisions;
+    float collision_distance = 0.0;
+    std::vector<uint32_t> collision_start;      // Particle count + 1 offsets into collision_side
+    std::vector<uint32_t> collision_side;       // pair << 1 | (0 = a, 1 = b) for every pair a particle is in
+    Vec3Array collision_push_a;                 // Per pair, what it does to each side this substep
+    Vec3Array collision_push_b;
+    std::vector<uint8_t> collision_hit;         // Per pair, bit 0 / 1 set if a / b actually got pushed
+    Vec3Array collision_delta;
+};
+
+// These take rest values from where the particles are right now and return the constraint's index in its array
+uint32_t xpbd_add_distance(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle a, ParticleHandle b, float compliance = 0.0);
+uint32_t xpbd_add_bending(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle a, ParticleHandle b,
+                          ParticleHandle c, ParticleHandle d, float compliance = 0.0);
+uint32_t xpbd_add_volume(XpbdSolver& solver, const ParticleWorld& world, const ParticleHandle* triangles, size_t triangle_count,
+                         float compliance = 0.0, float pressure = 1.0);
+uint32_t xpbd_add_attachment(XpbdSolver& solver, const ParticleWorld& world, ParticleHandle particle, float compliance = 0.0);
+
+// Remove the constraint at index, the last constraint of the same kind moves into its index
+void xpbd_remove_distance(XpbdSolver& solver, uint32_t index);
+void xpbd_remove_bending(XpbdSolver& solver, uint32_t index);
+void xpbd_remove_volume(XpbdSolver& solver, uint32_t index);
+void xpbd_remove_attachment(XpbdSolver& solver, uint32_t index);
+
+// Volume of the closed mesh as it is right now
+float xpbd_volume(const ParticleWorld& world, const ParticleHandle* triangles, size_t triangle_count);
+
+// Looks up slots and colors every constraint. xpbd_step does this on its own whenever a constraint or particle got
+// added / removed (see version), only call it directly after changing which particles an existing constraint uses.
+void xpbd_build(XpbdSolver& solver, const ParticleWorld& world);
+
+inline uint32_t xpbd_color_count(const XpbdSolver& solver)
+{
+    return solver.color_start.empty() ? 0 : (uint32_t)solver.color_start.size() - 1;
+}
+
+// Steps the world by delta in solver.substeps substeps. Replaces phys_world_step for worlds with constraints,
+// world.integrator isn't used.
+void xpbd_step(XpbdSolver& solver, ParticleWorld& world, float delta);
+
+// Fixed step driver, same as phys_world_update but stepping with xpbd_step
+void xpbd_update(XpbdSolver& solver, ParticleWorld& world, FixedStepper& stepper, double frame_delta);